@@ -146,10 +146,45 @@ bool SimpleClient::OnQuery(CefRefPtr<CefBrowser> browser,
         callback->Success(result);
         return true;
     }
+    else if (request_str.substr(0, 14) == "ipc_subscribe:") {
+        // Persistent IPC subscriptions: format is "ipc_subscribe:topic:message"
+        if (!persistent) {
+            callback->Failure(-1, "Subscriptions require a persistent query");
+            return true;
+        }
+        
+        std::string remaining = request_str.substr(14);
+        size_t colon_pos = remaining.find(':');
+        std::string topic = remaining.substr(0, colon_pos);
+        std::string message = colon_pos != std::string::npos ? remaining.substr(colon_pos + 1) : "";
+        
+        // Callbacks may be run from any browser process thread
+        int subscription = SimpleIPC::IPCHandler::GetInstance().Subscribe(topic, message,
+            [callback](const std::string& event) { callback->Success(event); });
+        if (subscription == 0) {
+            callback->Failure(-1, "Unknown subscription topic: " + topic);
+            return true;
+        }
+        
+        subscriptions_[query_id] = subscription;
+        return true;
+    }
     
     return false; // Request not handled
 }
 
+void SimpleClient::OnQueryCanceled(CefRefPtr<CefBrowser> browser,
+                                   CefRefPtr<CefFrame> frame,
+                                   int64_t query_id) {
+    CEF_REQUIRE_UI_THREAD();
+    
+    auto it = subscriptions_.find(query_id);
+    if (it != subscriptions_.end()) {
+        SimpleIPC::IPCHandler::GetInstance().Unsubscribe(it->second);
+        subscriptions_.erase(it);
+    }
+}
+
 void SimpleClient::OnTitleChange(CefRefPtr<CefBrowser> browser,
                                 const CefString& title) {
     CEF_REQUIRE_UI_THREAD();
@@ -344,6 +379,11 @@ void SimpleClient::OnAfterCreated(CefRefPtr<CefBrowser> browser) {
 void SimpleClient::OnBeforeClose(CefRefPtr<CefBrowser> browser) {
     CEF_REQUIRE_UI_THREAD();
     
+    // Cancels the browser's pending queries, which ends its subscriptions
+    if (message_router_) {
+        message_router_->OnBeforeClose(browser);
+    }
+    
     // Clean up message router when all browsers are closed
     if (browser_list_.empty() && message_router_) {
         message_router_->RemoveHandler(this);
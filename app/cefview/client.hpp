@@ -13,6 +13,7 @@
 #include "../resources/binaryresourceprovider.hpp"
 #include <SDL3/SDL.h>
 #include <list>
+#include <map>
 
 class SimpleClient;
 
@@ -59,6 +60,9 @@ public:
                         const CefString& request,
                         bool persistent,
                         CefRefPtr<CefMessageRouterBrowserSide::Callback> callback) override;
+    virtual void OnQueryCanceled(CefRefPtr<CefBrowser> browser,
+                                 CefRefPtr<CefFrame> frame,
+                                 int64_t query_id) override;
 
     // CefDisplayHandler methods
     virtual void OnTitleChange(CefRefPtr<CefBrowser> browser,
@@ -169,6 +173,9 @@ private:
     // Message router for handling JavaScript queries
     CefRefPtr<CefMessageRouterBrowserSide> message_router_;
     
+    // IPC subscriptions of persistent queries, by query ID
+    std::map<int64_t, int> subscriptions_;
+    
     // Binary resource provider for handling miko:// protocol
     CefRefPtr<BinaryResourceProvider> resource_provider_;
 
@@ -0,0 +1,205 @@
+#include "concurrencycontroller.hpp"
+#include <algorithm>
+
+namespace launcher {
+
+namespace {
+
+// Long enough for a new connection to get past TCP slow start
+const double kWindowSeconds = 2.0;
+
+// An added connection has to raise goodput by 5% to stay
+const double kProbeGain = 1.05;
+
+// Latency counts as inflated at twice the baseline and at least 50 ms above it
+const double kLatencyFactor = 2.0;
+const double kLatencyMarginMs = 50.0;
+// How fast the baseline follows slower windows, in case the route itself changed
+const double kBaselineDrift = 0.02;
+
+// Failed connections per window that count as the server pushing back
+const size_t kFailureLimit = 2;
+
+// Windows without increases after a throttle, and after an increase that bought nothing
+const size_t kBackoffWindows = 5;
+const size_t kPlateauWindows = 15;
+
+} // namespace
+
+ConcurrencyController::ConcurrencyController(size_t initialLimit, size_t maxLimit)
+    : m_initialLimit(std::max<size_t>(initialLimit, 1)),
+      m_maxLimit(std::max(maxLimit, std::max<size_t>(initialLimit, 1))) {
+}
+
+ConcurrencyController::Host& ConcurrencyController::host(const std::string& key) {
+    auto it = m_hosts.find(key);
+    if (it == m_hosts.end()) {
+        it = m_hosts.emplace(key, Host()).first;
+        it->second.limit = m_initialLimit;
+        it->second.windowStart = std::chrono::steady_clock::now();
+    }
+    return it->second;
+}
+
+bool ConcurrencyController::tryAcquire(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& state = host(key);
+    if (state.inUse >= state.limit) {
+        state.saturated = true;
+        return false;
+    }
+
+    if (++state.inUse >= state.limit) {
+        state.saturated = true;
+    }
+    return true;
+}
+
+void ConcurrencyController::release(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& state = host(key);
+    if (state.inUse > 0) {
+        --state.inUse;
+    }
+}
+
+bool ConcurrencyController::shrink(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& state = host(key);
+    if (state.inUse <= state.limit) {
+        return false;
+    }
+
+    --state.inUse;
+    return true;
+}
+
+void ConcurrencyController::recordBytes(const std::string& key, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    host(key).bytes += bytes;
+}
+
+void ConcurrencyController::recordResponse(const std::string& key, std::chrono::steady_clock::duration latency,
+                                           int status) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& state = host(key);
+    if (status == 429 || status == 503) {
+        state.throttled = true;
+        return;
+    }
+
+    // Error pages come back faster than data and would drag the baseline down
+    if (status < 400) {
+        state.latencySumMs += std::chrono::duration<double, std::milli>(latency).count();
+        ++state.latencyCount;
+    }
+}
+
+void ConcurrencyController::recordFailure(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++host(key).failures;
+}
+
+bool ConcurrencyController::update(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool grew = false;
+    for (auto& entry : m_hosts) {
+        auto& state = entry.second;
+        double seconds = std::chrono::duration<double>(now - state.windowStart).count();
+        if (seconds < kWindowSeconds) {
+            continue;
+        }
+
+        // An idle host keeps its window for when downloads come back
+        if (state.inUse == 0 && state.bytes == 0) {
+            state.latencySumMs = 0.0;
+            state.latencyCount = 0;
+            state.failures = 0;
+            state.throttled = false;
+            state.saturated = false;
+            state.probing = false;
+        } else {
+            size_t before = state.limit;
+            evaluate(state, seconds);
+            grew |= state.limit > before;
+        }
+        state.windowStart = now;
+    }
+    return grew;
+}
+
+void ConcurrencyController::evaluate(Host& state, double seconds) {
+    double goodput = static_cast<double>(state.bytes) / seconds;
+    state.bytesPerSecond = goodput;
+
+    bool inflated = false;
+    if (state.latencyCount > 0) {
+        double latency = state.latencySumMs / static_cast<double>(state.latencyCount);
+        state.latencyMs = latency;
+
+        inflated = state.baseLatencyMs > 0.0 && latency > state.baseLatencyMs * kLatencyFactor &&
+                   latency - state.baseLatencyMs > kLatencyMarginMs;
+
+        if (state.baseLatencyMs == 0.0 || latency < state.baseLatencyMs) {
+            state.baseLatencyMs = latency;
+        } else {
+            state.baseLatencyMs += (latency - state.baseLatencyMs) * kBaselineDrift;
+        }
+    }
+
+    size_t before = state.limit;
+    if (state.throttled || state.failures >= kFailureLimit) {
+        // Multiplicative decrease: the server asked for less or is dropping connections
+        state.limit = std::max<size_t>(state.limit / 2, 1);
+        state.hold = kBackoffWindows;
+    } else if (inflated) {
+        // Queues are building up somewhere on the path; ease off before the server throttles
+        state.limit = std::max<size_t>(state.limit - 1, 1);
+        state.hold = std::max<size_t>(state.hold, 1);
+    } else if (state.probing && state.saturated && goodput < state.goodputBeforeProbe * kProbeGain) {
+        // The last connection added bought nothing; step back and stay on this plateau for a while
+        state.limit = std::max<size_t>(state.limit - 1, 1);
+        state.hold = kPlateauWindows;
+    } else if (state.hold > 0) {
+        --state.hold;
+    } else if (state.saturated && state.limit < m_maxLimit) {
+        state.goodputBeforeProbe = goodput;
+        ++state.limit;
+    }
+
+    state.probing = state.limit > before;
+    if (state.limit > before) {
+        ++state.increases;
+    } else if (state.limit < before) {
+        ++state.decreases;
+    }
+
+    state.bytes = 0;
+    state.latencySumMs = 0.0;
+    state.latencyCount = 0;
+    state.failures = 0;
+    state.throttled = false;
+    state.saturated = state.inUse >= state.limit;
+}
+
+std::vector<ConcurrencyController::HostStats> ConcurrencyController::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<HostStats> result;
+    for (const auto& entry : m_hosts) {
+        const auto& state = entry.second;
+        HostStats stats;
+        stats.host = entry.first;
+        stats.limit = state.limit;
+        stats.inUse = state.inUse;
+        stats.bytesPerSecond = state.bytesPerSecond;
+        stats.latencyMs = state.latencyMs;
+        stats.baseLatencyMs = state.baseLatencyMs;
+        stats.increases = state.increases;
+        stats.decreases = state.decreases;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+} // namespace launcher
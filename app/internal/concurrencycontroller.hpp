@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// How many connections each host gets, adjusted AIMD-style from what the host delivers.
+// While the window is in use, it grows by one connection per measurement window as long as
+// that still raises goodput. It halves when the server throttles (429/503) or connections
+// fail, and shrinks by one when response latency climbs well above its baseline.
+class ConcurrencyController {
+public:
+    struct HostStats {
+        std::string host;
+        size_t limit = 0;
+        size_t inUse = 0;
+        // Goodput and average time to response headers over the last window
+        double bytesPerSecond = 0.0;
+        double latencyMs = 0.0;
+        double baseLatencyMs = 0.0;
+        uint64_t increases = 0;
+        uint64_t decreases = 0;
+    };
+
+    ConcurrencyController(size_t initialLimit, size_t maxLimit);
+
+    ConcurrencyController(const ConcurrencyController&) = delete;
+    ConcurrencyController& operator=(const ConcurrencyController&) = delete;
+
+    // Take one connection slot of host if its window has room
+    bool tryAcquire(const std::string& host);
+    void release(const std::string& host);
+
+    // Give a slot back if the host is over its window; on true the caller must not release it again
+    bool shrink(const std::string& host);
+
+    void recordBytes(const std::string& host, uint64_t bytes);
+    void recordResponse(const std::string& host, std::chrono::steady_clock::duration latency, int status);
+    void recordFailure(const std::string& host);
+
+    // Close the measurement window of every host that is due; call at least a few times per second.
+    // Returns true if a window grew, so waiting work may start.
+    bool update(std::chrono::steady_clock::time_point now);
+
+    std::vector<HostStats> getStats() const;
+
+private:
+    struct Host {
+        size_t limit = 1;
+        size_t inUse = 0;
+
+        // Current window
+        std::chrono::steady_clock::time_point windowStart;
+        uint64_t bytes = 0;
+        double latencySumMs = 0.0;
+        size_t latencyCount = 0;
+        size_t failures = 0;
+        bool throttled = false;
+        // Something wanted a connection the window did not have
+        bool saturated = false;
+
+        // The last window added a connection; goodput from before it tells whether that helped
+        bool probing = false;
+        double goodputBeforeProbe = 0.0;
+        // Windows left before the next increase
+        size_t hold = 0;
+
+        double bytesPerSecond = 0.0;
+        double latencyMs = 0.0;
+        double baseLatencyMs = 0.0;
+        uint64_t increases = 0;
+        uint64_t decreases = 0;
+    };
+
+    // Requires m_mutex
+    Host& host(const std::string& key);
+    void evaluate(Host& host, double seconds);
+
+    size_t m_initialLimit;
+    size_t m_maxLimit;
+    mutable std::mutex m_mutex;
+    std::map<std::string, Host> m_hosts;
+};
+
+} // namespace launcher
@@ -0,0 +1,135 @@
+#include "connectionpool.hpp"
+#include <httplib.h>
+
+namespace launcher {
+
+namespace {
+
+// Servers drop idle keep-alive connections after a while (nginx: 75 s); older ones are not worth keeping
+const std::chrono::seconds kIdleTimeout(60);
+
+double averageMs(uint64_t totalNs, uint64_t count) {
+    return count > 0 ? static_cast<double>(totalNs) / static_cast<double>(count) / 1e6 : 0.0;
+}
+
+} // namespace
+
+ConnectionPool::Lease::Lease(ConnectionPool* pool, std::string key, std::unique_ptr<httplib::Client> client,
+                             bool reused)
+    : m_pool(pool), m_key(std::move(key)), m_client(std::move(client)), m_reused(reused) {
+}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : m_pool(other.m_pool), m_key(std::move(other.m_key)), m_client(std::move(other.m_client)),
+      m_reused(other.m_reused), m_measured(other.m_measured) {
+    other.m_pool = nullptr;
+}
+
+ConnectionPool::Lease::~Lease() {
+    if (m_pool && m_client) {
+        m_pool->release(m_key, std::move(m_client));
+    }
+}
+
+void ConnectionPool::Lease::recordLatency(std::chrono::steady_clock::duration elapsed) {
+    if (m_measured) {
+        return;
+    }
+    m_measured = true;
+    m_pool->recordLatency(m_reused, elapsed);
+}
+
+ConnectionPool::ConnectionPool(size_t maxIdlePerHost)
+    : m_maxIdlePerHost(maxIdlePerHost), m_idleCount(0), m_leases(0), m_reused(0),
+      m_newLatencyNs(0), m_newLatencyCount(0), m_reusedLatencyNs(0), m_reusedLatencyCount(0) {
+}
+
+ConnectionPool::~ConnectionPool() {
+}
+
+ConnectionPool::Lease ConnectionPool::acquire(const std::string& host, int port) {
+    std::string key = host + ":" + std::to_string(port);
+    auto now = std::chrono::steady_clock::now();
+
+    std::unique_ptr<httplib::Client> client;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_idle.find(key);
+        if (it != m_idle.end()) {
+            auto& idle = it->second;
+            while (!idle.empty() && !client) {
+                if (now - idle.front().since < kIdleTimeout) {
+                    client = std::move(idle.front().client);
+                }
+                idle.pop_front();
+                --m_idleCount;
+            }
+            if (idle.empty()) {
+                m_idle.erase(it);
+            }
+        }
+    }
+
+    if (!client) {
+        client = std::make_unique<httplib::Client>(host, port);
+        client->set_follow_location(true);
+        client->set_keep_alive(true);
+        // Compressed bodies reach StreamDecoder as they came; httplib would decode gzip a
+        // second time, or refuse it with a 415 when built without zlib
+        client->set_decompress(false);
+    }
+
+    // httplib reconnects on its own if the server closed the socket meanwhile
+    bool reused = client->is_socket_open();
+    ++m_leases;
+    if (reused) {
+        ++m_reused;
+    }
+
+    return Lease(this, key, std::move(client), reused);
+}
+
+void ConnectionPool::release(const std::string& key, std::unique_ptr<httplib::Client> client) {
+    // A request that failed or was cancelled leaves the socket closed; nothing left to reuse
+    if (!client->is_socket_open()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& idle = m_idle[key];
+    idle.push_front(IdleClient{std::move(client), std::chrono::steady_clock::now()});
+    ++m_idleCount;
+
+    if (idle.size() > m_maxIdlePerHost) {
+        idle.pop_back();
+        --m_idleCount;
+    }
+}
+
+void ConnectionPool::recordLatency(bool reused, std::chrono::steady_clock::duration elapsed) {
+    auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    if (reused) {
+        m_reusedLatencyNs += ns;
+        ++m_reusedLatencyCount;
+    } else {
+        m_newLatencyNs += ns;
+        ++m_newLatencyCount;
+    }
+}
+
+ConnectionPool::Stats ConnectionPool::getStats() const {
+    Stats stats;
+    stats.leases = m_leases;
+    stats.reused = m_reused;
+    stats.reuseRatio = stats.leases > 0
+        ? static_cast<double>(stats.reused) / static_cast<double>(stats.leases)
+        : 0.0;
+    stats.newConnectionLatencyMs = averageMs(m_newLatencyNs, m_newLatencyCount);
+    stats.reusedConnectionLatencyMs = averageMs(m_reusedLatencyNs, m_reusedLatencyCount);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.idle = m_idleCount;
+    return stats;
+}
+
+} // namespace launcher
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace httplib {
+class Client;
+}
+
+namespace launcher {
+
+// Keep-alive HTTP clients per host. A worker borrows a client for one download and hands
+// it back afterwards, so consecutive files from the same CDN skip the TCP (and TLS) handshake.
+class ConnectionPool {
+public:
+    struct Stats {
+        uint64_t leases = 0;
+        // Leases that got a client whose socket was still open
+        uint64_t reused = 0;
+        size_t idle = 0;
+        double reuseRatio = 0.0;
+        // Average time from sending the first request of a lease to its response headers.
+        // The gap between the two is what connecting costs.
+        double newConnectionLatencyMs = 0.0;
+        double reusedConnectionLatencyMs = 0.0;
+    };
+
+    // Exclusive use of one client; returns it to the pool when destroyed
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&&) = delete;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        httplib::Client& client() { return *m_client; }
+        bool reused() const { return m_reused; }
+
+        // Report how long the first request took to get its response headers; later calls are ignored
+        void recordLatency(std::chrono::steady_clock::duration elapsed);
+
+    private:
+        friend class ConnectionPool;
+        Lease(ConnectionPool* pool, std::string key, std::unique_ptr<httplib::Client> client, bool reused);
+
+        ConnectionPool* m_pool;
+        std::string m_key;
+        std::unique_ptr<httplib::Client> m_client;
+        bool m_reused;
+        bool m_measured = false;
+    };
+
+    explicit ConnectionPool(size_t maxIdlePerHost = 16);
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Borrow the most recently returned client for host:port, or a new one
+    Lease acquire(const std::string& host, int port);
+
+    Stats getStats() const;
+
+private:
+    struct IdleClient {
+        std::unique_ptr<httplib::Client> client;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    void release(const std::string& key, std::unique_ptr<httplib::Client> client);
+    void recordLatency(bool reused, std::chrono::steady_clock::duration elapsed);
+
+    size_t m_maxIdlePerHost;
+    mutable std::mutex m_mutex;
+    // Most recently returned first; its connection is the least likely to have timed out
+    std::map<std::string, std::deque<IdleClient>> m_idle;
+    size_t m_idleCount;
+
+    std::atomic<uint64_t> m_leases;
+    std::atomic<uint64_t> m_reused;
+    std::atomic<uint64_t> m_newLatencyNs;
+    std::atomic<uint64_t> m_newLatencyCount;
+    std::atomic<uint64_t> m_reusedLatencyNs;
+    std::atomic<uint64_t> m_reusedLatencyCount;
+};
+
+} // namespace launcher
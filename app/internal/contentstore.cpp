@@ -0,0 +1,225 @@
+#include "contentstore.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <cctype>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+namespace launcher {
+
+namespace {
+
+// Object names are the lowercase hex MD5, nothing else, so a key can never leave the store
+bool isMd5(const std::string& name) {
+    return name.size() == 32 && std::all_of(name.begin(), name.end(), [](unsigned char c) {
+        return std::isdigit(c) || (c >= 'a' && c <= 'f');
+    });
+}
+
+// Share the data of from at to, which must not exist: hardlink, then reflink, then a copy
+bool cloneFile(const std::filesystem::path& from, const std::filesystem::path& to) {
+    std::error_code ec;
+    std::filesystem::create_hard_link(from, to, ec);
+    if (!ec) {
+        return true;
+    }
+
+#ifdef __linux__
+    // Copy-on-write filesystems (btrfs, XFS) share the extents across volumes of one pool
+    int source = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source >= 0) {
+        int target = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        bool cloned = false;
+        if (target >= 0) {
+            cloned = ::ioctl(target, FICLONE, source) == 0;
+            ::close(target);
+            if (!cloned) {
+                std::filesystem::remove(to, ec);
+            }
+        }
+        ::close(source);
+        if (cloned) {
+            return true;
+        }
+    }
+#endif
+
+    return std::filesystem::copy_file(from, to, ec) && !ec;
+}
+
+} // namespace
+
+void ContentStore::open(const std::string& root, uint64_t budgetBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_root = root;
+    m_budget = budgetBytes;
+    m_objects.clear();
+    m_useOrder.clear();
+    m_bytes = 0;
+    if (m_root.empty()) {
+        return;
+    }
+
+    struct Found {
+        std::filesystem::file_time_type used;
+        std::string md5;
+        uint64_t size;
+    };
+    std::vector<Found> found;
+
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(m_root, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (!it->is_regular_file(ec) || !isMd5(name)) {
+            continue;
+        }
+
+        uint64_t size = it->file_size(ec);
+        auto used = it->last_write_time(ec);
+        if (!ec) {
+            found.push_back(Found{used, name, size});
+        }
+        ec.clear();
+    }
+
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.used < b.used; });
+    for (const auto& file : found) {
+        Object object;
+        object.size = file.size;
+        object.use = m_useOrder.insert(m_useOrder.end(), file.md5);
+        m_objects[file.md5] = object;
+        m_bytes += file.size;
+    }
+
+    evict();
+}
+
+void ContentStore::setBudget(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    evict();
+}
+
+uint64_t ContentStore::getBudget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+std::string ContentStore::objectPath(const std::string& md5) const {
+    return (std::filesystem::path(m_root) / md5.substr(0, 2) / md5).string();
+}
+
+bool ContentStore::contains(const std::string& md5) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_objects.count(md5) > 0;
+}
+
+bool ContentStore::materialize(const std::string& md5, const std::string& target, uint64_t& size) {
+    std::string source;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_objects.find(md5);
+        if (it == m_objects.end()) {
+            return false;
+        }
+        source = objectPath(md5);
+        size = it->second.size;
+        touch(md5, it->second);
+    }
+
+    // The file at target may itself be a link of the object; unlinking it leaves the object alone
+    std::error_code ec;
+    std::filesystem::remove(target, ec);
+    if (!cloneFile(source, target)) {
+        return false;
+    }
+
+    // Evicted meanwhile, or changed through a hardlinked install
+    if (std::filesystem::file_size(target, ec) != size || ec) {
+        std::filesystem::remove(target, ec);
+        remove(md5);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_hits;
+    m_savedBytes += size;
+    return true;
+}
+
+void ContentStore::add(const std::string& md5, const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (ec || m_root.empty() || !isMd5(md5) || size > m_budget || m_objects.count(md5) > 0) {
+        return;
+    }
+
+    std::filesystem::path object(objectPath(md5));
+    std::filesystem::create_directories(object.parent_path(), ec);
+    std::filesystem::create_hard_link(path, object, ec);
+    if (ec) {
+        return;
+    }
+
+    Object entry;
+    entry.size = size;
+    entry.use = m_useOrder.insert(m_useOrder.end(), md5);
+    m_objects[md5] = entry;
+    m_bytes += size;
+    touch(md5, m_objects[md5]);
+    evict();
+}
+
+void ContentStore::remove(const std::string& md5) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    erase(md5);
+}
+
+void ContentStore::touch(const std::string& md5, Object& object) {
+    m_useOrder.splice(m_useOrder.end(), m_useOrder, object.use);
+
+    std::error_code ec;
+    std::filesystem::last_write_time(objectPath(md5), std::filesystem::file_time_type::clock::now(), ec);
+}
+
+void ContentStore::evict() {
+    while (m_bytes > m_budget && !m_useOrder.empty()) {
+        erase(m_useOrder.front());
+    }
+}
+
+void ContentStore::erase(const std::string& md5) {
+    auto it = m_objects.find(md5);
+    if (it == m_objects.end()) {
+        return;
+    }
+
+    // Installs that link the file keep their copy; only the store's name goes away
+    std::error_code ec;
+    std::filesystem::remove(objectPath(md5), ec);
+    m_bytes -= it->second.size;
+    m_useOrder.erase(it->second.use);
+    m_objects.erase(it);
+}
+
+ContentStore::Stats ContentStore::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.objects = m_objects.size();
+    stats.bytes = m_bytes;
+    stats.budget = m_budget;
+    stats.hits = m_hits;
+    stats.savedBytes = m_savedBytes;
+    return stats;
+}
+
+} // namespace launcher
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Verified files kept by MD5, so content shared by several games or by the beta and live
+// branches of one is downloaded and stored once. Files enter as hardlinks of what a download
+// just wrote, costing no extra disk while the install keeps them, and come out as hardlinks,
+// reflinks or copies, whichever the filesystem allows. Least recently used files are evicted
+// to stay within a byte budget; use order survives restarts through the files' mtimes.
+class ContentStore {
+public:
+    struct Stats {
+        size_t objects = 0;
+        uint64_t bytes = 0;
+        uint64_t budget = 0;
+        // Files materialized from the store instead of downloaded, and their bytes
+        uint64_t hits = 0;
+        uint64_t savedBytes = 0;
+    };
+
+    ContentStore() = default;
+
+    ContentStore(const ContentStore&) = delete;
+    ContentStore& operator=(const ContentStore&) = delete;
+
+    // Index the files under root; an empty root or a zero budget disables the store
+    void open(const std::string& root, uint64_t budgetBytes);
+
+    // Shrinking the budget evicts right away
+    void setBudget(uint64_t bytes);
+    uint64_t getBudget() const;
+
+    bool contains(const std::string& md5) const;
+
+    // Put the file with this MD5 at target, replacing whatever is there. The caller still
+    // verifies the result: a hardlinked file could have been changed through the install.
+    bool materialize(const std::string& md5, const std::string& target, uint64_t& size);
+
+    // Take in a file whose MD5 was just verified. Only by hardlink: a copy would double the disk
+    // use of every install, so files on another volume than the store are left out.
+    void add(const std::string& md5, const std::string& path);
+
+    // Drop a file that turned out not to match its MD5
+    void remove(const std::string& md5);
+
+    Stats getStats() const;
+
+private:
+    struct Object {
+        uint64_t size = 0;
+        std::list<std::string>::iterator use;
+    };
+
+    std::string objectPath(const std::string& md5) const;
+    // Requires m_mutex
+    void touch(const std::string& md5, Object& object);
+    void evict();
+    void erase(const std::string& md5);
+
+    std::string m_root;
+    uint64_t m_budget = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_hits = 0;
+    uint64_t m_savedBytes = 0;
+    std::unordered_map<std::string, Object> m_objects;
+    // Least recently used first
+    std::list<std::string> m_useOrder;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace launcher
@@ -0,0 +1,317 @@
+#include "deltaupdate.hpp"
+#include "md5.hpp"
+#include "filewriter.hpp"
+#include <rapidjson/document.h>
+#include <filesystem>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+#include <cstring>
+
+namespace launcher {
+
+namespace {
+
+// Read ahead of the scan window, and the copy size while assembling
+const size_t kScanChunk = 4 * 1024 * 1024;
+
+// Bounds on blockSize; smaller blocks find more but make the manifest and the scan costlier
+const uint32_t kMinBlockSize = 4 * 1024;
+const uint32_t kMaxBlockSize = 64 * 1024 * 1024;
+
+uint32_t digest(uint32_t a, uint32_t b) {
+    return (a & 0xffff) | (b << 16);
+}
+
+} // namespace
+
+ChunkManifest ChunkManifest::parse(const std::string& json) {
+    rapidjson::Document doc;
+    doc.Parse(json.c_str());
+
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("size") || !doc["size"].IsUint64() ||
+        !doc.HasMember("blockSize") || !doc["blockSize"].IsUint() ||
+        !doc.HasMember("blocks") || !doc["blocks"].IsArray()) {
+        throw std::runtime_error("Invalid chunk manifest");
+    }
+
+    ChunkManifest manifest;
+    manifest.size = doc["size"].GetUint64();
+    manifest.blockSize = doc["blockSize"].GetUint();
+    if (manifest.blockSize < kMinBlockSize || manifest.blockSize > kMaxBlockSize) {
+        throw std::runtime_error("Unsupported chunk manifest block size");
+    }
+
+    const auto& items = doc["blocks"];
+    uint64_t expected = (manifest.size + manifest.blockSize - 1) / manifest.blockSize;
+    if (items.Size() != expected) {
+        throw std::runtime_error("Chunk manifest does not cover the file");
+    }
+
+    manifest.blocks.reserve(items.Size());
+    for (auto it = items.Begin(); it != items.End(); ++it) {
+        if (!it->IsObject() || !it->HasMember("weak") || !(*it)["weak"].IsUint() ||
+            !it->HasMember("md5") || !(*it)["md5"].IsString()) {
+            throw std::runtime_error("Invalid block in chunk manifest");
+        }
+
+        Block block;
+        block.weak = (*it)["weak"].GetUint();
+        block.md5 = (*it)["md5"].GetString();
+        std::transform(block.md5.begin(), block.md5.end(), block.md5.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        manifest.blocks.push_back(block);
+    }
+
+    return manifest;
+}
+
+DeltaBuilder::DeltaBuilder(const ChunkManifest& manifest)
+    : m_manifest(manifest), m_sources(manifest.blocks.size(), -1) {
+}
+
+uint32_t DeltaBuilder::weakChecksum(const char* data, size_t length) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    for (size_t i = 0; i < length; ++i) {
+        uint32_t x = static_cast<unsigned char>(data[i]);
+        a += x;
+        b += static_cast<uint32_t>(length - i) * x;
+    }
+    return digest(a, b);
+}
+
+uint64_t DeltaBuilder::blockOffset(size_t block) const {
+    return static_cast<uint64_t>(block) * m_manifest.blockSize;
+}
+
+size_t DeltaBuilder::blockLength(size_t block) const {
+    return static_cast<size_t>(std::min<uint64_t>(m_manifest.blockSize, m_manifest.size - blockOffset(block)));
+}
+
+bool DeltaBuilder::resolve(const std::vector<uint32_t>& candidates, const std::string& md5, uint64_t offset) {
+    bool matched = false;
+    for (uint32_t block : candidates) {
+        if (m_manifest.blocks[block].md5 != md5) {
+            continue;
+        }
+
+        matched = true;
+        if (m_sources[block] < 0) {
+            m_sources[block] = static_cast<int64_t>(offset);
+            m_reusedBytes += blockLength(block);
+            ++m_found;
+        }
+    }
+    return matched;
+}
+
+bool DeltaBuilder::blockMatches(std::ifstream& file, size_t block, uint64_t offset) {
+    std::vector<char> data(blockLength(block));
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(offset));
+    if (!file.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+        return false;
+    }
+
+    Md5 md5;
+    md5.update(data.data(), data.size());
+    return md5.hexDigest() == m_manifest.blocks[block].md5;
+}
+
+bool DeltaBuilder::scan(const std::string& oldPath, const std::atomic<bool>* cancelled) {
+    std::fill(m_sources.begin(), m_sources.end(), -1);
+    m_found = 0;
+    m_reusedBytes = 0;
+    m_error.clear();
+
+    std::error_code ec;
+    uint64_t oldSize = std::filesystem::file_size(oldPath, ec);
+    std::ifstream file(oldPath, std::ios::binary);
+    if (ec || !file) {
+        m_error = "Failed to read " + oldPath;
+        return false;
+    }
+
+    // Only full-size blocks roll; a short last block is looked for where it can plausibly be
+    const size_t window = m_manifest.blockSize;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> index;
+    size_t rolling = 0;
+    for (size_t i = 0; i < m_manifest.blocks.size(); ++i) {
+        if (blockLength(i) == window) {
+            index[m_manifest.blocks[i].weak].push_back(static_cast<uint32_t>(i));
+            ++rolling;
+        }
+    }
+
+    std::vector<char> buffer(window + kScanChunk);
+    uint64_t bufferBase = 0;   // old file offset of buffer[0]
+    size_t filled = 0;
+    size_t pos = 0;
+    bool eof = false;
+    bool fresh = true;
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    while (!index.empty() && m_found < rolling) {
+        // Keep the window and the byte after it in the buffer
+        if (pos + window >= filled && !eof) {
+            if (cancelled && *cancelled) {
+                m_error = "Cancelled";
+                return false;
+            }
+
+            std::memmove(buffer.data(), buffer.data() + pos, filled - pos);
+            filled -= pos;
+            bufferBase += pos;
+            pos = 0;
+
+            file.read(buffer.data() + filled, static_cast<std::streamsize>(buffer.size() - filled));
+            size_t got = static_cast<size_t>(file.gcount());
+            filled += got;
+            eof = got == 0 || !file;
+        }
+        if (filled - pos < window) {
+            break;
+        }
+
+        const char* data = buffer.data() + pos;
+        if (fresh) {
+            a = 0;
+            b = 0;
+            for (size_t i = 0; i < window; ++i) {
+                uint32_t x = static_cast<unsigned char>(data[i]);
+                a += x;
+                b += static_cast<uint32_t>(window - i) * x;
+            }
+            fresh = false;
+        }
+
+        auto it = index.find(digest(a, b));
+        if (it != index.end()) {
+            Md5 md5;
+            md5.update(data, window);
+            if (resolve(it->second, md5.hexDigest(), bufferBase + pos)) {
+                // Blocks do not overlap in the new version, so neither do their sources
+                pos += window;
+                fresh = true;
+                continue;
+            }
+        }
+
+        if (pos + window >= filled) {
+            break;
+        }
+
+        // Slide one byte: drop data[0], take data[window]
+        uint32_t out = static_cast<unsigned char>(data[0]);
+        uint32_t in = static_cast<unsigned char>(data[window]);
+        a += in - out;
+        b += a - static_cast<uint32_t>(window) * out;
+        ++pos;
+    }
+
+    // The short last block: unchanged in place, or still at the end of a file that grew or shrank
+    if (!m_manifest.blocks.empty()) {
+        size_t last = m_manifest.blocks.size() - 1;
+        size_t length = blockLength(last);
+        if (length < window && m_sources[last] < 0) {
+            uint64_t tails[] = {blockOffset(last), oldSize >= length ? oldSize - length : oldSize};
+            for (uint64_t offset : tails) {
+                if (offset + length <= oldSize && blockMatches(file, last, offset)) {
+                    m_sources[last] = static_cast<int64_t>(offset);
+                    m_reusedBytes += length;
+                    ++m_found;
+                    break;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool DeltaBuilder::assemble(const std::string& oldPath, const std::string& newPath) {
+    std::ifstream in(oldPath, std::ios::binary);
+    FileWriter out;
+    if (!in) {
+        m_error = "Failed to read " + oldPath;
+        return false;
+    }
+    if (!out.open(newPath, 0, true)) {
+        m_error = out.error();
+        return false;
+    }
+    out.preallocate(m_manifest.size);
+
+    std::vector<char> buffer(std::min<size_t>(kScanChunk, m_manifest.blockSize));
+    for (size_t i = 0; i < m_manifest.blocks.size(); ++i) {
+        if (m_sources[i] < 0) {
+            continue;
+        }
+
+        // A gap left for a missing block: continue past it
+        uint64_t offset = blockOffset(i);
+        if (out.position() != offset && !out.open(newPath, offset, false)) {
+            m_error = out.error();
+            return false;
+        }
+
+        in.seekg(static_cast<std::streamoff>(m_sources[i]));
+        size_t remaining = blockLength(i);
+        while (remaining > 0) {
+            size_t take = std::min(remaining, buffer.size());
+            if (!in.read(buffer.data(), static_cast<std::streamsize>(take))) {
+                m_error = "Failed to read " + oldPath;
+                return false;
+            }
+            if (!out.write(buffer.data(), take)) {
+                m_error = out.error();
+                return false;
+            }
+            remaining -= take;
+        }
+    }
+
+    if (!out.close()) {
+        m_error = out.error();
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::resize_file(newPath, m_manifest.size, ec);
+    if (ec) {
+        m_error = "Failed to size " + newPath + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+std::vector<DownloadJournal::Range> DeltaBuilder::ranges() const {
+    std::vector<DownloadJournal::Range> result;
+    for (size_t i = 0; i < m_manifest.blocks.size(); ++i) {
+        bool reused = m_sources[i] >= 0;
+        uint64_t begin = blockOffset(i);
+        uint64_t end = begin + blockLength(i);
+
+        // Runs of reused or missing blocks become one range each
+        if (!result.empty() && (result.back().done == result.back().end) == reused &&
+            result.back().end == begin) {
+            result.back().end = end;
+            if (reused) {
+                result.back().done = end;
+            }
+            continue;
+        }
+
+        DownloadJournal::Range range;
+        range.begin = begin;
+        range.end = end;
+        range.done = reused ? end : begin;
+        result.push_back(range);
+    }
+    return result;
+}
+
+} // namespace launcher
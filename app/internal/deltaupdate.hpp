@@ -0,0 +1,70 @@
+#pragma once
+
+#include "downloadjournal.hpp"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Block checksums of the new version of a file, published next to it on the CDN:
+// {"size": N, "blockSize": B, "blocks": [{"weak": <DeltaBuilder::weakChecksum>, "md5": "<hex>"}, ...]}
+// Every block is blockSize bytes except the last, which holds the rest of the file.
+struct ChunkManifest {
+    struct Block {
+        uint32_t weak = 0;
+        std::string md5;
+    };
+
+    uint64_t size = 0;
+    uint32_t blockSize = 0;
+    std::vector<Block> blocks;
+
+    // Throws std::runtime_error on malformed input
+    static ChunkManifest parse(const std::string& json);
+};
+
+// Rebuilds the new version of a file from what is still usable in the old one, rsync style.
+// A rolling checksum is slid over the old file byte by byte, so blocks are found even where
+// a patch moved them; candidates are confirmed by MD5. Only blocks found nowhere are fetched.
+class DeltaBuilder {
+public:
+    explicit DeltaBuilder(const ChunkManifest& manifest);
+
+    // The rsync weak checksum: 16-bit sum of the bytes and 16-bit sum of the running sums
+    static uint32_t weakChecksum(const char* data, size_t length);
+
+    // Look for every block of the new version in oldPath; false if it cannot be read or on cancel
+    bool scan(const std::string& oldPath, const std::atomic<bool>* cancelled = nullptr);
+
+    // Write the new version to newPath at its final size: found blocks copied from oldPath,
+    // missing ones left as holes for the download to fill
+    bool assemble(const std::string& oldPath, const std::string& newPath);
+
+    // The new version as byte ranges, done where assembled and pending where still missing
+    std::vector<DownloadJournal::Range> ranges() const;
+
+    uint64_t reusedBytes() const { return m_reusedBytes; }
+    uint64_t missingBytes() const { return m_manifest.size - m_reusedBytes; }
+    const std::string& error() const { return m_error; }
+
+private:
+    uint64_t blockOffset(size_t block) const;
+    size_t blockLength(size_t block) const;
+    // Record offset as the source of every unfound candidate with this MD5; true if the data
+    // is one of the candidates, found before or not
+    bool resolve(const std::vector<uint32_t>& candidates, const std::string& md5, uint64_t offset);
+    bool blockMatches(std::ifstream& file, size_t block, uint64_t offset);
+
+    const ChunkManifest& m_manifest;
+    // Offset of each block in the old file, or -1 if it has to be fetched
+    std::vector<int64_t> m_sources;
+    size_t m_found = 0;
+    uint64_t m_reusedBytes = 0;
+    std::string m_error;
+};
+
+} // namespace launcher
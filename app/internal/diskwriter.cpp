@@ -0,0 +1,547 @@
+#include "diskwriter.hpp"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(__linux__) && defined(IORING_OFF_SQ_RING) && defined(__NR_io_uring_setup)
+#define LAUNCHER_IO_URING 1
+#endif
+
+namespace launcher {
+
+namespace {
+
+// Threads writing when io_uring is not available
+const size_t kWorkerThreads = 2;
+
+// Buffers kept for reuse; more than this are freed when they come back
+const size_t kIdleBuffers = 16;
+
+// Submission queue entries; writes beyond twice this wait for room
+const unsigned kRingEntries = 64;
+
+std::string errorText(int error) {
+#ifdef _WIN32
+    return "error " + std::to_string(error);
+#else
+    return std::strerror(error);
+#endif
+}
+
+double toMilliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+bool DiskWriter::Tracker::wait(size_t limit) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_pending <= limit; });
+    return m_error.empty();
+}
+
+std::string DiskWriter::Tracker::error() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_error;
+}
+
+bool DiskWriter::Tracker::takeDirectFailed() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool failed = m_directFailed;
+    m_directFailed = false;
+    return failed;
+}
+
+void DiskWriter::Tracker::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_error.clear();
+    m_directFailed = false;
+}
+
+#ifdef __linux__
+
+struct DiskWriter::Ring {
+#ifdef LAUNCHER_IO_URING
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    // Writes in the kernel, kept within the completion queue so none can overflow
+    size_t inFlight = 0;
+    size_t capacity = 0;
+    std::mutex mutex;
+    std::condition_variable room;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#endif
+};
+
+#ifdef LAUNCHER_IO_URING
+
+namespace {
+
+int ringEnter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+}
+
+} // namespace
+
+bool DiskWriter::startRing() {
+    auto ring = std::make_unique<Ring>();
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring->fd = static_cast<int>(syscall(__NR_io_uring_setup, kRingEntries, &params));
+    if (ring->fd < 0) {
+        // Old kernels, and sandboxes that filter the syscall
+        return false;
+    }
+
+    // IORING_OP_WRITE came with 5.6, as did the probe
+    std::vector<char> probeStorage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(probeStorage.data());
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) != 0 ||
+        probe->last_op < IORING_OP_WRITE || !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+        return false;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+    }
+
+    ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        return false;
+    }
+    ring->cqRing = single ? ring->sqRing
+                          : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) {
+        return false;
+    }
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES));
+    if (ring->sqes == MAP_FAILED) {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(ring->sqRing);
+    char* cq = static_cast<char*>(ring->cqRing);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    ring->capacity = params.cq_entries;
+
+    m_ring = std::move(ring);
+    m_reaper = std::thread(&DiskWriter::reaperLoop, this);
+    return true;
+}
+
+void DiskWriter::stopRing() {
+    ringSubmit(nullptr, false);
+    m_reaper.join();
+    m_ring.reset();
+}
+
+void DiskWriter::ringSubmit(Pending* pending, bool resubmit) {
+    Ring& ring = *m_ring;
+    std::unique_lock<std::mutex> lock(ring.mutex);
+    if (!resubmit) {
+        ring.room.wait(lock, [&]() { return ring.inFlight < ring.capacity; });
+        ++ring.inFlight;
+    }
+
+    // Every submission is entered right away, so the queue is empty again before the next one
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+    io_uring_sqe& sqe = ring.sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    if (pending) {
+        const Segment& segment = pending->segment;
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = segment.handle;
+        sqe.addr = reinterpret_cast<uintptr_t>(pending->job->buffer + segment.from + pending->written);
+        sqe.len = static_cast<uint32_t>(segment.length - pending->written);
+        sqe.off = segment.offset + pending->written;
+        sqe.user_data = reinterpret_cast<uintptr_t>(pending);
+    } else {
+        sqe.opcode = IORING_OP_NOP;
+    }
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while (ringEnter(ring.fd, 1, 0, 0) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+        std::this_thread::yield();
+    }
+}
+
+void DiskWriter::ringCompleted(Pending& pending, int result) {
+    Job* job = pending.job;
+    bool again = false;
+    if (result > 0) {
+        pending.written += static_cast<size_t>(result);
+        again = pending.written < pending.segment.length;
+    } else if (result == -EINTR || result == -EAGAIN) {
+        again = true;
+    } else if (pending.segment.handle != pending.segment.fallback) {
+        // Some volumes refuse unbuffered writes; carry on through the cache
+        pending.segment.handle = pending.segment.fallback;
+        job->directFailed = true;
+        again = true;
+    } else {
+        job->error = "Failed to write output file: " + (result < 0 ? errorText(-result) : "nothing written");
+    }
+
+    if (again) {
+        ringSubmit(&pending, true);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_ring->mutex);
+        --m_ring->inFlight;
+    }
+    m_ring->room.notify_one();
+
+    if (--job->remaining == 0) {
+        complete(job);
+    }
+}
+
+void DiskWriter::reaperLoop() {
+    Ring& ring = *m_ring;
+    bool stopping = false;
+    while (!stopping) {
+        ringEnter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS);
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = ring.cqes[head & *ring.cqMask];
+            ++head;
+            // Hand the entry back first; continuing a short write needs the room
+            __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+            if (cqe.user_data == 0) {
+                stopping = true;
+                continue;
+            }
+            ringCompleted(*reinterpret_cast<Pending*>(cqe.user_data), cqe.res);
+        }
+    }
+}
+
+#else
+
+bool DiskWriter::startRing() {
+    return false;
+}
+
+void DiskWriter::stopRing() {
+}
+
+void DiskWriter::ringSubmit(Pending*, bool) {
+}
+
+void DiskWriter::ringCompleted(Pending&, int) {
+}
+
+void DiskWriter::reaperLoop() {
+}
+
+#endif
+#endif
+
+DiskWriter::DiskWriter() {
+    m_idle.reserve(kIdleBuffers);
+
+#ifdef __linux__
+    if (startRing()) {
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < kWorkerThreads; ++i) {
+        m_workers.emplace_back(&DiskWriter::workerLoop, this);
+    }
+}
+
+DiskWriter::~DiskWriter() {
+    // Writers drain their own jobs before they close, so nothing is in flight here
+#ifdef __linux__
+    if (m_ring) {
+        stopRing();
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queued.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+char* DiskWriter::acquire() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_idle.empty()) {
+        char* buffer = m_idle.back();
+        m_idle.pop_back();
+        return buffer;
+    }
+
+    std::unique_ptr<char[]> storage(new char[kBufferSize + kAlignment]);
+    void* start = storage.get();
+    size_t space = kBufferSize + kAlignment;
+    char* buffer = static_cast<char*>(std::align(kAlignment, kBufferSize, start, space));
+    m_allocations[buffer] = std::move(storage);
+    return buffer;
+}
+
+void DiskWriter::release(char* buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle.size() < kIdleBuffers) {
+        m_idle.push_back(buffer);
+    } else {
+        m_allocations.erase(buffer);
+    }
+}
+
+DiskWriter::Job* DiskWriter::takeJob() {
+    if (m_freeJobs) {
+        Job* job = m_freeJobs;
+        m_freeJobs = job->next;
+        job->next = nullptr;
+        return job;
+    }
+
+    m_jobs.push_back(std::make_unique<Job>());
+    return m_jobs.back().get();
+}
+
+void DiskWriter::submit(Tracker& tracker, char* buffer, const Segment* segments, size_t count) {
+    Job* job;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job = takeJob();
+        ++m_depth;
+        m_peakDepth = std::max(m_peakDepth, m_depth);
+    }
+
+    job->tracker = &tracker;
+    job->buffer = buffer;
+    job->count = std::min<size_t>(count, 2);
+    job->remaining = job->count;
+    job->error.clear();
+    job->directFailed = false;
+    job->submitted = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < job->count; ++i) {
+        job->writes[i].job = job;
+        job->writes[i].segment = segments[i];
+        job->writes[i].written = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(tracker.m_mutex);
+        ++tracker.m_pending;
+    }
+
+#ifdef __linux__
+    if (m_ring) {
+        for (size_t i = 0; i < job->count; ++i) {
+            ringSubmit(&job->writes[i], false);
+        }
+        return;
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queueTail) {
+            m_queueTail->next = job;
+        } else {
+            m_queueHead = job;
+        }
+        m_queueTail = job;
+    }
+    m_queued.notify_one();
+}
+
+void DiskWriter::complete(Job* job) {
+    auto latency = std::chrono::steady_clock::now() - job->submitted;
+    Tracker* tracker = job->tracker;
+    std::string error = std::move(job->error);
+    bool directFailed = job->directFailed;
+
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < job->count; ++i) {
+        bytes += job->writes[i].segment.length;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_writes;
+        m_bytes += bytes;
+        m_latencyTotal += latency;
+        m_latencyMax = std::max(m_latencyMax, latency);
+        --m_depth;
+
+        if (m_idle.size() < kIdleBuffers) {
+            m_idle.push_back(job->buffer);
+        } else {
+            m_allocations.erase(job->buffer);
+        }
+        job->next = m_freeJobs;
+        m_freeJobs = job;
+    }
+
+    // Notified under the lock: the writer may destroy the tracker as soon as it wakes
+    std::lock_guard<std::mutex> lock(tracker->m_mutex);
+    if (!error.empty() && tracker->m_error.empty()) {
+        tracker->m_error = std::move(error);
+    }
+    tracker->m_directFailed = tracker->m_directFailed || directFailed;
+    --tracker->m_pending;
+    tracker->m_done.notify_all();
+}
+
+bool DiskWriter::writeSegment(Job* job, Pending& pending) {
+    Segment& segment = pending.segment;
+    while (pending.written < segment.length) {
+        const char* data = job->buffer + segment.from + pending.written;
+        size_t length = segment.length - pending.written;
+        uint64_t offset = segment.offset + pending.written;
+
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD request = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+        DWORD written = 0;
+        bool ok = WriteFile(static_cast<HANDLE>(segment.handle), data, request, &written, &overlapped) && written > 0;
+        int error = ok ? 0 : static_cast<int>(GetLastError());
+#else
+        ssize_t written = pwrite(segment.handle, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        bool ok = written > 0;
+        int error = written < 0 ? errno : 0;
+#endif
+
+        if (ok) {
+            pending.written += static_cast<size_t>(written);
+            continue;
+        }
+
+        if (segment.handle != segment.fallback) {
+            // Some volumes refuse unbuffered writes; carry on through the cache
+            segment.handle = segment.fallback;
+            job->directFailed = true;
+            continue;
+        }
+
+        job->error = "Failed to write output file: " + (error ? errorText(error) : std::string("nothing written"));
+        return false;
+    }
+    return true;
+}
+
+void DiskWriter::workerLoop() {
+    while (true) {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queued.wait(lock, [&]() { return m_stopping || m_queueHead != nullptr; });
+            if (!m_queueHead) {
+                return;
+            }
+            job = m_queueHead;
+            m_queueHead = job->next;
+            if (!m_queueHead) {
+                m_queueTail = nullptr;
+            }
+            job->next = nullptr;
+        }
+
+        for (size_t i = 0; i < job->count; ++i) {
+            if (!writeSegment(job, job->writes[i])) {
+                break;
+            }
+        }
+        complete(job);
+    }
+}
+
+DiskWriter::Stats DiskWriter::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+#ifdef __linux__
+    if (m_ring) {
+        stats.backend = "io_uring";
+    }
+#endif
+    stats.queueDepth = m_depth;
+    stats.peakQueueDepth = m_peakDepth;
+    stats.writes = m_writes;
+    stats.bytes = m_bytes;
+    if (m_writes > 0) {
+        stats.averageLatencyMs = toMilliseconds(m_latencyTotal) / static_cast<double>(m_writes);
+    }
+    stats.maxLatencyMs = toMilliseconds(m_latencyMax);
+    stats.buffers = m_allocations.size();
+    stats.idleBuffers = m_idle.size();
+    return stats;
+}
+
+} // namespace launcher
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Write stage shared by the downloads. FileWriter hands it full staging buffers and carries on
+// receiving into a recycled one, so a slow disk no longer holds up the socket and the other way
+// round. Linux submits through io_uring; elsewhere, or where the kernel refuses it, a few
+// threads do the writes. Buffers and jobs are recycled, so the steady state does not allocate.
+class DiskWriter {
+public:
+    // Staging buffer size and the alignment used for unbuffered writes
+    static constexpr size_t kBufferSize = 4 * 1024 * 1024;
+    static constexpr size_t kAlignment = 4096;
+
+#ifdef _WIN32
+    using Handle = void*;
+#else
+    using Handle = int;
+#endif
+
+    // One write of a job; fallback takes over when an unbuffered handle refuses it
+    struct Segment {
+        Handle handle{};
+        Handle fallback{};
+        size_t from = 0;        // offset into the buffer
+        size_t length = 0;
+        uint64_t offset = 0;    // offset in the file
+    };
+
+    // The writes of one file, so it can wait for them and learn whether one failed
+    class Tracker {
+    public:
+        Tracker() = default;
+        Tracker(const Tracker&) = delete;
+        Tracker& operator=(const Tracker&) = delete;
+
+        // Wait until at most limit writes are outstanding; false if any failed
+        bool wait(size_t limit = 0);
+        // Set by a failed wait
+        std::string error() const;
+        // An unbuffered write was refused and went through the fallback; cleared by reading it
+        bool takeDirectFailed();
+        void reset();
+
+    private:
+        friend class DiskWriter;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_done;
+        size_t m_pending = 0;
+        std::string m_error;
+        bool m_directFailed = false;
+    };
+
+    struct Stats {
+        const char* backend = "threads";
+        // Jobs submitted and not yet completed, now and at most
+        size_t queueDepth = 0;
+        size_t peakQueueDepth = 0;
+        uint64_t writes = 0;
+        uint64_t bytes = 0;
+        // Submission to completion
+        double averageLatencyMs = 0.0;
+        double maxLatencyMs = 0.0;
+        size_t buffers = 0;
+        size_t idleBuffers = 0;
+    };
+
+    DiskWriter();
+    ~DiskWriter();
+
+    DiskWriter(const DiskWriter&) = delete;
+    DiskWriter& operator=(const DiskWriter&) = delete;
+
+    // An aligned kBufferSize buffer from the pool; also lent out for reading files back
+    char* acquire();
+    void release(char* buffer);
+
+    // Write the segments of buffer, which belongs to the stage until the job completes
+    void submit(Tracker& tracker, char* buffer, const Segment* segments, size_t count);
+
+    Stats getStats() const;
+
+private:
+    struct Job;
+
+    struct Pending {
+        Job* job = nullptr;
+        Segment segment;
+        size_t written = 0;
+    };
+
+    struct Job {
+        Tracker* tracker = nullptr;
+        char* buffer = nullptr;
+        Pending writes[2];
+        size_t count = 0;
+        size_t remaining = 0;
+        std::chrono::steady_clock::time_point submitted;
+        std::string error;
+        bool directFailed = false;
+        Job* next = nullptr;
+    };
+
+    Job* takeJob();
+    void complete(Job* job);
+    // Thread backend: write one segment to the end, through its fallback if need be
+    bool writeSegment(Job* job, Pending& pending);
+
+    void workerLoop();
+
+#ifdef __linux__
+    struct Ring;
+    bool startRing();
+    void stopRing();
+    // Queue one write, or the stop marker for a null pending. A resubmission reuses the
+    // completion slot of the write it continues, so the reaper never waits for room.
+    void ringSubmit(Pending* pending, bool resubmit);
+    void ringCompleted(Pending& pending, int result);
+    void reaperLoop();
+    std::unique_ptr<Ring> m_ring;
+    std::thread m_reaper;
+#endif
+
+    // Buffers in use or idle, by their aligned start
+    std::map<char*, std::unique_ptr<char[]>> m_allocations;
+    std::vector<char*> m_idle;
+    Job* m_freeJobs = nullptr;
+    std::vector<std::unique_ptr<Job>> m_jobs;
+
+    // Thread backend: jobs waiting for a worker, oldest first
+    Job* m_queueHead = nullptr;
+    Job* m_queueTail = nullptr;
+    std::vector<std::thread> m_workers;
+    std::condition_variable m_queued;
+    bool m_stopping = false;
+
+    size_t m_depth = 0;
+    size_t m_peakDepth = 0;
+    uint64_t m_writes = 0;
+    uint64_t m_bytes = 0;
+    std::chrono::steady_clock::duration m_latencyTotal{0};
+    std::chrono::steady_clock::duration m_latencyMax{0};
+    mutable std::mutex m_mutex;
+};
+
+} // namespace launcher
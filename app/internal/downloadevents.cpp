@@ -0,0 +1,249 @@
+#include "downloadevents.hpp"
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <algorithm>
+
+namespace launcher {
+
+namespace {
+
+// Add the fields of current that differ from previous (all of them without a previous);
+// returns false if nothing changed
+bool addChangedFields(rapidjson::Value& json, const DownloadInfo& current, const DownloadInfo* previous,
+                      rapidjson::Document::AllocatorType& allocator) {
+    size_t before = json.MemberCount();
+
+    if (!previous || previous->url != current.url) {
+        json.AddMember("url", rapidjson::Value(current.url.c_str(), allocator), allocator);
+    }
+    if (!previous || previous->destination != current.destination) {
+        json.AddMember("destination", rapidjson::Value(current.destination.c_str(), allocator), allocator);
+    }
+    if (!previous || previous->filename != current.filename) {
+        json.AddMember("filename", rapidjson::Value(current.filename.c_str(), allocator), allocator);
+    }
+    if (!previous || previous->totalSize != current.totalSize) {
+        json.AddMember("totalSize", static_cast<uint64_t>(current.totalSize), allocator);
+    }
+    if (!previous || previous->downloadedSize != current.downloadedSize) {
+        json.AddMember("downloadedSize", static_cast<uint64_t>(current.downloadedSize), allocator);
+    }
+    if (!previous || previous->progress != current.progress) {
+        json.AddMember("progress", current.progress, allocator);
+    }
+    if (!previous || previous->speed != current.speed) {
+        json.AddMember("speed", current.speed, allocator);
+    }
+    if (!previous || previous->averageSpeed != current.averageSpeed) {
+        json.AddMember("averageSpeed", current.averageSpeed, allocator);
+    }
+    if (!previous || previous->isCompleted != current.isCompleted) {
+        json.AddMember("isCompleted", current.isCompleted, allocator);
+    }
+    if (!previous || previous->isFailed != current.isFailed) {
+        json.AddMember("isFailed", current.isFailed, allocator);
+    }
+    if (!previous || previous->errorMessage != current.errorMessage) {
+        json.AddMember("errorMessage", rapidjson::Value(current.errorMessage.c_str(), allocator), allocator);
+    }
+    if (!previous || previous->priority != current.priority) {
+        json.AddMember("priority", rapidjson::Value(priorityName(current.priority), allocator), allocator);
+    }
+    if (!previous || previous->isPaused != current.isPaused) {
+        json.AddMember("isPaused", current.isPaused, allocator);
+    }
+    if (!previous || previous->reusedSize != current.reusedSize) {
+        json.AddMember("reusedSize", static_cast<uint64_t>(current.reusedSize), allocator);
+    }
+
+    return json.MemberCount() > before;
+}
+
+} // namespace
+
+DownloadEvents::DownloadEvents(DownloadManager& manager)
+    : m_manager(manager), m_subscriberCount(0), m_nextId(1), m_running(true) {
+    m_thread = std::thread(&DownloadEvents::publisherThread, this);
+    m_manager.setChangeCallback([this](int downloadId) { markChanged(downloadId); });
+}
+
+DownloadEvents::~DownloadEvents() {
+    m_manager.setChangeCallback(nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+int DownloadEvents::subscribe(Sink sink, std::chrono::milliseconds interval) {
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->sink = std::move(sink);
+    subscriber->interval = interval;
+    subscriber->nextPush = std::chrono::steady_clock::now();
+
+    int id = 0;
+    {
+        // Every existing download counts as changed, which turns the first push into a snapshot.
+        // Listed under the lock so the publisher cannot send that snapshot half-filled.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& info : m_manager.getAllDownloads()) {
+            subscriber->dirty.insert(info.downloadId);
+        }
+
+        id = m_nextId++;
+        subscriber->id = id;
+        m_subscribers[id] = subscriber;
+        m_subscriberCount = m_subscribers.size();
+    }
+    m_wake.notify_all();
+
+    return id;
+}
+
+void DownloadEvents::unsubscribe(int subscriptionId) {
+    std::shared_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_subscribers.find(subscriptionId);
+        if (it == m_subscribers.end()) {
+            return;
+        }
+        subscriber = it->second;
+        m_subscribers.erase(it);
+        m_subscriberCount = m_subscribers.size();
+    }
+
+    std::lock_guard<std::mutex> lock(m_pushMutex);
+    subscriber->active = false;
+    subscriber->sink = nullptr;
+}
+
+void DownloadEvents::markChanged(int downloadId) {
+    if (m_subscriberCount == 0) {
+        return;
+    }
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_subscribers) {
+            auto& dirty = entry.second->dirty;
+            wake |= dirty.empty();
+            dirty.insert(downloadId);
+        }
+    }
+
+    // Only the first change after a push needs the publisher; later ones ride along
+    if (wake) {
+        m_wake.notify_all();
+    }
+}
+
+void DownloadEvents::publisherThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        auto now = std::chrono::steady_clock::now();
+        auto wakeAt = std::chrono::steady_clock::time_point::max();
+
+        struct Push {
+            std::shared_ptr<Subscriber> subscriber;
+            std::vector<int> ids;
+            bool snapshot;
+        };
+        std::vector<Push> due;
+        for (auto& entry : m_subscribers) {
+            auto& subscriber = entry.second;
+            if (subscriber->dirty.empty() && subscriber->snapshotSent) {
+                continue;
+            }
+
+            if (subscriber->nextPush <= now) {
+                std::vector<int> ids(subscriber->dirty.begin(), subscriber->dirty.end());
+                due.push_back(Push{subscriber, std::move(ids), !subscriber->snapshotSent});
+                subscriber->dirty.clear();
+                subscriber->snapshotSent = true;
+                subscriber->nextPush = now + subscriber->interval;
+            } else {
+                wakeAt = std::min(wakeAt, subscriber->nextPush);
+            }
+        }
+
+        if (due.empty()) {
+            // Nothing changed: sleep until something does, not on a timer
+            if (wakeAt == std::chrono::steady_clock::time_point::max()) {
+                m_wake.wait(lock);
+            } else {
+                m_wake.wait_until(lock, wakeAt);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        for (auto& push : due) {
+            publish(*push.subscriber, std::move(push.ids), push.snapshot);
+        }
+        lock.lock();
+    }
+}
+
+void DownloadEvents::publish(Subscriber& subscriber, std::vector<int> ids, bool snapshot) {
+    std::sort(ids.begin(), ids.end());
+
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto& allocator = doc.GetAllocator();
+
+    rapidjson::Value downloads(rapidjson::kArrayType);
+    rapidjson::Value removed(rapidjson::kArrayType);
+
+    for (int id : ids) {
+        DownloadInfo info = m_manager.getDownloadInfo(id);
+        auto previous = subscriber.sent.find(id);
+
+        if (info.downloadId == 0) {
+            if (previous != subscriber.sent.end()) {
+                removed.PushBack(id, allocator);
+                subscriber.sent.erase(previous);
+            }
+            continue;
+        }
+
+        // Install job files are reported through the job, as in getAllDownloads
+        if (info.jobId != 0) {
+            continue;
+        }
+
+        rapidjson::Value downloadJson(rapidjson::kObjectType);
+        downloadJson.AddMember("downloadId", id, allocator);
+        if (addChangedFields(downloadJson, info, previous != subscriber.sent.end() ? &previous->second : nullptr,
+                             allocator)) {
+            downloads.PushBack(downloadJson, allocator);
+            subscriber.sent[id] = std::move(info);
+        }
+    }
+
+    if (downloads.Empty() && removed.Empty() && !snapshot) {
+        return;
+    }
+
+    doc.AddMember("downloads", downloads, allocator);
+    doc.AddMember("removed", removed, allocator);
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+
+    std::lock_guard<std::mutex> lock(m_pushMutex);
+    if (subscriber.active) {
+        subscriber.sink(buffer.GetString());
+    }
+}
+
+} // namespace launcher
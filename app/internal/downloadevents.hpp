@@ -0,0 +1,70 @@
+#pragma once
+
+#include "downloadmanager.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace launcher {
+
+// Pushes download changes to subscribers so the UI does not have to poll getAllDownloads.
+// Changes are coalesced per subscriber and sent at most once per interval, each push holding
+// only the downloads that changed and, for those, only the fields that differ from the last push.
+class DownloadEvents {
+public:
+    using Sink = std::function<void(const std::string& json)>;
+
+    explicit DownloadEvents(DownloadManager& manager);
+    ~DownloadEvents();
+
+    DownloadEvents(const DownloadEvents&) = delete;
+    DownloadEvents& operator=(const DownloadEvents&) = delete;
+
+    // The first push is a full snapshot of all standalone downloads. Returns the subscription ID.
+    int subscribe(Sink sink, std::chrono::milliseconds interval);
+
+    // No push reaches the sink once this returns
+    void unsubscribe(int subscriptionId);
+
+private:
+    struct Subscriber {
+        int id = 0;
+        Sink sink;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point nextPush;
+        std::unordered_set<int> dirty;
+        // What the subscriber was last sent; only touched by the publisher thread
+        std::map<int, DownloadInfo> sent;
+        // The first push goes out even if there are no downloads, so the UI knows it has them all
+        bool snapshotSent = false;
+        bool active = true;
+    };
+
+    void markChanged(int downloadId);
+    void publisherThread();
+    void publish(Subscriber& subscriber, std::vector<int> ids, bool snapshot);
+
+    DownloadManager& m_manager;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::map<int, std::shared_ptr<Subscriber>> m_subscribers;
+    // Lets progress updates skip the lock while nobody listens
+    std::atomic<size_t> m_subscriberCount;
+    int m_nextId;
+    bool m_running;
+
+    // Held while a sink runs, so unsubscribe can wait for an in-flight push
+    std::mutex m_pushMutex;
+    std::thread m_thread;
+};
+
+} // namespace launcher
@@ -0,0 +1,293 @@
+#include "downloadjournal.hpp"
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <map>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace launcher {
+
+namespace {
+
+uint32_t fnv1a(const std::string& data) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::string checksumHex(const std::string& payload) {
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%08x", fnv1a(payload));
+    return hex;
+}
+
+std::string stringField(const rapidjson::Value& value, const char* name) {
+    return value.HasMember(name) && value[name].IsString() ? value[name].GetString() : "";
+}
+
+uint64_t numberField(const rapidjson::Value& value, const char* name) {
+    return value.HasMember(name) && value[name].IsUint64() ? value[name].GetUint64() : 0;
+}
+
+std::string toString(const rapidjson::Document& doc) {
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+    return buffer.GetString();
+}
+
+} // namespace
+
+DownloadJournal::DownloadJournal() {
+}
+
+DownloadJournal::~DownloadJournal() {
+    if (m_file) {
+        sync();
+        std::fclose(m_file);
+    }
+}
+
+std::vector<DownloadJournal::Entry> DownloadJournal::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::map<int, Entry> entries;
+    std::vector<int> order;
+
+    std::ifstream input(path, std::ios::binary);
+    std::string line;
+    while (std::getline(input, line)) {
+        // "<8 hex> <json>"; anything malformed is the torn tail of an interrupted append
+        if (line.size() < 10 || line[8] != ' ') {
+            break;
+        }
+        std::string payload = line.substr(9);
+        if (line.compare(0, 8, checksumHex(payload)) != 0) {
+            break;
+        }
+
+        rapidjson::Document doc;
+        doc.Parse(payload.c_str());
+        if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("id") || !doc["id"].IsInt()) {
+            break;
+        }
+
+        std::string op = stringField(doc, "op");
+        int id = doc["id"].GetInt();
+
+        if (op == "task") {
+            Entry entry;
+            entry.downloadId = id;
+            entry.url = stringField(doc, "url");
+            entry.destination = stringField(doc, "destination");
+            entry.filename = stringField(doc, "filename");
+            entry.expectedMd5 = stringField(doc, "md5");
+            entry.expectedSize = numberField(doc, "size");
+            entry.segments = static_cast<int>(numberField(doc, "segments"));
+            entry.unbufferedIo = doc.HasMember("unbufferedIo") && doc["unbufferedIo"].IsBool() &&
+                                 doc["unbufferedIo"].GetBool();
+            entry.acceptEncoding = doc.HasMember("acceptEncoding") && doc["acceptEncoding"].IsBool() &&
+                                   doc["acceptEncoding"].GetBool();
+            entry.decompress = doc.HasMember("decompress") && doc["decompress"].IsBool() &&
+                               doc["decompress"].GetBool();
+            entry.jobId = static_cast<int>(numberField(doc, "jobId"));
+            entry.priority = static_cast<int>(numberField(doc, "priority"));
+            if (doc.HasMember("mirrors") && doc["mirrors"].IsArray()) {
+                for (const auto& mirror : doc["mirrors"].GetArray()) {
+                    if (mirror.IsString()) {
+                        entry.mirrors.push_back(mirror.GetString());
+                    }
+                }
+            }
+            if (entries.find(id) == entries.end()) {
+                order.push_back(id);
+            }
+            entries[id] = entry;
+        } else if (op == "range") {
+            auto it = entries.find(id);
+            if (it == entries.end()) {
+                continue;
+            }
+
+            Range range;
+            range.begin = numberField(doc, "begin");
+            range.end = numberField(doc, "end");
+            range.done = numberField(doc, "done");
+            range.hashState = stringField(doc, "hash");
+
+            // Later checkpoints of the same range replace earlier ones
+            auto& ranges = it->second.ranges;
+            auto existing = std::find_if(ranges.begin(), ranges.end(),
+                                         [&range](const Range& r) { return r.begin == range.begin; });
+            if (existing != ranges.end()) {
+                *existing = range;
+            } else {
+                ranges.push_back(range);
+            }
+        } else if (op == "finished") {
+            entries.erase(id);
+        }
+    }
+    input.close();
+
+    std::vector<Entry> live;
+    for (int id : order) {
+        auto it = entries.find(id);
+        if (it != entries.end()) {
+            std::sort(it->second.ranges.begin(), it->second.ranges.end(),
+                      [](const Range& a, const Range& b) { return a.begin < b.begin; });
+            live.push_back(it->second);
+        }
+    }
+
+    // Compact into a fresh file and swap it in, so a crash here leaves the old journal intact
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    std::string compactPath = path + ".tmp";
+    m_file = std::fopen(compactPath.c_str(), "wb");
+    if (!m_file) {
+        return live;
+    }
+
+    m_live.clear();
+    for (const auto& entry : live) {
+        appendLine(taskPayload(entry));
+        for (const auto& range : entry.ranges) {
+            appendLine(rangePayload(entry.downloadId, range));
+        }
+        m_live.insert(entry.downloadId);
+    }
+    sync();
+    std::fclose(m_file);
+    m_file = nullptr;
+
+    std::filesystem::rename(compactPath, path, ec);
+    if (ec) {
+        return live;
+    }
+
+    m_path = path;
+    m_file = std::fopen(path.c_str(), "ab");
+    return live;
+}
+
+bool DownloadJournal::isOpen() const {
+    return m_file != nullptr;
+}
+
+void DownloadJournal::recordTask(const Entry& entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) {
+        return;
+    }
+
+    m_live.insert(entry.downloadId);
+    appendLine(taskPayload(entry));
+    std::fflush(m_file);
+}
+
+void DownloadJournal::recordRange(int downloadId, const Range& range) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file || m_live.find(downloadId) == m_live.end()) {
+        return;
+    }
+
+    appendLine(rangePayload(downloadId, range));
+    sync();
+}
+
+void DownloadJournal::recordFinished(int downloadId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file || m_live.erase(downloadId) == 0) {
+        return;
+    }
+
+    if (!m_live.empty()) {
+        rapidjson::Document doc;
+        doc.SetObject();
+        auto& allocator = doc.GetAllocator();
+        doc.AddMember("op", "finished", allocator);
+        doc.AddMember("id", downloadId, allocator);
+        appendLine(toString(doc));
+        std::fflush(m_file);
+        return;
+    }
+
+    // Nothing left to resume; start the next session from an empty file
+    std::FILE* emptied = std::freopen(m_path.c_str(), "wb", m_file);
+    m_file = emptied;
+}
+
+bool DownloadJournal::appendLine(const std::string& payload) {
+    std::string line = checksumHex(payload) + " " + payload + "\n";
+    return std::fwrite(line.data(), 1, line.size(), m_file) == line.size();
+}
+
+bool DownloadJournal::sync() {
+    if (std::fflush(m_file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(m_file)) == 0;
+#else
+    return fsync(fileno(m_file)) == 0;
+#endif
+}
+
+std::string DownloadJournal::taskPayload(const Entry& entry) {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto& allocator = doc.GetAllocator();
+
+    doc.AddMember("op", "task", allocator);
+    doc.AddMember("id", entry.downloadId, allocator);
+    doc.AddMember("url", rapidjson::Value(entry.url.c_str(), allocator), allocator);
+    doc.AddMember("destination", rapidjson::Value(entry.destination.c_str(), allocator), allocator);
+    doc.AddMember("filename", rapidjson::Value(entry.filename.c_str(), allocator), allocator);
+    doc.AddMember("md5", rapidjson::Value(entry.expectedMd5.c_str(), allocator), allocator);
+    doc.AddMember("size", entry.expectedSize, allocator);
+    doc.AddMember("segments", entry.segments, allocator);
+    doc.AddMember("unbufferedIo", entry.unbufferedIo, allocator);
+    doc.AddMember("acceptEncoding", entry.acceptEncoding, allocator);
+    doc.AddMember("decompress", entry.decompress, allocator);
+    doc.AddMember("jobId", entry.jobId, allocator);
+    doc.AddMember("priority", entry.priority, allocator);
+    if (!entry.mirrors.empty()) {
+        rapidjson::Value mirrors(rapidjson::kArrayType);
+        for (const auto& mirror : entry.mirrors) {
+            mirrors.PushBack(rapidjson::Value(mirror.c_str(), allocator), allocator);
+        }
+        doc.AddMember("mirrors", mirrors, allocator);
+    }
+
+    return toString(doc);
+}
+
+std::string DownloadJournal::rangePayload(int downloadId, const Range& range) {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto& allocator = doc.GetAllocator();
+
+    doc.AddMember("op", "range", allocator);
+    doc.AddMember("id", downloadId, allocator);
+    doc.AddMember("begin", static_cast<uint64_t>(range.begin), allocator);
+    doc.AddMember("end", static_cast<uint64_t>(range.end), allocator);
+    doc.AddMember("done", static_cast<uint64_t>(range.done), allocator);
+    doc.AddMember("hash", rapidjson::Value(range.hashState.c_str(), allocator), allocator);
+
+    return toString(doc);
+}
+
+} // namespace launcher
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <cstdint>
+#include <cstdio>
+
+namespace launcher {
+
+// Append-only record of queued and running downloads, so a restarted launcher can resume
+// each one from the last byte known to be on disk. Every line is "<fnv1a> <json>"; a line
+// whose checksum does not match ends the replay, which drops a torn write after a crash.
+class DownloadJournal {
+public:
+    // Bytes [begin, done) of the block [begin, end) are flushed and synced to disk.
+    // A single-stream download has one range starting at 0; segmented ones have one per segment.
+    struct Range {
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        uint64_t done = 0;
+        // Md5::saveState() at done, for the range that starts at 0
+        std::string hashState;
+    };
+
+    struct Entry {
+        int downloadId = 0;
+        std::string url;
+        std::string destination;
+        std::string filename;
+        std::string expectedMd5;
+        uint64_t expectedSize = 0;
+        int segments = 4;
+        bool unbufferedIo = false;
+        bool acceptEncoding = false;
+        bool decompress = false;
+        int jobId = 0;
+        // DownloadPriority as an int; 0 (foreground) for journals written before it existed
+        int priority = 0;
+        std::vector<std::string> mirrors;
+        std::vector<Range> ranges;
+    };
+
+    DownloadJournal();
+    ~DownloadJournal();
+
+    DownloadJournal(const DownloadJournal&) = delete;
+    DownloadJournal& operator=(const DownloadJournal&) = delete;
+
+    // Replay the journal at path and return the downloads that never finished. The file
+    // is rewritten with only those entries before new records are appended.
+    std::vector<Entry> open(const std::string& path);
+
+    bool isOpen() const;
+
+    // Record a newly queued download; buffered until the next checkpoint
+    void recordTask(const Entry& entry);
+
+    // Checkpoint progress of one range. Call only after the data itself was synced;
+    // the journal is synced before this returns.
+    void recordRange(int downloadId, const Range& range);
+
+    // The download completed, failed or was cancelled and must not be resumed
+    void recordFinished(int downloadId);
+
+private:
+    bool appendLine(const std::string& payload);
+    bool sync();
+
+    static std::string taskPayload(const Entry& entry);
+    static std::string rangePayload(int downloadId, const Range& range);
+
+    std::string m_path;
+    std::FILE* m_file = nullptr;
+    // Downloads recorded but not finished; the file is emptied once none remain
+    std::set<int> m_live;
+    std::mutex m_mutex;
+};
+
+} // namespace launcher
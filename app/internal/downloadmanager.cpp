@@ -1,77 +1,715 @@
 #include "downloadmanager.hpp"
+#include "md5.hpp"
+#include "filewriter.hpp"
+#include "streamdecoder.hpp"
+#include "splicetransfer.hpp"
 #include <httplib.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
 
 namespace launcher {
 
-DownloadManager::DownloadManager() 
-    : m_running(true), m_nextDownloadId(1) {
-    m_workerThread = std::thread(&DownloadManager::workerThread, this);
+namespace {
+
+// Feed bytes [begin, end) of a file that is already on disk into the hasher
+// Reads through a buffer of the write stage's pool instead of allocating one per call
+bool hashFileRange(DiskWriter& pool, const std::string& path, size_t begin, size_t end, Md5& hasher) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.seekg(static_cast<std::streamoff>(begin));
+    char* buffer = pool.acquire();
+    size_t remaining = end - begin;
+    bool ok = true;
+    while (ok && remaining > 0) {
+        size_t chunk = std::min(remaining, DiskWriter::kBufferSize);
+        ok = static_cast<bool>(file.read(buffer, static_cast<std::streamsize>(chunk)));
+        if (ok) {
+            hasher.update(buffer, chunk);
+            remaining -= chunk;
+        }
+    }
+    pool.release(buffer);
+
+    return ok;
+}
+
+// Install jobs and restored entries may spell the same target path differently
+std::string resumeKey(const std::filesystem::path& path) {
+    return path.lexically_normal().make_preferred().string();
+}
+
+// Append range to ranges, its pending part cut into pieces of at most pieceSize so several
+// connections can share a long run of missing delta blocks
+void splitRange(const DownloadJournal::Range& range, uint64_t pieceSize,
+                std::vector<DownloadJournal::Range>& ranges) {
+    if (range.done > range.begin || pieceSize == 0) {
+        ranges.push_back(range);
+        return;
+    }
+
+    for (uint64_t begin = range.begin; begin < range.end; begin += pieceSize) {
+        DownloadJournal::Range piece;
+        piece.begin = begin;
+        piece.end = std::min(begin + pieceSize, range.end);
+        piece.done = begin;
+        ranges.push_back(piece);
+    }
+}
+
+// Written data is synced and journaled after this many bytes or this much time, whichever comes first
+const size_t kCheckpointBytes = 32 * 1024 * 1024;
+const std::chrono::seconds kCheckpointInterval(5);
+
+// Progress callbacks fire at most this often, or whenever a download crosses 1 / kProgressSteps
+const std::chrono::milliseconds kProgressInterval(100);
+const uint64_t kProgressSteps = 100;
+
+// Time constant of the smoothed speed and the shortest interval a speed is measured over
+const double kSpeedSmoothingSeconds = 3.0;
+const double kMinSpeedSampleSeconds = 0.05;
+
+// Connection window a host starts with, and the most it can grow to
+const size_t kInitialConnectionsPerHost = 4;
+const size_t kMaxConnectionsPerHost = 32;
+
+// Large files are split into this many ranges per allowed connection, so connections can be
+// added or dropped between ranges
+const size_t kRangesPerSegment = 4;
+// How often extra segment connections check whether the host's window shrank
+const size_t kYieldCheckBytes = 1024 * 1024;
+const std::chrono::milliseconds kConnectionPollInterval(250);
+// First wait after a 429/503 on the last connection of a download; doubles per attempt
+const std::chrono::seconds kThrottleBackoff(1);
+
+// Mirrors are ranked by how long this much of the file takes to arrive
+const size_t kProbeBytes = 256 * 1024;
+// A transfer slower than this over a whole window has stalled and moves to another mirror
+const std::chrono::seconds kStallWindow(10);
+const double kStallBytesPerSecond = 16 * 1024;
+
+// Disk the content store may use until the user sets a budget
+const uint64_t kDefaultStoreBudget = 20ull * 1024 * 1024 * 1024;
+
+// Notices a transfer that still trickles, but too slowly to be worth waiting for. Time spent
+// in the rate limiters does not count, so a low cap is not mistaken for a stalled mirror.
+class StallDetector {
+public:
+    bool stalled(size_t length, std::chrono::steady_clock::duration waited) {
+        m_bytes += length;
+        m_waited += waited;
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = now - m_windowStart - m_waited;
+        if (elapsed < kStallWindow) {
+            return false;
+        }
+
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        bool slow = static_cast<double>(m_bytes) < kStallBytesPerSecond * seconds;
+        m_windowStart = now;
+        m_waited = std::chrono::steady_clock::duration::zero();
+        m_bytes = 0;
+        return slow;
+    }
+
+private:
+    size_t m_bytes = 0;
+    std::chrono::steady_clock::duration m_waited{0};
+    std::chrono::steady_clock::time_point m_windowStart = std::chrono::steady_clock::now();
+};
+
+// Goodput of a connection, handed to the engine metrics and to the mirror's connection window
+// in batches. Only downloads with mirrors credit the window; the progress thread credits the
+// others to their host.
+class GoodputBatch {
+public:
+    GoodputBatch(ConcurrencyController& controller, EngineMetrics& metrics, const std::string& host, bool enabled)
+        : m_controller(controller), m_metrics(metrics), m_host(host), m_enabled(enabled) {
+    }
+
+    ~GoodputBatch() {
+        flush();
+    }
+
+    void add(size_t length) {
+        m_bytes += length;
+        if (m_bytes >= kYieldCheckBytes) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (m_bytes == 0) {
+            return;
+        }
+        if (m_enabled) {
+            m_controller.recordBytes(m_host, m_bytes);
+        }
+        m_metrics.addBytes(m_bytes);
+        m_bytes = 0;
+    }
+
+private:
+    ConcurrencyController& m_controller;
+    EngineMetrics& m_metrics;
+    const std::string& m_host;
+    bool m_enabled;
+    uint64_t m_bytes = 0;
+};
+
+class CheckpointTimer {
+public:
+    bool due(size_t length) {
+        m_bytes += length;
+        auto now = std::chrono::steady_clock::now();
+        if (m_bytes < kCheckpointBytes && now - m_last < kCheckpointInterval) {
+            return false;
+        }
+
+        m_bytes = 0;
+        m_last = now;
+        return true;
+    }
+
+private:
+    size_t m_bytes = 0;
+    std::chrono::steady_clock::time_point m_last = std::chrono::steady_clock::now();
+};
+
+} // namespace
+
+const char* priorityName(DownloadPriority priority) {
+    switch (priority) {
+        case DownloadPriority::Background: return "background";
+        case DownloadPriority::Predownload: return "predownload";
+        default: return "foreground";
+    }
+}
+
+bool parsePriority(const std::string& name, DownloadPriority& priority) {
+    if (name == "foreground") {
+        priority = DownloadPriority::Foreground;
+    } else if (name == "background") {
+        priority = DownloadPriority::Background;
+    } else if (name == "predownload") {
+        priority = DownloadPriority::Predownload;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+DownloadManager::DownloadManager(size_t maxConcurrent, size_t maxPerHost, const std::string& journalPath) 
+    : m_running(true), m_nextDownloadId(1), m_activeCount(0),
+      m_maxConcurrent(0), m_maxPerHost(0),
+      m_finishedProgress(0.0), m_historyLimit(100),
+      m_concurrency(kInitialConnectionsPerHost, kMaxConnectionsPerHost), m_userRateLimit(0),
+      m_gamePolicy(GamePolicy::None), m_gameThrottleRate(0), m_gameRunning(false),
+      m_progressDue(false) {
+    if (!journalPath.empty()) {
+        m_store.open((std::filesystem::path(journalPath).parent_path() / "store").string(), kDefaultStoreBudget);
+        restoreJournal(journalPath);
+    }
+    m_progressThread = std::thread(&DownloadManager::progressThread, this);
+    setConcurrencyLimits(maxConcurrent, maxPerHost);
 }
 
 DownloadManager::~DownloadManager() {
-    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_running = false;
+    }
     m_queueCondition.notify_all();
     
-    if (m_workerThread.joinable()) {
-        m_workerThread.join();
+    // Interrupt running transfers; they checkpoint and stay in the journal for the next session
+    {
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        for (auto& token : m_cancelTokens) {
+            *token.second = true;
+        }
+    }
+    
+    for (auto& worker : m_workerThreads) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_progressMutex);
+        m_progressDue = true;
+    }
+    m_progressCondition.notify_all();
+    if (m_progressThread.joinable()) {
+        m_progressThread.join();
     }
 }
 
+std::string DownloadManager::defaultJournalPath() {
+    std::filesystem::path basePath;
+#ifdef _WIN32
+    char* appDataPath = nullptr;
+    size_t len;
+    _dupenv_s(&appDataPath, &len, "APPDATA");
+    basePath = appDataPath ? appDataPath : ".";
+    free(appDataPath);
+#else
+    const char* home = std::getenv("HOME");
+    basePath = home ? std::filesystem::path(home) / ".config" : std::filesystem::path(".");
+#endif
+    
+    return (basePath / "launcher" / "downloads.journal").string();
+}
+
 int DownloadManager::startDownload(const std::string& url, const std::string& destination, 
-                                  const std::string& filename) {
+                                  const std::string& filename,
+                                  const DownloadOptions& options) {
     int downloadId = m_nextDownloadId++;
+    std::shared_ptr<DownloadTask> created = createTask(downloadId, url, destination, filename, options);
+    DownloadTask& task = *created;
+    
+    // Pick up where an install job of an earlier session left this file
+    int previousId = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        auto hint = m_resumeHints.find(resumeKey(std::filesystem::path(destination) / task.filename));
+        if (hint != m_resumeHints.end()) {
+            if (hint->second.url == url && hint->second.expectedMd5 == options.expectedMd5) {
+                task.journaled = true;
+                task.resume = hint->second.ranges;
+            }
+            previousId = hint->second.downloadId;
+            m_resumeHints.erase(hint);
+        }
+    }
+    
+    // A delta update resumes like a segmented download whose reused blocks are already done
+    if (!task.journaled && !options.deltaRanges.empty()) {
+        task.journaled = true;
+        size_t reused = 0;
+        for (const auto& range : options.deltaRanges) {
+            reused += static_cast<size_t>(range.done - range.begin);
+            splitRange(range, options.minSegmentSize, task.resume);
+        }
+        
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        task.info->reusedSize = reused;
+    }
+    
+    m_journal.recordTask(journalEntry(task));
+    if (task.journaled) {
+        for (const auto& range : task.resume) {
+            m_journal.recordRange(downloadId, range);
+        }
+    }
+    if (previousId != 0) {
+        m_journal.recordFinished(previousId);
+    }
+    
+    // Space is claimed as the task is queued, not when it starts writing
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        reserveSpace(task);
+    }
     
+    enqueueTask(std::move(created));
+    notifyChanged(downloadId);
+    return downloadId;
+}
+
+std::shared_ptr<DownloadManager::DownloadTask> DownloadManager::createTask(int downloadId, const std::string& url,
+                                                                           const std::string& destination,
+                                                                           const std::string& filename,
+                                                                           const DownloadOptions& options) {
     auto info = std::make_shared<DownloadInfo>();
     info->url = url;
     info->destination = destination;
     info->filename = filename.empty() ? std::filesystem::path(url).filename().string() : filename;
     info->downloadId = downloadId;
+    info->jobId = options.jobId;
+    info->priority = options.priority;
+    
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    auto rateLimit = std::make_shared<TokenBucket>(options.maxBytesPerSecond);
+    auto progress = std::make_shared<TransferProgress>();
     
     {
         std::lock_guard<std::mutex> lock(m_downloadsMutex);
-        m_downloads.push_back(info);
+        m_downloads[downloadId] = info;
+        m_activeIds.insert(downloadId);
+        m_cancelTokens[downloadId] = cancelled;
+        m_rateLimits[downloadId] = rateLimit;
+        m_progress[downloadId] = progress;
     }
     
-    DownloadTask task;
+    auto created = std::make_shared<DownloadTask>();
+    DownloadTask& task = *created;
     task.id = downloadId;
     task.url = url;
     task.destination = destination;
     task.filename = info->filename;
+    task.options = options;
+    // 0 means no minimum; segmentation divides by it
+    task.options.minSegmentSize = std::max<size_t>(options.minSegmentSize, 1);
+    task.cancelled = cancelled;
+    task.rateLimit = rateLimit;
+    task.progress = progress;
+    task.control = std::make_shared<TransferControl>();
+
+    if (parseUrl(url, task.endpoint)) {
+        task.hostKey = task.endpoint.host + ":" + std::to_string(task.endpoint.port);
+        task.mirrors.push_back(Mirror{task.endpoint, task.hostKey});
+    } else {
+        task.endpoint = UrlParts();
+    }
+    // Mirrors that do not parse are left out; a bad one must not fail the download
+    for (const auto& mirrorUrl : options.mirrors) {
+        Mirror mirror;
+        if (mirrorUrl != url && parseUrl(mirrorUrl, mirror.endpoint)) {
+            mirror.hostKey = mirror.endpoint.host + ":" + std::to_string(mirror.endpoint.port);
+            task.mirrors.push_back(mirror);
+        }
+    }
+    if (task.endpoint.host.empty() && !task.mirrors.empty()) {
+        task.endpoint = task.mirrors.front().endpoint;
+        task.hostKey = task.mirrors.front().hostKey;
+    }
     task.info = info;
     
+    return created;
+}
+
+void DownloadManager::enqueueTask(std::shared_ptr<DownloadTask> task) {
     {
         std::lock_guard<std::mutex> lock(m_queueMutex);
-        m_downloadQueue.push(task);
+        size_t priority = static_cast<size_t>(task->options.priority);
+        m_downloadQueues[priority].push_back(std::move(task));
+        preemptLowerClasses();
     }
     
-    m_queueCondition.notify_one();
-    return downloadId;
+    m_queueCondition.notify_all();
+}
+
+bool DownloadManager::requeueInterrupted(const std::shared_ptr<DownloadTask>& queued) {
+    DownloadTask& task = *queued;
+    auto& control = *task.control;
+    if (!m_running || !control.interrupted) {
+        return false;
+    }
+    
+    // Resume from exactly where every range stopped, as after a restart
+    {
+        std::lock_guard<std::mutex> lock(control.mutex);
+        if (!control.ranges.empty()) {
+            task.journaled = true;
+            task.resume = control.ranges;
+        }
+    }
+    
+    // Waiting tasks are not sampled; the counters stay so the download still shows how far it got
+    {
+        std::lock_guard<std::mutex> lock(m_progressMutex);
+        if (m_transfers.erase(task.id) > 0 && m_transfers.empty()) {
+            m_metrics.pause();
+        }
+        task.progress->speed.store(0.0, std::memory_order_relaxed);
+        task.progress->averageSpeed.store(0.0, std::memory_order_relaxed);
+        task.progress->sampledAt = std::chrono::steady_clock::time_point();
+    }
+    
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    {
+        std::lock_guard<std::mutex> downloadsLock(m_downloadsMutex);
+        // Cancelled while it was stopping; finish it like any other cancelled download
+        if (task.info->isCompleted || task.info->isFailed) {
+            return false;
+        }
+        task.cancelled = std::make_shared<std::atomic<bool>>(false);
+        m_cancelTokens[task.id] = task.cancelled;
+    }
+    
+    auto running = m_runningTasks.find(task.id);
+    if (running != m_runningTasks.end()) {
+        task.options.priority = running->second.priority;
+        m_runningTasks.erase(running);
+    }
+    --m_activeCount;
+    if (--m_activePerHost[task.hostKey] == 0) {
+        m_activePerHost.erase(task.hostKey);
+    }
+    if (!task.hostKey.empty()) {
+        m_concurrency.release(task.hostKey);
+    }
+    
+    // Ahead of its class, so it continues before anything queued after it starts
+    control.interrupted = false;
+    m_downloadQueues[static_cast<size_t>(task.options.priority)].push_front(queued);
+    return true;
+}
+
+void DownloadManager::restoreJournal(const std::string& journalPath) {
+    for (const auto& entry : m_journal.open(journalPath)) {
+        m_nextDownloadId = std::max(m_nextDownloadId.load(), entry.downloadId + 1);
+        
+        if (entry.jobId != 0) {
+            // Install jobs do not survive a restart; keep their progress until the file is requested again
+            std::filesystem::path filePath = std::filesystem::path(entry.destination) / entry.filename;
+            std::error_code ec;
+            if (std::filesystem::exists(filePath, ec)) {
+                m_resumeHints[resumeKey(filePath)] = entry;
+            } else {
+                m_journal.recordFinished(entry.downloadId);
+            }
+            continue;
+        }
+        
+        DownloadOptions options;
+        options.segments = entry.segments;
+        options.expectedMd5 = entry.expectedMd5;
+        options.expectedSize = entry.expectedSize;
+        options.unbufferedIo = entry.unbufferedIo;
+        options.acceptEncoding = entry.acceptEncoding;
+        options.decompress = entry.decompress;
+        options.mirrors = entry.mirrors;
+        if (entry.priority > 0 && static_cast<size_t>(entry.priority) < kPriorityCount) {
+            options.priority = static_cast<DownloadPriority>(entry.priority);
+        }
+        
+        std::shared_ptr<DownloadTask> task = createTask(entry.downloadId, entry.url, entry.destination,
+                                                        entry.filename, options);
+        task->journaled = true;
+        task->resume = entry.ranges;
+        enqueueTask(std::move(task));
+    }
+}
+
+DownloadJournal::Entry DownloadManager::journalEntry(const DownloadTask& task) {
+    DownloadJournal::Entry entry;
+    entry.downloadId = task.id;
+    entry.url = task.url;
+    entry.destination = task.destination;
+    entry.filename = task.filename;
+    entry.expectedMd5 = task.options.expectedMd5;
+    entry.expectedSize = task.options.expectedSize;
+    entry.segments = task.options.segments;
+    entry.unbufferedIo = task.options.unbufferedIo;
+    entry.acceptEncoding = task.options.acceptEncoding;
+    entry.decompress = task.options.decompress;
+    entry.jobId = task.options.jobId;
+    entry.priority = static_cast<int>(task.options.priority);
+    entry.mirrors = task.options.mirrors;
+    return entry;
+}
+
+void DownloadManager::checkpoint(const DownloadTask& task, FileWriter& file, const DownloadJournal::Range& range) {
+    rememberRange(task, range);
+    
+    // The journal may only claim bytes that are already on stable storage
+    if (m_journal.isOpen() && file.sync()) {
+        m_journal.recordRange(task.id, range);
+    }
+}
+
+void DownloadManager::rememberRange(const DownloadTask& task, const DownloadJournal::Range& range) {
+    std::lock_guard<std::mutex> lock(task.control->mutex);
+    auto& ranges = task.control->ranges;
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), range,
+                               [](const DownloadJournal::Range& a, const DownloadJournal::Range& b) {
+                                   return a.begin < b.begin;
+                               });
+    if (it != ranges.end() && it->begin == range.begin) {
+        *it = range;
+    } else {
+        ranges.insert(it, range);
+    }
 }
 
 bool DownloadManager::cancelDownload(int downloadId) {
-    std::lock_guard<std::mutex> lock(m_downloadsMutex);
+    std::vector<std::shared_ptr<DownloadTask>> removed;
+    bool cancelled = false;
+    {
+        // Held throughout, so a paused or preempted task cannot slip back into a queue meanwhile
+        std::lock_guard<std::mutex> queueLock(m_queueMutex);
+        
+        // Drop the task outright if no worker has picked it up yet
+        for (auto& queue : m_downloadQueues) {
+            auto it = std::stable_partition(queue.begin(), queue.end(),
+                                            [downloadId](const std::shared_ptr<DownloadTask>& task) {
+                                                return task->id != downloadId;
+                                            });
+            std::move(it, queue.end(), std::back_inserter(removed));
+            queue.erase(it, queue.end());
+        }
+        
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        
+        auto it = m_downloads.find(downloadId);
+        if (it != m_downloads.end() && !it->second->isCompleted && !it->second->isFailed) {
+            auto token = m_cancelTokens.find(downloadId);
+            if (token != m_cancelTokens.end()) {
+                *token->second = true;
+                m_cancelTokens.erase(token);
+            }
+            m_rateLimits.erase(downloadId);
+            
+            it->second->isFailed = true;
+            it->second->errorMessage = "Download cancelled by user";
+            cancelled = true;
+        }
+    }
     
-    for (auto& info : m_downloads) {
-        if (info->downloadId == downloadId && !info->isCompleted) {
-            info->isFailed = true;
-            info->errorMessage = "Download cancelled by user";
-            return true;
+    if (cancelled) {
+        notifyChanged(downloadId);
+    }
+    
+    // Running tasks report from their worker; queued ones never reach one
+    if (removed.empty()) {
+        return cancelled;
+    }
+    
+    CompletionCallback completionCallback;
+    {
+        std::lock_guard<std::mutex> lock(m_callbackMutex);
+        completionCallback = m_completionCallback;
+    }
+    
+    for (const auto& task : removed) {
+        m_space.release(task->id);
+        finishProgress(*task);
+        discardPartial(*task);
+        m_journal.recordFinished(task->id);
+        
+        DownloadInfo finished;
+        {
+            std::lock_guard<std::mutex> lock(m_downloadsMutex);
+            finished = *task->info;
+        }
+        if (completionCallback) {
+            completionCallback(finished);
+        }
+        if (task->options.onFinished) {
+            task->options.onFinished(finished);
         }
     }
     
-    return false;
+    return cancelled;
+}
+
+bool DownloadManager::pauseDownload(int downloadId) {
+    {
+        std::lock_guard<std::mutex> queueLock(m_queueMutex);
+        auto control = findControl(downloadId);
+        if (!control || control->paused) {
+            return false;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(m_downloadsMutex);
+            auto it = m_downloads.find(downloadId);
+            if (it == m_downloads.end() || it->second->isCompleted || it->second->isFailed) {
+                return false;
+            }
+            it->second->isPaused = true;
+        }
+        control->paused = true;
+        
+        // A running transfer stops at the next chunk; its worker puts it back in the queue
+        auto running = m_runningTasks.find(downloadId);
+        if (running != m_runningTasks.end()) {
+            control->interrupted = true;
+            *running->second.cancelled = true;
+        }
+    }
+    
+    // Lower classes may get the slot if this was the last task of its class
+    m_queueCondition.notify_all();
+    notifyChanged(downloadId);
+    return true;
+}
+
+bool DownloadManager::resumeDownload(int downloadId) {
+    {
+        std::lock_guard<std::mutex> queueLock(m_queueMutex);
+        auto control = findControl(downloadId);
+        if (!control || !control->paused) {
+            return false;
+        }
+        
+        control->paused = false;
+        {
+            std::lock_guard<std::mutex> lock(m_downloadsMutex);
+            auto it = m_downloads.find(downloadId);
+            if (it != m_downloads.end()) {
+                it->second->isPaused = false;
+            }
+        }
+        preemptLowerClasses();
+    }
+    
+    m_queueCondition.notify_all();
+    notifyChanged(downloadId);
+    return true;
+}
+
+bool DownloadManager::setDownloadPriority(int downloadId, DownloadPriority priority) {
+    {
+        std::lock_guard<std::mutex> queueLock(m_queueMutex);
+        
+        auto running = m_runningTasks.find(downloadId);
+        if (running != m_runningTasks.end()) {
+            running->second.priority = priority;
+        } else {
+            bool queued = false;
+            for (auto& queue : m_downloadQueues) {
+                auto it = std::find_if(queue.begin(), queue.end(),
+                                       [downloadId](const std::shared_ptr<DownloadTask>& task) {
+                                           return task->id == downloadId;
+                                       });
+                if (it != queue.end()) {
+                    std::shared_ptr<DownloadTask> task = std::move(*it);
+                    queue.erase(it);
+                    task->options.priority = priority;
+                    m_downloadQueues[static_cast<size_t>(priority)].push_back(std::move(task));
+                    queued = true;
+                    break;
+                }
+            }
+            if (!queued) {
+                return false;
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(m_downloadsMutex);
+            auto it = m_downloads.find(downloadId);
+            if (it != m_downloads.end()) {
+                it->second->priority = priority;
+            }
+        }
+        
+        // Promoted tasks push lower ones aside; a demoted running task may have to step aside itself
+        preemptLowerClasses();
+    }
+    
+    m_queueCondition.notify_all();
+    notifyChanged(downloadId);
+    return true;
 }
 
 DownloadInfo DownloadManager::getDownloadInfo(int downloadId) const {
     std::lock_guard<std::mutex> lock(m_downloadsMutex);
     
-    for (const auto& info : m_downloads) {
-        if (info->downloadId == downloadId) {
-            return *info;
-        }
+    auto it = m_downloads.find(downloadId);
+    if (it != m_downloads.end()) {
+        return snapshot(*it->second);
     }
     
     return DownloadInfo{};
@@ -81,10 +719,15 @@ std::vector<DownloadInfo> DownloadManager::getAllDownloads() const {
     std::lock_guard<std::mutex> lock(m_downloadsMutex);
     
     std::vector<DownloadInfo> result;
-    for (const auto& info : m_downloads) {
-        result.push_back(*info);
+    for (const auto& entry : m_downloads) {
+        if (entry.second->jobId == 0) {
+            result.push_back(snapshot(*entry.second));
+        }
     }
     
+    // Oldest first, as they were started
+    std::sort(result.begin(), result.end(),
+              [](const DownloadInfo& a, const DownloadInfo& b) { return a.downloadId < b.downloadId; });
     return result;
 }
 
@@ -98,16 +741,27 @@ void DownloadManager::setCompletionCallback(CompletionCallback callback) {
     m_completionCallback = callback;
 }
 
+void DownloadManager::setChangeCallback(ChangeCallback callback) {
+    std::lock_guard<std::mutex> lock(m_callbackMutex);
+    m_changeCallback = callback;
+}
+
+void DownloadManager::notifyChanged(int downloadId) {
+    // Called with no lock of ours held, but callers such as InstallManager may hold their own;
+    // the callback therefore runs outside m_callbackMutex so it can never join a lock cycle
+    ChangeCallback changeCallback;
+    {
+        std::lock_guard<std::mutex> lock(m_callbackMutex);
+        changeCallback = m_changeCallback;
+    }
+    if (changeCallback) {
+        changeCallback(downloadId);
+    }
+}
+
 bool DownloadManager::isBusy() const {
     std::lock_guard<std::mutex> lock(m_downloadsMutex);
-    
-    for (const auto& info : m_downloads) {
-        if (!info->isCompleted && !info->isFailed) {
-            return true;
-        }
-    }
-    
-    return false;
+    return !m_activeIds.empty();
 }
 
 double DownloadManager::getTotalProgress() const {
@@ -117,63 +771,1110 @@ double DownloadManager::getTotalProgress() const {
         return 0.0;
     }
     
-    double totalProgress = 0.0;
-    for (const auto& info : m_downloads) {
-        totalProgress += info->progress;
+    // Unfinished downloads add their live counters; paused ones keep what they already have
+    double totalProgress = m_finishedProgress;
+    for (const auto& entry : m_progress) {
+        const auto& progress = *entry.second;
+        uint64_t total = progress.totalSize.load(std::memory_order_relaxed);
+        if (total > 0) {
+            totalProgress += static_cast<double>(progress.downloadedSize.load(std::memory_order_relaxed)) /
+                             static_cast<double>(total);
+        }
     }
     
     return totalProgress / m_downloads.size();
 }
 
-void DownloadManager::workerThread() {
-    while (m_running) {
-        std::unique_lock<std::mutex> lock(m_queueMutex);
-        m_queueCondition.wait(lock, [this] { return !m_downloadQueue.empty() || !m_running; });
+void DownloadManager::setHistoryLimit(size_t limit) {
+    std::vector<int> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        m_historyLimit = limit;
+        evicted = trimHistory();
+    }
+    
+    for (int id : evicted) {
+        notifyChanged(id);
+    }
+}
+
+size_t DownloadManager::getHistoryLimit() const {
+    std::lock_guard<std::mutex> lock(m_downloadsMutex);
+    return m_historyLimit;
+}
+
+std::vector<int> DownloadManager::trimHistory() {
+    std::vector<int> evicted;
+    while (m_finishedIds.size() > m_historyLimit) {
+        int id = m_finishedIds.front();
+        m_finishedIds.pop_front();
         
-        if (!m_running) {
-            break;
+        auto it = m_downloads.find(id);
+        if (it != m_downloads.end()) {
+            m_finishedProgress -= it->second->progress;
+            m_downloads.erase(it);
         }
+        evicted.push_back(id);
+    }
+    
+    // Keep rounding errors from piling up over a long session
+    if (m_finishedIds.empty()) {
+        m_finishedProgress = 0.0;
+    }
+    
+    return evicted;
+}
+
+void DownloadManager::setConcurrencyLimits(size_t maxConcurrent, size_t maxPerHost) {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_maxConcurrent = std::max<size_t>(maxConcurrent, 1);
+        m_maxPerHost = std::max<size_t>(maxPerHost, 1);
         
-        if (!m_downloadQueue.empty()) {
-            DownloadTask task = m_downloadQueue.front();
-            m_downloadQueue.pop();
-            lock.unlock();
-            
-            downloadFile(task);
+        // Grow the pool on demand; surplus workers stay parked when the limit shrinks
+        while (m_workerThreads.size() < m_maxConcurrent) {
+            m_workerThreads.emplace_back(&DownloadManager::workerThread, this);
         }
     }
+    
+    m_queueCondition.notify_all();
 }
 
-bool DownloadManager::downloadFile(const DownloadTask& task) {
-    try {
-        std::string url = task.url;
-        std::string protocol, host, path;
-        int port = 80;
-
-        if (url.find("https://") == 0) {
-            protocol = "https";
-            url = url.substr(8);
-            port = 443;
-        } else if (url.find("http://") == 0) {
-            protocol = "http";
-            url = url.substr(7);
-            port = 80;
-        } else {
-            task.info->isFailed = true;
-            task.info->errorMessage = "Unsupported protocol";
-            return false;
-        }
+size_t DownloadManager::getMaxConcurrent() const {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_maxConcurrent;
+}
 
-        size_t slashPos = url.find('/');
-        host = (slashPos != std::string::npos) ? url.substr(0, slashPos) : url;
-        path = (slashPos != std::string::npos) ? url.substr(slashPos) : "/";
+size_t DownloadManager::getMaxPerHost() const {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_maxPerHost;
+}
 
-        size_t colonPos = host.find(':');
-        if (colonPos != std::string::npos) {
-            port = std::stoi(host.substr(colonPos + 1));
-            host = host.substr(0, colonPos);
+bool DownloadManager::takeNextTask(std::shared_ptr<DownloadTask>& task) {
+    if (m_activeCount >= m_maxConcurrent) {
+        return false;
+    }
+    
+    // Lower classes wait until the active one has drained
+    size_t priority = activeClass();
+    if (priority == kPriorityCount) {
+        return false;
+    }
+    
+    // Oldest task of that class whose host still has a free slot
+    auto& queue = m_downloadQueues[priority];
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+        DownloadTask& queued = **it;
+        if (queued.control->paused) {
+            continue;
         }
-
+        
+        // Held until disk space frees up; a rejected task fails without a connection
+        if (!reserveSpace(queued)) {
+            continue;
+        }
+        bool rejected = !queued.admissionError.empty();
+        
+        // The task's own connection, on the best of its mirrors with room; segmented downloads
+        // ask for more as they go
+        const Mirror* admitted = nullptr;
+        std::vector<size_t> order;
+        if (!rejected && queued.mirrors.size() > 1) {
+            order = m_mirrors.rank(mirrorHosts(queued));
+        } else if (!rejected && !queued.mirrors.empty()) {
+            order.push_back(0);
+        }
+        for (size_t index : order) {
+            const auto& mirror = queued.mirrors[index];
+            auto active = m_activePerHost.find(mirror.hostKey);
+            if (active != m_activePerHost.end() && active->second >= m_maxPerHost) {
+                continue;
+            }
+            if (m_concurrency.tryAcquire(mirror.hostKey)) {
+                admitted = &mirror;
+                break;
+            }
+        }
+        
+        // Without a usable URL it fails as soon as a worker looks at it
+        if (!admitted && !queued.mirrors.empty() && !rejected) {
+            continue;
+        }
+        
+        if (admitted) {
+            queued.endpoint = admitted->endpoint;
+            queued.hostKey = admitted->hostKey;
+        } else if (rejected) {
+            queued.hostKey.clear();
+        }
+        task = std::move(*it);
+        queue.erase(it);
+        ++m_activeCount;
+        ++m_activePerHost[task->hostKey];
+        m_runningTasks[task->id] = RunningTask{task->options.priority, task->cancelled, task->control};
+        return true;
+    }
+    
+    return false;
+}
+
+bool DownloadManager::reserveSpace(DownloadTask& task) {
+    if (task.options.expectedSize == 0 || !task.admissionError.empty()) {
+        return true;
+    }
+    
+    // An install job's files must fit together; a standalone download is a group of its own
+    int group = task.options.jobId != 0 ? task.options.jobId : -task.id;
+    std::string path = (std::filesystem::path(task.destination) / task.filename).string();
+    switch (m_space.reserve(task.id, group, path, task.options.expectedSize)) {
+        case VolumeSpace::Admission::Granted:
+            return true;
+        case VolumeSpace::Admission::Held:
+            return false;
+        case VolumeSpace::Admission::Rejected:
+            task.admissionError = m_space.describe(path, task.options.expectedSize);
+            return true;
+    }
+    return true;
+}
+
+size_t DownloadManager::activeClass() const {
+    // Tasks already stopping for a pause or preemption no longer count
+    size_t active = kPriorityCount;
+    for (const auto& running : m_runningTasks) {
+        if (!running.second.control->interrupted) {
+            active = std::min(active, static_cast<size_t>(running.second.priority));
+        }
+    }
+    
+    for (size_t priority = 0; priority < active; ++priority) {
+        for (const auto& task : m_downloadQueues[priority]) {
+            if (!task->control->paused) {
+                return priority;
+            }
+        }
+    }
+    
+    return active;
+}
+
+void DownloadManager::preemptLowerClasses() {
+    size_t active = activeClass();
+    for (auto& running : m_runningTasks) {
+        auto& task = running.second;
+        if (static_cast<size_t>(task.priority) > active && !task.control->interrupted) {
+            task.control->interrupted = true;
+            *task.cancelled = true;
+        }
+    }
+}
+
+std::shared_ptr<DownloadManager::TransferControl> DownloadManager::findControl(int downloadId) const {
+    auto running = m_runningTasks.find(downloadId);
+    if (running != m_runningTasks.end()) {
+        return running->second.control;
+    }
+    
+    for (const auto& queue : m_downloadQueues) {
+        for (const auto& task : queue) {
+            if (task->id == downloadId) {
+                return task->control;
+            }
+        }
+    }
+    
+    return nullptr;
+}
+
+void DownloadManager::workerThread() {
+    while (true) {
+        std::shared_ptr<DownloadTask> running;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCondition.wait(lock, [&] { return !m_running || takeNextTask(running); });
+            
+            if (!m_running) {
+                break;
+            }
+        }
+        DownloadTask& task = *running;
+        
+        {
+            std::lock_guard<std::mutex> lock(m_progressMutex);
+            if (m_transfers.empty()) {
+                m_metrics.resume();
+            }
+            m_transfers[task.id] = running;
+        }
+        m_progressCondition.notify_all();
+        
+        {
+            std::lock_guard<std::mutex> lock(task.control->mutex);
+            task.control->ranges = task.resume;
+        }
+        
+        downloadFile(task);
+        
+        // Paused or preempted: back to the queue instead of finishing
+        if (requeueInterrupted(running)) {
+            m_queueCondition.notify_all();
+            notifyChanged(task.id);
+            continue;
+        }
+        
+        finishProgress(task);
+        notifyChanged(task.id);
+        
+        // A cancel can still rewrite the DownloadInfo, so the callbacks get a copy taken under the lock
+        DownloadInfo finished;
+        {
+            std::lock_guard<std::mutex> lock(m_downloadsMutex);
+            m_cancelTokens.erase(task.id);
+            m_rateLimits.erase(task.id);
+            finished = *task.info;
+        }
+        
+        // A cancelled transfer is gone for good; shutdown leaves isFailed unset
+        if (finished.isFailed && *task.cancelled) {
+            discardPartial(task);
+        }
+        
+        if (finished.isCompleted || finished.isFailed) {
+            CompletionCallback completionCallback;
+            {
+                std::lock_guard<std::mutex> lock(m_callbackMutex);
+                completionCallback = m_completionCallback;
+            }
+            if (completionCallback) {
+                completionCallback(finished);
+            }
+        }
+        
+        // Transfers interrupted by shutdown stay journaled so the next session resumes them
+        if (m_running || finished.isCompleted || finished.isFailed) {
+            m_journal.recordFinished(task.id);
+        }
+        
+        if (task.options.onFinished) {
+            task.options.onFinished(finished);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_space.release(task.id);
+            m_runningTasks.erase(task.id);
+            --m_activeCount;
+            if (--m_activePerHost[task.hostKey] == 0) {
+                m_activePerHost.erase(task.hostKey);
+            }
+            if (!task.hostKey.empty()) {
+                m_concurrency.release(task.hostKey);
+            }
+        }
+        
+        // A finished slot may unblock a task waiting on its host limit
+        m_queueCondition.notify_all();
+    }
+}
+
+void DownloadManager::setGlobalRateLimit(uint64_t bytesPerSecond) {
+    {
+        std::lock_guard<std::mutex> lock(m_limitMutex);
+        m_userRateLimit = bytesPerSecond;
+    }
+    applyGlobalLimit();
+}
+
+uint64_t DownloadManager::getGlobalRateLimit() const {
+    std::lock_guard<std::mutex> lock(m_limitMutex);
+    return m_userRateLimit;
+}
+
+bool DownloadManager::setDownloadRateLimit(int downloadId, uint64_t bytesPerSecond) {
+    std::lock_guard<std::mutex> lock(m_downloadsMutex);
+    auto it = m_rateLimits.find(downloadId);
+    if (it == m_rateLimits.end()) {
+        return false;
+    }
+    
+    it->second->setRate(bytesPerSecond);
+    return true;
+}
+
+void DownloadManager::setGamePolicy(GamePolicy policy, uint64_t throttleBytesPerSecond) {
+    {
+        std::lock_guard<std::mutex> lock(m_limitMutex);
+        m_gamePolicy = policy;
+        m_gameThrottleRate = throttleBytesPerSecond;
+    }
+    applyGlobalLimit();
+}
+
+DownloadManager::GamePolicy DownloadManager::getGamePolicy() const {
+    std::lock_guard<std::mutex> lock(m_limitMutex);
+    return m_gamePolicy;
+}
+
+uint64_t DownloadManager::getGameThrottleRate() const {
+    std::lock_guard<std::mutex> lock(m_limitMutex);
+    return m_gameThrottleRate;
+}
+
+void DownloadManager::setGameRunning(bool running) {
+    {
+        std::lock_guard<std::mutex> lock(m_limitMutex);
+        m_gameRunning = running;
+    }
+    applyGlobalLimit();
+}
+
+void DownloadManager::applyGlobalLimit() {
+    std::lock_guard<std::mutex> lock(m_limitMutex);
+    
+    uint64_t rate = m_userRateLimit;
+    bool paused = false;
+    if (m_gameRunning && m_gamePolicy == GamePolicy::Pause) {
+        paused = true;
+    } else if (m_gameRunning && m_gamePolicy == GamePolicy::Throttle && m_gameThrottleRate > 0) {
+        rate = rate > 0 ? std::min(rate, m_gameThrottleRate) : m_gameThrottleRate;
+    }
+    
+    m_globalLimit.setRate(rate);
+    m_globalLimit.setPaused(paused);
+}
+
+void DownloadManager::throttle(const DownloadTask& task, size_t bytes) {
+    task.rateLimit->consume(bytes, task.cancelled.get());
+    m_globalLimit.consume(bytes, task.cancelled.get());
+}
+
+bool DownloadManager::hasResumeState(const std::string& filePath) const {
+    std::lock_guard<std::mutex> lock(m_downloadsMutex);
+    return m_resumeHints.find(resumeKey(filePath)) != m_resumeHints.end();
+}
+
+bool DownloadManager::fetch(const std::string& url, std::string& body, std::string& error, size_t maxBytes) {
+    UrlParts endpoint;
+    if (!parseUrl(url, endpoint)) {
+        error = "Unsupported protocol";
+        return false;
+    }
+    std::string hostKey = endpoint.host + ":" + std::to_string(endpoint.port);
+    
+    body.clear();
+    std::unique_ptr<StreamDecoder> decoder;
+    StreamDecoder::Sink store = [&](const char* data, size_t length) {
+        if (body.size() + length > maxBytes) {
+            error = "Response too large: " + url;
+            return false;
+        }
+        body.append(data, length);
+        return true;
+    };
+    
+    httplib::Headers headers;
+    headers.emplace("Accept-Encoding", "zstd, gzip, deflate");
+    
+    auto lease = m_connections.acquire(endpoint.host, endpoint.port);
+    auto start = std::chrono::steady_clock::now();
+    auto result = lease.client().Get(endpoint.path, headers,
+        [&](const httplib::Response& res) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            lease.recordLatency(elapsed);
+            m_concurrency.recordResponse(hostKey, elapsed, res.status);
+            if (res.status != 200) {
+                error = "HTTP " + std::to_string(res.status) + ": " + url;
+                return false;
+            }
+            
+            // Undeclared compression of the file itself is caught by its magic bytes
+            auto format = StreamDecoder::Format::None;
+            std::string encoding = res.get_header_value("Content-Encoding");
+            if (!StreamDecoder::parseEncoding(encoding, format)) {
+                error = "Unsupported Content-Encoding: " + encoding;
+                return false;
+            }
+            decoder = std::make_unique<StreamDecoder>(
+                format == StreamDecoder::Format::None ? StreamDecoder::Format::Detect : format);
+            return true;
+        },
+        [&](const char* data, size_t data_length) {
+            if (!decoder->write(data, data_length, store)) {
+                if (error.empty()) {
+                    error = decoder->error();
+                }
+                return false;
+            }
+            return true;
+        });
+    
+    if (!result) {
+        if (error.empty()) {
+            m_concurrency.recordFailure(hostKey);
+            error = "Connection failed: " + url;
+        }
+        return false;
+    }
+    if (!decoder->finish(store)) {
+        if (error.empty()) {
+            error = decoder->error();
+        }
+        return false;
+    }
+    return true;
+}
+
+ConnectionPool::Stats DownloadManager::getConnectionStats() const {
+    return m_connections.getStats();
+}
+
+std::vector<ConcurrencyController::HostStats> DownloadManager::getHostStats() const {
+    return m_concurrency.getStats();
+}
+
+std::vector<MirrorSelector::MirrorStats> DownloadManager::getMirrorStats() const {
+    return m_mirrors.getStats();
+}
+
+void DownloadManager::setContentStoreBudget(uint64_t bytes) {
+    m_store.setBudget(bytes);
+}
+
+uint64_t DownloadManager::getContentStoreBudget() const {
+    return m_store.getBudget();
+}
+
+bool DownloadManager::hasStoredContent(const std::string& md5) const {
+    return m_store.contains(md5);
+}
+
+ContentStore::Stats DownloadManager::getContentStoreStats() const {
+    return m_store.getStats();
+}
+
+std::vector<VolumeSpace::VolumeStats> DownloadManager::getVolumeStats() const {
+    return m_space.getStats();
+}
+
+DiskWriter::Stats DownloadManager::getDiskWriterStats() const {
+    return m_disk.getStats();
+}
+
+EngineMetrics::Stats DownloadManager::getEngineStats() const {
+    return m_metrics.getStats();
+}
+
+void DownloadManager::resetEngineStats() {
+    m_metrics.reset();
+}
+
+std::vector<std::string> DownloadManager::mirrorHosts(const DownloadTask& task) {
+    std::vector<std::string> hosts;
+    for (const auto& mirror : task.mirrors) {
+        hosts.push_back(mirror.hostKey);
+    }
+    return hosts;
+}
+
+bool DownloadManager::parseUrl(const std::string& url, UrlParts& parts) {
+    // Sliced straight out of url; parts keeps its buffers when it is reused
+    size_t hostStart;
+    if (url.compare(0, 8, "https://") == 0) {
+        hostStart = 8;
+        parts.port = 443;
+        parts.secure = true;
+    } else if (url.compare(0, 7, "http://") == 0) {
+        hostStart = 7;
+        parts.port = 80;
+        parts.secure = false;
+    } else {
+        return false;
+    }
+
+    size_t slashPos = url.find('/', hostStart);
+    size_t hostEnd = slashPos != std::string::npos ? slashPos : url.size();
+    if (slashPos != std::string::npos) {
+        parts.path.assign(url, slashPos, std::string::npos);
+    } else {
+        parts.path.assign(1, '/');
+    }
+
+    size_t colonPos = url.find(':', hostStart);
+    if (colonPos != std::string::npos && colonPos < hostEnd) {
+        // Parsed when the task is queued, where a malformed port must not throw
+        size_t digits = hostEnd - colonPos - 1;
+        if (digits == 0 || digits > 5 ||
+            url.find_first_not_of("0123456789", colonPos + 1) < hostEnd) {
+            return false;
+        }
+        parts.port = std::atoi(url.c_str() + colonPos + 1);
+        hostEnd = colonPos;
+    }
+    parts.host.assign(url, hostStart, hostEnd - hostStart);
+
+    return !parts.host.empty();
+}
+
+void DownloadManager::probeMirrors(const DownloadTask& task) {
+    std::vector<std::thread> probes;
+    for (const auto& mirror : task.mirrors) {
+        if (!m_mirrors.claimProbe(mirror.hostKey)) {
+            continue;
+        }
+
+        probes.emplace_back([this, &task, &mirror]() {
+            auto lease = m_connections.acquire(mirror.endpoint.host, mirror.endpoint.port);
+            httplib::Headers headers;
+            headers.emplace("Range", "bytes=0-" + std::to_string(kProbeBytes - 1));
+
+            size_t received = 0;
+            bool answered = false;
+            auto start = std::chrono::steady_clock::now();
+            auto result = lease.client().Get(mirror.endpoint.path, headers,
+                [&](const httplib::Response& res) {
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    lease.recordLatency(elapsed);
+                    m_concurrency.recordResponse(mirror.hostKey, elapsed, res.status);
+                    answered = res.status == 200 || res.status == 206;
+                    return answered;
+                },
+                [&](const char*, size_t data_length) {
+                    // A server that ignores the range sends the whole file; the first bytes are enough
+                    received += data_length;
+                    return received < kProbeBytes && !*task.cancelled;
+                });
+
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            // A cancelled probe only hands its claim back; too little data is not counted as a sample
+            if (*task.cancelled || (answered && (result || received >= kProbeBytes))) {
+                m_mirrors.recordThroughput(mirror.hostKey, received, elapsed);
+            } else {
+                if (!answered && !result) {
+                    m_concurrency.recordFailure(mirror.hostKey);
+                }
+                m_mirrors.recordFailure(mirror.hostKey);
+            }
+        });
+    }
+
+    for (auto& probe : probes) {
+        probe.join();
+    }
+}
+
+bool DownloadManager::probeRangeSupport(const UrlParts& url, const std::string& hostKey, size_t& contentLength) {
+    auto lease = m_connections.acquire(url.host, url.port);
+
+    auto start = std::chrono::steady_clock::now();
+    auto result = lease.client().Head(url.path, httplib::Headers());
+    if (result) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        lease.recordLatency(elapsed);
+        m_concurrency.recordResponse(hostKey, elapsed, result->status);
+    } else {
+        m_concurrency.recordFailure(hostKey);
+    }
+    if (!result || result->status != 200) {
+        return false;
+    }
+
+    if (result->get_header_value("Accept-Ranges") != "bytes" || !result->has_header("Content-Length")) {
+        return false;
+    }
+
+    contentLength = std::stoull(result->get_header_value("Content-Length"));
+    return contentLength > 0;
+}
+
+DownloadManager::SegmentResult DownloadManager::downloadSegmented(const DownloadTask& task,
+                                                                  const std::string& filePath, size_t total,
+                                                                  Md5* hasher,
+                                                                  const std::vector<DownloadJournal::Range>& resume) {
+    const int maxAttempts = 3;
+
+    std::vector<DownloadJournal::Range> ranges = resume;
+    if (ranges.empty()) {
+        size_t rangeCount = static_cast<size_t>(task.options.segments) * kRangesPerSegment;
+        rangeCount = std::min(rangeCount, total / task.options.minSegmentSize);
+        size_t rangeSize = (total + rangeCount - 1) / rangeCount;
+
+        // Reserve the whole file in one extent, then size it so every range can be written at its own offset
+        {
+            FileWriter create;
+            if (!create.open(filePath, 0, true)) {
+                markFailed(task, create.error());
+                return SegmentResult::Failed;
+            }
+            create.preallocate(total);
+        }
+        std::filesystem::resize_file(filePath, total);
+
+        for (size_t begin = 0; begin < total; begin += rangeSize) {
+            DownloadJournal::Range range;
+            range.begin = begin;
+            range.end = std::min(begin + rangeSize, total);
+            range.done = begin;
+            ranges.push_back(range);
+            rememberRange(task, range);
+            m_journal.recordRange(task.id, range);
+        }
+    }
+
+    size_t resumed = 0;
+    for (const auto& range : ranges) {
+        resumed += static_cast<size_t>(range.done - range.begin);
+    }
+    setProgress(task, resumed, total);
+
+    // The leading range is hashed as it streams in, so bring the hash up to where it resumes
+    const auto& leading = ranges.front();
+    if (hasher && leading.done > 0 &&
+        (!hasher->restoreState(leading.hashState) || hasher->length() != leading.done)) {
+        hasher->reset();
+        if (!hashFileRange(m_disk, filePath, 0, static_cast<size_t>(leading.done), *hasher)) {
+            markFailed(task, "Failed to read partial file");
+            return SegmentResult::Failed;
+        }
+    }
+
+    std::atomic<bool> failed(false);
+    std::atomic<bool> rangeRejected(false);
+    std::mutex errorMutex;
+    std::string errorMessage;
+
+    // Unfinished ranges wait here, lowest first; a connection that leaves mid-range puts the rest back
+    std::mutex rangeMutex;
+    std::condition_variable connectionLeft;
+    std::deque<DownloadJournal::Range> pending;
+    for (const auto& range : ranges) {
+        if (range.done < range.end) {
+            pending.push_back(range);
+        }
+    }
+    size_t connections = 0;
+    // Connections per mirror, so new ones spread over the mirrors by throughput
+    std::vector<std::string> hosts = mirrorHosts(task);
+    std::vector<size_t> onMirror(hosts.size(), 0);
+
+    enum class RangeEnd {
+        Finished,   // done, or the download failed or was cancelled
+        Yielded,    // the connection gave its slot back through shrink()
+        Throttled,  // an extra connection got a 429/503
+        Failover    // the mirror errored or stalled and another one is usable
+    };
+
+    auto fetchRange = [&](DownloadJournal::Range& range, ConnectionPool::Lease& lease, size_t mirror, bool extra) {
+        const std::string& hostKey = hosts[mirror];
+        const std::string& path = task.mirrors[mirror].endpoint.path;
+        size_t begin = static_cast<size_t>(range.begin);
+        size_t end = static_cast<size_t>(range.end);
+        size_t position = static_cast<size_t>(range.done);
+
+        FileWriter file;
+        file.setWriteStage(&m_disk);
+        if (!file.open(filePath, position, false, task.options.unbufferedIo)) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errorMessage = file.error();
+            failed = true;
+            return RangeEnd::Finished;
+        }
+
+        CheckpointTimer checkpointTimer;
+        auto recordProgress = [&]() {
+            range.done = position;
+            if (hasher && begin == 0) {
+                range.hashState = hasher->saveState();
+            }
+            checkpoint(task, file, range);
+        };
+
+        RangeEnd outcome = RangeEnd::Finished;
+        size_t sinceYieldCheck = 0;
+        GoodputBatch goodput(m_concurrency, m_metrics, hostKey, task.mirrors.size() > 1);
+        auto fetchStart = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration waited{0};
+        size_t startPosition = position;
+
+        // Ranges that are hashed from disk afterwards go from the socket to the file without a copy
+        // through user space where the platform can splice; httplib stays the fallback
+        SpliceTransfer splice;
+        const UrlParts& endpoint = task.mirrors[mirror].endpoint;
+        bool splicing = !(hasher && begin == 0) && !endpoint.secure && splice.open(filePath);
+        size_t uncached = position;
+
+        // Retry from the last written byte so a dropped connection only costs the remainder
+        for (int attempt = 0; attempt < maxAttempts && position < end && !failed && !*task.cancelled; ++attempt) {
+            bool throttled = false;
+            bool mirrorFailed = false;
+            StallDetector stall;
+            size_t attemptStart = position;
+            int status = 0;
+
+            auto onStatus = [&](int code, std::chrono::steady_clock::duration elapsed) {
+                status = code;
+                m_metrics.recordFirstByte(elapsed);
+                m_concurrency.recordResponse(hostKey, elapsed, code);
+                if (code == 429 || code == 503) {
+                    throttled = true;
+                    return false;
+                }
+                if (code != 206) {
+                    // Only give up on ranges if no other mirror can serve them
+                    if (m_mirrors.hasAlternative(hosts, mirror)) {
+                        mirrorFailed = true;
+                    } else {
+                        rangeRejected = true;
+                    }
+                    return false;
+                }
+                return true;
+            };
+
+            // Bookkeeping for length bytes that are in the file; data is null when they were spliced
+            auto onWritten = [&](const char* data, size_t length) {
+                position += length;
+
+                // Only the leading range arrives in order, the rest is hashed from disk afterwards
+                if (data && hasher && begin == 0) {
+                    hasher->update(data, length);
+                }
+
+                if (checkpointTimer.due(length)) {
+                    recordProgress();
+                    if (splicing && task.options.unbufferedIo) {
+                        splice.dropCache(uncached, position);
+                        uncached = position;
+                    }
+                }
+
+                addProgress(task, length);
+                goodput.add(length);
+                auto throttleStart = std::chrono::steady_clock::now();
+                throttle(task, length);
+                auto throttleTime = std::chrono::steady_clock::now() - throttleStart;
+                waited += throttleTime;
+
+                // A mirror that trickles is left for another one, as if it had dropped the connection
+                if (task.mirrors.size() > 1 && stall.stalled(length, throttleTime)) {
+                    mirrorFailed = true;
+                    return false;
+                }
+
+                // Extra connections give their slot back mid-range once the host's window shrank
+                sinceYieldCheck += length;
+                if (extra && sinceYieldCheck >= kYieldCheckBytes) {
+                    sinceYieldCheck = 0;
+                    if (m_concurrency.shrink(hostKey)) {
+                        outcome = RangeEnd::Yielded;
+                    }
+                }
+                return !failed && !*task.cancelled && outcome == RangeEnd::Finished;
+            };
+
+            bool connected = false;
+            bool spliced = false;
+            if (splicing) {
+                auto result = splice.fetch(endpoint.host, endpoint.port, path, position, end, onStatus,
+                    [&](size_t length) {
+                        return length > 0 ? onWritten(nullptr, length) : !failed && !*task.cancelled;
+                    });
+                if (result == SpliceTransfer::Outcome::Unsupported) {
+                    // A redirect or an encoded body; httplib serves the range from here on
+                    splicing = false;
+                } else {
+                    spliced = true;
+                    connected = result == SpliceTransfer::Outcome::Completed;
+                    if (result == SpliceTransfer::Outcome::WriteFailed) {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        errorMessage = "Failed to write output file";
+                        failed = true;
+                    }
+                }
+            }
+
+            if (!spliced) {
+                // The writer still points where splicing took over
+                if (file.position() != position && !file.open(filePath, position, false, task.options.unbufferedIo)) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    errorMessage = file.error();
+                    failed = true;
+                    break;
+                }
+
+                httplib::Headers headers;
+                headers.emplace("Range", "bytes=" + std::to_string(position) + "-" + std::to_string(end - 1));
+
+                auto start = std::chrono::steady_clock::now();
+                auto result = lease.client().Get(path, headers,
+                    [&](const httplib::Response& res) {
+                        auto elapsed = std::chrono::steady_clock::now() - start;
+                        lease.recordLatency(elapsed);
+                        return onStatus(res.status, elapsed);
+                    },
+                    [&](const char* data, size_t data_length) {
+                        size_t length = std::min(data_length, end - position);
+                        if (!file.write(data, length)) {
+                            failed = true;
+                            return false;
+                        }
+                        return onWritten(data, length);
+                    });
+                connected = static_cast<bool>(result);
+            }
+
+            if (rangeRejected) {
+                failed = true;
+                return RangeEnd::Finished;
+            }
+
+            if (position >= end || outcome != RangeEnd::Finished) {
+                break;
+            }
+
+            if (throttled) {
+                if (extra) {
+                    outcome = RangeEnd::Throttled;
+                    break;
+                }
+
+                // The download's last connection waits the throttle out instead of failing
+                auto until = std::chrono::steady_clock::now() + kThrottleBackoff * (1 << attempt);
+                while (attempt < maxAttempts - 1 && std::chrono::steady_clock::now() < until && !*task.cancelled) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            } else if (!connected && !mirrorFailed && !*task.cancelled && !failed &&
+                       !(attempt == 0 && !spliced && lease.reused() && position == attemptStart)) {
+                // A pooled socket the server closed meanwhile says nothing about its load
+                m_concurrency.recordFailure(hostKey);
+                mirrorFailed = true;
+            }
+
+            // Carry on from this byte on another mirror
+            if (mirrorFailed) {
+                m_mirrors.recordFailure(hostKey);
+                if (m_mirrors.hasAlternative(hosts, mirror)) {
+                    outcome = RangeEnd::Failover;
+                    break;
+                }
+            }
+
+            if (attempt == maxAttempts - 1) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                errorMessage = connected
+                    ? "HTTP error: " + std::to_string(status)
+                    : throttled ? "Server is throttling downloads" : "Connection failed";
+            }
+        }
+
+        goodput.flush();
+        if (outcome != RangeEnd::Failover) {
+            m_mirrors.recordThroughput(hostKey, position - startPosition,
+                                       std::chrono::steady_clock::now() - fetchStart - waited);
+        }
+
+        // An interrupted range leaves an exact resume point behind
+        if (position < end && position > range.done) {
+            recordProgress();
+        }
+
+        bool finished = outcome != RangeEnd::Finished || position >= end;
+        if (!file.close() || !finished) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!file.error().empty()) {
+                errorMessage = file.error();
+            }
+            failed = true;
+        }
+        return outcome;
+    };
+
+    // The first connection runs on the slot the task was admitted with; extras have their own
+    // on the mirror they were started for
+    auto connection = [&](size_t mirror, bool extra) {
+        std::optional<ConnectionPool::Lease> lease;
+        lease.emplace(m_connections.acquire(task.mirrors[mirror].endpoint.host, task.mirrors[mirror].endpoint.port));
+        bool released = false;
+
+        while (!failed && !*task.cancelled) {
+            DownloadJournal::Range range;
+            {
+                std::lock_guard<std::mutex> lock(rangeMutex);
+                if (pending.empty()) {
+                    break;
+                }
+                range = pending.front();
+                pending.pop_front();
+            }
+
+            RangeEnd outcome = fetchRange(range, *lease, mirror, extra);
+            if (outcome == RangeEnd::Failover && !extra) {
+                // The task's own connection moves on and picks the range up where it stopped
+                {
+                    std::lock_guard<std::mutex> lock(rangeMutex);
+                    pending.push_front(range);
+                    --onMirror[mirror];
+                    mirror = m_mirrors.candidates(hosts, onMirror).front();
+                    ++onMirror[mirror];
+                }
+                lease.emplace(m_connections.acquire(task.mirrors[mirror].endpoint.host,
+                                                    task.mirrors[mirror].endpoint.port));
+                continue;
+            }
+            if (outcome != RangeEnd::Finished) {
+                // The monitor starts a replacement for a failed-over extra on another mirror
+                {
+                    std::lock_guard<std::mutex> lock(rangeMutex);
+                    pending.push_front(range);
+                }
+                released = outcome == RangeEnd::Yielded;
+                break;
+            }
+
+            // Between ranges, an extra connection leaves if the window shrank meanwhile
+            if (extra && m_concurrency.shrink(hosts[mirror])) {
+                released = true;
+                break;
+            }
+        }
+
+        if (extra && !released) {
+            m_concurrency.release(hosts[mirror]);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(rangeMutex);
+            --connections;
+            --onMirror[mirror];
+        }
+        connectionLeft.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    {
+        std::unique_lock<std::mutex> lock(rangeMutex);
+        size_t maxConnections = static_cast<size_t>(task.options.segments);
+        while (connections > 0 || (!pending.empty() && !failed && !*task.cancelled)) {
+            bool wanted = !pending.empty() && !failed && !*task.cancelled;
+
+            // Every connection left but ranges came back; the task's own slot picks them up
+            if (connections == 0) {
+                size_t mirror = m_mirrors.candidates(hosts, onMirror).front();
+                ++connections;
+                ++onMirror[mirror];
+                threads.emplace_back(connection, mirror, false);
+                continue;
+            }
+
+            // Add connections while ranges are waiting and a mirror's window has room,
+            // spread over the mirrors by throughput
+            bool added = false;
+            if (wanted && connections < maxConnections) {
+                for (size_t mirror : m_mirrors.candidates(hosts, onMirror)) {
+                    if (m_concurrency.tryAcquire(hosts[mirror])) {
+                        ++connections;
+                        ++onMirror[mirror];
+                        threads.emplace_back(connection, mirror, true);
+                        added = true;
+                        break;
+                    }
+                }
+            }
+            if (added) {
+                continue;
+            }
+
+            connectionLeft.wait_for(lock, kConnectionPollInterval);
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (*task.cancelled) {
+        return SegmentResult::Failed;
+    }
+
+    if (rangeRejected) {
+        return SegmentResult::RangeUnsupported;
+    }
+
+    if (failed || !pending.empty()) {
+        markFailed(task, errorMessage.empty() ? "Segmented download failed" : errorMessage);
+        return SegmentResult::Failed;
+    }
+
+    if (hasher && !hashFileRange(m_disk, filePath, static_cast<size_t>(leading.end), total, *hasher)) {
+        markFailed(task, "Failed to read back downloaded file");
+        return SegmentResult::Failed;
+    }
+
+    return SegmentResult::Completed;
+}
+
+bool DownloadManager::restoreFromStore(const DownloadTask& task, const std::string& filePath) {
+    uint64_t size = 0;
+    if (!m_store.materialize(task.options.expectedMd5, filePath, size)) {
+        return false;
+    }
+
+    // Reading the file back is still far cheaper than fetching it
+    if (Md5::hashFile(filePath) != task.options.expectedMd5) {
+        std::error_code ec;
+        std::filesystem::remove(filePath, ec);
+        m_store.remove(task.options.expectedMd5);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        task.info->reusedSize = static_cast<size_t>(size);
+    }
+    setProgress(task, static_cast<size_t>(size), static_cast<size_t>(size));
+    markCompleted(task);
+    return true;
+}
+
+bool DownloadManager::verifyDigest(const DownloadTask& task, Md5& hasher, const std::string& filePath) {
+    std::string digest = hasher.hexDigest();
+    if (digest == task.options.expectedMd5) {
+        return true;
+    }
+
+    // A corrupt file must not be picked up as a resumable prefix next time
+    std::error_code ec;
+    std::filesystem::remove(filePath, ec);
+
+    markFailed(task, "Hash mismatch: expected " + task.options.expectedMd5 + ", got " + digest);
+    return false;
+}
+
+void DownloadManager::discardPartial(const DownloadTask& task) {
+    // A delta update's file still holds the older version's data for the next attempt
+    if (!task.options.deltaRanges.empty()) {
+        return;
+    }
+    
+    // Only the name goes; a file shared with the content store keeps the store's link
+    std::error_code ec;
+    std::filesystem::remove(std::filesystem::path(task.destination) / task.filename, ec);
+}
+
+bool DownloadManager::downloadFile(const DownloadTask& task) {
+    if (*task.cancelled) {
+        return false;
+    }
+
+    try {
+        if (!task.admissionError.empty()) {
+            markFailed(task, task.admissionError);
+            return false;
+        }
+        
+        if (task.mirrors.empty()) {
+            markFailed(task, "Unsupported protocol");
+            return false;
+        }
+
         std::filesystem::path destPath(task.destination);
         if (!std::filesystem::exists(destPath)) {
             std::filesystem::create_directories(destPath);
@@ -182,88 +1883,569 @@ bool DownloadManager::downloadFile(const DownloadTask& task) {
         std::filesystem::path filePath = destPath / task.filename;
         size_t alreadyDownloaded = 0;
 
+        // Another game or branch may have downloaded the same file already
+        bool verify = !task.options.expectedMd5.empty();
+        if (verify && restoreFromStore(task, filePath.string())) {
+            return true;
+        }
+
+        // A file linked from the store is shared with it and must not be written through
+        std::error_code linkError;
+        if (std::filesystem::hard_link_count(filePath, linkError) > 1 && !linkError) {
+            std::filesystem::remove(filePath);
+        }
+
         // Resume: ถ้ามีไฟล์อยู่แล้ว ให้ต่อ
         if (std::filesystem::exists(filePath)) {
             alreadyDownloaded = std::filesystem::file_size(filePath);
         }
 
-        std::ofstream file(filePath, std::ios::binary | std::ios::app);
-        if (!file.is_open()) {
-            task.info->isFailed = true;
-            task.info->errorMessage = "Failed to create output file";
-            return false;
+        Md5 hasher;
+        std::string resumeHashState = task.options.resumeHashState;
+
+        // A journaled download trusts only what its last checkpoint synced, not the file size
+        std::vector<DownloadJournal::Range> resumeSegments;
+        size_t contentLength = 0;
+        if (task.journaled) {
+            if (task.resume.size() > 1 && alreadyDownloaded == task.resume.back().end) {
+                resumeSegments = task.resume;
+                contentLength = static_cast<size_t>(task.resume.back().end);
+            } else if (task.resume.size() == 1 && alreadyDownloaded >= task.resume.front().done) {
+                alreadyDownloaded = static_cast<size_t>(task.resume.front().done);
+                resumeHashState = task.resume.front().hashState;
+                std::filesystem::resize_file(filePath, alreadyDownloaded);
+            } else if (alreadyDownloaded > 0) {
+                alreadyDownloaded = 0;
+                std::filesystem::resize_file(filePath, 0);
+            }
         }
 
-        httplib::Client client(host, port);
-        client.set_follow_location(true);
+        // Decoded output cannot be resumed from an offset into the compressed body
+        bool decode = task.options.acceptEncoding || task.options.decompress;
+        if (decode && (alreadyDownloaded > 0 || !resumeSegments.empty())) {
+            resumeSegments.clear();
+            alreadyDownloaded = 0;
+            std::filesystem::resize_file(filePath, 0);
+        }
+
+        // Rank the mirrors before deciding where the file comes from
+        std::vector<std::string> hosts = mirrorHosts(task);
+        if (task.mirrors.size() > 1) {
+            probeMirrors(task);
+            if (*task.cancelled) {
+                return false;
+            }
+        }
+        const Mirror& best = task.mirrors[m_mirrors.rank(hosts).front()];
 
-        httplib::Headers headers;
-        if (alreadyDownloaded > 0) {
-            headers.emplace("Range", "bytes=" + std::to_string(alreadyDownloaded) + "-");
+        // Large fresh downloads are split into byte ranges fetched in parallel
+        if (!resumeSegments.empty() ||
+            (alreadyDownloaded == 0 && !decode && task.options.segments > 1 &&
+             probeRangeSupport(best.endpoint, best.hostKey, contentLength) &&
+             contentLength >= 2 * task.options.minSegmentSize)) {
+            SegmentResult segmented = downloadSegmented(task, filePath.string(), contentLength,
+                                                        verify ? &hasher : nullptr, resumeSegments);
+
+            if (segmented == SegmentResult::Failed) {
+                return false;
+            }
+
+            if (segmented == SegmentResult::Completed) {
+                if (verify && !verifyDigest(task, hasher, filePath.string())) {
+                    return false;
+                }
+                if (verify) {
+                    m_store.add(task.options.expectedMd5, filePath.string());
+                }
+
+                markCompleted(task);
+                return true;
+            }
+
+            // Server ignored the Range header; start over on a single stream. Recording the task
+            // again replaces its segment ranges, so a restart does not resume them.
+            {
+                std::lock_guard<std::mutex> lock(task.control->mutex);
+                task.control->ranges.clear();
+            }
+            m_journal.recordTask(journalEntry(task));
+            std::filesystem::resize_file(filePath, 0);
+            alreadyDownloaded = 0;
+            hasher.reset();
+        }
+
+        // Seed the hash with the bytes already on disk, from a saved state when it matches
+        if (verify && alreadyDownloaded > 0) {
+            if (!hasher.restoreState(resumeHashState) || hasher.length() != alreadyDownloaded) {
+                hasher.reset();
+                if (!hashFileRange(m_disk, filePath.string(), 0, alreadyDownloaded, hasher)) {
+                    markFailed(task, "Failed to read partial file");
+                    return false;
+                }
+            }
+        }
+
+        FileWriter file;
+        file.setWriteStage(&m_disk);
+        if (!file.open(filePath, alreadyDownloaded, false, task.options.unbufferedIo)) {
+            markFailed(task, file.error());
+            return false;
         }
 
+        // Mirrors in the order to try them; the transfer moves down the list when one fails
+        std::vector<size_t> order = m_mirrors.rank(hosts);
+        size_t current = 0;
+        std::optional<ConnectionPool::Lease> lease;
+        lease.emplace(m_connections.acquire(task.mirrors[order[current]].endpoint.host,
+                                            task.mirrors[order[current]].endpoint.port));
+
         size_t downloaded = alreadyDownloaded;
         size_t total = 0;
 
-        auto result = client.Get(path, headers,
-            [&](const httplib::Response& res) {
-                // Content-Length = ขนาดใหม่ที่เหลือ
-                if (res.has_header("Content-Length")) {
-                    total = std::stoull(res.get_header_value("Content-Length")) + alreadyDownloaded;
+        CheckpointTimer checkpointTimer;
+        size_t checkpointed = alreadyDownloaded;
+        auto recordProgress = [&]() {
+            DownloadJournal::Range range;
+            range.end = total;
+            range.done = downloaded;
+            if (verify) {
+                range.hashState = hasher.saveState();
+            }
+            checkpoint(task, file, range);
+            checkpointed = downloaded;
+        };
+
+        // Compressed bodies are decoded chunk by chunk on this thread; progress then counts
+        // the bytes received, as the decoded size is not known up front
+        std::unique_ptr<StreamDecoder> decoder;
+        size_t encodedBytes = 0;
+        std::string decodeError;
+        StreamDecoder::Sink store = [&](const char* data, size_t length) {
+            if (!file.write(data, length)) {
+                return false;
+            }
+            downloaded += length;
+
+            if (verify) {
+                hasher.update(data, length);
+            }
+            return true;
+        };
+
+        // A connection dropped mid-body, for example by a server that gave up during a long
+        // pause, picks up from the last received byte; on another mirror if there is one
+        const int maxAttempts = 2 + static_cast<int>(task.mirrors.size());
+        bool connected = false;
+        int status = 0;
+        for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+            const Mirror& mirror = task.mirrors[order[current]];
+
+            // A decoded transfer that broke off starts over from the first byte
+            if (decode && (downloaded > 0 || encodedBytes > 0)) {
+                if (!file.open(filePath, 0, true, task.options.unbufferedIo)) {
+                    break;
                 }
-                task.info->totalSize = total;
-                return true;
-            },
-            [&](const char* data, size_t data_length) {
-                file.write(data, data_length);
-                downloaded += data_length;
+                alreadyDownloaded = 0;
+                downloaded = 0;
+                encodedBytes = 0;
+                hasher.reset();
+            }
 
-                updateProgress(task.info, downloaded, total);
-                return true;
-            });
+            httplib::Headers headers;
+            if (alreadyDownloaded > 0) {
+                headers.emplace("Range", "bytes=" + std::to_string(alreadyDownloaded) + "-");
+            }
+            if (task.options.acceptEncoding) {
+                headers.emplace("Accept-Encoding", "zstd, gzip, deflate");
+            }
+
+            bool rejected = false;
+            StallDetector stall;
+            GoodputBatch goodput(m_concurrency, m_metrics, mirror.hostKey, task.mirrors.size() > 1);
+            std::chrono::steady_clock::duration waited{0};
+            auto start = std::chrono::steady_clock::now();
+            auto result = lease->client().Get(mirror.endpoint.path, headers,
+                [&](const httplib::Response& res) {
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    lease->recordLatency(elapsed);
+                    m_metrics.recordFirstByte(elapsed);
+                    m_concurrency.recordResponse(mirror.hostKey, elapsed, res.status);
+
+                    // Another mirror may still have what this one answered with an error for
+                    if (res.status >= 400 && current + 1 < order.size()) {
+                        rejected = true;
+                        return false;
+                    }
+
+                    // A full 200 response to a resume request replaces the partial file
+                    if (alreadyDownloaded > 0 && res.status == 200) {
+                        if (!file.open(filePath, 0, true, task.options.unbufferedIo)) {
+                            return false;
+                        }
+                        alreadyDownloaded = 0;
+                        downloaded = 0;
+                        hasher.reset();
+
+                        // The old checkpoint no longer describes the file
+                        recordProgress();
+                    }
+
+                    // Content-Length = ขนาดใหม่ที่เหลือ
+                    if (res.has_header("Content-Length")) {
+                        total = std::stoull(res.get_header_value("Content-Length")) + alreadyDownloaded;
+                    }
+
+                    decoder.reset();
+                    if (decode && (res.status == 200 || res.status == 206)) {
+                        auto format = StreamDecoder::Format::None;
+                        std::string encoding = res.get_header_value("Content-Encoding");
+                        if (task.options.acceptEncoding && !StreamDecoder::parseEncoding(encoding, format)) {
+                            decodeError = "Unsupported Content-Encoding: " + encoding;
+                            return false;
+                        }
+                        if (format == StreamDecoder::Format::None && task.options.decompress) {
+                            format = StreamDecoder::Format::Detect;
+                        }
+                        decoder = std::make_unique<StreamDecoder>(format);
+                        setProgress(task, encodedBytes, total);
+                        return true;
+                    }
+                    setProgress(task, downloaded, total);
+
+                    // Reserving the final size up front keeps the file in few extents
+                    if (total > 0) {
+                        file.preallocate(total);
+                    }
+                    return true;
+                },
+                [&](const char* data, size_t data_length) {
+                    if (decoder) {
+                        if (!decoder->write(data, data_length, store)) {
+                            // No decoder error means the file write failed
+                            decodeError = decoder->error();
+                            return false;
+                        }
+                        encodedBytes += data_length;
+                    } else if (!store(data, data_length)) {
+                        return false;
+                    }
+
+                    if (checkpointTimer.due(data_length)) {
+                        recordProgress();
+                    }
+
+                    setProgress(task, decoder ? encodedBytes : downloaded, total);
+                    goodput.add(data_length);
+                    auto throttleStart = std::chrono::steady_clock::now();
+                    throttle(task, data_length);
+                    auto throttleTime = std::chrono::steady_clock::now() - throttleStart;
+                    waited += throttleTime;
+
+                    // A mirror that trickles is left for the next one, as if it had dropped the connection
+                    if (current + 1 < order.size() && stall.stalled(data_length, throttleTime)) {
+                        return false;
+                    }
+
+                    // Returning false makes httplib drop the connection
+                    return !*task.cancelled;
+                });
+
+            connected = static_cast<bool>(result);
+            status = result ? result->status : 0;
+            goodput.flush();
+
+            // The body is only complete once the compressed stream ended properly
+            if (decoder && result && decodeError.empty() && !decoder->finish(store)) {
+                decodeError = decoder->error();
+            }
+            if (!decodeError.empty()) {
+                break;
+            }
+
+            // A pooled connection the server closed just as it was reused fails before any
+            // data; that is worth one more try on a fresh socket
+            bool staleConnection = attempt == 0 && lease->reused() && downloaded == alreadyDownloaded && !rejected;
+            bool received = status == 200 || status == 206;
+            if (!connected && !rejected && !*task.cancelled && file.error().empty() && !staleConnection) {
+                m_concurrency.recordFailure(mirror.hostKey);
+            }
+            if (received) {
+                m_mirrors.recordThroughput(mirror.hostKey, decoder ? encodedBytes : downloaded - alreadyDownloaded,
+                                           std::chrono::steady_clock::now() - start - waited);
+            }
+            if (received || *task.cancelled || !file.error().empty()) {
+                break;
+            }
+
+            // Carry on from the last received byte on the next mirror
+            if (!staleConnection) {
+                m_mirrors.recordFailure(mirror.hostKey);
+                if (current + 1 < order.size()) {
+                    ++current;
+                    alreadyDownloaded = downloaded;
+                    lease.emplace(m_connections.acquire(task.mirrors[order[current]].endpoint.host,
+                                                        task.mirrors[order[current]].endpoint.port));
+                    continue;
+                }
+            }
+
+            if (connected || (downloaded == alreadyDownloaded && !staleConnection)) {
+                break;
+            }
+            alreadyDownloaded = downloaded;
+        }
+
+        // An interrupted transfer leaves an exact resume point behind
+        bool received = (status == 200 || status == 206) && !*task.cancelled;
+        if (!received && downloaded > checkpointed) {
+            recordProgress();
+        }
 
-        file.close();
+        bool written = file.close();
 
-        if (!result || (result->status != 200 && result->status != 206)) {
-            task.info->isFailed = true;
-            task.info->errorMessage = result
-                ? "HTTP error: " + std::to_string(result->status)
-                : "Connection failed";
+        if (*task.cancelled) {
             return false;
         }
 
-        task.info->isCompleted = true;
-        task.info->progress = 1.0;
+        if (!written) {
+            markFailed(task, file.error());
+            return false;
+        }
 
-        std::lock_guard<std::mutex> lock(m_callbackMutex);
-        if (m_completionCallback) {
-            m_completionCallback(*task.info);
+        if (!decodeError.empty()) {
+            markFailed(task, decodeError);
+            return false;
+        }
+
+        if (status != 200 && status != 206) {
+            markFailed(task, connected
+                ? "HTTP error: " + std::to_string(status)
+                : "Connection failed");
+            return false;
         }
 
+        if (verify && !verifyDigest(task, hasher, filePath.string())) {
+            return false;
+        }
+        if (verify) {
+            m_store.add(task.options.expectedMd5, filePath.string());
+        }
+
+        markCompleted(task);
         return true;
     }
     catch (const std::exception& e) {
-        task.info->isFailed = true;
-        task.info->errorMessage = "Exception: " + std::string(e.what());
+        markFailed(task, "Exception: " + std::string(e.what()));
+        return false;
+    }
+}
 
+void DownloadManager::markFailed(const DownloadTask& task, const std::string& message) {
+    std::lock_guard<std::mutex> lock(m_downloadsMutex);
+    task.info->isFailed = true;
+    task.info->errorMessage = message;
+}
+
+void DownloadManager::markCompleted(const DownloadTask& task) {
+    std::lock_guard<std::mutex> lock(m_downloadsMutex);
+    task.info->isCompleted = true;
+}
+
+void DownloadManager::setProgress(const DownloadTask& task, size_t downloaded, size_t total) {
+    auto& progress = *task.progress;
+    progress.totalSize.store(total, std::memory_order_relaxed);
+    uint64_t before = progress.downloadedSize.exchange(downloaded, std::memory_order_relaxed);
+    progressAdvanced(task, before, downloaded);
+}
+
+void DownloadManager::addProgress(const DownloadTask& task, size_t bytes) {
+    uint64_t before = task.progress->downloadedSize.fetch_add(bytes, std::memory_order_relaxed);
+    progressAdvanced(task, before, before + bytes);
+}
+
+void DownloadManager::progressAdvanced(const DownloadTask& task, uint64_t before, uint64_t after) {
+    uint64_t step = task.progress->totalSize.load(std::memory_order_relaxed) / kProgressSteps;
+    if (step == 0 || before / step == after / step) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_progressMutex);
+        m_progressDue = true;
+    }
+    m_progressCondition.notify_all();
+}
+
+void DownloadManager::progressThread() {
+    DownloadInfo reported;
+    std::vector<std::shared_ptr<const DownloadTask>> changed;
+    std::unique_lock<std::mutex> lock(m_progressMutex);
+    while (m_running) {
+        if (m_transfers.empty()) {
+            // Nothing is downloading; sleep until a worker starts a transfer
+            m_progressCondition.wait(lock);
+            continue;
+        }
+        
+        m_progressCondition.wait_for(lock, kProgressInterval, [this] { return m_progressDue || !m_running; });
+        m_progressDue = false;
+        
+        auto now = std::chrono::steady_clock::now();
+        changed.clear();
+        for (const auto& transfer : m_transfers) {
+            const auto& task = *transfer.second;
+            auto& progress = *task.progress;
+            bool measured = progress.sampledAt != std::chrono::steady_clock::time_point();
+            uint64_t sampledBefore = progress.sampledSize;
+            
+            if (sampleProgress(progress, now)) {
+                changed.push_back(transfer.second);
+            }
+            
+            // Goodput per host for the connection windows; a baseline sample carries no rate.
+            // Downloads spread over mirrors credit each host themselves.
+            if (measured && progress.sampledSize > sampledBefore && task.mirrors.size() == 1) {
+                m_concurrency.recordBytes(task.hostKey, progress.sampledSize - sampledBefore);
+            }
+        }
+        bool windowGrew = m_concurrency.update(now);
+        
+        lock.unlock();
+        if (windowGrew) {
+            m_queueCondition.notify_all();
+        }
+        for (const auto& task : changed) {
+            reportProgress(*task, reported);
+        }
+        // Tasks that finished meanwhile are not kept alive until the next round
+        changed.clear();
+        lock.lock();
+    }
+}
+
+bool DownloadManager::sampleProgress(TransferProgress& progress, std::chrono::steady_clock::time_point now) {
+    uint64_t bytes = progress.downloadedSize.load(std::memory_order_relaxed);
+    double speed = progress.speed.load(std::memory_order_relaxed);
+    
+    // The first bytes seen, including any resumed prefix, or a restart from zero only set the baseline
+    if (progress.sampledAt == std::chrono::steady_clock::time_point() || bytes < progress.sampledSize) {
+        if (bytes == 0 && progress.reportedSize == 0) {
+            return false;
+        }
+        progress.sampledSize = bytes;
+        progress.sampledAt = now;
+        progress.speed.store(0.0, std::memory_order_relaxed);
+        progress.averageSpeed.store(0.0, std::memory_order_relaxed);
+    } else {
+        double seconds = std::chrono::duration<double>(now - progress.sampledAt).count();
+        if (seconds >= kMinSpeedSampleSeconds) {
+            double instant = static_cast<double>(bytes - progress.sampledSize) / seconds;
+            double average = progress.averageSpeed.load(std::memory_order_relaxed);
+            
+            // Exponential moving average weighted by elapsed time, so irregular samples count fairly
+            double alpha = 1.0 - std::exp(-seconds / kSpeedSmoothingSeconds);
+            average = average > 0.0 ? average + alpha * (instant - average) : instant;
+            
+            progress.speed.store(instant, std::memory_order_relaxed);
+            progress.averageSpeed.store(average, std::memory_order_relaxed);
+            progress.sampledSize = bytes;
+            progress.sampledAt = now;
+        }
+    }
+    
+    // A stalled transfer is reported once more so its speed drops to zero
+    bool changed = bytes != progress.reportedSize || speed != progress.speed.load(std::memory_order_relaxed);
+    progress.reportedSize = bytes;
+    return changed;
+}
+
+void DownloadManager::reportProgress(const DownloadTask& task, DownloadInfo& info) {
+    {
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        snapshot(*task.info, info);
+    }
+    
+    // onProgress takes the install job's mutex, whose holders call startDownload and so
+    // notifyChanged; running callbacks under m_callbackMutex would invert that lock order
+    ProgressCallback progressCallback;
+    ChangeCallback changeCallback;
+    {
         std::lock_guard<std::mutex> lock(m_callbackMutex);
-        if (m_completionCallback) {
-            m_completionCallback(*task.info);
+        progressCallback = m_progressCallback;
+        changeCallback = m_changeCallback;
+    }
+    
+    if (progressCallback) {
+        progressCallback(info);
+    }
+    if (changeCallback) {
+        changeCallback(task.id);
+    }
+    if (task.options.onProgress) {
+        task.options.onProgress(info);
+    }
+}
+
+void DownloadManager::finishProgress(const DownloadTask& task) {
+    {
+        std::lock_guard<std::mutex> lock(m_progressMutex);
+        if (m_transfers.erase(task.id) > 0 && m_transfers.empty()) {
+            m_metrics.pause();
         }
-        return false;
     }
+    
+    std::vector<int> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_downloadsMutex);
+        auto& info = *task.info;
+        info = snapshot(info);
+        info.speed = 0.0;
+        info.averageSpeed = 0.0;
+        if (info.isCompleted) {
+            info.progress = 1.0;
+        }
+        m_progress.erase(task.id);
+        
+        if (m_activeIds.erase(task.id) > 0) {
+            if (info.jobId != 0) {
+                // Install job files are accounted for by the job; keeping them would flood the history
+                m_downloads.erase(task.id);
+            } else {
+                m_finishedIds.push_back(task.id);
+                m_finishedProgress += info.progress;
+                evicted = trimHistory();
+            }
+        }
+    }
+    
+    // Lets subscribers drop the evicted downloads
+    for (int id : evicted) {
+        notifyChanged(id);
+    }
+}
+
+DownloadInfo DownloadManager::snapshot(const DownloadInfo& info) const {
+    DownloadInfo result;
+    snapshot(info, result);
+    return result;
 }
 
-void DownloadManager::updateProgress(std::shared_ptr<DownloadInfo> info, size_t downloaded, size_t total) {
-    info->totalSize = total;
-    info->downloadedSize = downloaded;
-    if (total > 0) {
-        info->progress = static_cast<double>(downloaded) / static_cast<double>(total);
+void DownloadManager::snapshot(const DownloadInfo& info, DownloadInfo& result) const {
+    // Assigning into result reuses the capacity of its strings
+    if (&result != &info) {
+        result = info;
     }
     
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    if (m_progressCallback) {
-        m_progressCallback(*info);
+    auto it = m_progress.find(info.downloadId);
+    if (it != m_progress.end()) {
+        const auto& progress = *it->second;
+        result.totalSize = static_cast<size_t>(progress.totalSize.load(std::memory_order_relaxed));
+        result.downloadedSize = static_cast<size_t>(progress.downloadedSize.load(std::memory_order_relaxed));
+        if (result.totalSize > 0) {
+            result.progress = static_cast<double>(result.downloadedSize) / static_cast<double>(result.totalSize);
+        }
+        result.speed = progress.speed.load(std::memory_order_relaxed);
+        result.averageSpeed = progress.averageSpeed.load(std::memory_order_relaxed);
     }
 }
 
@@ -1,5 +1,14 @@
 #pragma once
 
+#include "downloadjournal.hpp"
+#include "tokenbucket.hpp"
+#include "connectionpool.hpp"
+#include "concurrencycontroller.hpp"
+#include "mirrorselector.hpp"
+#include "contentstore.hpp"
+#include "volumespace.hpp"
+#include "diskwriter.hpp"
+#include "enginemetrics.hpp"
 #include <string>
 #include <vector>
 #include <functional>
@@ -8,10 +17,32 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
+#include <map>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 
 namespace launcher {
 
+class Md5;
+class FileWriter;
+
+// Scheduling class, highest first. While a class has work, lower classes get no worker slots
+// and their running transfers step aside, so their bandwidth goes to it as well.
+enum class DownloadPriority {
+    Foreground,     // an install or patch the player is waiting for
+    Background,     // updates that may finish whenever
+    Predownload     // content for a release that is not out yet
+};
+
+// "foreground", "background" and "predownload", as the UI names them
+const char* priorityName(DownloadPriority priority);
+bool parsePriority(const std::string& name, DownloadPriority& priority);
+
 struct DownloadInfo {
     std::string url;
     std::string destination;
@@ -19,69 +50,377 @@ struct DownloadInfo {
     size_t totalSize = 0;
     size_t downloadedSize = 0;
     double progress = 0.0;
+    // Bytes per second over the last progress interval, and smoothed over a few seconds
+    double speed = 0.0;
+    double averageSpeed = 0.0;
     bool isCompleted = false;
     bool isFailed = false;
     std::string errorMessage;
     int downloadId;
+    int jobId = 0;
+    DownloadPriority priority = DownloadPriority::Foreground;
+    // Paused by the user; keeps its data and waits in the queue until resumed
+    bool isPaused = false;
+    // Bytes a delta update took from the previous version of the file instead of downloading
+    size_t reusedSize = 0;
+};
+
+struct DownloadOptions {
+    // Most parallel byte-range connections for a large file (1 disables segmentation). How many
+    // are used at a time follows the host's adaptive connection window.
+    int segments = 8;
+    // Files smaller than two segments of this size use a single stream
+    size_t minSegmentSize = 8 * 1024 * 1024;
+    // Expected MD5 (hex) of the finished file, verified as the data is written
+    std::string expectedMd5;
+    // Final size if known up front. Disk space for it is reserved when the download is queued;
+    // it waits while other jobs' reservations leave too little and fails if it cannot fit at all.
+    uint64_t expectedSize = 0;
+    // Md5::saveState() taken at the end of an existing partial file; spares re-reading it on resume
+    std::string resumeHashState;
+    // Write past the OS page cache so multi-GB files do not evict everything else
+    bool unbufferedIo = false;
+    // Offer gzip and zstd Content-Encoding and store the decoded body. Decoded downloads use a
+    // single stream and start over instead of resuming; expectedMd5 is checked on what is stored.
+    bool acceptEncoding = false;
+    // The file itself may be gzip or zstd (told apart by its magic bytes); store it decoded
+    bool decompress = false;
+    // Bandwidth cap for this download in bytes per second, on top of the global one (0 = none)
+    uint64_t maxBytesPerSecond = 0;
+    // Owning install job; such downloads are reported through the job instead of getAllDownloads
+    int jobId = 0;
+    DownloadPriority priority = DownloadPriority::Foreground;
+    // Other URLs of the same file, such as the other CDNs of a game's index. All of them are
+    // probed and ranked by throughput; segments spread over the fastest, and a transfer moves
+    // to another mirror when its own stalls or errors.
+    std::vector<std::string> mirrors;
+    // Delta update: the file at the destination is already at its final size, assembled from an
+    // older version with the done ranges in place (see DeltaBuilder). Only the rest is fetched.
+    std::vector<DownloadJournal::Range> deltaRanges;
+    // Per-download hooks, invoked alongside the manager-wide callbacks
+    std::function<void(const DownloadInfo&)> onProgress;
+    // Called exactly once when the download completes, fails or is cancelled
+    std::function<void(const DownloadInfo&)> onFinished;
 };
 
 class DownloadManager {
 public:
+    // Progress is reported from a single progress thread, at most every 100 ms or 1% per download
     using ProgressCallback = std::function<void(const DownloadInfo&)>;
+    // Called once per download that completes, fails or is cancelled
     using CompletionCallback = std::function<void(const DownloadInfo&)>;
+    // Receives the ID of a download that was queued, made progress or finished
+    using ChangeCallback = std::function<void(int downloadId)>;
 
-    DownloadManager();
+    // With a journal path, downloads that were queued or running when the launcher last
+    // exited are restored and resume from the last data synced to disk
+    DownloadManager(size_t maxConcurrent = 8, size_t maxPerHost = 6,
+                    const std::string& journalPath = "");
     ~DownloadManager();
 
+    // %APPDATA%/launcher/downloads.journal
+    static std::string defaultJournalPath();
+
     // Start a download and return download ID
     int startDownload(const std::string& url, const std::string& destination, 
-                     const std::string& filename = "");
+                     const std::string& filename = "",
+                     const DownloadOptions& options = DownloadOptions());
     
     // Cancel a download by ID
     bool cancelDownload(int downloadId);
     
+    // A paused download stops transferring but keeps its data; resuming queues it again
+    bool pauseDownload(int downloadId);
+    bool resumeDownload(int downloadId);
+    
+    // Move a queued or running download to another class
+    bool setDownloadPriority(int downloadId, DownloadPriority priority);
+    
     // Get download info by ID
     DownloadInfo getDownloadInfo(int downloadId) const;
     
-    // Get all active downloads
+    // Get all standalone downloads (install job files are reported by the job)
     std::vector<DownloadInfo> getAllDownloads() const;
     
     // Set callbacks
     void setProgressCallback(ProgressCallback callback);
     void setCompletionCallback(CompletionCallback callback);
+    // Must be cheap and must not block; runs on worker threads and the progress thread
+    void setChangeCallback(ChangeCallback callback);
     
     // Check if download manager is busy
     bool isBusy() const;
     
     // Get total download progress (0.0 to 1.0)
     double getTotalProgress() const;
+    
+    // How many finished standalone downloads stay listed; older ones are dropped
+    void setHistoryLimit(size_t limit);
+    size_t getHistoryLimit() const;
+    
+    // Limit how many downloads run at once, overall and against a single host
+    void setConcurrencyLimits(size_t maxConcurrent, size_t maxPerHost);
+    size_t getMaxConcurrent() const;
+    size_t getMaxPerHost() const;
+
+    // Bandwidth cap shared by all downloads in bytes per second (0 = unlimited)
+    void setGlobalRateLimit(uint64_t bytesPerSecond);
+    uint64_t getGlobalRateLimit() const;
+    
+    // Change the cap of a single queued or running download
+    bool setDownloadRateLimit(int downloadId, uint64_t bytesPerSecond);
+    
+    // What downloads do while a game is running: carry on, pause, or drop to a throttled rate
+    enum class GamePolicy {
+        None,
+        Pause,
+        Throttle
+    };
+    void setGamePolicy(GamePolicy policy, uint64_t throttleBytesPerSecond);
+    GamePolicy getGamePolicy() const;
+    uint64_t getGameThrottleRate() const;
+    void setGameRunning(bool running);
+    
+    // True if the journal holds synced progress for this file from an earlier session
+    bool hasResumeState(const std::string& filePath) const;
+    
+    // Fetch a small side file, such as a chunk manifest, straight into memory without queueing.
+    // A gzip or zstd body is decoded. False with error set on failure or past maxBytes decoded.
+    bool fetch(const std::string& url, std::string& body, std::string& error,
+               size_t maxBytes = 64 * 1024 * 1024);
+    
+    // Keep-alive reuse and connect latency of the per-host connection pool
+    ConnectionPool::Stats getConnectionStats() const;
+    
+    // Connection window, goodput and latency of every host downloaded from
+    std::vector<ConcurrencyController::HostStats> getHostStats() const;
+    
+    // Measured throughput and failures of every host downloaded from
+    std::vector<MirrorSelector::MirrorStats> getMirrorStats() const;
+    
+    // Verified files are kept by MD5 next to the journal, and a download whose expectedMd5 is
+    // already stored is linked in instead of fetched. The budget bounds the store's disk use;
+    // 0 empties and disables it.
+    void setContentStoreBudget(uint64_t bytes);
+    uint64_t getContentStoreBudget() const;
+    bool hasStoredContent(const std::string& md5) const;
+    ContentStore::Stats getContentStoreStats() const;
+    
+    // Free and reserved space of every volume downloads were admitted to
+    std::vector<VolumeSpace::VolumeStats> getVolumeStats() const;
+    
+    // Queue depth and latency of the stage that writes downloaded buffers to disk
+    DiskWriter::Stats getDiskWriterStats() const;
+    
+    // Throughput, time to first byte and CPU time of the engine since the last reset
+    EngineMetrics::Stats getEngineStats() const;
+    void resetEngineStats();
 
 private:
+    struct UrlParts {
+        std::string host;
+        int port = 80;
+        std::string path;
+        // https://; httplib handles TLS, so these never take the splice path
+        bool secure = false;
+    };
+
+    struct Mirror {
+        UrlParts endpoint;
+        std::string hostKey;
+    };
+
+    // Live counters of a download. Transfer threads only touch the atomics; the progress
+    // thread turns them into speeds and callbacks at a bounded rate.
+    struct TransferProgress {
+        std::atomic<uint64_t> totalSize{0};
+        std::atomic<uint64_t> downloadedSize{0};
+        std::atomic<double> speed{0.0};
+        std::atomic<double> averageSpeed{0.0};
+        // Owned by the progress thread
+        uint64_t sampledSize = 0;
+        uint64_t reportedSize = 0;
+        std::chrono::steady_clock::time_point sampledAt;
+    };
+
+    // Shared by the copies of a task, so the scheduler can stop a transfer without failing it
+    struct TransferControl {
+        std::atomic<bool> paused{false};
+        // Stopped for a pause or a higher class; the worker puts the task back in the queue
+        std::atomic<bool> interrupted{false};
+        // Last recorded position of every range, for resuming within this session
+        std::mutex mutex;
+        std::vector<DownloadJournal::Range> ranges;
+    };
+
+    // Created once per download and shared, never copied, from the queue to its worker and
+    // the progress thread; a paused or preempted task goes back to the queue as the same object
     struct DownloadTask {
-        int id;
+        DownloadTask() = default;
+        DownloadTask(const DownloadTask&) = delete;
+        DownloadTask& operator=(const DownloadTask&) = delete;
+        DownloadTask(DownloadTask&&) = default;
+        DownloadTask& operator=(DownloadTask&&) = default;
+
+        int id = 0;
         std::string url;
         std::string destination;
         std::string filename;
+        // Parsed once when queued; host is empty if the URL is not http(s)
+        UrlParts endpoint;
+        std::string hostKey;
+        // Where the file can come from: the URL itself, then every mirror that parsed.
+        // endpoint and hostKey above are the one whose slot the task was admitted on.
+        std::vector<Mirror> mirrors;
+        DownloadOptions options;
         std::shared_ptr<DownloadInfo> info;
+        // Set by cancelDownload; transfers poll it and abort the request
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        // Progress recovered from the journal; when set, only these ranges are trusted on disk
+        bool journaled = false;
+        std::vector<DownloadJournal::Range> resume;
+        // Set when disk space admission rejected the task; it fails without connecting
+        std::string admissionError;
+        std::shared_ptr<TokenBucket> rateLimit;
+        std::shared_ptr<TransferProgress> progress;
+        std::shared_ptr<TransferControl> control;
     };
 
+    struct RunningTask {
+        DownloadPriority priority;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        std::shared_ptr<TransferControl> control;
+    };
+
+    static constexpr size_t kPriorityCount = 3;
+
+    // Host of every mirror, indexed like DownloadTask::mirrors
+    static std::vector<std::string> mirrorHosts(const DownloadTask& task);
+
+    enum class SegmentResult {
+        Completed,
+        Failed,
+        RangeUnsupported
+    };
+
+    static bool parseUrl(const std::string& url, UrlParts& parts);
+    static DownloadJournal::Entry journalEntry(const DownloadTask& task);
+
+    std::shared_ptr<DownloadTask> createTask(int downloadId, const std::string& url, const std::string& destination,
+                            const std::string& filename, const DownloadOptions& options);
+    void enqueueTask(std::shared_ptr<DownloadTask> task);
+    // Put a paused or preempted task back in its queue; false if it finished meanwhile
+    bool requeueInterrupted(const std::shared_ptr<DownloadTask>& task);
+    void restoreJournal(const std::string& journalPath);
+    // Sync the written data, then record how far this range got
+    void checkpoint(const DownloadTask& task, FileWriter& file, const DownloadJournal::Range& range);
+    static void rememberRange(const DownloadTask& task, const DownloadJournal::Range& range);
+
     void workerThread();
+    bool takeNextTask(std::shared_ptr<DownloadTask>& task);
+    // The scheduler state below requires m_queueMutex.
+    // Highest class with a running or runnable task (kPriorityCount if none)
+    size_t activeClass() const;
+    // Interrupt running tasks below the active class
+    void preemptLowerClasses();
+    // Control of a queued or running task, or nullptr
+    std::shared_ptr<TransferControl> findControl(int downloadId) const;
     bool downloadFile(const DownloadTask& task);
-    void updateProgress(std::shared_ptr<DownloadInfo> info, size_t downloaded, size_t total);
+    // Time the first bytes of the file from every mirror not measured lately, all at once
+    void probeMirrors(const DownloadTask& task);
+    bool probeRangeSupport(const UrlParts& url, const std::string& hostKey, size_t& contentLength);
+    // Reserve disk space for the task; false while it has to wait. Requires m_queueMutex.
+    bool reserveSpace(DownloadTask& task);
+    // Complete the download from the content store if it holds the expected file
+    bool restoreFromStore(const DownloadTask& task, const std::string& filePath);
+    SegmentResult downloadSegmented(const DownloadTask& task, const std::string& filePath, size_t total,
+                                    Md5* hasher,
+                                    const std::vector<DownloadJournal::Range>& resume);
+    bool verifyDigest(const DownloadTask& task, Md5& hasher, const std::string& filePath);
+    // Delete what a cancelled download left at its destination
+    void discardPartial(const DownloadTask& task);
+    // Set the terminal state; the progress thread snapshots the DownloadInfo concurrently
+    void markFailed(const DownloadTask& task, const std::string& message);
+    void markCompleted(const DownloadTask& task);
+    // Record absolute progress, or bytes added by one of several segments
+    void setProgress(const DownloadTask& task, size_t downloaded, size_t total);
+    void addProgress(const DownloadTask& task, size_t bytes);
+    // Wake the progress thread early when a download crossed a 1% step
+    void progressAdvanced(const DownloadTask& task, uint64_t before, uint64_t after);
+    void progressThread();
+    // Update the speeds; returns true if the download changed since it was last reported
+    static bool sampleProgress(TransferProgress& progress, std::chrono::steady_clock::time_point now);
+    // info is the progress thread's own, so its strings keep their capacity from report to report
+    void reportProgress(const DownloadTask& task, DownloadInfo& info);
+    // Fold the final counters into the DownloadInfo, stop reporting the download and move it to the history
+    void finishProgress(const DownloadTask& task);
+    // Drop the oldest finished downloads beyond the history limit; requires m_downloadsMutex
+    std::vector<int> trimHistory();
+    // DownloadInfo with the live counters applied; requires m_downloadsMutex
+    DownloadInfo snapshot(const DownloadInfo& info) const;
+    void snapshot(const DownloadInfo& info, DownloadInfo& result) const;
+    void notifyChanged(int downloadId);
+    // Hold the receiving thread until both the download's and the global bucket allow the bytes
+    void throttle(const DownloadTask& task, size_t bytes);
+    // Recompute the global bucket from the user cap and the game policy
+    void applyGlobalLimit();
     
     std::atomic<bool> m_running;
     std::atomic<int> m_nextDownloadId;
     
-    std::thread m_workerThread;
-    std::mutex m_queueMutex;
+    std::vector<std::thread> m_workerThreads;
+    mutable std::mutex m_queueMutex;
     std::condition_variable m_queueCondition;
-    std::queue<DownloadTask> m_downloadQueue;
+    // One queue per DownloadPriority, and the tasks holding a worker
+    std::array<std::deque<std::shared_ptr<DownloadTask>>, kPriorityCount> m_downloadQueues;
+    std::map<int, RunningTask> m_runningTasks;
+    std::map<std::string, size_t> m_activePerHost;
+    size_t m_activeCount;
+    size_t m_maxConcurrent;
+    size_t m_maxPerHost;
     
     mutable std::mutex m_downloadsMutex;
-    std::vector<std::shared_ptr<DownloadInfo>> m_downloads;
+    std::unordered_map<int, std::shared_ptr<DownloadInfo>> m_downloads;
+    // Queued or running downloads, and finished ones oldest first
+    std::unordered_set<int> m_activeIds;
+    std::deque<int> m_finishedIds;
+    // Sum of the progress of the finished downloads still listed
+    double m_finishedProgress;
+    size_t m_historyLimit;
+    std::map<int, std::shared_ptr<std::atomic<bool>>> m_cancelTokens;
+    std::map<int, std::shared_ptr<TokenBucket>> m_rateLimits;
+    std::map<int, std::shared_ptr<TransferProgress>> m_progress;
+    // Unfinished install job files from an earlier session, by target path
+    std::map<std::string, DownloadJournal::Entry> m_resumeHints;
+    
+    DownloadJournal m_journal;
+    ConnectionPool m_connections;
+    // Bounds the connections per host on top of m_maxPerHost; every running task holds one
+    ConcurrencyController m_concurrency;
+    MirrorSelector m_mirrors;
+    ContentStore m_store;
+    VolumeSpace m_space;
+    // Transfers hand full buffers to it, so receiving goes on while the disk writes
+    DiskWriter m_disk;
+    EngineMetrics m_metrics;
+    
+    TokenBucket m_globalLimit;
+    mutable std::mutex m_limitMutex;
+    uint64_t m_userRateLimit;
+    GamePolicy m_gamePolicy;
+    uint64_t m_gameThrottleRate;
+    bool m_gameRunning;
+    
+    // Running downloads, sampled by the progress thread; idle while empty
+    std::thread m_progressThread;
+    mutable std::mutex m_progressMutex;
+    std::condition_variable m_progressCondition;
+    std::map<int, std::shared_ptr<const DownloadTask>> m_transfers;
+    bool m_progressDue;
     
     ProgressCallback m_progressCallback;
     CompletionCallback m_completionCallback;
+    ChangeCallback m_changeCallback;
     std::mutex m_callbackMutex;
 };
 
@@ -0,0 +1,133 @@
+#include "enginemetrics.hpp"
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace launcher {
+
+namespace {
+
+// User and kernel time of all threads of the process
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        return 0.0;
+    }
+    auto ticks = [](const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    // 100 ns units
+    return static_cast<double>(ticks(kernel) + ticks(user)) / 1e7;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    auto seconds = [](const timeval& time) {
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+    };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+}
+
+double percentile(std::vector<uint32_t>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * static_cast<double>(samples.size())));
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(index), samples.end());
+    return static_cast<double>(samples[index]) / 1000.0;
+}
+
+} // namespace
+
+void EngineMetrics::addBytes(uint64_t bytes) {
+    m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void EngineMetrics::recordFirstByte(std::chrono::steady_clock::duration elapsed) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    uint32_t sample = static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(micros, 0), UINT32_MAX));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_firstByte[m_responses % kFirstByteSamples] = sample;
+    ++m_responses;
+}
+
+void EngineMetrics::resume() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_busy) {
+        return;
+    }
+    m_busy = true;
+    m_busySince = std::chrono::steady_clock::now();
+    m_cpuSince = processCpuSeconds();
+}
+
+void EngineMetrics::pause() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_busy) {
+        return;
+    }
+    accumulate();
+    m_busy = false;
+}
+
+void EngineMetrics::accumulate() {
+    auto now = std::chrono::steady_clock::now();
+    double cpu = processCpuSeconds();
+    m_busyTime += now - m_busySince;
+    m_cpuSeconds += std::max(0.0, cpu - m_cpuSince);
+    m_busySince = now;
+    m_cpuSince = cpu;
+}
+
+void EngineMetrics::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bytes.store(0, std::memory_order_relaxed);
+    m_busyTime = std::chrono::steady_clock::duration::zero();
+    m_cpuSeconds = 0.0;
+    m_responses = 0;
+    if (m_busy) {
+        m_busySince = std::chrono::steady_clock::now();
+        m_cpuSince = processCpuSeconds();
+    }
+}
+
+EngineMetrics::Stats EngineMetrics::getStats() const {
+    std::vector<uint32_t> samples;
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.bytes = m_bytes.load(std::memory_order_relaxed);
+        // A busy period still running counts up to now
+        auto busyTime = m_busyTime;
+        stats.cpuSeconds = m_cpuSeconds;
+        if (m_busy) {
+            busyTime += std::chrono::steady_clock::now() - m_busySince;
+            stats.cpuSeconds += std::max(0.0, processCpuSeconds() - m_cpuSince);
+        }
+        stats.busySeconds = std::chrono::duration<double>(busyTime).count();
+        stats.responses = m_responses;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(m_responses, kFirstByteSamples));
+        samples.assign(m_firstByte.begin(), m_firstByte.begin() + static_cast<std::ptrdiff_t>(count));
+    }
+
+    if (stats.busySeconds > 0.0) {
+        stats.bytesPerSecond = static_cast<double>(stats.bytes) / stats.busySeconds;
+    }
+    if (stats.bytes > 0) {
+        stats.cpuSecondsPerGiB = stats.cpuSeconds / (static_cast<double>(stats.bytes) / (1024.0 * 1024.0 * 1024.0));
+    }
+    stats.firstByteP50Ms = percentile(samples, 0.50);
+    stats.firstByteP99Ms = percentile(samples, 0.99);
+    return stats;
+}
+
+} // namespace launcher
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Figures of merit for the download engine as a whole, to compare releases by: throughput
+// over the time anything was downloading, time to the response headers, and the CPU the
+// process spent meanwhile. reset() starts a new measurement window.
+class EngineMetrics {
+public:
+    struct Stats {
+        // Received from the network, before decoding
+        uint64_t bytes = 0;
+        // While at least one download was running
+        double busySeconds = 0.0;
+        double bytesPerSecond = 0.0;
+        // Responses timed, and their time to headers over the last kFirstByteSamples
+        uint64_t responses = 0;
+        double firstByteP50Ms = 0.0;
+        double firstByteP99Ms = 0.0;
+        // CPU time of the whole process while busy, and per GiB received
+        double cpuSeconds = 0.0;
+        double cpuSecondsPerGiB = 0.0;
+    };
+
+    static constexpr size_t kFirstByteSamples = 1024;
+
+    EngineMetrics() = default;
+
+    EngineMetrics(const EngineMetrics&) = delete;
+    EngineMetrics& operator=(const EngineMetrics&) = delete;
+
+    // Transfer threads; batched by the caller
+    void addBytes(uint64_t bytes);
+    void recordFirstByte(std::chrono::steady_clock::duration elapsed);
+
+    // The first download started and the last one ended
+    void resume();
+    void pause();
+
+    void reset();
+    Stats getStats() const;
+
+private:
+    // Requires m_mutex
+    void accumulate();
+
+    std::atomic<uint64_t> m_bytes{0};
+
+    bool m_busy = false;
+    std::chrono::steady_clock::time_point m_busySince;
+    double m_cpuSince = 0.0;
+    std::chrono::steady_clock::duration m_busyTime{0};
+    double m_cpuSeconds = 0.0;
+
+    // Ring of the latest times to headers, in microseconds
+    std::array<uint32_t, kFirstByteSamples> m_firstByte{};
+    uint64_t m_responses = 0;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace launcher
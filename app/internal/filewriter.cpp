@@ -0,0 +1,401 @@
+#include "filewriter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+namespace launcher {
+
+namespace {
+
+// Buffers of one file queued for the disk; beyond that the writer, and so the socket, waits
+const size_t kWritesInFlight = 2;
+
+uint64_t alignDown(uint64_t value) {
+    return value - value % FileWriter::kAlignment;
+}
+
+uint64_t alignUp(uint64_t value) {
+    return alignDown(value + FileWriter::kAlignment - 1);
+}
+
+std::string lastErrorText() {
+#ifdef _WIN32
+    return "error " + std::to_string(GetLastError());
+#else
+    return std::strerror(errno);
+#endif
+}
+
+} // namespace
+
+FileWriter::FileWriter() {
+}
+
+FileWriter::~FileWriter() {
+    close();
+    if (m_stage && m_buffer) {
+        m_stage->release(m_buffer);
+    }
+}
+
+void FileWriter::setWriteStage(DiskWriter* stage) {
+    if (!m_buffer) {
+        m_stage = stage;
+    }
+}
+
+bool FileWriter::open(const std::filesystem::path& path, uint64_t offset, bool truncate, bool unbuffered) {
+    close();
+    m_failed = false;
+    m_error.clear();
+    m_tracker.reset();
+
+#ifdef _WIN32
+    // Segments of one file are written through separate handles and read back while open
+    const DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+    HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, share, nullptr,
+                                truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return fail("Failed to open output file: " + lastErrorText());
+    }
+    m_handle = handle;
+
+    if (unbuffered) {
+        HANDLE direct = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, share, nullptr,
+                                    OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+        if (direct != INVALID_HANDLE_VALUE) {
+            m_directHandle = direct;
+        }
+    }
+#else
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    m_fd = ::open(path.c_str(), flags, 0644);
+    if (m_fd < 0) {
+        return fail("Failed to open output file: " + lastErrorText());
+    }
+
+    if (unbuffered) {
+#if defined(O_DIRECT)
+        // Not every filesystem accepts O_DIRECT (tmpfs does not); those stay buffered
+        m_directFd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC | O_DIRECT);
+#elif defined(F_NOCACHE)
+        fcntl(m_fd, F_NOCACHE, 1);
+#endif
+    }
+#endif
+
+    if (m_stage) {
+        if (!m_buffer) {
+            m_buffer = m_stage->acquire();
+        }
+    } else if (m_storage.empty()) {
+        m_storage.resize(kBufferSize + kAlignment);
+        void* start = m_storage.data();
+        size_t space = m_storage.size();
+        m_buffer = static_cast<char*>(std::align(kAlignment, kBufferSize, start, space));
+    }
+
+    m_position = offset;
+    m_stagedBegin = offset;
+    m_bufferBase = alignDown(offset);
+    return true;
+}
+
+bool FileWriter::preallocate(uint64_t size) {
+    if (!isOpen()) {
+        return false;
+    }
+
+#ifdef _WIN32
+    // Reserves clusters but leaves the end of file alone, unlike SetFileValidData
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    return SetFileInformationByHandle(static_cast<HANDLE>(m_handle), FileAllocationInfo,
+                                      &allocation, sizeof(allocation)) != 0;
+#elif defined(__linux__)
+    return fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+#elif defined(F_PREALLOCATE)
+    fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0};
+    if (fcntl(m_fd, F_PREALLOCATE, &store) == 0) {
+        return true;
+    }
+    store.fst_flags = F_ALLOCATEALL;
+    return fcntl(m_fd, F_PREALLOCATE, &store) == 0;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
+bool FileWriter::write(const char* data, size_t length) {
+    if (!isOpen() || m_failed) {
+        return false;
+    }
+
+    while (length > 0) {
+        size_t used = static_cast<size_t>(m_position - m_bufferBase);
+        if (used == kBufferSize) {
+            if (!writeStaged(false)) {
+                return false;
+            }
+            continue;
+        }
+
+        size_t count = std::min(length, kBufferSize - used);
+        std::memcpy(m_buffer + used, data, count);
+        m_position += count;
+        data += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+bool FileWriter::flush() {
+    if (!isOpen() || m_failed) {
+        return false;
+    }
+    if (m_stage && !drain()) {
+        return false;
+    }
+
+    return writeStaged(true);
+}
+
+bool FileWriter::sync() {
+    if (!flush()) {
+        return false;
+    }
+
+#ifdef _WIN32
+    if (!FlushFileBuffers(static_cast<HANDLE>(m_handle))) {
+        return fail("Failed to sync output file: " + lastErrorText());
+    }
+#else
+    if (fsync(m_fd) != 0) {
+        return fail("Failed to sync output file: " + lastErrorText());
+    }
+#endif
+
+    return true;
+}
+
+bool FileWriter::close() {
+    if (!isOpen()) {
+        return !m_failed;
+    }
+
+    // Queued writes still use the handles
+    if (m_stage) {
+        drain();
+    }
+    bool ok = !m_failed && writeStaged(true);
+
+    closeDirect();
+#ifdef _WIN32
+    CloseHandle(static_cast<HANDLE>(m_handle));
+    m_handle = nullptr;
+#else
+    if (::close(m_fd) != 0 && ok) {
+        ok = fail("Failed to close output file: " + lastErrorText());
+    }
+    m_fd = -1;
+#endif
+
+    return ok;
+}
+
+bool FileWriter::isOpen() const {
+#ifdef _WIN32
+    return m_handle != nullptr;
+#else
+    return m_fd >= 0;
+#endif
+}
+
+bool FileWriter::writeStaged(bool final) {
+    if (m_stage && !final) {
+        return submitStaged();
+    }
+
+    uint64_t begin = m_stagedBegin;
+    uint64_t end = m_position;
+
+#ifdef _WIN32
+    bool direct = m_directHandle != nullptr;
+#else
+    bool direct = m_directFd >= 0;
+#endif
+
+    if (!direct) {
+        if (end > begin && !writeAt(false, m_buffer + (begin - m_bufferBase), static_cast<size_t>(end - begin), begin)) {
+            return false;
+        }
+        m_stagedBegin = end;
+        m_bufferBase = alignDown(end);
+        return true;
+    }
+
+    // Unbuffered writes need aligned offsets, lengths and memory; the buffer base is always
+    // aligned, so only the unaligned head and tail go through the cached handle
+    uint64_t alignedBegin = std::min(alignUp(begin), end);
+    uint64_t alignedEnd = std::max(alignDown(end), alignedBegin);
+
+    if (alignedBegin > begin &&
+        !writeAt(false, m_buffer + (begin - m_bufferBase), static_cast<size_t>(alignedBegin - begin), begin)) {
+        return false;
+    }
+
+    if (alignedEnd > alignedBegin) {
+        const char* body = m_buffer + (alignedBegin - m_bufferBase);
+        size_t length = static_cast<size_t>(alignedEnd - alignedBegin);
+        if (!writeAt(true, body, length, alignedBegin)) {
+            // Some volumes refuse unbuffered writes; carry on through the cache
+            closeDirect();
+            m_failed = false;
+            m_error.clear();
+            if (!writeAt(false, body, length, alignedBegin)) {
+                return false;
+            }
+        }
+    }
+
+    if (final) {
+        if (end > alignedEnd &&
+            !writeAt(false, m_buffer + (alignedEnd - m_bufferBase), static_cast<size_t>(end - alignedEnd), alignedEnd)) {
+            return false;
+        }
+        m_stagedBegin = end;
+        m_bufferBase = alignDown(end);
+        return true;
+    }
+
+    // Keep the partial block staged so the next unbuffered write starts aligned
+    std::memmove(m_buffer, m_buffer + (alignedEnd - m_bufferBase), static_cast<size_t>(end - alignedEnd));
+    m_stagedBegin = alignedEnd;
+    m_bufferBase = alignedEnd;
+    return true;
+}
+
+bool FileWriter::submitStaged() {
+    if (!m_tracker.wait(kWritesInFlight - 1)) {
+        return fail(m_tracker.error());
+    }
+    if (m_tracker.takeDirectFailed()) {
+        // Wait out the writes that still use the unbuffered handle before dropping it
+        if (!m_tracker.wait()) {
+            return fail(m_tracker.error());
+        }
+        closeDirect();
+    }
+
+    // The buffer is full, so it ends aligned; only an unaligned head goes through the cache
+    uint64_t begin = m_stagedBegin;
+    uint64_t end = m_position;
+#ifdef _WIN32
+    DiskWriter::Handle cached = m_handle;
+    DiskWriter::Handle direct = m_directHandle;
+    bool unbuffered = direct != nullptr;
+#else
+    DiskWriter::Handle cached = m_fd;
+    DiskWriter::Handle direct = m_directFd;
+    bool unbuffered = direct >= 0;
+#endif
+    uint64_t alignedBegin = unbuffered ? std::min(alignUp(begin), end) : end;
+
+    DiskWriter::Segment segments[2];
+    size_t count = 0;
+    if (alignedBegin > begin) {
+        DiskWriter::Segment& head = segments[count++];
+        head.handle = cached;
+        head.fallback = cached;
+        head.from = static_cast<size_t>(begin - m_bufferBase);
+        head.length = static_cast<size_t>(alignedBegin - begin);
+        head.offset = begin;
+    }
+    if (end > alignedBegin) {
+        DiskWriter::Segment& body = segments[count++];
+        body.handle = direct;
+        body.fallback = cached;
+        body.from = static_cast<size_t>(alignedBegin - m_bufferBase);
+        body.length = static_cast<size_t>(end - alignedBegin);
+        body.offset = alignedBegin;
+    }
+
+    if (count > 0) {
+        m_stage->submit(m_tracker, m_buffer, segments, count);
+        m_buffer = m_stage->acquire();
+    }
+    m_stagedBegin = end;
+    m_bufferBase = alignDown(end);
+    return true;
+}
+
+bool FileWriter::drain() {
+    bool ok = m_tracker.wait();
+    if (m_tracker.takeDirectFailed()) {
+        closeDirect();
+    }
+    return ok || fail(m_tracker.error());
+}
+
+void FileWriter::closeDirect() {
+#ifdef _WIN32
+    if (m_directHandle) {
+        CloseHandle(static_cast<HANDLE>(m_directHandle));
+        m_directHandle = nullptr;
+    }
+#else
+    if (m_directFd >= 0) {
+        ::close(m_directFd);
+        m_directFd = -1;
+    }
+#endif
+}
+
+bool FileWriter::writeAt(bool direct, const char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+#ifdef _WIN32
+        HANDLE handle = static_cast<HANDLE>(direct ? m_directHandle : m_handle);
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD request = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(handle, data, request, &written, &overlapped) || written == 0) {
+            return fail("Failed to write output file: " + lastErrorText());
+        }
+#else
+        ssize_t written = pwrite(direct ? m_directFd : m_fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return fail("Failed to write output file: " + lastErrorText());
+        }
+#endif
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+
+    return true;
+}
+
+bool FileWriter::fail(const std::string& message) {
+    m_failed = true;
+    m_error = message;
+    return false;
+}
+
+} // namespace launcher
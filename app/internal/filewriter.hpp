@@ -0,0 +1,85 @@
+#pragma once
+
+#include "diskwriter.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+namespace launcher {
+
+// Sequential output file for downloads. Data is staged in a large aligned buffer and
+// written in few big requests instead of one syscall per network chunk.
+class FileWriter {
+public:
+    // Staging buffer size and the alignment used for unbuffered writes
+    static constexpr size_t kBufferSize = DiskWriter::kBufferSize;
+    static constexpr size_t kAlignment = DiskWriter::kAlignment;
+
+    FileWriter();
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    // Hand full buffers to stage instead of writing them in write(); set before the first open.
+    // Write errors then show up on a later write, flush or close.
+    void setWriteStage(DiskWriter* stage);
+
+    // Open for writing at offset, keeping the bytes before it unless truncate is set.
+    // With unbuffered set, aligned chunks bypass the OS page cache where the platform allows it.
+    bool open(const std::filesystem::path& path, uint64_t offset, bool truncate, bool unbuffered = false);
+
+    // Reserve disk space for the final size without changing the file length, so resume
+    // logic still sees only the bytes written. Best effort; returns false if unsupported.
+    bool preallocate(uint64_t size);
+
+    // Stage data, writing it out whenever the buffer fills
+    bool write(const char* data, size_t length);
+
+    // Write out everything staged so far
+    bool flush();
+
+    // Flush and wait until the data is on stable storage
+    bool sync();
+
+    // Flush and release the file; returns false if any write failed
+    bool close();
+
+    bool isOpen() const;
+    uint64_t position() const { return m_position; }
+    const std::string& error() const { return m_error; }
+
+private:
+    // Write [m_stagedBegin, m_position); keeps an unaligned tail staged unless final is set
+    bool writeStaged(bool final);
+    // Give the full buffer to the write stage and carry on in a fresh one
+    bool submitStaged();
+    // Wait for everything handed to the write stage
+    bool drain();
+    void closeDirect();
+    bool writeAt(bool direct, const char* data, size_t length, uint64_t offset);
+    bool fail(const std::string& message);
+
+    std::vector<char> m_storage;
+    char* m_buffer = nullptr;
+    uint64_t m_bufferBase = 0;    // file offset of m_buffer[0]
+    uint64_t m_stagedBegin = 0;   // first staged byte not yet written
+    uint64_t m_position = 0;      // next byte to be written
+    bool m_failed = false;
+    std::string m_error;
+
+    DiskWriter* m_stage = nullptr;
+    DiskWriter::Tracker m_tracker;
+
+#ifdef _WIN32
+    void* m_handle = nullptr;
+    void* m_directHandle = nullptr;
+#else
+    int m_fd = -1;
+    int m_directFd = -1;
+#endif
+};
+
+} // namespace launcher
@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <random>
 #include <iomanip>
+#include <thread>
 #include <windows.h>
 #include <shellapi.h>
 #include <rapidjson/prettywriter.h>
@@ -366,7 +367,14 @@ bool GameManager::launchExecutable(const std::string& path) {
     sei.lpFile = path.c_str();
     sei.nShow = SW_SHOWNORMAL;
     
-    return ShellExecuteExA(&sei) != FALSE;
+    if (ShellExecuteExA(&sei) == FALSE) {
+        return false;
+    }
+    
+    if (sei.hProcess) {
+        trackProcess(sei.hProcess);
+    }
+    return true;
 }
 
 bool GameManager::launchSteamGame(const std::string& steamId) {
@@ -395,6 +403,36 @@ bool GameManager::launchEpicGame(const std::string& epicId) {
     return ShellExecuteExA(&sei) != FALSE;
 }
 
+bool GameManager::isGameRunning() const {
+    std::lock_guard<std::mutex> lock(runningMutex_);
+    return runningGames_ > 0;
+}
+
+void GameManager::setRunningChangedCallback(std::function<void(bool)> callback) {
+    std::lock_guard<std::mutex> lock(runningMutex_);
+    runningCallback_ = callback;
+}
+
+void GameManager::trackProcess(void* process) {
+    {
+        std::lock_guard<std::mutex> lock(runningMutex_);
+        if (runningGames_++ == 0 && runningCallback_) {
+            runningCallback_(true);
+        }
+    }
+    
+    // Detached so a game that outlives the launcher does not block its exit
+    std::thread([this, process]() {
+        WaitForSingleObject(static_cast<HANDLE>(process), INFINITE);
+        CloseHandle(static_cast<HANDLE>(process));
+        
+        std::lock_guard<std::mutex> lock(runningMutex_);
+        if (--runningGames_ == 0 && runningCallback_) {
+            runningCallback_(false);
+        }
+    }).detach();
+}
+
 bool GameManager::launchGame(const std::string& gameId) {
     auto it = std::find_if(games_.begin(), games_.end(),
         [&gameId](const Game& game) { return game.id == gameId; });
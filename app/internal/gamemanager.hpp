@@ -5,6 +5,8 @@
 #include <memory>
 #include <optional>
 #include <chrono>
+#include <functional>
+#include <mutex>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
@@ -86,6 +88,13 @@ public:
     bool launchSteamGame(const std::string& steamId);
     bool launchEpicGame(const std::string& epicId);
     
+    // Games launched as executables that are still running; Steam and Epic launches go
+    // through their own clients and cannot be tracked
+    bool isGameRunning() const;
+    
+    // Called with true when the first tracked game starts and false when the last one exits
+    void setRunningChangedCallback(std::function<void(bool)> callback);
+    
     // CEF IPC handler
     std::string handleCefQuery(const std::string& request);
 
@@ -98,6 +107,13 @@ private:
     std::vector<Game> games_;
     std::string getGamesFilePath() const;
     std::string generateGameId() const;
+    
+    // Wait for a launched process on a detached thread and keep the running count
+    void trackProcess(void* process);
+    
+    mutable std::mutex runningMutex_;
+    int runningGames_ = 0;
+    std::function<void(bool)> runningCallback_;
 };
 
 } // namespace launcher
\ No newline at end of file
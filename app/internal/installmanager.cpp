@@ -0,0 +1,647 @@
+#include "installmanager.hpp"
+#include "md5.hpp"
+#include "deltaupdate.hpp"
+#include <rapidjson/document.h>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <fstream>
+#include <numeric>
+#include <functional>
+
+namespace launcher {
+
+namespace {
+
+const int kMaxFileAttempts = 3;
+
+// Per-file read size while checking; a multiple of the MD5 block so lanes stay aligned,
+// and a full set of lanes still issues about 4 MiB of reads per pass
+const size_t kLaneChunkSize = 256 * 1024;
+
+// Files this large are written past the page cache so an install does not flush it
+const uint64_t kUnbufferedFileSize = 256ull * 1024 * 1024;
+
+// base + dest without doubling the slash between them
+std::string joinUrl(std::string base, const std::string& dest) {
+    if (!base.empty() && base.back() == '/' && !dest.empty() && dest.front() == '/') {
+        base.pop_back();
+    }
+    return base + dest;
+}
+
+bool isTerminalState(const std::string& state) {
+    return state == "completed" || state == "failed" || state == "cancelled";
+}
+
+} // namespace
+
+InstallManager::InstallManager(DownloadManager& downloadManager)
+    : m_downloadManager(downloadManager), m_nextInstallId(1) {
+}
+
+InstallManager::~InstallManager() {
+    std::map<int, std::shared_ptr<InstallJob>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        jobs = m_jobs;
+    }
+
+    for (auto& entry : jobs) {
+        cancelInstall(entry.first);
+        if (entry.second->planner.joinable()) {
+            entry.second->planner.join();
+        }
+    }
+}
+
+std::vector<ResourceEntry> InstallManager::parseManifest(const std::string& json) {
+    rapidjson::Document doc;
+    doc.Parse(json.c_str());
+
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("resource") || !doc["resource"].IsArray()) {
+        throw std::runtime_error("Invalid resource manifest");
+    }
+
+    std::vector<ResourceEntry> resources;
+    const auto& items = doc["resource"];
+    resources.reserve(items.Size());
+
+    for (auto it = items.Begin(); it != items.End(); ++it) {
+        if (!it->IsObject() || !it->HasMember("dest") || !(*it)["dest"].IsString() ||
+            !it->HasMember("size") || !(*it)["size"].IsUint64()) {
+            throw std::runtime_error("Invalid resource entry in manifest");
+        }
+
+        ResourceEntry entry;
+        entry.dest = (*it)["dest"].GetString();
+        entry.size = (*it)["size"].GetUint64();
+        if (it->HasMember("md5") && (*it)["md5"].IsString()) {
+            entry.md5 = (*it)["md5"].GetString();
+            std::transform(entry.md5.begin(), entry.md5.end(), entry.md5.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        }
+
+        if (it->HasMember("chunks") && (*it)["chunks"].IsString()) {
+            entry.chunks = (*it)["chunks"].GetString();
+        }
+
+        // Never let a manifest write outside the install directory, or fetch outside the base URL
+        for (const auto* path : {&entry.dest, &entry.chunks}) {
+            for (const auto& part : std::filesystem::path(*path)) {
+                if (part == "..") {
+                    throw std::runtime_error("Manifest entry escapes install directory: " + *path);
+                }
+            }
+        }
+
+        resources.push_back(entry);
+    }
+
+    return resources;
+}
+
+int InstallManager::startInstall(const std::string& baseUrl, const std::vector<ResourceEntry>& resources,
+                                 const std::string& installDir, DownloadPriority priority,
+                                 const std::vector<std::string>& mirrorBaseUrls) {
+    return startJob("install", baseUrl, resources, installDir, priority, mirrorBaseUrls);
+}
+
+int InstallManager::startVerify(const std::string& baseUrl, const std::vector<ResourceEntry>& resources,
+                                const std::string& installDir, DownloadPriority priority,
+                                const std::vector<std::string>& mirrorBaseUrls) {
+    return startJob("verify", baseUrl, resources, installDir, priority, mirrorBaseUrls);
+}
+
+int InstallManager::startJob(const std::string& mode, const std::string& baseUrl,
+                             const std::vector<ResourceEntry>& resources, const std::string& installDir,
+                             DownloadPriority priority, const std::vector<std::string>& mirrorBaseUrls) {
+    int installId = m_nextInstallId++;
+
+    auto job = std::make_shared<InstallJob>();
+    job->info.installId = installId;
+    job->info.installDir = installDir;
+    job->info.mode = mode;
+    job->info.state = "checking";
+    job->info.priority = priority;
+    job->info.totalFiles = resources.size();
+    job->baseUrl = baseUrl;
+    job->mirrorBaseUrls = mirrorBaseUrls;
+    job->resources = resources;
+    job->downloadManager = &m_downloadManager;
+
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_jobs[installId] = job;
+    }
+
+    job->planner = std::thread(&InstallManager::planInstall, job);
+    return installId;
+}
+
+bool InstallManager::cancelInstall(int installId) {
+    std::shared_ptr<InstallJob> job;
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        auto it = m_jobs.find(installId);
+        if (it == m_jobs.end()) {
+            return false;
+        }
+        job = it->second;
+    }
+
+    std::vector<int> downloadIds;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (isTerminalState(job->info.state) || job->cancelled) {
+            return false;
+        }
+
+        job->cancelled = true;
+        for (const auto& pending : job->pending) {
+            downloadIds.push_back(pending.first);
+        }
+    }
+
+    // Cancelling may run onFinished synchronously, so the job lock must be released
+    for (int downloadId : downloadIds) {
+        m_downloadManager.cancelDownload(downloadId);
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    finishIfDone(*job);
+    return true;
+}
+
+bool InstallManager::setInstallPriority(int installId, DownloadPriority priority) {
+    std::shared_ptr<InstallJob> job;
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        auto it = m_jobs.find(installId);
+        if (it == m_jobs.end()) {
+            return false;
+        }
+        job = it->second;
+    }
+
+    // Files scheduled from now on pick up the new class themselves
+    std::vector<int> downloadIds;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (isTerminalState(job->info.state) || job->cancelled) {
+            return false;
+        }
+
+        job->info.priority = priority;
+        for (const auto& pending : job->pending) {
+            downloadIds.push_back(pending.first);
+        }
+    }
+
+    for (int downloadId : downloadIds) {
+        m_downloadManager.setDownloadPriority(downloadId, priority);
+    }
+    return true;
+}
+
+InstallInfo InstallManager::getInstallInfo(int installId) const {
+    std::shared_ptr<InstallJob> job;
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        auto it = m_jobs.find(installId);
+        if (it == m_jobs.end()) {
+            return InstallInfo{};
+        }
+        job = it->second;
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    return job->info;
+}
+
+std::vector<InstallInfo> InstallManager::getAllInstalls() const {
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+    std::vector<InstallInfo> result;
+    for (const auto& entry : m_jobs) {
+        std::lock_guard<std::mutex> jobLock(entry.second->mutex);
+        result.push_back(entry.second->info);
+    }
+
+    return result;
+}
+
+void InstallManager::planInstall(std::shared_ptr<InstallJob> job) {
+    // Largest files first so a single huge pak does not leave one core hashing alone at the end
+    std::vector<size_t> order(job->resources.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&job](size_t a, size_t b) {
+        return job->resources[a].size > job->resources[b].size;
+    });
+
+    job->checkStarted = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+
+    size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    threadCount = std::min(threadCount, std::max<size_t>(order.size(), 1));
+
+    std::vector<std::thread> checkers;
+    for (size_t i = 1; i < threadCount; ++i) {
+        checkers.emplace_back(&InstallManager::checkFiles, job, std::cref(order), std::ref(next));
+    }
+    checkFiles(job, order, next);
+    for (auto& checker : checkers) {
+        checker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->planned = true;
+    finishIfDone(*job);
+}
+
+void InstallManager::checkFiles(std::shared_ptr<InstallJob> job, const std::vector<size_t>& order,
+                                std::atomic<size_t>& next) {
+    struct Stream {
+        size_t index = 0;
+        std::ifstream file;
+        Md5 md5;
+    };
+
+    // Keep one open file per MD5 lane so each pass hashes several files side by side
+    size_t width = Md5::laneWidth();
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::vector<char> buffer(width * kLaneChunkSize);
+    bool drained = false;
+
+    auto finish = [&job](size_t index, bool upToDate) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->info.checkedFiles++;
+        if (!upToDate) {
+            scheduleFile(job, index);
+        }
+    };
+
+    // A changed file with a chunk manifest is patched instead of fetched whole, unless the
+    // content store already holds the new version
+    auto patch = [&job, &finish](size_t index) {
+        if (job->downloadManager->hasStoredContent(job->resources[index].md5)) {
+            finish(index, false);
+            return;
+        }
+
+        std::vector<DownloadJournal::Range> ranges;
+        uint64_t reusedBytes = 0;
+        if (!prepareDelta(*job, job->resources[index], ranges, reusedBytes)) {
+            finish(index, false);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->info.checkedFiles++;
+        if (ranges.empty()) {
+            job->info.reusedBytes += reusedBytes;
+        } else {
+            scheduleFile(job, index, ranges);
+        }
+    };
+
+    while (!job->cancelled) {
+        while (!drained && streams.size() < width) {
+            size_t i = next++;
+            if (i >= order.size()) {
+                drained = true;
+                break;
+            }
+
+            size_t index = order[i];
+            const auto& entry = job->resources[index];
+
+            // Left unfinished by an earlier session; the download journal knows which bytes are good
+            if (job->downloadManager->hasResumeState(localPath(*job, entry))) {
+                finish(index, false);
+                continue;
+            }
+
+            if (!sizeMatches(*job, entry)) {
+                if (!entry.chunks.empty()) {
+                    patch(index);
+                } else {
+                    finish(index, false);
+                }
+                continue;
+            }
+            if (entry.md5.empty()) {
+                finish(index, true);
+                continue;
+            }
+
+            // Unbuffered stream so each read goes straight to the OS in one large request
+            auto stream = std::make_unique<Stream>();
+            stream->index = index;
+            stream->file.rdbuf()->pubsetbuf(nullptr, 0);
+            stream->file.open(localPath(*job, entry), std::ios::binary);
+            if (!stream->file.is_open()) {
+                finish(index, false);
+                continue;
+            }
+            streams.push_back(std::move(stream));
+        }
+
+        if (streams.empty()) {
+            break;
+        }
+
+        std::vector<Md5*> hashers(streams.size());
+        std::vector<const uint8_t*> data(streams.size());
+        std::vector<size_t> lengths(streams.size());
+        uint64_t readBytes = 0;
+
+        for (size_t lane = 0; lane < streams.size(); ++lane) {
+            char* chunk = buffer.data() + lane * kLaneChunkSize;
+            streams[lane]->file.read(chunk, static_cast<std::streamsize>(kLaneChunkSize));
+
+            hashers[lane] = &streams[lane]->md5;
+            data[lane] = reinterpret_cast<const uint8_t*>(chunk);
+            lengths[lane] = static_cast<size_t>(std::max<std::streamsize>(streams[lane]->file.gcount(), 0));
+            readBytes += lengths[lane];
+        }
+
+        Md5::updateLanes(hashers.data(), data.data(), lengths.data(), streams.size());
+
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->info.checkedBytes += readBytes;
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - job->checkStarted).count();
+            if (elapsed > 0.0) {
+                job->info.checkBytesPerSecond = static_cast<double>(job->info.checkedBytes) / elapsed;
+            }
+        }
+
+        // A short read means the file is exhausted and its lane can take the next one
+        for (auto it = streams.begin(); it != streams.end();) {
+            Stream& stream = **it;
+            if (stream.file.good()) {
+                ++it;
+                continue;
+            }
+
+            const auto& entry = job->resources[stream.index];
+            bool upToDate = !stream.file.bad() && stream.md5.hexDigest() == entry.md5;
+            stream.file.close();
+            if (!upToDate && !entry.chunks.empty()) {
+                patch(stream.index);
+            } else {
+                if (!upToDate) {
+                    std::error_code ec;
+                    std::filesystem::remove(localPath(*job, entry), ec);
+                }
+                finish(stream.index, upToDate);
+            }
+            it = streams.erase(it);
+        }
+    }
+}
+
+bool InstallManager::sizeMatches(const InstallJob& job, const ResourceEntry& entry) {
+    std::string path = localPath(job, entry);
+
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        return false;
+    }
+
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec || size != entry.size) {
+        // Shorter files are resumed by the download manager; anything else is fetched again,
+        // unless a delta update can reuse its blocks
+        if (ec || (size > entry.size && entry.chunks.empty())) {
+            std::filesystem::remove(path, ec);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool InstallManager::prepareDelta(const InstallJob& job, const ResourceEntry& entry,
+                                  std::vector<DownloadJournal::Range>& ranges, uint64_t& reusedBytes) {
+    std::string path = localPath(job, entry);
+    std::string staging = path + ".delta";
+    std::error_code ec;
+
+    auto discard = [&]() {
+        std::filesystem::remove(staging, ec);
+        std::filesystem::remove(path, ec);
+        return false;
+    };
+
+    // A cancelled job leaves the old version as it was
+    if (job.cancelled) {
+        return false;
+    }
+    if (!std::filesystem::exists(path, ec)) {
+        return discard();
+    }
+
+    // The chunk manifest comes from whichever CDN answers first
+    std::string body;
+    std::string error;
+    bool fetched = job.downloadManager->fetch(joinUrl(job.baseUrl, entry.chunks), body, error);
+    for (size_t i = 0; !fetched && i < job.mirrorBaseUrls.size(); ++i) {
+        fetched = job.downloadManager->fetch(joinUrl(job.mirrorBaseUrls[i], entry.chunks), body, error);
+    }
+    if (!fetched) {
+        return discard();
+    }
+
+    ChunkManifest manifest;
+    try {
+        manifest = ChunkManifest::parse(body);
+    } catch (const std::exception&) {
+        return discard();
+    }
+    if (manifest.size != entry.size) {
+        return discard();
+    }
+
+    DeltaBuilder builder(manifest);
+    if (!builder.scan(path, &job.cancelled)) {
+        return job.cancelled ? false : discard();
+    }
+    if (builder.reusedBytes() == 0) {
+        return discard();
+    }
+
+    // Built alongside so the old file stays readable until the new one is complete
+    if (!builder.assemble(path, staging)) {
+        return discard();
+    }
+    std::filesystem::rename(staging, path, ec);
+    if (ec) {
+        return discard();
+    }
+
+    reusedBytes = builder.reusedBytes();
+    if (builder.missingBytes() > 0) {
+        ranges = builder.ranges();
+        return true;
+    }
+
+    // Every block was found; the blocks were checked, the file as a whole still is
+    if (!entry.md5.empty() && Md5::hashFile(path) != entry.md5) {
+        return discard();
+    }
+    return true;
+}
+
+void InstallManager::scheduleFile(std::shared_ptr<InstallJob> job, size_t index,
+                                  const std::vector<DownloadJournal::Range>& deltaRanges) {
+    if (job->cancelled) {
+        return;
+    }
+
+    const auto& entry = job->resources[index];
+    std::filesystem::path target(localPath(*job, entry));
+
+    std::string url = joinUrl(job->baseUrl, entry.dest);
+
+    DownloadOptions options;
+    for (const auto& mirrorBaseUrl : job->mirrorBaseUrls) {
+        options.mirrors.push_back(joinUrl(mirrorBaseUrl, entry.dest));
+    }
+    options.jobId = job->info.installId;
+    options.expectedMd5 = entry.md5;
+    options.expectedSize = entry.size;
+    options.unbufferedIo = entry.size >= kUnbufferedFileSize;
+    options.priority = job->info.priority;
+    options.deltaRanges = deltaRanges;
+    options.onProgress = [job](const DownloadInfo& download) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        auto it = job->inflightBytes.find(download.downloadId);
+        if (it == job->inflightBytes.end()) {
+            return;
+        }
+
+        job->info.downloadedBytes += download.downloadedSize - it->second;
+        it->second = download.downloadedSize;
+        if (job->info.totalBytes > 0) {
+            job->info.progress = static_cast<double>(job->info.downloadedBytes) /
+                                 static_cast<double>(job->info.totalBytes);
+        }
+    };
+    options.onFinished = [job](const DownloadInfo& download) {
+        onFileFinished(job, download);
+    };
+
+    if (job->attempts[index] == 0) {
+        job->info.queuedFiles++;
+        job->info.totalBytes += entry.size;
+    }
+    if (job->info.state == "checking") {
+        job->info.state = "downloading";
+    }
+
+    // The job lock is held, so onFinished cannot observe the download before it is recorded
+    int downloadId = job->downloadManager->startDownload(url, target.parent_path().string(),
+                                                         target.filename().string(), options);
+    job->pending[downloadId] = index;
+    job->inflightBytes[downloadId] = 0;
+}
+
+void InstallManager::onFileFinished(std::shared_ptr<InstallJob> job, const DownloadInfo& download) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        auto it = job->pending.find(download.downloadId);
+        if (it == job->pending.end()) {
+            return;
+        }
+        index = it->second;
+    }
+
+    const auto& entry = job->resources[index];
+    std::string path = localPath(*job, entry);
+
+    // The MD5 was already checked while the file was written
+    bool verified = download.isCompleted && !download.isFailed;
+    std::string error = download.errorMessage;
+    if (verified && !job->cancelled) {
+        std::error_code ec;
+        if (std::filesystem::file_size(path, ec) != entry.size || ec) {
+            verified = false;
+            error = "Size mismatch: " + entry.dest;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+
+    // Drop whatever this attempt had counted; a retry starts from zero
+    job->info.downloadedBytes -= job->inflightBytes[download.downloadId];
+    job->inflightBytes.erase(download.downloadId);
+    job->pending.erase(download.downloadId);
+
+    if (job->cancelled) {
+        finishIfDone(*job);
+        return;
+    }
+
+    if (!verified && ++job->attempts[index] < kMaxFileAttempts) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        scheduleFile(job, index);
+        return;
+    }
+
+    if (verified) {
+        job->info.completedFiles++;
+        job->info.downloadedBytes += entry.size;
+        job->info.reusedBytes += download.reusedSize;
+    } else {
+        job->info.failedFiles++;
+        if (job->info.errorMessage.empty()) {
+            job->info.errorMessage = error;
+        }
+    }
+
+    if (job->info.totalBytes > 0) {
+        job->info.progress = static_cast<double>(job->info.downloadedBytes) /
+                             static_cast<double>(job->info.totalBytes);
+    }
+
+    finishIfDone(*job);
+}
+
+void InstallManager::finishIfDone(InstallJob& job) {
+    if (!job.pending.empty() || isTerminalState(job.info.state)) {
+        return;
+    }
+
+    if (job.cancelled) {
+        // A cancelled planner may still be walking the manifest; it stops at the next file
+        job.info.state = "cancelled";
+        return;
+    }
+
+    if (!job.planned) {
+        return;
+    }
+
+    if (job.info.failedFiles > 0) {
+        job.info.state = "failed";
+    } else {
+        job.info.state = "completed";
+        job.info.progress = 1.0;
+    }
+}
+
+std::string InstallManager::localPath(const InstallJob& job, const ResourceEntry& entry) {
+    std::string relative = entry.dest;
+    while (!relative.empty() && (relative.front() == '/' || relative.front() == '\\')) {
+        relative.erase(relative.begin());
+    }
+
+    return (std::filesystem::path(job.info.installDir) / relative).string();
+}
+
+} // namespace launcher
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "downloadmanager.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+#include <chrono>
+
+namespace launcher {
+
+// One file entry of a resource manifest ({"resource": [{dest, size, md5, chunks}]})
+struct ResourceEntry {
+    std::string dest;
+    uint64_t size = 0;
+    std::string md5;
+    // Optional ChunkManifest of this version, relative to the base URL; lets a patch fetch
+    // only the blocks that changed since the version on disk
+    std::string chunks;
+};
+
+// Aggregate state of an install job, reported instead of per-file downloads
+struct InstallInfo {
+    int installId = 0;
+    std::string installDir;
+    std::string mode;           // install or verify
+    std::string state;          // checking, downloading, completed, failed, cancelled
+    DownloadPriority priority = DownloadPriority::Foreground;
+    size_t totalFiles = 0;      // files listed in the manifest
+    size_t checkedFiles = 0;    // files compared against the disk so far
+    uint64_t checkedBytes = 0;  // bytes hashed while checking
+    double checkBytesPerSecond = 0.0;
+    size_t queuedFiles = 0;     // files that were missing or changed on disk
+    size_t completedFiles = 0;
+    size_t failedFiles = 0;
+    uint64_t totalBytes = 0;    // bytes of the queued files
+    uint64_t downloadedBytes = 0;
+    uint64_t reusedBytes = 0;   // part of downloadedBytes taken from old files by delta updates
+    double progress = 0.0;
+    std::string errorMessage;
+};
+
+class InstallManager {
+public:
+    explicit InstallManager(DownloadManager& downloadManager);
+    ~InstallManager();
+
+    // Parse a resource manifest, throws std::runtime_error on malformed input
+    static std::vector<ResourceEntry> parseManifest(const std::string& json);
+
+    // Bring installDir in line with the manifest, fetching files from baseUrl + dest.
+    // mirrorBaseUrls are other CDNs with the same layout; each file may come from any of them.
+    int startInstall(const std::string& baseUrl, const std::vector<ResourceEntry>& resources,
+                     const std::string& installDir,
+                     DownloadPriority priority = DownloadPriority::Foreground,
+                     const std::vector<std::string>& mirrorBaseUrls = {});
+
+    // Hash every installed file against the manifest and re-download the damaged ones
+    int startVerify(const std::string& baseUrl, const std::vector<ResourceEntry>& resources,
+                    const std::string& installDir,
+                    DownloadPriority priority = DownloadPriority::Foreground,
+                    const std::vector<std::string>& mirrorBaseUrls = {});
+
+    // Cancel an install job and all of its pending downloads
+    bool cancelInstall(int installId);
+
+    // Move the job and its pending downloads to another class, e.g. when the player
+    // wants a background update now
+    bool setInstallPriority(int installId, DownloadPriority priority);
+
+    // Get install info by ID
+    InstallInfo getInstallInfo(int installId) const;
+
+    // Get all install jobs
+    std::vector<InstallInfo> getAllInstalls() const;
+
+private:
+    struct InstallJob {
+        InstallInfo info;
+        std::string baseUrl;
+        std::vector<std::string> mirrorBaseUrls;
+        std::vector<ResourceEntry> resources;
+        DownloadManager* downloadManager = nullptr;
+
+        // downloadId -> resource index for files still in flight
+        std::map<int, size_t> pending;
+        std::map<int, uint64_t> inflightBytes;
+        std::map<size_t, int> attempts;
+        bool planned = false;
+
+        std::atomic<bool> cancelled{false};
+        std::thread planner;
+        std::chrono::steady_clock::time_point checkStarted;
+        mutable std::mutex mutex;
+    };
+
+    int startJob(const std::string& mode, const std::string& baseUrl,
+                 const std::vector<ResourceEntry>& resources, const std::string& installDir,
+                 DownloadPriority priority, const std::vector<std::string>& mirrorBaseUrls);
+
+    // Job callbacks run on download workers and must not touch the InstallManager itself
+    static void planInstall(std::shared_ptr<InstallJob> job);
+    static void checkFiles(std::shared_ptr<InstallJob> job, const std::vector<size_t>& order,
+                           std::atomic<size_t>& next);
+    static bool sizeMatches(const InstallJob& job, const ResourceEntry& entry);
+    // Rebuild what it can of a changed file from the version on disk using its chunk manifest.
+    // True if that worked: ranges is what is left to fetch, empty if the file came out complete.
+    // Otherwise the old file is removed and the whole file has to be fetched.
+    static bool prepareDelta(const InstallJob& job, const ResourceEntry& entry,
+                             std::vector<DownloadJournal::Range>& ranges, uint64_t& reusedBytes);
+    // Called with the job lock held
+    static void scheduleFile(std::shared_ptr<InstallJob> job, size_t index,
+                             const std::vector<DownloadJournal::Range>& deltaRanges = {});
+    static void onFileFinished(std::shared_ptr<InstallJob> job, const DownloadInfo& download);
+    static void finishIfDone(InstallJob& job);
+    static std::string localPath(const InstallJob& job, const ResourceEntry& entry);
+
+    DownloadManager& m_downloadManager;
+    std::atomic<int> m_nextInstallId;
+
+    mutable std::mutex m_jobsMutex;
+    std::map<int, std::shared_ptr<InstallJob>> m_jobs;
+};
+
+} // namespace launcher
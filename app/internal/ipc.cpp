@@ -3,13 +3,18 @@
 #include <sstream>
 #include <chrono>
 #include <ctime>
+#include <fstream>
+#include <algorithm>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
 
 namespace SimpleIPC {
     
-    IPCHandler::IPCHandler() {
+    IPCHandler::IPCHandler()
+        : downloadManager_(8, 6, launcher::DownloadManager::defaultJournalPath()),
+          installManager_(downloadManager_),
+          downloadEvents_(downloadManager_) {
         // Register default handlers
         RegisterHandler("ping", HandlePing);
         RegisterHandler("getSystemInfo", HandleGetSystemInfo);
@@ -24,12 +29,34 @@ namespace SimpleIPC {
         // Register DownloadManager handlers
         RegisterHandler("startDownload", HandleStartDownload);
         RegisterHandler("cancelDownload", HandleCancelDownload);
+        RegisterHandler("pauseDownload", HandlePauseDownload);
+        RegisterHandler("resumeDownload", HandleResumeDownload);
+        RegisterHandler("setDownloadPriority", HandleSetDownloadPriority);
         RegisterHandler("getDownloadInfo", HandleGetDownloadInfo);
         RegisterHandler("getAllDownloads", HandleGetAllDownloads);
+        RegisterHandler("setDownloadLimits", HandleSetDownloadLimits);
+        RegisterHandler("setDownloadRateLimit", HandleSetDownloadRateLimit);
+        RegisterHandler("getDownloadStats", HandleGetDownloadStats);
+        
+        // Register InstallManager handlers
+        RegisterHandler("startInstall", HandleStartInstall);
+        RegisterHandler("verifyInstall", HandleVerifyInstall);
+        RegisterHandler("cancelInstall", HandleCancelInstall);
+        RegisterHandler("setInstallPriority", HandleSetInstallPriority);
+        RegisterHandler("getInstallInfo", HandleGetInstallInfo);
         
         // Register system dialog handlers
         RegisterHandler("showFolderDialog", HandleShowFolderDialog);
         RegisterHandler("getDriveLetters", HandleGetDriveLetters);
+        
+        // Let the download policy react to games started from the launcher
+        launcher::GameManager::getInstance().setRunningChangedCallback([this](bool running) {
+            downloadManager_.setGameRunning(running);
+        });
+    }
+    
+    IPCHandler::~IPCHandler() {
+        launcher::GameManager::getInstance().setRunningChangedCallback(nullptr);
     }
     
     std::string IPCHandler::HandleCall(const std::string& method, const std::string& message) {
@@ -49,6 +76,31 @@ namespace SimpleIPC {
         handlers_[method] = handler;
     }
     
+    int IPCHandler::Subscribe(const std::string& topic, const std::string& message, EventSink sink) {
+        if (topic != "downloads") {
+            return 0;
+        }
+        
+        // {"intervalMs": n} bounds how often changes are pushed
+        int intervalMs = 250;
+        if (!message.empty()) {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            if (json.HasParseError() || !json.IsObject()) {
+                return 0;
+            }
+            if (json.HasMember("intervalMs") && json["intervalMs"].IsInt()) {
+                intervalMs = std::min(std::max(json["intervalMs"].GetInt(), 16), 5000);
+            }
+        }
+        
+        return downloadEvents_.subscribe(sink, std::chrono::milliseconds(intervalMs));
+    }
+    
+    void IPCHandler::Unsubscribe(int subscriptionId) {
+        downloadEvents_.unsubscribe(subscriptionId);
+    }
+    
     IPCHandler& IPCHandler::GetInstance() {
         static IPCHandler instance;
         return instance;
@@ -77,6 +129,24 @@ namespace SimpleIPC {
                             reject(new Error('CEF Query not available'));
                         }
                     });
+                },
+                subscribe: function(topic, message, onEvent, onError) {
+                    // Persistent query: the browser process keeps answering it until cancelled
+                    if (!window.cefQuery) {
+                        if (onError) onError(new Error('CEF Query not available'));
+                        return function() {};
+                    }
+                    var queryId = window.cefQuery({
+                        request: 'ipc_subscribe:' + topic + ':' + (message || ''),
+                        persistent: true,
+                        onSuccess: onEvent,
+                        onFailure: function(error_code, error_message) {
+                            if (onError) onError(new Error(error_message));
+                        }
+                    });
+                    return function() {
+                        window.cefQueryCancel(queryId);
+                    };
                 }
             };
         )";
@@ -135,6 +205,38 @@ namespace SimpleIPC {
         }
     }
     
+    // "priority" is foreground (the default), background or predownload
+    static launcher::DownloadPriority ReadPriority(const rapidjson::Value& json) {
+        launcher::DownloadPriority priority = launcher::DownloadPriority::Foreground;
+        if (json.HasMember("priority")) {
+            if (!json["priority"].IsString()) {
+                throw std::runtime_error("priority must be a string");
+            }
+            std::string name = json["priority"].GetString();
+            if (!launcher::parsePriority(name, priority)) {
+                throw std::runtime_error("Unknown priority: " + name);
+            }
+        }
+        return priority;
+    }
+    
+    // "mirrors" lists other URLs (or base URLs, for install jobs) serving the same files
+    static std::vector<std::string> ReadMirrors(const rapidjson::Value& json) {
+        std::vector<std::string> mirrors;
+        if (json.HasMember("mirrors")) {
+            if (!json["mirrors"].IsArray()) {
+                throw std::runtime_error("mirrors must be an array of URLs");
+            }
+            for (const auto& mirror : json["mirrors"].GetArray()) {
+                if (!mirror.IsString()) {
+                    throw std::runtime_error("mirrors must be an array of URLs");
+                }
+                mirrors.push_back(mirror.GetString());
+            }
+        }
+        return mirrors;
+    }
+    
     std::string HandleStartDownload(const std::string& message) {
         try {
             rapidjson::Document json;
@@ -157,8 +259,33 @@ namespace SimpleIPC {
             std::string destination = json["destination"].GetString();
             std::string filename = json.HasMember("filename") ? json["filename"].GetString() : "";
             
+            launcher::DownloadOptions options;
+            if (json.HasMember("segments")) {
+                options.segments = json["segments"].GetInt();
+            }
+            if (json.HasMember("md5")) {
+                options.expectedMd5 = json["md5"].GetString();
+            }
+            if (json.HasMember("size")) {
+                options.expectedSize = json["size"].GetUint64();
+            }
+            if (json.HasMember("unbufferedIo")) {
+                options.unbufferedIo = json["unbufferedIo"].GetBool();
+            }
+            if (json.HasMember("acceptEncoding")) {
+                options.acceptEncoding = json["acceptEncoding"].GetBool();
+            }
+            if (json.HasMember("decompress")) {
+                options.decompress = json["decompress"].GetBool();
+            }
+            if (json.HasMember("maxBytesPerSecond")) {
+                options.maxBytesPerSecond = json["maxBytesPerSecond"].GetUint64();
+            }
+            options.priority = ReadPriority(json);
+            options.mirrors = ReadMirrors(json);
+            
             auto& handler = IPCHandler::GetInstance();
-            int downloadId = handler.getDownloadManager()->startDownload(url, destination, filename);
+            int downloadId = handler.getDownloadManager()->startDownload(url, destination, filename, options);
             
             rapidjson::Document response;
             response.SetObject();
@@ -230,6 +357,154 @@ namespace SimpleIPC {
         }
     }
     
+    std::string HandlePauseDownload(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.HasMember("downloadId")) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing downloadId", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int downloadId = json["downloadId"].GetInt();
+            
+            auto& handler = IPCHandler::GetInstance();
+            bool success = handler.getDownloadManager()->pauseDownload(downloadId);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", success, allocator);
+            if (!success) {
+                response.AddMember("error", "Download not found, finished or already paused", allocator);
+            }
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleResumeDownload(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.HasMember("downloadId")) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing downloadId", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int downloadId = json["downloadId"].GetInt();
+            
+            auto& handler = IPCHandler::GetInstance();
+            bool success = handler.getDownloadManager()->resumeDownload(downloadId);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", success, allocator);
+            if (!success) {
+                response.AddMember("error", "Download not found or not paused", allocator);
+            }
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleSetDownloadPriority(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.HasMember("downloadId") || !json.HasMember("priority")) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing downloadId/priority", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int downloadId = json["downloadId"].GetInt();
+            launcher::DownloadPriority priority = ReadPriority(json);
+            
+            auto& handler = IPCHandler::GetInstance();
+            bool success = handler.getDownloadManager()->setDownloadPriority(downloadId, priority);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", success, allocator);
+            if (!success) {
+                response.AddMember("error", "Download not found or already finished", allocator);
+            }
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
     std::string HandleGetDownloadInfo(const std::string& message) {
         try {
             rapidjson::Document json;
@@ -265,10 +540,15 @@ namespace SimpleIPC {
             downloadInfo.AddMember("totalSize", info.totalSize, allocator);
             downloadInfo.AddMember("downloadedSize", info.downloadedSize, allocator);
             downloadInfo.AddMember("progress", info.progress, allocator);
+            downloadInfo.AddMember("speed", info.speed, allocator);
+            downloadInfo.AddMember("averageSpeed", info.averageSpeed, allocator);
             downloadInfo.AddMember("isCompleted", info.isCompleted, allocator);
             downloadInfo.AddMember("isFailed", info.isFailed, allocator);
             downloadInfo.AddMember("errorMessage", rapidjson::Value(info.errorMessage.c_str(), allocator), allocator);
             downloadInfo.AddMember("downloadId", info.downloadId, allocator);
+            downloadInfo.AddMember("priority", rapidjson::Value(launcher::priorityName(info.priority), allocator), allocator);
+            downloadInfo.AddMember("isPaused", info.isPaused, allocator);
+            downloadInfo.AddMember("reusedSize", info.reusedSize, allocator);
             
             response.AddMember("downloadInfo", downloadInfo, allocator);
             
@@ -310,10 +590,15 @@ namespace SimpleIPC {
                 downloadJson.AddMember("totalSize", info.totalSize, allocator);
                 downloadJson.AddMember("downloadedSize", info.downloadedSize, allocator);
                 downloadJson.AddMember("progress", info.progress, allocator);
+                downloadJson.AddMember("speed", info.speed, allocator);
+                downloadJson.AddMember("averageSpeed", info.averageSpeed, allocator);
                 downloadJson.AddMember("isCompleted", info.isCompleted, allocator);
                 downloadJson.AddMember("isFailed", info.isFailed, allocator);
                 downloadJson.AddMember("errorMessage", rapidjson::Value(info.errorMessage.c_str(), allocator), allocator);
                 downloadJson.AddMember("downloadId", info.downloadId, allocator);
+                downloadJson.AddMember("priority", rapidjson::Value(launcher::priorityName(info.priority), allocator), allocator);
+                downloadJson.AddMember("isPaused", info.isPaused, allocator);
+                downloadJson.AddMember("reusedSize", info.reusedSize, allocator);
                 
                 downloadsArray.PushBack(downloadJson, allocator);
             }
@@ -338,6 +623,561 @@ namespace SimpleIPC {
         }
     }
     
+    std::string HandleSetDownloadLimits(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError()) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            auto& handler = IPCHandler::GetInstance();
+            auto* downloadManager = handler.getDownloadManager();
+            
+            size_t maxConcurrent = json.HasMember("maxConcurrent")
+                ? json["maxConcurrent"].GetUint() : downloadManager->getMaxConcurrent();
+            size_t maxPerHost = json.HasMember("maxPerHost")
+                ? json["maxPerHost"].GetUint() : downloadManager->getMaxPerHost();
+            
+            downloadManager->setConcurrencyLimits(maxConcurrent, maxPerHost);
+            
+            if (json.HasMember("maxBytesPerSecond")) {
+                downloadManager->setGlobalRateLimit(json["maxBytesPerSecond"].GetUint64());
+            }
+            
+            if (json.HasMember("historyLimit")) {
+                downloadManager->setHistoryLimit(json["historyLimit"].GetUint());
+            }
+            
+            if (json.HasMember("storeBytes")) {
+                downloadManager->setContentStoreBudget(json["storeBytes"].GetUint64());
+            }
+            
+            if (json.HasMember("gamePolicy")) {
+                std::string policyName = json["gamePolicy"].GetString();
+                launcher::DownloadManager::GamePolicy policy = launcher::DownloadManager::GamePolicy::None;
+                if (policyName == "pause") {
+                    policy = launcher::DownloadManager::GamePolicy::Pause;
+                } else if (policyName == "throttle") {
+                    policy = launcher::DownloadManager::GamePolicy::Throttle;
+                } else if (policyName != "none") {
+                    throw std::runtime_error("Unknown game policy: " + policyName);
+                }
+                
+                uint64_t gameBytesPerSecond = json.HasMember("gameBytesPerSecond")
+                    ? json["gameBytesPerSecond"].GetUint64() : downloadManager->getGameThrottleRate();
+                downloadManager->setGamePolicy(policy, gameBytesPerSecond);
+            }
+            
+            const char* policyNames[] = {"none", "pause", "throttle"};
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", true, allocator);
+            response.AddMember("maxConcurrent", downloadManager->getMaxConcurrent(), allocator);
+            response.AddMember("maxPerHost", downloadManager->getMaxPerHost(), allocator);
+            response.AddMember("maxBytesPerSecond", downloadManager->getGlobalRateLimit(), allocator);
+            response.AddMember("gamePolicy",
+                rapidjson::Value(policyNames[static_cast<int>(downloadManager->getGamePolicy())], allocator), allocator);
+            response.AddMember("gameBytesPerSecond", downloadManager->getGameThrottleRate(), allocator);
+            response.AddMember("historyLimit", downloadManager->getHistoryLimit(), allocator);
+            response.AddMember("storeBytes", downloadManager->getContentStoreBudget(), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleSetDownloadRateLimit(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.HasMember("downloadId") || !json.HasMember("maxBytesPerSecond")) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing downloadId/maxBytesPerSecond", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int downloadId = json["downloadId"].GetInt();
+            uint64_t maxBytesPerSecond = json["maxBytesPerSecond"].GetUint64();
+            
+            auto& handler = IPCHandler::GetInstance();
+            bool success = handler.getDownloadManager()->setDownloadRateLimit(downloadId, maxBytesPerSecond);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", success, allocator);
+            if (!success) {
+                response.AddMember("error", "Download not found or already finished", allocator);
+            }
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleGetDownloadStats(const std::string& message) {
+        try {
+            auto& handler = IPCHandler::GetInstance();
+            auto connections = handler.getDownloadManager()->getConnectionStats();
+            auto hosts = handler.getDownloadManager()->getHostStats();
+            auto mirrors = handler.getDownloadManager()->getMirrorStats();
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", true, allocator);
+            
+            rapidjson::Value connectionsJson(rapidjson::kObjectType);
+            connectionsJson.AddMember("leases", connections.leases, allocator);
+            connectionsJson.AddMember("reused", connections.reused, allocator);
+            connectionsJson.AddMember("idle", static_cast<uint64_t>(connections.idle), allocator);
+            connectionsJson.AddMember("reuseRatio", connections.reuseRatio, allocator);
+            connectionsJson.AddMember("newConnectionLatencyMs", connections.newConnectionLatencyMs, allocator);
+            connectionsJson.AddMember("reusedConnectionLatencyMs", connections.reusedConnectionLatencyMs, allocator);
+            response.AddMember("connections", connectionsJson, allocator);
+            
+            rapidjson::Value hostsArray(rapidjson::kArrayType);
+            for (const auto& host : hosts) {
+                rapidjson::Value hostJson(rapidjson::kObjectType);
+                hostJson.AddMember("host", rapidjson::Value(host.host.c_str(), allocator), allocator);
+                hostJson.AddMember("limit", static_cast<uint64_t>(host.limit), allocator);
+                hostJson.AddMember("inUse", static_cast<uint64_t>(host.inUse), allocator);
+                hostJson.AddMember("bytesPerSecond", host.bytesPerSecond, allocator);
+                hostJson.AddMember("latencyMs", host.latencyMs, allocator);
+                hostJson.AddMember("baseLatencyMs", host.baseLatencyMs, allocator);
+                hostJson.AddMember("increases", host.increases, allocator);
+                hostJson.AddMember("decreases", host.decreases, allocator);
+                hostsArray.PushBack(hostJson, allocator);
+            }
+            response.AddMember("hosts", hostsArray, allocator);
+            
+            rapidjson::Value mirrorsArray(rapidjson::kArrayType);
+            for (const auto& mirror : mirrors) {
+                rapidjson::Value mirrorJson(rapidjson::kObjectType);
+                mirrorJson.AddMember("host", rapidjson::Value(mirror.host.c_str(), allocator), allocator);
+                mirrorJson.AddMember("bytesPerSecond", mirror.bytesPerSecond, allocator);
+                mirrorJson.AddMember("samples", mirror.samples, allocator);
+                mirrorJson.AddMember("failures", mirror.failures, allocator);
+                mirrorJson.AddMember("benched", mirror.benched, allocator);
+                mirrorsArray.PushBack(mirrorJson, allocator);
+            }
+            response.AddMember("mirrors", mirrorsArray, allocator);
+            
+            auto store = handler.getDownloadManager()->getContentStoreStats();
+            rapidjson::Value storeJson(rapidjson::kObjectType);
+            storeJson.AddMember("objects", static_cast<uint64_t>(store.objects), allocator);
+            storeJson.AddMember("bytes", store.bytes, allocator);
+            storeJson.AddMember("budget", store.budget, allocator);
+            storeJson.AddMember("hits", store.hits, allocator);
+            storeJson.AddMember("savedBytes", store.savedBytes, allocator);
+            response.AddMember("store", storeJson, allocator);
+            
+            rapidjson::Value volumesArray(rapidjson::kArrayType);
+            for (const auto& volume : handler.getDownloadManager()->getVolumeStats()) {
+                rapidjson::Value volumeJson(rapidjson::kObjectType);
+                volumeJson.AddMember("volume", rapidjson::Value(volume.volume.c_str(), allocator), allocator);
+                volumeJson.AddMember("capacity", volume.capacity, allocator);
+                volumeJson.AddMember("available", volume.available, allocator);
+                volumeJson.AddMember("reserved", volume.reserved, allocator);
+                volumeJson.AddMember("reservations", static_cast<uint64_t>(volume.reservations), allocator);
+                volumesArray.PushBack(volumeJson, allocator);
+            }
+            response.AddMember("volumes", volumesArray, allocator);
+            
+            auto disk = handler.getDownloadManager()->getDiskWriterStats();
+            rapidjson::Value diskJson(rapidjson::kObjectType);
+            diskJson.AddMember("backend", rapidjson::Value(disk.backend, allocator), allocator);
+            diskJson.AddMember("queueDepth", static_cast<uint64_t>(disk.queueDepth), allocator);
+            diskJson.AddMember("peakQueueDepth", static_cast<uint64_t>(disk.peakQueueDepth), allocator);
+            diskJson.AddMember("writes", disk.writes, allocator);
+            diskJson.AddMember("bytes", disk.bytes, allocator);
+            diskJson.AddMember("averageLatencyMs", disk.averageLatencyMs, allocator);
+            diskJson.AddMember("maxLatencyMs", disk.maxLatencyMs, allocator);
+            diskJson.AddMember("buffers", static_cast<uint64_t>(disk.buffers), allocator);
+            diskJson.AddMember("idleBuffers", static_cast<uint64_t>(disk.idleBuffers), allocator);
+            response.AddMember("disk", diskJson, allocator);
+            
+            auto engine = handler.getDownloadManager()->getEngineStats();
+            rapidjson::Value engineJson(rapidjson::kObjectType);
+            engineJson.AddMember("bytes", engine.bytes, allocator);
+            engineJson.AddMember("busySeconds", engine.busySeconds, allocator);
+            engineJson.AddMember("bytesPerSecond", engine.bytesPerSecond, allocator);
+            engineJson.AddMember("responses", engine.responses, allocator);
+            engineJson.AddMember("firstByteP50Ms", engine.firstByteP50Ms, allocator);
+            engineJson.AddMember("firstByteP99Ms", engine.firstByteP99Ms, allocator);
+            engineJson.AddMember("cpuSeconds", engine.cpuSeconds, allocator);
+            engineJson.AddMember("cpuSecondsPerGiB", engine.cpuSecondsPerGiB, allocator);
+            response.AddMember("engine", engineJson, allocator);
+            
+            // {"reset": true} starts a new measurement window once this one is reported
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            if (!json.HasParseError() && json.IsObject() && json.HasMember("reset") &&
+                json["reset"].IsBool() && json["reset"].GetBool()) {
+                handler.getDownloadManager()->resetEngineStats();
+            }
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    // The manifest is passed inline or as a path to a local copy
+    static std::vector<launcher::ResourceEntry> LoadManifest(const rapidjson::Value& json) {
+        std::string manifest;
+        if (json.HasMember("manifest")) {
+            if (!json["manifest"].IsString()) {
+                throw std::runtime_error("manifest must be a string");
+            }
+            manifest = json["manifest"].GetString();
+        } else if (json.HasMember("manifestPath")) {
+            if (!json["manifestPath"].IsString()) {
+                throw std::runtime_error("manifestPath must be a string");
+            }
+            std::ifstream file(json["manifestPath"].GetString(), std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open manifest file");
+            }
+            std::stringstream contents;
+            contents << file.rdbuf();
+            manifest = contents.str();
+        } else {
+            throw std::runtime_error("Missing manifest");
+        }
+        
+        return launcher::InstallManager::parseManifest(manifest);
+    }
+    
+    std::string HandleStartInstall(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.IsObject() ||
+                !json.HasMember("baseUrl") || !json["baseUrl"].IsString() ||
+                !json.HasMember("installDir") || !json["installDir"].IsString()) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing baseUrl/installDir", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            std::string baseUrl = json["baseUrl"].GetString();
+            std::string installDir = json["installDir"].GetString();
+            auto resources = LoadManifest(json);
+            
+            auto& handler = IPCHandler::GetInstance();
+            int installId = handler.getInstallManager()->startInstall(baseUrl, resources, installDir,
+                                                                      ReadPriority(json), ReadMirrors(json));
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", true, allocator);
+            response.AddMember("installId", installId, allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleVerifyInstall(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.IsObject() ||
+                !json.HasMember("baseUrl") || !json["baseUrl"].IsString() ||
+                !json.HasMember("installDir") || !json["installDir"].IsString()) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing baseUrl/installDir", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            std::string baseUrl = json["baseUrl"].GetString();
+            std::string installDir = json["installDir"].GetString();
+            auto resources = LoadManifest(json);
+            
+            auto& handler = IPCHandler::GetInstance();
+            int installId = handler.getInstallManager()->startVerify(baseUrl, resources, installDir,
+                                                                     ReadPriority(json), ReadMirrors(json));
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", true, allocator);
+            response.AddMember("installId", installId, allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleCancelInstall(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.IsObject() ||
+                !json.HasMember("installId") || !json["installId"].IsInt()) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing installId", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int installId = json["installId"].GetInt();
+            
+            auto& handler = IPCHandler::GetInstance();
+            bool success = handler.getInstallManager()->cancelInstall(installId);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", success, allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleSetInstallPriority(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.IsObject() || !json.HasMember("installId") ||
+                !json["installId"].IsInt() || !json.HasMember("priority")) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing installId/priority", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int installId = json["installId"].GetInt();
+            launcher::DownloadPriority priority = ReadPriority(json);
+            
+            auto& handler = IPCHandler::GetInstance();
+            bool success = handler.getInstallManager()->setInstallPriority(installId, priority);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", success, allocator);
+            if (!success) {
+                response.AddMember("error", "Install not found or already finished", allocator);
+            }
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
+    std::string HandleGetInstallInfo(const std::string& message) {
+        try {
+            rapidjson::Document json;
+            json.Parse(message.c_str());
+            
+            if (json.HasParseError() || !json.IsObject() ||
+                !json.HasMember("installId") || !json["installId"].IsInt()) {
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("success", false, allocator);
+                response.AddMember("error", "Invalid JSON or missing installId", allocator);
+                
+                rapidjson::StringBuffer buffer;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                response.Accept(writer);
+                return buffer.GetString();
+            }
+            
+            int installId = json["installId"].GetInt();
+            
+            auto& handler = IPCHandler::GetInstance();
+            auto info = handler.getInstallManager()->getInstallInfo(installId);
+            
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", true, allocator);
+            
+            rapidjson::Value installInfo(rapidjson::kObjectType);
+            installInfo.AddMember("installId", info.installId, allocator);
+            installInfo.AddMember("installDir", rapidjson::Value(info.installDir.c_str(), allocator), allocator);
+            installInfo.AddMember("mode", rapidjson::Value(info.mode.c_str(), allocator), allocator);
+            installInfo.AddMember("state", rapidjson::Value(info.state.c_str(), allocator), allocator);
+            installInfo.AddMember("priority", rapidjson::Value(launcher::priorityName(info.priority), allocator), allocator);
+            installInfo.AddMember("totalFiles", info.totalFiles, allocator);
+            installInfo.AddMember("checkedFiles", info.checkedFiles, allocator);
+            installInfo.AddMember("checkedBytes", info.checkedBytes, allocator);
+            installInfo.AddMember("checkBytesPerSecond", info.checkBytesPerSecond, allocator);
+            installInfo.AddMember("queuedFiles", info.queuedFiles, allocator);
+            installInfo.AddMember("completedFiles", info.completedFiles, allocator);
+            installInfo.AddMember("failedFiles", info.failedFiles, allocator);
+            installInfo.AddMember("totalBytes", info.totalBytes, allocator);
+            installInfo.AddMember("downloadedBytes", info.downloadedBytes, allocator);
+            installInfo.AddMember("reusedBytes", info.reusedBytes, allocator);
+            installInfo.AddMember("progress", info.progress, allocator);
+            installInfo.AddMember("errorMessage", rapidjson::Value(info.errorMessage.c_str(), allocator), allocator);
+            
+            response.AddMember("installInfo", installInfo, allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        } catch (const std::exception& e) {
+            rapidjson::Document response;
+            response.SetObject();
+            auto& allocator = response.GetAllocator();
+            response.AddMember("success", false, allocator);
+            response.AddMember("error", rapidjson::Value(e.what(), allocator), allocator);
+            
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            response.Accept(writer);
+            return buffer.GetString();
+        }
+    }
+    
     std::string HandleLaunchGame(const std::string& message) {
         try {
             auto& handler = IPCHandler::GetInstance();
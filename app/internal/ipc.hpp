@@ -4,6 +4,8 @@
 #include "include/cef_frame.h"
 #include "gamemanager.hpp"
 #include "downloadmanager.hpp"
+#include "installmanager.hpp"
+#include "downloadevents.hpp"
 #include "fs.hpp"
 #include <string>
 #include <functional>
@@ -14,10 +16,14 @@ namespace SimpleIPC {
     // Message handler callback type
     using MessageHandler = std::function<std::string(const std::string&)>;
     
+    // Receives each message pushed to a subscription
+    using EventSink = std::function<void(const std::string&)>;
+    
     // IPC Handler class for ExecuteJavaScript-based communication
     class IPCHandler {
     public:
         IPCHandler();
+        ~IPCHandler();
         
         // Handle IPC call
         std::string HandleCall(const std::string& method, const std::string& message);
@@ -25,6 +31,10 @@ namespace SimpleIPC {
         // Register a message handler
         void RegisterHandler(const std::string& method, MessageHandler handler);
         
+        // Start pushing events of a topic to sink; returns 0 for an unknown topic or bad message
+        int Subscribe(const std::string& topic, const std::string& message, EventSink sink);
+        void Unsubscribe(int subscriptionId);
+        
         // Get singleton instance
         static IPCHandler& GetInstance();
         
@@ -34,9 +44,14 @@ namespace SimpleIPC {
         // Public access to DownloadManager
         launcher::DownloadManager* getDownloadManager() { return &downloadManager_; }
         
+        // Public access to InstallManager
+        launcher::InstallManager* getInstallManager() { return &installManager_; }
+        
     private:
         std::map<std::string, MessageHandler> handlers_;
         launcher::DownloadManager downloadManager_;
+        launcher::InstallManager installManager_;
+        launcher::DownloadEvents downloadEvents_;
     };
     
     // Initialize IPC system with ExecuteJavaScript
@@ -56,8 +71,21 @@ namespace SimpleIPC {
     // DownloadManager IPC methods
     std::string HandleStartDownload(const std::string& message);
     std::string HandleCancelDownload(const std::string& message);
+    std::string HandlePauseDownload(const std::string& message);
+    std::string HandleResumeDownload(const std::string& message);
+    std::string HandleSetDownloadPriority(const std::string& message);
     std::string HandleGetDownloadInfo(const std::string& message);
     std::string HandleGetAllDownloads(const std::string& message);
+    std::string HandleSetDownloadLimits(const std::string& message);
+    std::string HandleSetDownloadRateLimit(const std::string& message);
+    std::string HandleGetDownloadStats(const std::string& message);
+    
+    // InstallManager IPC methods
+    std::string HandleStartInstall(const std::string& message);
+    std::string HandleVerifyInstall(const std::string& message);
+    std::string HandleCancelInstall(const std::string& message);
+    std::string HandleSetInstallPriority(const std::string& message);
+    std::string HandleGetInstallInfo(const std::string& message);
     
     // System dialog methods
     std::string HandleShowFolderDialog(const std::string& message);
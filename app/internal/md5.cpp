@@ -0,0 +1,297 @@
+#include "md5.hpp"
+#include "md5lanes.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace launcher {
+
+namespace {
+
+const uint32_t kSines[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int kShifts[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+inline uint32_t rotateLeft(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+} // namespace
+
+Md5::Md5() {
+    reset();
+}
+
+void Md5::reset() {
+    m_state[0] = 0x67452301;
+    m_state[1] = 0xefcdab89;
+    m_state[2] = 0x98badcfe;
+    m_state[3] = 0x10325476;
+    m_length = 0;
+}
+
+void Md5::update(const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t buffered = static_cast<size_t>(m_length % 64);
+    m_length += length;
+
+    // Top up a partially filled block first
+    if (buffered > 0) {
+        size_t take = std::min(length, 64 - buffered);
+        std::memcpy(m_buffer + buffered, bytes, take);
+        bytes += take;
+        length -= take;
+        buffered += take;
+
+        if (buffered < 64) {
+            return;
+        }
+        transform(m_state, m_buffer, 1);
+    }
+
+    size_t blocks = length / 64;
+    if (blocks > 0) {
+        transform(m_state, bytes, blocks);
+        bytes += blocks * 64;
+        length -= blocks * 64;
+    }
+
+    if (length > 0) {
+        std::memcpy(m_buffer, bytes, length);
+    }
+}
+
+std::string Md5::hexDigest() {
+    uint64_t bitLength = m_length * 8;
+
+    uint8_t padding[72] = {0x80};
+    size_t buffered = static_cast<size_t>(m_length % 64);
+    size_t padLength = (buffered < 56) ? (56 - buffered) : (120 - buffered);
+    update(padding, padLength);
+
+    uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; ++i) {
+        lengthBytes[i] = static_cast<uint8_t>(bitLength >> (8 * i));
+    }
+    update(lengthBytes, 8);
+
+    static const char hex[] = "0123456789abcdef";
+    std::string digest;
+    digest.reserve(32);
+    for (uint32_t word : m_state) {
+        for (int i = 0; i < 4; ++i) {
+            uint8_t byte = static_cast<uint8_t>(word >> (8 * i));
+            digest += hex[byte >> 4];
+            digest += hex[byte & 0x0f];
+        }
+    }
+
+    reset();
+    return digest;
+}
+
+std::string Md5::saveState() const {
+    // <state words>:<length>:<buffered tail>, all hex except the length
+    static const char hex[] = "0123456789abcdef";
+    std::string state;
+    for (uint32_t word : m_state) {
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            state += hex[(word >> shift) & 0x0f];
+        }
+    }
+
+    state += ":" + std::to_string(m_length) + ":";
+    size_t buffered = static_cast<size_t>(m_length % 64);
+    for (size_t i = 0; i < buffered; ++i) {
+        state += hex[m_buffer[i] >> 4];
+        state += hex[m_buffer[i] & 0x0f];
+    }
+
+    return state;
+}
+
+bool Md5::restoreState(const std::string& state) {
+    size_t first = state.find(':');
+    size_t second = (first == std::string::npos) ? first : state.find(':', first + 1);
+    if (first != 32 || second == std::string::npos) {
+        return false;
+    }
+
+    try {
+        uint64_t length = std::stoull(state.substr(first + 1, second - first - 1));
+        std::string tail = state.substr(second + 1);
+        if (tail.size() != 2 * (length % 64)) {
+            return false;
+        }
+
+        for (int i = 0; i < 4; ++i) {
+            m_state[i] = static_cast<uint32_t>(std::stoul(state.substr(i * 8, 8), nullptr, 16));
+        }
+        for (size_t i = 0; i < tail.size() / 2; ++i) {
+            m_buffer[i] = static_cast<uint8_t>(std::stoul(tail.substr(i * 2, 2), nullptr, 16));
+        }
+        m_length = length;
+    } catch (const std::exception&) {
+        reset();
+        return false;
+    }
+
+    return true;
+}
+
+std::string Md5::hashFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return "";
+    }
+
+    Md5 md5;
+    std::vector<char> buffer(1024 * 1024);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        std::streamsize count = file.gcount();
+        if (count <= 0) {
+            break;
+        }
+        md5.update(buffer.data(), static_cast<size_t>(count));
+    }
+
+    if (file.bad()) {
+        return "";
+    }
+
+    return md5.hexDigest();
+}
+
+void Md5::updateLanes(Md5* const* hashers, const uint8_t* const* data,
+                      const size_t* lengths, size_t count) {
+    const auto& kernels = md5lanes::availableKernels();
+    std::vector<size_t> consumed(count, 0);
+
+    if (!kernels.empty()) {
+        // Streams with no buffered tail and at least one whole block can share a kernel
+        std::vector<size_t> eligible;
+        for (size_t i = 0; i < count; ++i) {
+            if (hashers[i]->m_length % 64 == 0 && lengths[i] >= 64) {
+                eligible.push_back(i);
+            }
+        }
+
+        size_t widest = static_cast<size_t>(kernels.back().lanes);
+        for (size_t first = 0; first + 1 < eligible.size(); first += widest) {
+            size_t group = std::min(widest, eligible.size() - first);
+
+            // Narrowest kernel that still fits the group wastes the fewest idle lanes
+            const md5lanes::KernelInfo* kernel = &kernels.back();
+            for (const auto& candidate : kernels) {
+                if (static_cast<size_t>(candidate.lanes) >= group) {
+                    kernel = &candidate;
+                    break;
+                }
+            }
+
+            size_t blocks = SIZE_MAX;
+            for (size_t lane = 0; lane < group; ++lane) {
+                blocks = std::min(blocks, lengths[eligible[first + lane]] / 64);
+            }
+
+            // Idle lanes churn a scratch state over the first lane's data
+            uint32_t scratch[4] = {0, 0, 0, 0};
+            uint32_t* states[16];
+            const uint8_t* inputs[16];
+            for (int lane = 0; lane < kernel->lanes; ++lane) {
+                if (static_cast<size_t>(lane) < group) {
+                    size_t index = eligible[first + lane];
+                    states[lane] = hashers[index]->m_state;
+                    inputs[lane] = data[index];
+                } else {
+                    states[lane] = scratch;
+                    inputs[lane] = data[eligible[first]];
+                }
+            }
+
+            kernel->compress(states, inputs, blocks);
+
+            for (size_t lane = 0; lane < group; ++lane) {
+                size_t index = eligible[first + lane];
+                hashers[index]->m_length += blocks * 64;
+                consumed[index] = blocks * 64;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        hashers[i]->update(data[i] + consumed[i], lengths[i] - consumed[i]);
+    }
+}
+
+const char* Md5::laneKernel() {
+    const auto& kernels = md5lanes::availableKernels();
+    return kernels.empty() ? "scalar" : kernels.back().name;
+}
+
+size_t Md5::laneWidth() {
+    const auto& kernels = md5lanes::availableKernels();
+    return kernels.empty() ? 1 : static_cast<size_t>(kernels.back().lanes);
+}
+
+void Md5::transform(uint32_t state[4], const uint8_t* blocks, size_t count) {
+    for (size_t block = 0; block < count; ++block, blocks += 64) {
+        uint32_t words[16];
+        for (int i = 0; i < 16; ++i) {
+            words[i] = static_cast<uint32_t>(blocks[i * 4]) |
+                       (static_cast<uint32_t>(blocks[i * 4 + 1]) << 8) |
+                       (static_cast<uint32_t>(blocks[i * 4 + 2]) << 16) |
+                       (static_cast<uint32_t>(blocks[i * 4 + 3]) << 24);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+        for (int i = 0; i < 64; ++i) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+
+            uint32_t next = d;
+            d = c;
+            c = b;
+            b = b + rotateLeft(a + f + kSines[i] + words[g], kShifts[i]);
+            a = next;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+}
+
+} // namespace launcher
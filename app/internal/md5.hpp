@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Incremental MD5 (RFC 1321) used to verify downloaded game files
+class Md5 {
+public:
+    Md5();
+
+    // Reset to the initial state
+    void reset();
+
+    // Feed more message bytes
+    void update(const void* data, size_t length);
+
+    // Finish the message and return the digest as lowercase hex
+    std::string hexDigest();
+
+    // Number of message bytes fed so far
+    uint64_t length() const { return m_length; }
+
+    // Serialize the running state so hashing can continue after a restart
+    std::string saveState() const;
+    bool restoreState(const std::string& state);
+
+    // Hash a whole file, returns an empty string if it cannot be read
+    static std::string hashFile(const std::string& path);
+
+    // Feed data[i] into hashers[i] for several independent streams at once, running
+    // block-aligned streams side by side in SIMD lanes and the remainder through update()
+    static void updateLanes(Md5* const* hashers, const uint8_t* const* data,
+                            const size_t* lengths, size_t count);
+
+    // Widest lane kernel picked for this CPU (scalar, sse2, avx2 or avx512) and its stream count
+    static const char* laneKernel();
+    static size_t laneWidth();
+
+private:
+    static void transform(uint32_t state[4], const uint8_t* blocks, size_t count);
+
+    uint32_t m_state[4];
+    uint64_t m_length;
+    uint8_t m_buffer[64];
+};
+
+} // namespace launcher
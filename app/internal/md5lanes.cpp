@@ -0,0 +1,90 @@
+#include "md5lanes.hpp"
+
+#ifdef LAUNCHER_MD5_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace launcher {
+namespace md5lanes {
+
+namespace {
+
+#ifdef LAUNCHER_MD5_X86
+
+void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = static_cast<unsigned int>(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switch (XCR0)
+unsigned long long enabledStateMask() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+std::vector<KernelInfo> detectKernels() {
+    std::vector<KernelInfo> kernels;
+
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    unsigned int maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    bool sse2 = (regs[3] & (1u << 26)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    if (sse2) {
+        kernels.push_back({"sse2", 4, compressSse2});
+    }
+
+    if (!osxsave || maxLeaf < 7) {
+        return kernels;
+    }
+
+    unsigned long long xcr0 = enabledStateMask();
+    bool avxState = (xcr0 & 0x06) == 0x06;
+    bool avx512State = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    if (avxState && (regs[1] & (1u << 5))) {
+        kernels.push_back({"avx2", 8, compressAvx2});
+    }
+    if (avx512State && (regs[1] & (1u << 16))) {
+        kernels.push_back({"avx512", 16, compressAvx512});
+    }
+
+    return kernels;
+}
+
+#else
+
+std::vector<KernelInfo> detectKernels() {
+    return {};
+}
+
+#endif
+
+} // namespace
+
+const std::vector<KernelInfo>& availableKernels() {
+    static const std::vector<KernelInfo> kernels = detectKernels();
+    return kernels;
+}
+
+} // namespace md5lanes
+} // namespace launcher
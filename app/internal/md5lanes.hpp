@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace launcher {
+namespace md5lanes {
+
+// Compress `blocks` consecutive 64-byte blocks of data[lane] into states[lane],
+// for every lane of the kernel at once
+using Kernel = void (*)(uint32_t* const* states, const uint8_t* const* data, size_t blocks);
+
+struct KernelInfo {
+    const char* name;
+    int lanes;
+    Kernel compress;
+};
+
+// Kernels this CPU can run, narrowest first; detected once at first use and
+// empty when only the scalar Md5 path is available
+const std::vector<KernelInfo>& availableKernels();
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LAUNCHER_MD5_X86 1
+// Each lives in its own translation unit, built with the matching instruction set flags
+void compressSse2(uint32_t* const* states, const uint8_t* const* data, size_t blocks);
+void compressAvx2(uint32_t* const* states, const uint8_t* const* data, size_t blocks);
+void compressAvx512(uint32_t* const* states, const uint8_t* const* data, size_t blocks);
+#endif
+
+} // namespace md5lanes
+} // namespace launcher
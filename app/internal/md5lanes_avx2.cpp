@@ -0,0 +1,40 @@
+#include "md5lanes.hpp"
+
+#ifdef LAUNCHER_MD5_X86
+
+#include <immintrin.h>
+#include "md5lanes_kernel.hpp"
+
+namespace {
+
+struct Avx2Ops {
+    typedef __m256i Vec;
+    static const int kLanes = 8;
+
+    static Vec load(const uint32_t* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void store(uint32_t* p, Vec v) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+    static Vec set1(uint32_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+    static Vec add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+    static Vec bitAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    static Vec bitOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    static Vec bitXor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+    static Vec andNot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); }
+    static Vec rotateLeft(Vec v, int bits) {
+        return _mm256_or_si256(_mm256_sll_epi32(v, _mm_cvtsi32_si128(bits)),
+                               _mm256_srl_epi32(v, _mm_cvtsi32_si128(32 - bits)));
+    }
+};
+
+} // namespace
+
+namespace launcher {
+namespace md5lanes {
+
+void compressAvx2(uint32_t* const* states, const uint8_t* const* data, size_t blocks) {
+    compressLanes<Avx2Ops>(states, data, blocks);
+}
+
+} // namespace md5lanes
+} // namespace launcher
+
+#endif
@@ -0,0 +1,37 @@
+#include "md5lanes.hpp"
+
+#ifdef LAUNCHER_MD5_X86
+
+#include <immintrin.h>
+#include "md5lanes_kernel.hpp"
+
+namespace {
+
+struct Avx512Ops {
+    typedef __m512i Vec;
+    static const int kLanes = 16;
+
+    static Vec load(const uint32_t* p) { return _mm512_load_si512(p); }
+    static void store(uint32_t* p, Vec v) { _mm512_store_si512(p, v); }
+    static Vec set1(uint32_t x) { return _mm512_set1_epi32(static_cast<int>(x)); }
+    static Vec add(Vec a, Vec b) { return _mm512_add_epi32(a, b); }
+    static Vec bitAnd(Vec a, Vec b) { return _mm512_and_si512(a, b); }
+    static Vec bitOr(Vec a, Vec b) { return _mm512_or_si512(a, b); }
+    static Vec bitXor(Vec a, Vec b) { return _mm512_xor_si512(a, b); }
+    static Vec andNot(Vec a, Vec b) { return _mm512_andnot_si512(a, b); }
+    static Vec rotateLeft(Vec v, int bits) { return _mm512_rolv_epi32(v, _mm512_set1_epi32(bits)); }
+};
+
+} // namespace
+
+namespace launcher {
+namespace md5lanes {
+
+void compressAvx512(uint32_t* const* states, const uint8_t* const* data, size_t blocks) {
+    compressLanes<Avx512Ops>(states, data, blocks);
+}
+
+} // namespace md5lanes
+} // namespace launcher
+
+#endif
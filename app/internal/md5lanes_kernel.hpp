@@ -0,0 +1,103 @@
+#pragma once
+
+// Lane-parallel MD5 compression shared by the SSE2, AVX2 and AVX-512 translation units.
+// Only include this from a file compiled for the instruction set of its Ops type, and
+// keep everything here free of library inlines so no wide instructions leak into
+// functions the scalar build could pick up at link time.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+const uint32_t kLaneSines[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int kLaneShifts[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+template <typename Ops>
+void compressLanes(uint32_t* const* states, const uint8_t* const* data, size_t blocks) {
+    typedef typename Ops::Vec Vec;
+    const int lanes = Ops::kLanes;
+
+    alignas(64) uint32_t column[lanes];
+    Vec state[4];
+    for (int word = 0; word < 4; ++word) {
+        for (int lane = 0; lane < lanes; ++lane) {
+            column[lane] = states[lane][word];
+        }
+        state[word] = Ops::load(column);
+    }
+
+    // Message words transposed so word j of every lane forms one vector (x86 is little-endian)
+    alignas(64) uint32_t words[16][lanes];
+    const Vec ones = Ops::set1(0xffffffffu);
+
+    for (size_t block = 0; block < blocks; ++block) {
+        for (int lane = 0; lane < lanes; ++lane) {
+            const uint8_t* source = data[lane] + block * 64;
+            for (int j = 0; j < 16; ++j) {
+                std::memcpy(&words[j][lane], source + j * 4, 4);
+            }
+        }
+
+        Vec w[16];
+        for (int j = 0; j < 16; ++j) {
+            w[j] = Ops::load(words[j]);
+        }
+
+        Vec a = state[0], b = state[1], c = state[2], d = state[3];
+
+        for (int i = 0; i < 64; ++i) {
+            Vec f;
+            int g;
+            if (i < 16) {
+                f = Ops::bitOr(Ops::bitAnd(b, c), Ops::andNot(b, d));
+                g = i;
+            } else if (i < 32) {
+                f = Ops::bitOr(Ops::bitAnd(d, b), Ops::andNot(d, c));
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = Ops::bitXor(Ops::bitXor(b, c), d);
+                g = (3 * i + 5) % 16;
+            } else {
+                f = Ops::bitXor(c, Ops::bitOr(b, Ops::bitXor(d, ones)));
+                g = (7 * i) % 16;
+            }
+
+            Vec sum = Ops::add(Ops::add(a, f), Ops::add(Ops::set1(kLaneSines[i]), w[g]));
+            a = d;
+            d = c;
+            c = b;
+            b = Ops::add(b, Ops::rotateLeft(sum, kLaneShifts[i]));
+        }
+
+        state[0] = Ops::add(state[0], a);
+        state[1] = Ops::add(state[1], b);
+        state[2] = Ops::add(state[2], c);
+        state[3] = Ops::add(state[3], d);
+    }
+
+    for (int word = 0; word < 4; ++word) {
+        Ops::store(column, state[word]);
+        for (int lane = 0; lane < lanes; ++lane) {
+            states[lane][word] = column[lane];
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,40 @@
+#include "md5lanes.hpp"
+
+#ifdef LAUNCHER_MD5_X86
+
+#include <emmintrin.h>
+#include "md5lanes_kernel.hpp"
+
+namespace {
+
+struct Sse2Ops {
+    typedef __m128i Vec;
+    static const int kLanes = 4;
+
+    static Vec load(const uint32_t* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void store(uint32_t* p, Vec v) { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+    static Vec set1(uint32_t x) { return _mm_set1_epi32(static_cast<int>(x)); }
+    static Vec add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+    static Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    static Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    static Vec bitXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+    static Vec andNot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+    static Vec rotateLeft(Vec v, int bits) {
+        return _mm_or_si128(_mm_sll_epi32(v, _mm_cvtsi32_si128(bits)),
+                            _mm_srl_epi32(v, _mm_cvtsi32_si128(32 - bits)));
+    }
+};
+
+} // namespace
+
+namespace launcher {
+namespace md5lanes {
+
+void compressSse2(uint32_t* const* states, const uint8_t* const* data, size_t blocks) {
+    compressLanes<Sse2Ops>(states, data, blocks);
+}
+
+} // namespace md5lanes
+} // namespace launcher
+
+#endif
@@ -0,0 +1,186 @@
+#include "mirrorselector.hpp"
+#include <algorithm>
+
+namespace launcher {
+
+namespace {
+
+// Weight of a new throughput sample; the rest is history
+const double kThroughputSmoothing = 0.3;
+// Too little data to say anything about throughput
+const uint64_t kMinSampleBytes = 64 * 1024;
+
+// Measurements older than this are probed again before they decide anything
+const std::chrono::minutes kMeasurementMaxAge(10);
+
+// Bench time after a failure, doubling per failure in a row
+const std::chrono::seconds kBenchTime(10);
+const std::chrono::seconds kMaxBenchTime(300);
+
+// Mirrors slower than this share of the fastest get no connections while it is usable
+const double kSpreadRatio = 0.5;
+
+} // namespace
+
+const MirrorSelector::Mirror* MirrorSelector::find(const std::string& host) const {
+    auto it = m_mirrors.find(host);
+    return it != m_mirrors.end() ? &it->second : nullptr;
+}
+
+bool MirrorSelector::benched(const Mirror* mirror, std::chrono::steady_clock::time_point now) const {
+    return mirror && mirror->benchedUntil > now;
+}
+
+bool MirrorSelector::claimProbe(const std::string& host) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& mirror = m_mirrors[host];
+    auto now = std::chrono::steady_clock::now();
+    if (mirror.probing || benched(&mirror, now) ||
+        (mirror.samples > 0 && now - mirror.measuredAt < kMeasurementMaxAge)) {
+        return false;
+    }
+
+    mirror.probing = true;
+    return true;
+}
+
+void MirrorSelector::recordThroughput(const std::string& host, uint64_t bytes,
+                                      std::chrono::steady_clock::duration elapsed) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& mirror = m_mirrors[host];
+    mirror.probing = false;
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    if (bytes < kMinSampleBytes || seconds <= 0.0) {
+        return;
+    }
+
+    double sample = static_cast<double>(bytes) / seconds;
+    mirror.bytesPerSecond = mirror.samples == 0
+        ? sample
+        : mirror.bytesPerSecond + (sample - mirror.bytesPerSecond) * kThroughputSmoothing;
+    ++mirror.samples;
+    mirror.measuredAt = std::chrono::steady_clock::now();
+    mirror.failuresInRow = 0;
+}
+
+void MirrorSelector::recordFailure(const std::string& host) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& mirror = m_mirrors[host];
+    mirror.probing = false;
+    ++mirror.failures;
+
+    auto bench = kBenchTime * (1 << std::min<size_t>(mirror.failuresInRow, 5));
+    mirror.benchedUntil = std::chrono::steady_clock::now() + std::min<std::chrono::seconds>(bench, kMaxBenchTime);
+    ++mirror.failuresInRow;
+}
+
+std::vector<size_t> MirrorSelector::rank(const std::vector<std::string>& hosts) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<const Mirror*> mirrors;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        mirrors.push_back(find(hosts[i]));
+        order.push_back(i);
+    }
+
+    auto throughput = [&](size_t i) { return mirrors[i] ? mirrors[i]->bytesPerSecond : 0.0; };
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        bool benchedA = benched(mirrors[a], now);
+        bool benchedB = benched(mirrors[b], now);
+        if (benchedA != benchedB) {
+            return benchedB;
+        }
+        if (benchedA) {
+            return mirrors[a]->benchedUntil < mirrors[b]->benchedUntil;
+        }
+        return throughput(a) > throughput(b);
+    });
+    return order;
+}
+
+std::vector<size_t> MirrorSelector::candidates(const std::vector<std::string>& hosts,
+                                               const std::vector<size_t>& connections) const {
+    std::vector<size_t> order = rank(hosts);
+    if (order.empty()) {
+        return order;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    double best = 0.0;
+    for (size_t i : order) {
+        const Mirror* mirror = find(hosts[i]);
+        if (!benched(mirror, now) && mirror) {
+            best = std::max(best, mirror->bytesPerSecond);
+        }
+    }
+
+    // Unmeasured mirrors are assumed as fast as the best one, so they get a chance to show otherwise
+    struct Candidate {
+        size_t index;
+        double load;
+    };
+    std::vector<Candidate> eligible;
+    for (size_t i : order) {
+        const Mirror* mirror = find(hosts[i]);
+        if (benched(mirror, now)) {
+            continue;
+        }
+
+        double throughput = mirror && mirror->samples > 0 ? mirror->bytesPerSecond : best;
+        if (best > 0.0 && throughput < best * kSpreadRatio) {
+            continue;
+        }
+
+        size_t open = i < connections.size() ? connections[i] : 0;
+        double load = static_cast<double>(open + 1) / std::max(throughput, 1.0);
+        eligible.push_back(Candidate{i, load});
+    }
+
+    if (eligible.empty()) {
+        return {order.front()};
+    }
+
+    std::stable_sort(eligible.begin(), eligible.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.load < b.load; });
+
+    std::vector<size_t> result;
+    for (const auto& candidate : eligible) {
+        result.push_back(candidate.index);
+    }
+    return result;
+}
+
+bool MirrorSelector::hasAlternative(const std::vector<std::string>& hosts, size_t except) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        if (i != except && hosts[i] != hosts[except] && !benched(find(hosts[i]), now)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<MirrorSelector::MirrorStats> MirrorSelector::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<MirrorStats> result;
+    for (const auto& entry : m_mirrors) {
+        MirrorStats stats;
+        stats.host = entry.first;
+        stats.bytesPerSecond = entry.second.bytesPerSecond;
+        stats.samples = entry.second.samples;
+        stats.failures = entry.second.failures;
+        stats.benched = benched(&entry.second, now);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+} // namespace launcher
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// What the launcher knows about the mirrors (CDN hosts) files come from: throughput measured by
+// probes and by finished transfers, and recent failures. A host that errors or stalls is benched
+// for a while, longer each time in a row, so downloads move to the others.
+class MirrorSelector {
+public:
+    struct MirrorStats {
+        std::string host;
+        // Smoothed throughput of a single connection; 0 until measured
+        double bytesPerSecond = 0.0;
+        uint64_t samples = 0;
+        uint64_t failures = 0;
+        bool benched = false;
+    };
+
+    MirrorSelector() = default;
+
+    MirrorSelector(const MirrorSelector&) = delete;
+    MirrorSelector& operator=(const MirrorSelector&) = delete;
+
+    // True if host has no recent measurement and nobody is probing it yet; the caller then
+    // probes it and must report the outcome through recordThroughput or recordFailure
+    bool claimProbe(const std::string& host);
+
+    // Throughput of one connection over a probe or a transfer, not counting rate limiter waits
+    void recordThroughput(const std::string& host, uint64_t bytes, std::chrono::steady_clock::duration elapsed);
+    void recordFailure(const std::string& host);
+
+    // Indices into hosts: usable ones fastest first (unmeasured ones after them, in the given
+    // order), benched ones last
+    std::vector<size_t> rank(const std::vector<std::string>& hosts) const;
+
+    // Where the next connection of a download should go, best first, given how many connections
+    // it already has on each host. Only hosts within reach of the fastest are offered, each in
+    // proportion to its throughput; if all are benched, the least recently failed one.
+    std::vector<size_t> candidates(const std::vector<std::string>& hosts,
+                                   const std::vector<size_t>& connections) const;
+
+    // True if any host other than hosts[except] is not benched
+    bool hasAlternative(const std::vector<std::string>& hosts, size_t except) const;
+
+    std::vector<MirrorStats> getStats() const;
+
+private:
+    struct Mirror {
+        double bytesPerSecond = 0.0;
+        uint64_t samples = 0;
+        std::chrono::steady_clock::time_point measuredAt;
+        bool probing = false;
+
+        uint64_t failures = 0;
+        size_t failuresInRow = 0;
+        std::chrono::steady_clock::time_point benchedUntil;
+    };
+
+    // Requires m_mutex
+    const Mirror* find(const std::string& host) const;
+    bool benched(const Mirror* mirror, std::chrono::steady_clock::time_point now) const;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Mirror> m_mirrors;
+};
+
+} // namespace launcher
@@ -0,0 +1,348 @@
+#include "splicetransfer.hpp"
+#include <algorithm>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+
+namespace launcher {
+
+namespace {
+
+// Bytes moved per splice call; rate limiting and cancellation act at this granularity
+const size_t kSpliceChunk = 256 * 1024;
+const int kPipeSize = 1024 * 1024;
+
+// Longest response header accepted, and how long the socket may stay silent (httplib's default)
+const size_t kMaxHeaderSize = 16 * 1024;
+const std::chrono::seconds kReadTimeout(5);
+const int kPollMilliseconds = 250;
+
+std::string lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+struct ResponseHead {
+    int status = 0;
+    std::string contentRange;
+    std::string contentEncoding;
+    std::string transferEncoding;
+};
+
+bool parseHead(const std::string& text, ResponseHead& head) {
+    size_t lineEnd = text.find("\r\n");
+    if (text.compare(0, 5, "HTTP/") != 0 || lineEnd == std::string::npos) {
+        return false;
+    }
+
+    size_t space = text.find(' ');
+    if (space == std::string::npos || space > lineEnd) {
+        return false;
+    }
+    head.status = std::atoi(text.c_str() + space + 1);
+
+    size_t start = lineEnd + 2;
+    while (start < text.size()) {
+        size_t end = text.find("\r\n", start);
+        if (end == std::string::npos || end == start) {
+            break;
+        }
+
+        std::string line = text.substr(start, end - start);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name = lower(line.substr(0, colon));
+            size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+            if (name == "content-range") {
+                head.contentRange = value;
+            } else if (name == "content-encoding") {
+                head.contentEncoding = lower(value);
+            } else if (name == "transfer-encoding") {
+                head.transferEncoding = lower(value);
+            }
+        }
+        start = end + 2;
+    }
+    return head.status > 0;
+}
+
+#ifdef __linux__
+
+class Descriptor {
+public:
+    explicit Descriptor(int fd = -1) : m_fd(fd) {}
+    ~Descriptor() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+    Descriptor(const Descriptor&) = delete;
+    Descriptor& operator=(const Descriptor&) = delete;
+
+    int get() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+int connectTo(const std::string& host, int port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        fd = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+enum class Wait {
+    Ready,
+    Stopped,
+    TimedOut,
+    Error
+};
+
+// Wait for the socket to become readable, giving the caller a chance to stop on every tick
+Wait waitReadable(int fd, const SpliceTransfer::ChunkHandler& onChunk) {
+    auto deadline = std::chrono::steady_clock::now() + kReadTimeout;
+    while (true) {
+        pollfd entry = {fd, POLLIN, 0};
+        int ready = ::poll(&entry, 1, kPollMilliseconds);
+        if (ready > 0) {
+            return Wait::Ready;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return Wait::Error;
+        }
+        if (!onChunk(0)) {
+            return Wait::Stopped;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+            return Wait::TimedOut;
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+SpliceTransfer::SpliceTransfer() {
+}
+
+SpliceTransfer::~SpliceTransfer() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+}
+
+bool SpliceTransfer::open(const std::string& filePath) {
+#ifdef __linux__
+    m_fd = ::open(filePath.c_str(), O_WRONLY | O_CLOEXEC);
+    return m_fd >= 0;
+#else
+    (void)filePath;
+    return false;
+#endif
+}
+
+void SpliceTransfer::dropCache(uint64_t begin, uint64_t end) {
+#ifdef __linux__
+    if (m_fd >= 0 && end > begin) {
+        posix_fadvise(m_fd, static_cast<off_t>(begin), static_cast<off_t>(end - begin), POSIX_FADV_DONTNEED);
+    }
+#else
+    (void)begin;
+    (void)end;
+#endif
+}
+
+SpliceTransfer::Outcome SpliceTransfer::fetch(const std::string& host, int port, const std::string& path,
+                                              uint64_t begin, uint64_t end,
+                                              const ResponseHandler& onResponse, const ChunkHandler& onChunk) {
+#ifdef __linux__
+    if (m_fd < 0 || end <= begin) {
+        return Outcome::Unsupported;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Descriptor socket(connectTo(host, port));
+    if (socket.get() < 0) {
+        return Outcome::Failed;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\n"
+                          "Host: " + host + (port == 80 ? "" : ":" + std::to_string(port)) + "\r\n"
+                          "Range: bytes=" + std::to_string(begin) + "-" + std::to_string(end - 1) + "\r\n"
+                          "Accept-Encoding: identity\r\n"
+                          "Connection: close\r\n\r\n";
+    if (!sendAll(socket.get(), request)) {
+        return Outcome::Failed;
+    }
+
+    // Peek until the header ends, then take exactly the header so the body stays in the socket
+    std::string head;
+    size_t headerLength = std::string::npos;
+    std::vector<char> peek(kMaxHeaderSize);
+    while (headerLength == std::string::npos) {
+        Wait wait = waitReadable(socket.get(), onChunk);
+        if (wait == Wait::Stopped) {
+            return Outcome::Stopped;
+        }
+        if (wait != Wait::Ready) {
+            return Outcome::Failed;
+        }
+
+        ssize_t n = ::recv(socket.get(), peek.data(), peek.size(), MSG_PEEK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return Outcome::Failed;
+        }
+
+        head.assign(peek.data(), static_cast<size_t>(n));
+        size_t terminator = head.find("\r\n\r\n");
+        if (terminator != std::string::npos) {
+            headerLength = terminator + 4;
+        } else if (static_cast<size_t>(n) == peek.size()) {
+            return Outcome::Unsupported;
+        }
+    }
+
+    head.resize(headerLength);
+    size_t consumed = 0;
+    while (consumed < headerLength) {
+        ssize_t n = ::recv(socket.get(), peek.data(), headerLength - consumed, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return Outcome::Failed;
+        }
+        consumed += static_cast<size_t>(n);
+    }
+
+    ResponseHead response;
+    if (!parseHead(head, response)) {
+        return Outcome::Failed;
+    }
+
+    // Redirects and bodies that need decoding go to httplib, which handles them
+    std::string expectedRange = "bytes " + std::to_string(begin) + "-";
+    bool plain = (response.contentEncoding.empty() || response.contentEncoding == "identity") &&
+                 response.transferEncoding.empty();
+    if ((response.status >= 300 && response.status < 400) ||
+        (response.status == 206 && (!plain || response.contentRange.compare(0, expectedRange.size(), expectedRange) != 0))) {
+        return Outcome::Unsupported;
+    }
+
+    if (!onResponse(response.status, std::chrono::steady_clock::now() - start)) {
+        return Outcome::Stopped;
+    }
+
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+        return Outcome::Unsupported;
+    }
+    Descriptor pipeRead(pipeFds[0]);
+    Descriptor pipeWrite(pipeFds[1]);
+    fcntl(pipeWrite.get(), F_SETPIPE_SZ, kPipeSize);
+
+    loff_t offset = static_cast<loff_t>(begin);
+    uint64_t remaining = end - begin;
+    while (remaining > 0) {
+        Wait wait = waitReadable(socket.get(), onChunk);
+        if (wait == Wait::Stopped) {
+            return Outcome::Stopped;
+        }
+        if (wait != Wait::Ready) {
+            return Outcome::Failed;
+        }
+
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, kSpliceChunk));
+        ssize_t received = ::splice(socket.get(), nullptr, pipeWrite.get(), nullptr, want,
+                                    SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+        if (received < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (received <= 0) {
+            return Outcome::Failed;
+        }
+
+        size_t pending = static_cast<size_t>(received);
+        while (pending > 0) {
+            ssize_t written = ::splice(pipeRead.get(), nullptr, m_fd, &offset, pending, SPLICE_F_MOVE);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return Outcome::WriteFailed;
+            }
+            pending -= static_cast<size_t>(written);
+        }
+
+        remaining -= static_cast<uint64_t>(received);
+        if (!onChunk(static_cast<size_t>(received))) {
+            return remaining == 0 ? Outcome::Completed : Outcome::Stopped;
+        }
+    }
+    return Outcome::Completed;
+#else
+    (void)host;
+    (void)port;
+    (void)path;
+    (void)begin;
+    (void)end;
+    (void)onResponse;
+    (void)onChunk;
+    return Outcome::Unsupported;
+#endif
+}
+
+} // namespace launcher
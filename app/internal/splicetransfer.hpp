@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Byte-range fetch over plain HTTP that moves the body from the socket into the file with
+// splice(2), through a pipe, so it is never copied through user space. Only the response
+// headers are read normally. Linux only; elsewhere open() fails and callers use httplib.
+class SpliceTransfer {
+public:
+    enum class Outcome {
+        Completed,      // every requested byte is in the file
+        Stopped,        // a handler returned false
+        Failed,         // connection error or early end; what was reported through onChunk is on disk
+        WriteFailed,    // the file could not be written
+        Unsupported     // nothing written: a redirect, a chunked or encoded body, a range not as asked
+    };
+
+    // HTTP status and time to the response headers; return false to stop
+    using ResponseHandler = std::function<bool(int status, std::chrono::steady_clock::duration elapsed)>;
+    // length more bytes are in the file; 0 while waiting for data, so the caller can cancel
+    using ChunkHandler = std::function<bool(size_t length)>;
+
+    SpliceTransfer();
+    ~SpliceTransfer();
+
+    SpliceTransfer(const SpliceTransfer&) = delete;
+    SpliceTransfer& operator=(const SpliceTransfer&) = delete;
+
+    // Open the output file, which must exist; false where splicing is not available
+    bool open(const std::string& filePath);
+
+    // GET path from host:port for bytes [begin, end) and write them to the file at begin
+    Outcome fetch(const std::string& host, int port, const std::string& path, uint64_t begin, uint64_t end,
+                  const ResponseHandler& onResponse, const ChunkHandler& onChunk);
+
+    // Evict [begin, end) from the page cache once it was synced, for unbuffered downloads
+    void dropCache(uint64_t begin, uint64_t end);
+
+private:
+    int m_fd = -1;
+};
+
+} // namespace launcher
@@ -0,0 +1,253 @@
+#include "streamdecoder.hpp"
+#include <zlib.h>
+#include <zstd.h>
+#include <algorithm>
+#include <cctype>
+
+namespace launcher {
+
+namespace {
+
+const size_t kOutputChunk = 64 * 1024;
+
+// The longest magic Detect looks for, and the zlib header Deflate looks at
+const size_t kMagicLength = 4;
+const size_t kZlibHeaderLength = 2;
+
+// 1f 8b: gzip; 28 b5 2f fd: zstd frame
+bool isGzip(const std::string& head) {
+    return head.size() >= 2 && static_cast<unsigned char>(head[0]) == 0x1f &&
+           static_cast<unsigned char>(head[1]) == 0x8b;
+}
+
+bool isZstd(const std::string& head) {
+    return head.size() >= 4 && static_cast<unsigned char>(head[0]) == 0x28 &&
+           static_cast<unsigned char>(head[1]) == 0xb5 && static_cast<unsigned char>(head[2]) == 0x2f &&
+           static_cast<unsigned char>(head[3]) == 0xfd;
+}
+
+// RFC 1950 header: deflate method, a window of at most 32 KiB, and a check over both bytes.
+// A raw stream would have to open with a non-final stored block and pass the check by chance.
+bool isZlib(const std::string& head) {
+    if (head.size() < kZlibHeaderLength) {
+        return false;
+    }
+    unsigned cmf = static_cast<unsigned char>(head[0]);
+    unsigned flg = static_cast<unsigned char>(head[1]);
+    return (cmf & 0x0f) == 8 && (cmf >> 4) <= 7 && (cmf * 256 + flg) % 31 == 0;
+}
+
+} // namespace
+
+bool StreamDecoder::parseEncoding(const std::string& encoding, Format& format) {
+    std::string name;
+    for (char c : encoding) {
+        if (!std::isspace(static_cast<unsigned char>(c))) {
+            name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+
+    if (name.empty() || name == "identity") {
+        format = Format::None;
+    } else if (name == "gzip" || name == "x-gzip") {
+        format = Format::Gzip;
+    } else if (name == "deflate") {
+        format = Format::Deflate;
+    } else if (name == "zstd") {
+        format = Format::Zstd;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+StreamDecoder::StreamDecoder(Format format) : m_format(Format::None) {
+    if (format != Format::Detect && format != Format::Deflate) {
+        start(format);
+    } else {
+        m_format = format;
+    }
+}
+
+StreamDecoder::~StreamDecoder() {
+    if (m_zlib) {
+        inflateEnd(m_zlib);
+        delete m_zlib;
+    }
+    if (m_zstd) {
+        ZSTD_freeDCtx(m_zstd);
+    }
+}
+
+bool StreamDecoder::start(Format format) {
+    m_format = format;
+    if (format == Format::Gzip || format == Format::Deflate) {
+        m_zlib = new z_stream();
+        // 15 + 32: largest window, gzip or zlib header detected automatically; -15: no header
+        int windowBits = format == Format::Deflate && !isZlib(m_head) ? -15 : 15 + 32;
+        if (inflateInit2(m_zlib, windowBits) != Z_OK) {
+            delete m_zlib;
+            m_zlib = nullptr;
+            m_error = "Failed to initialise gzip decoder";
+            return false;
+        }
+    } else if (format == Format::Zstd) {
+        m_zstd = ZSTD_createDCtx();
+        if (!m_zstd) {
+            m_error = "Failed to initialise zstd decoder";
+            return false;
+        }
+    }
+
+    if (format != Format::None) {
+        m_output.resize(kOutputChunk);
+    }
+    return true;
+}
+
+bool StreamDecoder::write(const char* data, size_t length, const Sink& sink) {
+    if (!m_error.empty()) {
+        return false;
+    }
+
+    bool deflateHeader = m_format == Format::Deflate && !m_zlib;
+    if (m_format == Format::Detect || deflateHeader) {
+        size_t wanted = deflateHeader ? kZlibHeaderLength : kMagicLength;
+        size_t take = std::min(length, wanted - m_head.size());
+        m_head.append(data, take);
+        data += take;
+        length -= take;
+        if (m_head.size() < wanted) {
+            return true;
+        }
+
+        Format format = deflateHeader ? Format::Deflate
+                        : isGzip(m_head) ? Format::Gzip
+                        : isZstd(m_head) ? Format::Zstd
+                                         : Format::None;
+        if (!start(format)) {
+            return false;
+        }
+
+        std::string head;
+        head.swap(m_head);
+        if (!write(head.data(), head.size(), sink)) {
+            return false;
+        }
+    }
+
+    if (length == 0) {
+        return true;
+    }
+
+    switch (m_format) {
+        case Format::Gzip:
+        case Format::Deflate: return inflate(data, length, sink);
+        case Format::Zstd: return decompressZstd(data, length, sink);
+        default: return sink(data, length);
+    }
+}
+
+bool StreamDecoder::inflate(const char* data, size_t length, const Sink& sink) {
+    m_zlib->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    m_zlib->avail_in = static_cast<uInt>(length);
+
+    while (m_zlib->avail_in > 0) {
+        // Concatenated gzip members make one file
+        if (m_frameDone) {
+            inflateReset(m_zlib);
+            m_frameDone = false;
+        }
+
+        m_zlib->next_out = reinterpret_cast<Bytef*>(m_output.data());
+        m_zlib->avail_out = static_cast<uInt>(m_output.size());
+
+        int ret = ::inflate(m_zlib, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            std::string message = m_format == Format::Deflate ? "Corrupt deflate data" : "Corrupt gzip data";
+            m_error = m_zlib->msg ? message + ": " + m_zlib->msg : message;
+            return false;
+        }
+
+        size_t produced = m_output.size() - m_zlib->avail_out;
+        if (produced > 0 && !sink(m_output.data(), produced)) {
+            return false;
+        }
+
+        if (ret == Z_STREAM_END) {
+            m_frameDone = true;
+        } else if (ret == Z_BUF_ERROR && produced == 0) {
+            // Needs more input than this chunk had
+            break;
+        }
+    }
+    return true;
+}
+
+bool StreamDecoder::decompressZstd(const char* data, size_t length, const Sink& sink) {
+    ZSTD_inBuffer input = {data, length, 0};
+    while (input.pos < input.size) {
+        ZSTD_outBuffer output = {m_output.data(), m_output.size(), 0};
+        size_t ret = ZSTD_decompressStream(m_zstd, &output, &input);
+        if (ZSTD_isError(ret)) {
+            m_error = std::string("Corrupt zstd data: ") + ZSTD_getErrorName(ret);
+            return false;
+        }
+
+        if (output.pos > 0 && !sink(m_output.data(), output.pos)) {
+            return false;
+        }
+
+        // 0 means a frame just ended; the next input, if any, starts another
+        m_frameDone = ret == 0;
+    }
+    return true;
+}
+
+bool StreamDecoder::finish(const Sink& sink) {
+    if (!m_error.empty()) {
+        return false;
+    }
+
+    // A body shorter than any magic is passed through as it was
+    if (m_format == Format::Detect) {
+        std::string head;
+        head.swap(m_head);
+        m_format = Format::None;
+        return head.empty() || sink(head.data(), head.size());
+    }
+
+    // A deflate body of a byte or none at all; decoding it reports how it fell short
+    if (m_format == Format::Deflate && !m_zlib) {
+        std::string head;
+        head.swap(m_head);
+        if (!start(Format::Deflate) || (!head.empty() && !inflate(head.data(), head.size(), sink))) {
+            return false;
+        }
+    }
+
+    // Drain what zstd still holds for the last frame
+    if (m_format == Format::Zstd && !m_frameDone) {
+        ZSTD_inBuffer input = {nullptr, 0, 0};
+        size_t ret = 1;
+        while (ret != 0) {
+            ZSTD_outBuffer output = {m_output.data(), m_output.size(), 0};
+            ret = ZSTD_decompressStream(m_zstd, &output, &input);
+            if (ZSTD_isError(ret) || (output.pos == 0 && ret != 0)) {
+                break;
+            }
+            if (output.pos > 0 && !sink(m_output.data(), output.pos)) {
+                return false;
+            }
+        }
+        m_frameDone = ret == 0;
+    }
+
+    if (m_format != Format::None && !m_frameDone) {
+        m_error = "Compressed data ended early";
+        return false;
+    }
+    return true;
+}
+
+} // namespace launcher
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+struct z_stream_s;
+struct ZSTD_DCtx_s;
+
+namespace launcher {
+
+// Incremental decompression of a body as it arrives, for Content-Encoding and for files that
+// are themselves compressed (the CDN's resource index is gzip). Decoded data goes to a sink
+// in bounded chunks, so nothing is buffered beyond one input chunk.
+class StreamDecoder {
+public:
+    enum class Format {
+        None,       // passed through unchanged
+        Gzip,       // gzip or zlib, told apart by the header
+        Deflate,    // zlib or raw deflate, as servers differ on what "deflate" means
+        Zstd,
+        Detect      // gzip or zstd by the magic bytes, anything else passed through
+    };
+
+    // Return false to stop decoding
+    using Sink = std::function<bool(const char* data, size_t length)>;
+
+    // Format of a Content-Encoding header value; false for an encoding that cannot be decoded
+    static bool parseEncoding(const std::string& encoding, Format& format);
+
+    explicit StreamDecoder(Format format);
+    ~StreamDecoder();
+
+    StreamDecoder(const StreamDecoder&) = delete;
+    StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+    // Decode the next part of the body; false on corrupt data or if the sink stopped
+    bool write(const char* data, size_t length, const Sink& sink);
+
+    // Call after the last input; false if the compressed stream was cut short
+    bool finish(const Sink& sink);
+
+    // Format in use, once Detect has seen enough of the body
+    Format format() const { return m_format; }
+    const std::string& error() const { return m_error; }
+
+private:
+    bool start(Format format);
+    bool inflate(const char* data, size_t length, const Sink& sink);
+    bool decompressZstd(const char* data, size_t length, const Sink& sink);
+
+    Format m_format;
+    z_stream_s* m_zlib = nullptr;
+    ZSTD_DCtx_s* m_zstd = nullptr;
+    // At the end of a gzip member or zstd frame; another one may follow
+    bool m_frameDone = false;
+    // Detect and Deflate hold the first bytes until the magic or header is complete
+    std::string m_head;
+    std::vector<char> m_output;
+    std::string m_error;
+};
+
+} // namespace launcher
@@ -0,0 +1,98 @@
+#include "tokenbucket.hpp"
+#include <algorithm>
+
+namespace launcher {
+
+namespace {
+
+// Waiters wake at least this often to notice cancellation
+const std::chrono::milliseconds kMaxWait(100);
+
+// A quarter second of traffic may go out in one burst, but never less than one socket read
+double burstSize(uint64_t rate) {
+    return std::max(static_cast<double>(rate) / 4.0, 64.0 * 1024.0);
+}
+
+} // namespace
+
+TokenBucket::TokenBucket(uint64_t bytesPerSecond)
+    : m_limited(bytesPerSecond > 0), m_rate(bytesPerSecond), m_paused(false),
+      m_tokens(burstSize(bytesPerSecond)), m_lastRefill(std::chrono::steady_clock::now()) {
+}
+
+void TokenBucket::setRate(uint64_t bytesPerSecond) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        refill(std::chrono::steady_clock::now());
+        m_rate = bytesPerSecond;
+        if (m_rate > 0) {
+            m_tokens = std::min(m_tokens, burstSize(m_rate));
+        }
+        m_limited = m_rate > 0 || m_paused;
+    }
+    m_changed.notify_all();
+}
+
+uint64_t TokenBucket::getRate() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rate;
+}
+
+void TokenBucket::setPaused(bool paused) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        refill(std::chrono::steady_clock::now());
+        m_paused = paused;
+        m_limited = m_rate > 0 || m_paused;
+    }
+    m_changed.notify_all();
+}
+
+bool TokenBucket::isPaused() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_paused;
+}
+
+void TokenBucket::consumeLimited(size_t bytes, const std::atomic<bool>* cancelled) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_paused) {
+        if (cancelled && *cancelled) {
+            return;
+        }
+        m_changed.wait_for(lock, kMaxWait);
+    }
+
+    refill(std::chrono::steady_clock::now());
+    m_tokens -= static_cast<double>(bytes);
+
+    while (m_tokens < 0.0 && m_rate > 0 && !m_paused) {
+        if (cancelled && *cancelled) {
+            return;
+        }
+
+        auto debt = std::chrono::duration<double>(-m_tokens / static_cast<double>(m_rate));
+        auto wait = std::min(std::chrono::duration_cast<std::chrono::milliseconds>(debt) + std::chrono::milliseconds(1),
+                             kMaxWait);
+        m_changed.wait_for(lock, wait);
+        refill(std::chrono::steady_clock::now());
+    }
+}
+
+void TokenBucket::refill(std::chrono::steady_clock::time_point now) {
+    double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+
+    if (m_paused) {
+        return;
+    }
+
+    if (m_rate == 0) {
+        m_tokens = 0.0;
+        return;
+    }
+
+    m_tokens = std::min(m_tokens + elapsed * static_cast<double>(m_rate), burstSize(m_rate));
+}
+
+} // namespace launcher
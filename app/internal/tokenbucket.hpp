@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Byte-rate limiter shared by every transfer that draws from it. Callers take tokens
+// after receiving data and sleep off any debt, which stalls the socket read and lets
+// TCP flow control slow the sender down.
+class TokenBucket {
+public:
+    explicit TokenBucket(uint64_t bytesPerSecond = 0);
+
+    // 0 removes the cap
+    void setRate(uint64_t bytesPerSecond);
+    uint64_t getRate() const;
+
+    // While paused, consume() blocks regardless of the rate
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    // Account for bytes just received, blocking until the bucket allows them.
+    // Returns early once *cancelled is set. Costs a single atomic load when uncapped.
+    void consume(size_t bytes, const std::atomic<bool>* cancelled = nullptr) {
+        if (!m_limited.load(std::memory_order_relaxed)) {
+            return;
+        }
+        consumeLimited(bytes, cancelled);
+    }
+
+private:
+    void consumeLimited(size_t bytes, const std::atomic<bool>* cancelled);
+    void refill(std::chrono::steady_clock::time_point now);
+
+    std::atomic<bool> m_limited;
+    uint64_t m_rate;
+    bool m_paused;
+    // May go negative: a caller takes its bytes up front and waits out the debt
+    double m_tokens;
+    std::chrono::steady_clock::time_point m_lastRefill;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+};
+
+} // namespace launcher
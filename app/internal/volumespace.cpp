@@ -0,0 +1,205 @@
+#include "volumespace.hpp"
+#include <filesystem>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace launcher {
+
+namespace {
+
+// How long volume stats and reserved file sizes are trusted
+const std::chrono::seconds kRefreshInterval(2);
+
+// Left free for the system and for everything that is not a download
+const uint64_t kSpaceMargin = 256ull * 1024 * 1024;
+
+// Targets usually do not exist yet; their nearest existing directory is on the same volume
+std::filesystem::path existingAncestor(const std::filesystem::path& path) {
+    std::error_code ec;
+    std::filesystem::path current = std::filesystem::absolute(path, ec);
+    while (!current.empty() && !std::filesystem::exists(current, ec)) {
+        if (current == current.parent_path()) {
+            break;
+        }
+        current = current.parent_path();
+    }
+    return current;
+}
+
+// Space the file already holds on disk. FileWriter preallocates without growing the file, so
+// the logical size alone would count a preallocated download both here and in the free space.
+bool occupiedSize(const std::string& path, uint64_t& size) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(std::filesystem::path(path).wstring().c_str(), FILE_READ_ATTRIBUTES,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    FILE_STANDARD_INFO info;
+    bool ok = GetFileInformationByHandleEx(handle, FileStandardInfo, &info, sizeof(info)) != 0;
+    CloseHandle(handle);
+    if (!ok) {
+        return false;
+    }
+    size = static_cast<uint64_t>((std::max)(info.AllocationSize.QuadPart, info.EndOfFile.QuadPart));
+    return true;
+#else
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    // st_blocks is in 512-byte units whatever the filesystem block size
+    size = std::max(static_cast<uint64_t>(info.st_blocks) * 512, static_cast<uint64_t>(info.st_size));
+    return true;
+#endif
+}
+
+uint64_t toMiB(uint64_t bytes) {
+    return bytes / (1024 * 1024);
+}
+
+} // namespace
+
+std::string VolumeSpace::volumeKey(const std::string& path) {
+    std::filesystem::path existing = existingAncestor(path);
+#ifdef _WIN32
+    // "C:" or "\\server\share"
+    return existing.root_name().string();
+#else
+    struct stat info;
+    if (::stat(existing.c_str(), &info) != 0) {
+        return existing.root_path().string();
+    }
+    return "dev:" + std::to_string(static_cast<uint64_t>(info.st_dev));
+#endif
+}
+
+uint64_t VolumeSpace::outstanding(const std::string& path, uint64_t size) {
+    uint64_t existing = 0;
+    if (!occupiedSize(path, existing)) {
+        return size;
+    }
+    return existing >= size ? 0 : size - existing;
+}
+
+VolumeSpace::Volume& VolumeSpace::refresh(const std::string& key, const std::string& path) {
+    auto& volume = m_volumes[key];
+    auto now = std::chrono::steady_clock::now();
+    if (!volume.stale && now - volume.refreshedAt < kRefreshInterval) {
+        return volume;
+    }
+
+    std::error_code ec;
+    auto space = std::filesystem::space(existingAncestor(path), ec);
+    if (!ec) {
+        volume.capacity = space.capacity;
+        volume.available = space.available;
+    }
+    for (auto& entry : m_reservations) {
+        if (entry.second.volume == key) {
+            entry.second.outstanding = outstanding(entry.second.path, entry.second.size);
+        }
+    }
+
+    volume.refreshedAt = now;
+    volume.stale = false;
+    return volume;
+}
+
+VolumeSpace::Admission VolumeSpace::reserve(int downloadId, int group, const std::string& path, uint64_t size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_reservations.count(downloadId) > 0) {
+        return Admission::Granted;
+    }
+
+    std::string key = volumeKey(path);
+    const Volume& volume = refresh(key, path);
+
+    uint64_t needed = outstanding(path, size);
+    uint64_t reserved = 0;
+    uint64_t reservedByGroup = 0;
+    for (const auto& entry : m_reservations) {
+        if (entry.second.volume == key) {
+            reserved += entry.second.outstanding;
+            if (entry.second.group == group) {
+                reservedByGroup += entry.second.outstanding;
+            }
+        }
+    }
+
+    uint64_t usable = volume.available > kSpaceMargin ? volume.available - kSpaceMargin : 0;
+    if (needed > 0 && needed + reservedByGroup > usable) {
+        return Admission::Rejected;
+    }
+    if (needed > 0 && needed + reserved > usable) {
+        return Admission::Held;
+    }
+
+    Reservation reservation;
+    reservation.volume = key;
+    reservation.path = path;
+    reservation.group = group;
+    reservation.size = size;
+    reservation.outstanding = needed;
+    m_reservations[downloadId] = reservation;
+    return Admission::Granted;
+}
+
+void VolumeSpace::release(int downloadId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_reservations.find(downloadId);
+    if (it == m_reservations.end()) {
+        return;
+    }
+
+    // The file took its space for real; the cached free space does not show that yet
+    m_volumes[it->second.volume].stale = true;
+    m_reservations.erase(it);
+}
+
+std::string VolumeSpace::describe(const std::string& path, uint64_t size) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string key = volumeKey(path);
+
+    uint64_t available = 0;
+    auto volume = m_volumes.find(key);
+    if (volume != m_volumes.end()) {
+        available = volume->second.available > kSpaceMargin ? volume->second.available - kSpaceMargin : 0;
+    }
+    for (const auto& entry : m_reservations) {
+        if (entry.second.volume == key) {
+            available -= std::min(available, entry.second.outstanding);
+        }
+    }
+
+    return "Not enough disk space: " + std::to_string(toMiB(outstanding(path, size))) + " MiB needed, " +
+           std::to_string(toMiB(available)) + " MiB free";
+}
+
+std::vector<VolumeSpace::VolumeStats> VolumeSpace::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<VolumeStats> result;
+    for (const auto& entry : m_volumes) {
+        VolumeStats stats;
+        stats.volume = entry.first;
+        stats.capacity = entry.second.capacity;
+        stats.available = entry.second.available;
+        for (const auto& reservation : m_reservations) {
+            if (reservation.second.volume == entry.first) {
+                stats.reserved += reservation.second.outstanding;
+                ++stats.reservations;
+            }
+        }
+        result.push_back(stats);
+    }
+    return result;
+}
+
+} // namespace launcher
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+
+// Disk space admission for downloads. Each admitted download reserves what it still has to
+// write on its target volume, so concurrent jobs cannot together promise more than the volume
+// has free. Volume stats and what the reserved files already hold are refreshed every few
+// seconds rather than queried per request. A file counts by the space it occupies on disk, so a
+// preallocated download is not reserved a second time.
+class VolumeSpace {
+public:
+    enum class Admission {
+        Granted,
+        Held,       // fits once reservations of other groups go away, e.g. a cancelled job
+        Rejected    // does not fit next to what its own group already reserved
+    };
+
+    struct VolumeStats {
+        std::string volume;
+        uint64_t capacity = 0;
+        uint64_t available = 0;
+        // Still to be written by admitted downloads
+        uint64_t reserved = 0;
+        size_t reservations = 0;
+    };
+
+    VolumeSpace() = default;
+
+    VolumeSpace(const VolumeSpace&) = delete;
+    VolumeSpace& operator=(const VolumeSpace&) = delete;
+
+    // Reserve for the file at path to grow to size bytes. Downloads of one group (an install
+    // job) all have to fit together. Granted is remembered; asking again for the same ID is cheap.
+    Admission reserve(int downloadId, int group, const std::string& path, uint64_t size);
+
+    // The download finished or was dropped; the next request rereads its volume
+    void release(int downloadId);
+
+    // "Not enough disk space ..." for a download that was just rejected
+    std::string describe(const std::string& path, uint64_t size) const;
+
+    std::vector<VolumeStats> getStats() const;
+
+private:
+    struct Volume {
+        uint64_t capacity = 0;
+        uint64_t available = 0;
+        std::chrono::steady_clock::time_point refreshedAt;
+        bool stale = true;
+    };
+
+    struct Reservation {
+        std::string volume;
+        std::string path;
+        int group = 0;
+        uint64_t size = 0;
+        // size minus the space the file occupied at the last refresh, preallocation included
+        uint64_t outstanding = 0;
+    };
+
+    static std::string volumeKey(const std::string& path);
+    static uint64_t outstanding(const std::string& path, uint64_t size);
+    // Requires m_mutex
+    Volume& refresh(const std::string& key, const std::string& path);
+
+    std::map<std::string, Volume> m_volumes;
+    std::map<int, Reservation> m_reservations;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace launcher
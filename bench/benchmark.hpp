@@ -0,0 +1,180 @@
+#pragma once
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Shared by the benchmark programs: command line, timing and the JSON report. Every
+// measurement is one object of the "results" array, so runs of two releases can be diffed.
+
+namespace launcher {
+namespace bench {
+
+struct Options {
+    // Only scenarios whose name contains this; empty runs all
+    std::string scenario;
+    // Multiplies the amount of data of every scenario
+    double scale = 1.0;
+    // Report file; the report goes to stdout without one
+    std::string out;
+};
+
+inline Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--scenario") == 0) {
+            options.scenario = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--scale") == 0) {
+            options.scale = std::atof(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--out") == 0) {
+            options.out = argv[i + 1];
+        }
+    }
+    if (options.scale <= 0.0) {
+        options.scale = 1.0;
+    }
+    return options;
+}
+
+// User and kernel time of all threads of the process, the in-process server's included
+inline double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        return 0.0;
+    }
+    auto ticks = [](const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return static_cast<double>(ticks(kernel) + ticks(user)) / 1e7;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    auto seconds = [](const timeval& time) {
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+    };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+}
+
+// Wall and CPU time since construction
+class Stopwatch {
+public:
+    Stopwatch() : m_start(std::chrono::steady_clock::now()), m_cpuStart(processCpuSeconds()) {
+    }
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+    double cpuSeconds() const { return processCpuSeconds() - m_cpuStart; }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+    double m_cpuStart;
+};
+
+struct Measurement {
+    Measurement(std::string scenarioName, std::string variantName)
+        : scenario(std::move(scenarioName)), variant(std::move(variantName)) {
+    }
+
+    std::string scenario;
+    std::string variant;
+    std::vector<std::pair<std::string, double>> values;
+
+    Measurement& set(const std::string& name, double value) {
+        values.emplace_back(name, value);
+        return *this;
+    }
+};
+
+class Report {
+public:
+    explicit Report(const std::string& program) : m_program(program) {
+    }
+
+    void add(const Measurement& measurement) {
+        m_results.push_back(measurement);
+
+        std::fprintf(stderr, "%-16s %-20s", measurement.scenario.c_str(), measurement.variant.c_str());
+        for (const auto& value : measurement.values) {
+            std::fprintf(stderr, " %s=%.3f", value.first.c_str(), value.second);
+        }
+        std::fprintf(stderr, "\n");
+    }
+
+    // False if the report file could not be written
+    bool write(const std::string& path) const {
+        rapidjson::StringBuffer buffer;
+        rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+        writer.StartObject();
+        writer.Key("program");
+        writer.String(m_program.c_str());
+        writer.Key("results");
+        writer.StartArray();
+        for (const auto& result : m_results) {
+            writer.StartObject();
+            writer.Key("scenario");
+            writer.String(result.scenario.c_str());
+            writer.Key("variant");
+            writer.String(result.variant.c_str());
+            for (const auto& value : result.values) {
+                writer.Key(value.first.c_str());
+                writer.Double(value.second);
+            }
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+
+        if (path.empty()) {
+            std::printf("%s\n", buffer.GetString());
+            return true;
+        }
+
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = std::fwrite(buffer.GetString(), 1, buffer.GetSize(), file) == buffer.GetSize();
+        return std::fclose(file) == 0 && ok;
+    }
+
+private:
+    std::string m_program;
+    std::vector<Measurement> m_results;
+};
+
+inline double megabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0.0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+// Any amount, such as CPU seconds or allocations, per GiB of data
+inline double perGiB(double amount, uint64_t bytes) {
+    return bytes > 0 ? amount * (1024.0 * 1024.0 * 1024.0) / static_cast<double>(bytes) : 0.0;
+}
+
+inline double cpuSecondsPerGiB(double cpuSeconds, uint64_t bytes) {
+    return perGiB(cpuSeconds, bytes);
+}
+
+} // namespace bench
+} // namespace launcher
@@ -0,0 +1,585 @@
+#include "downloadmanager.hpp"
+#include "installmanager.hpp"
+#include "filewriter.hpp"
+#include "splicetransfer.hpp"
+#include "md5.hpp"
+#include "localserver.hpp"
+#include "allocationcounter.hpp"
+#include "testing.hpp"
+#include "benchmark.hpp"
+#include <fstream>
+#include <algorithm>
+
+// Download engine scenarios against LocalServer, an in-process httplib::Server. CPU time and
+// allocations are the whole process's and so include the server's side of every transfer;
+// the benchmark's own polling is left out of the allocations.
+//
+//   download_bench [--scenario name] [--scale factor] [--out report.json]
+
+using namespace launcher;
+using launcher::testing::AllocationCounter;
+using launcher::testing::LocalServer;
+using launcher::testing::ScratchDir;
+using launcher::testing::syntheticData;
+using launcher::testing::UncountedScope;
+using launcher::testing::waitUntil;
+using launcher::testing::writeFile;
+
+namespace {
+
+size_t scaled(size_t amount, double scale) {
+    return std::max<size_t>(1, static_cast<size_t>(static_cast<double>(amount) * scale));
+}
+
+const size_t kMiB = 1024 * 1024;
+
+bool waitIdle(const DownloadManager& manager) {
+    UncountedScope uncounted;
+    return waitUntil([&] { return !manager.isBusy(); }, std::chrono::minutes(30));
+}
+
+// Wait for one download; true if it completed
+bool waitFor(const DownloadManager& manager, int id) {
+    UncountedScope uncounted;
+    waitUntil([&] {
+        DownloadInfo info = manager.getDownloadInfo(id);
+        return info.isCompleted || info.isFailed;
+    }, std::chrono::minutes(30));
+    return manager.getDownloadInfo(id).isCompleted;
+}
+
+// Wait until a download has at least bytes on disk
+void waitForBytes(const DownloadManager& manager, int id, size_t bytes) {
+    UncountedScope uncounted;
+    waitUntil([&] {
+        DownloadInfo info = manager.getDownloadInfo(id);
+        return info.downloadedSize >= bytes || info.isCompleted || info.isFailed;
+    }, std::chrono::minutes(30));
+}
+
+// Start every URL into dir and wait for all of them; returns how many completed
+size_t downloadAll(DownloadManager& manager, const std::vector<std::string>& urls, const std::string& dir,
+                   const DownloadOptions& options) {
+    std::vector<int> ids;
+    ids.reserve(urls.size());
+    for (const auto& url : urls) {
+        ids.push_back(manager.startDownload(url, dir, "", options));
+    }
+    waitIdle(manager);
+
+    UncountedScope uncounted;
+    size_t completed = 0;
+    for (int id : ids) {
+        completed += manager.getDownloadInfo(id).isCompleted ? 1 : 0;
+    }
+    return completed;
+}
+
+std::string md5Of(const std::string& content) {
+    Md5 md5;
+    md5.update(content.data(), content.size());
+    return md5.hexDigest();
+}
+
+// What every engine scenario reports. Bytes are what the engine received, retries and
+// refetched prefixes included; CPU is the process's while a download ran.
+bench::Measurement engineMeasurement(const char* scenario, const std::string& variant,
+                                     const DownloadManager& manager, const bench::Stopwatch& watch,
+                                     const AllocationCounter& allocations) {
+    double seconds = watch.seconds();
+    EngineMetrics::Stats engine = manager.getEngineStats();
+    bench::Measurement measurement(scenario, variant);
+    measurement.set("seconds", seconds)
+        .set("MBps", bench::megabytesPerSecond(engine.bytes, seconds))
+        .set("ttfbP50Ms", engine.firstByteP50Ms)
+        .set("ttfbP99Ms", engine.firstByteP99Ms)
+        .set("cpuSeconds", engine.cpuSeconds)
+        .set("cpuSecondsPerGiB", engine.cpuSecondsPerGiB)
+        .set("allocations", static_cast<double>(allocations.count()))
+        .set("allocationsPerGiB", bench::perGiB(static_cast<double>(allocations.count()), engine.bytes));
+    return measurement;
+}
+
+// Thousands of small files, as a game install has them: one worker against a pool
+void smallFiles(const bench::Options& options, bench::Report& report) {
+    const size_t count = scaled(5000, options.scale);
+    const size_t size = 4 * 1024;
+
+    LocalServer server;
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; ++i) {
+        server.serve("small" + std::to_string(i), syntheticData(size, static_cast<uint32_t>(i)));
+        urls.push_back(server.url("small" + std::to_string(i)));
+    }
+
+    DownloadOptions download;
+    download.segments = 1;
+    for (size_t workers : {size_t(1), size_t(8)}) {
+        ScratchDir dir("bench-small");
+        DownloadManager manager(workers, workers);
+
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        size_t completed = downloadAll(manager, urls, dir.path().string(), download);
+
+        report.add(engineMeasurement("small-files", std::to_string(workers) + " workers", manager, watch,
+                                     allocations)
+                       .set("files", static_cast<double>(completed))
+                       .set("filesPerSecond", static_cast<double>(completed) / watch.seconds()));
+    }
+}
+
+// Many mid-sized objects from one host, where connecting would cost as much as the transfer
+void keepAlive(const bench::Options& options, bench::Report& report) {
+    const size_t count = scaled(10000, options.scale);
+    const size_t size = 64 * 1024;
+
+    LocalServer server;
+    std::vector<std::string> urls;
+    std::string content = syntheticData(size, 1);
+    for (size_t i = 0; i < count; ++i) {
+        server.serve("object" + std::to_string(i), content);
+        urls.push_back(server.url("object" + std::to_string(i)));
+    }
+
+    ScratchDir dir("bench-keepalive");
+    DownloadManager manager(4, 4);
+    DownloadOptions download;
+    download.segments = 1;
+
+    bench::Stopwatch watch;
+    AllocationCounter allocations;
+    size_t completed = downloadAll(manager, urls, dir.path().string(), download);
+
+    ConnectionPool::Stats stats = manager.getConnectionStats();
+    report.add(engineMeasurement("keep-alive", "4 workers", manager, watch, allocations)
+                   .set("files", static_cast<double>(completed))
+                   .set("filesPerSecond", static_cast<double>(completed) / watch.seconds())
+                   .set("connections", static_cast<double>(server.connections()))
+                   .set("reuseRatio", stats.reuseRatio)
+                   .set("newConnectionLatencyMs", stats.newConnectionLatencyMs)
+                   .set("reusedConnectionLatencyMs", stats.reusedConnectionLatencyMs));
+}
+
+// One multi-gigabyte file, over a single stream and over parallel ranges
+void hugeFile(const bench::Options& options, bench::Report& report) {
+    const size_t size = scaled(2048, options.scale) * kMiB;
+
+    LocalServer server;
+    std::string content = syntheticData(size, 1);
+    DownloadOptions download;
+    download.expectedMd5 = md5Of(content);
+    server.serve("huge.pak", std::move(content));
+
+    for (int segments : {1, 8}) {
+        ScratchDir dir("bench-huge");
+        DownloadManager manager(1, 1);
+        download.segments = segments;
+
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        int id = manager.startDownload(server.url("huge.pak"), dir.path().string(), "", download);
+        bool completed = waitFor(manager, id);
+
+        report.add(engineMeasurement("huge-file", std::to_string(segments) + (segments == 1 ? " stream" : " segments"),
+                                     manager, watch, allocations)
+                       .set("completed", completed ? 1.0 : 0.0)
+                       .set("requests", static_cast<double>(server.totalRequests())));
+        server.resetCounters();
+    }
+}
+
+// Picking a file up again: after a dropped connection, after a pause, and after a restart
+// that restores it from the journal. Only the part after the interruption is measured.
+void resume(const bench::Options& options, bench::Report& report) {
+    const size_t size = scaled(512, options.scale) * kMiB;
+
+    LocalServer server;
+    std::string content = syntheticData(size, 2);
+    DownloadOptions download;
+    download.expectedMd5 = md5Of(content);
+    server.serve("file.pak", std::move(content));
+
+    // Slow enough to interrupt halfway
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 64 * kMiB;
+
+    {
+        ScratchDir dir("bench-resume");
+        LocalServer::Behavior dropping;
+        dropping.dropAfter = size / 2;
+        server.setBehavior("file.pak", dropping);
+        server.resetCounters();
+        DownloadManager manager(1, 1);
+        DownloadOptions single = download;
+        single.segments = 1;
+
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        int id = manager.startDownload(server.url("file.pak"), dir.path().string(), "", single);
+        bool completed = waitFor(manager, id);
+        report.add(engineMeasurement("resume", "dropped connection", manager, watch, allocations)
+                       .set("completed", completed ? 1.0 : 0.0)
+                       .set("requests", static_cast<double>(server.totalRequests())));
+    }
+
+    {
+        ScratchDir dir("bench-resume");
+        server.setBehavior("file.pak", paced);
+        DownloadManager manager(1, 1);
+        int id = manager.startDownload(server.url("file.pak"), dir.path().string(), "", download);
+        waitForBytes(manager, id, size / 2);
+        manager.pauseDownload(id);
+        // A paused download stays queued, so the manager is never idle; its transfers stop at
+        // their next chunk, well within this
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        server.setBehavior("file.pak", LocalServer::Behavior());
+        server.resetCounters();
+        manager.resetEngineStats();
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        manager.resumeDownload(id);
+        bool completed = waitFor(manager, id);
+        report.add(engineMeasurement("resume", "pause", manager, watch, allocations)
+                       .set("completed", completed ? 1.0 : 0.0)
+                       .set("requests", static_cast<double>(server.totalRequests())));
+    }
+
+    {
+        ScratchDir dir("bench-resume");
+        std::string journal = dir.file("downloads.journal");
+        server.setBehavior("file.pak", paced);
+        {
+            DownloadManager manager(1, 1, journal);
+            int id = manager.startDownload(server.url("file.pak"), dir.file("game"), "", download);
+            waitForBytes(manager, id, size / 2);
+            // The launcher exits with the download running
+        }
+
+        server.setBehavior("file.pak", LocalServer::Behavior());
+        server.resetCounters();
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        DownloadManager manager(1, 1, journal);
+        waitIdle(manager);
+        auto measurement = engineMeasurement("resume", "restart", manager, watch, allocations);
+        bool completed = Md5::hashFile(dir.file("game/file.pak")) == download.expectedMd5;
+        report.add(measurement.set("completed", completed ? 1.0 : 0.0)
+                       .set("requests", static_cast<double>(server.totalRequests())));
+    }
+}
+
+// Downloads cancelled moments after they start, as when a user backs out of a large install:
+// how long the engine takes to wind down, and that it still works afterwards
+void cancelStorm(const bench::Options& options, bench::Report& report) {
+    const size_t count = 64;
+    const size_t rounds = scaled(10, options.scale);
+
+    LocalServer server;
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(20);
+    slow.bytesPerSecond = 4 * kMiB;
+    std::string content = syntheticData(4 * kMiB, 3);
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; ++i) {
+        server.serve("file" + std::to_string(i), content, slow);
+        urls.push_back(server.url("file" + std::to_string(i)));
+    }
+
+    ScratchDir dir("bench-cancel");
+    DownloadManager manager(8, 8);
+    DownloadOptions download;
+    download.segments = 1;
+
+    bench::Stopwatch watch;
+    AllocationCounter allocations;
+    std::vector<double> drainMs;
+    for (size_t round = 0; round < rounds; ++round) {
+        std::vector<int> ids;
+        for (const auto& url : urls) {
+            ids.push_back(manager.startDownload(url, dir.file(std::to_string(round)), "", download));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto start = std::chrono::steady_clock::now();
+        for (int id : ids) {
+            manager.cancelDownload(id);
+        }
+        waitIdle(manager);
+        drainMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    auto measurement = engineMeasurement("cancel-storm", std::to_string(count) + " downloads", manager, watch,
+                                         allocations);
+
+    server.setBehavior("file0", LocalServer::Behavior());
+    bool completed = waitFor(manager, manager.startDownload(urls[0], dir.file("after"), "", download));
+
+    std::sort(drainMs.begin(), drainMs.end());
+    report.add(measurement.set("cancelled", static_cast<double>(count * rounds))
+                   .set("drainP50Ms", drainMs[drainMs.size() / 2])
+                   .set("drainMaxMs", drainMs.back())
+                   .set("completedAfter", completed ? 1.0 : 0.0));
+}
+
+// Small files behind a slow first byte, as from a distant CDN edge
+void latency(const bench::Options& options, bench::Report& report) {
+    const size_t count = scaled(500, options.scale);
+    const size_t size = 64 * 1024;
+    std::string content = syntheticData(size, 4);
+
+    for (int ms : {0, 20, 100}) {
+        LocalServer server;
+        LocalServer::Behavior delayed;
+        delayed.latency = std::chrono::milliseconds(ms);
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < count; ++i) {
+            server.serve("file" + std::to_string(i), content, delayed);
+            urls.push_back(server.url("file" + std::to_string(i)));
+        }
+
+        ScratchDir dir("bench-latency");
+        DownloadManager manager(8, 8);
+        DownloadOptions download;
+        download.segments = 1;
+
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        size_t completed = downloadAll(manager, urls, dir.path().string(), download);
+        report.add(engineMeasurement("latency", std::to_string(ms) + " ms", manager, watch, allocations)
+                       .set("files", static_cast<double>(completed))
+                       .set("filesPerSecond", static_cast<double>(completed) / watch.seconds()));
+    }
+}
+
+// A limited link: every connection paced by the server, so throughput comes from the
+// connection window growing; then a client-side cap, which holds however many connections run
+void bandwidth(const bench::Options& options, bench::Report& report) {
+    const size_t size = scaled(256, options.scale) * kMiB;
+    const uint64_t perConnection = 4 * kMiB;
+    const uint64_t cap = 32 * kMiB;
+
+    LocalServer server;
+    std::string content = syntheticData(size, 5);
+    DownloadOptions download;
+    download.segments = 32;
+    download.expectedMd5 = md5Of(content);
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = perConnection;
+    server.serve("file.pak", std::move(content), paced);
+
+    {
+        ScratchDir dir("bench-bandwidth");
+        DownloadManager manager(1, 1);
+
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        bool completed = waitFor(manager, manager.startDownload(server.url("file.pak"), dir.path().string(), "",
+                                                                download));
+        auto hosts = manager.getHostStats();
+        report.add(engineMeasurement("bandwidth", "server 4 MB/s per connection", manager, watch, allocations)
+                       .set("completed", completed ? 1.0 : 0.0)
+                       .set("peakConnections", static_cast<double>(server.peakInFlight()))
+                       .set("connectionWindow", hosts.empty() ? 0.0 : static_cast<double>(hosts.front().limit)));
+    }
+
+    {
+        ScratchDir dir("bench-bandwidth");
+        server.setBehavior("file.pak", LocalServer::Behavior());
+        server.resetCounters();
+        DownloadManager manager(1, 1);
+        manager.setGlobalRateLimit(cap);
+
+        bench::Stopwatch watch;
+        AllocationCounter allocations;
+        bool completed = waitFor(manager, manager.startDownload(server.url("file.pak"), dir.path().string(), "",
+                                                                download));
+        report.add(engineMeasurement("bandwidth", "client cap 32 MB/s", manager, watch, allocations)
+                       .set("completed", completed ? 1.0 : 0.0)
+                       .set("capMBps", static_cast<double>(cap / kMiB))
+                       .set("peakConnections", static_cast<double>(server.peakInFlight())));
+    }
+}
+
+// Verify an intact multi-gigabyte install: nothing is fetched, so this is the hashing rate
+void verifyTree(const bench::Options& options, bench::Report& report) {
+    const size_t count = scaled(64, options.scale);
+    const size_t size = 32 * 1024 * 1024;
+
+    ScratchDir dir("bench-verify");
+    LocalServer server;
+    std::vector<ResourceEntry> resources;
+    for (size_t i = 0; i < count; ++i) {
+        std::string content = syntheticData(size, static_cast<uint32_t>(i));
+        Md5 md5;
+        md5.update(content.data(), content.size());
+
+        ResourceEntry entry;
+        entry.dest = "/data/pak" + std::to_string(i) + ".pak";
+        entry.size = content.size();
+        entry.md5 = md5.hexDigest();
+        resources.push_back(entry);
+        writeFile(dir.file("data/pak" + std::to_string(i) + ".pak"), content);
+    }
+
+    DownloadManager downloads(4, 4);
+    InstallManager installs(downloads);
+
+    bench::Stopwatch watch;
+    int installId = installs.startVerify(server.url("game"), resources, dir.path().string());
+    waitUntil([&] {
+        std::string state = installs.getInstallInfo(installId).state;
+        return state == "completed" || state == "failed" || state == "cancelled";
+    }, std::chrono::minutes(30));
+    double seconds = watch.seconds();
+
+    InstallInfo info = installs.getInstallInfo(installId);
+    report.add(bench::Measurement{"verify-tree", std::to_string(Md5::laneWidth()) + " lanes"}
+                   .set("files", static_cast<double>(info.checkedFiles))
+                   .set("seconds", seconds)
+                   .set("MBps", bench::megabytesPerSecond(info.checkedBytes, seconds))
+                   .set("checkMBps", info.checkBytesPerSecond / (1024.0 * 1024.0))
+                   .set("cpuSecondsPerGiB", bench::cpuSecondsPerGiB(watch.cpuSeconds(), info.checkedBytes))
+                   .set("refetched", static_cast<double>(info.queuedFiles)));
+}
+
+// The write path alone: 16 KB network chunks into one write per chunk, into FileWriter's
+// staging buffer, and into FileWriter with the DiskWriter stage
+void fileWriter(const bench::Options& options, bench::Report& report) {
+    const size_t chunk = 16 * 1024;
+    const uint64_t total = scaled(1024, options.scale) * 1024ull * 1024;
+    std::string data = syntheticData(chunk, 1);
+
+    auto measure = [&](const char* variant, const std::function<uint64_t(const std::string& path)>& run) {
+        ScratchDir dir("bench-writer");
+        bench::Stopwatch watch;
+        uint64_t requests = run(dir.file("out.bin"));
+        double seconds = watch.seconds();
+        report.add(bench::Measurement{"file-writer", variant}
+                       .set("MBps", bench::megabytesPerSecond(total, seconds))
+                       .set("cpuSecondsPerGiB", bench::cpuSecondsPerGiB(watch.cpuSeconds(), total))
+                       .set("writeRequests", static_cast<double>(requests)));
+    };
+
+    measure("write per chunk", [&](const std::string& path) {
+        std::ofstream file;
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        file.open(path, std::ios::binary | std::ios::trunc);
+        uint64_t requests = 0;
+        for (uint64_t done = 0; done < total; done += chunk, ++requests) {
+            file.write(data.data(), static_cast<std::streamsize>(chunk));
+        }
+        return requests;
+    });
+
+    measure("staged", [&](const std::string& path) {
+        FileWriter writer;
+        writer.open(path, 0, true);
+        for (uint64_t done = 0; done < total; done += chunk) {
+            writer.write(data.data(), chunk);
+        }
+        writer.close();
+        return (total + FileWriter::kBufferSize - 1) / FileWriter::kBufferSize;
+    });
+
+    measure("staged + disk stage", [&](const std::string& path) {
+        DiskWriter stage;
+        FileWriter writer;
+        writer.setWriteStage(&stage);
+        writer.open(path, 0, true);
+        for (uint64_t done = 0; done < total; done += chunk) {
+            writer.write(data.data(), chunk);
+        }
+        writer.close();
+        return stage.getStats().writes;
+    });
+}
+
+// One large body over plain HTTP, spliced from the socket into the file or read by httplib
+// and written through FileWriter, as the engine does where splicing is not available
+void splice(const bench::Options& options, bench::Report& report) {
+    const size_t size = 64 * 1024 * 1024;
+    const size_t rounds = scaled(16, options.scale);
+    const uint64_t total = static_cast<uint64_t>(rounds) * size;
+
+    LocalServer server;
+    server.serve("file.pak", syntheticData(size, 1));
+
+    auto measure = [&](const char* variant, const std::function<bool(const std::string& path)>& fetch) {
+        ScratchDir dir("bench-splice");
+        writeFile(dir.file("out.bin"), "");
+        size_t completed = 0;
+
+        bench::Stopwatch watch;
+        for (size_t i = 0; i < rounds; ++i) {
+            completed += fetch(dir.file("out.bin")) ? 1 : 0;
+        }
+        double seconds = watch.seconds();
+
+        uint64_t bytes = static_cast<uint64_t>(completed) * size;
+        report.add(bench::Measurement{"splice", variant}
+                       .set("transfers", static_cast<double>(completed))
+                       .set("MBps", bench::megabytesPerSecond(bytes, seconds))
+                       .set("cpuSecondsPerGiB", bench::cpuSecondsPerGiB(watch.cpuSeconds(), total)));
+    };
+
+    measure("splice", [&](const std::string& path) {
+        SpliceTransfer transfer;
+        if (!transfer.open(path)) {
+            return false;
+        }
+        return transfer.fetch(server.host(), server.port(), "/file.pak", 0, size,
+                              [](int status, std::chrono::steady_clock::duration) { return status == 206; },
+                              [](size_t) { return true; }) == SpliceTransfer::Outcome::Completed;
+    });
+
+    measure("httplib", [&](const std::string& path) {
+        FileWriter writer;
+        if (!writer.open(path, 0, false)) {
+            return false;
+        }
+        httplib::Client client(server.host(), server.port());
+        httplib::Headers headers = {{"Range", "bytes=0-" + std::to_string(size - 1)}};
+        auto res = client.Get("/file.pak", headers, [&](const char* data, size_t length) {
+            return writer.write(data, length);
+        });
+        return writer.close() && res && res->status == 206;
+    });
+}
+
+struct Scenario {
+    const char* name;
+    void (*run)(const bench::Options& options, bench::Report& report);
+};
+
+const Scenario kScenarios[] = {
+    {"small-files", smallFiles},
+    {"keep-alive", keepAlive},
+    {"huge-file", hugeFile},
+    {"resume", resume},
+    {"cancel-storm", cancelStorm},
+    {"latency", latency},
+    {"bandwidth", bandwidth},
+    {"verify-tree", verifyTree},
+    {"file-writer", fileWriter},
+    {"splice", splice},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bench::Options options = bench::parseOptions(argc, argv);
+    bench::Report report("download_bench");
+
+    for (const auto& scenario : kScenarios) {
+        if (options.scenario.empty() || std::string(scenario.name).find(options.scenario) != std::string::npos) {
+            scenario.run(options, report);
+        }
+    }
+
+    if (!report.write(options.out)) {
+        std::fprintf(stderr, "Cannot write %s\n", options.out.c_str());
+        return 1;
+    }
+    return 0;
+}
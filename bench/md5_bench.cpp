@@ -0,0 +1,140 @@
+#include "md5.hpp"
+#include "md5lanes.hpp"
+#include "testing.hpp"
+#include "benchmark.hpp"
+#include <array>
+
+// MD5 throughput of the scalar path, of every lane kernel this CPU runs, and of
+// Md5::updateLanes as the install checker drives it.
+//
+//   md5_bench [--scenario name] [--scale factor] [--out report.json]
+
+using namespace launcher;
+using launcher::testing::syntheticData;
+
+namespace {
+
+// Bytes hashed per variant at scale 1
+constexpr uint64_t kBytes = 1024ull * 1024 * 1024;
+// Data of one stream per pass, as the checker reads it
+constexpr size_t kChunk = 1024 * 1024;
+
+// Results land here so the hashing is not optimized away
+volatile uint32_t g_sink = 0;
+
+uint64_t scaledBytes(double scale) {
+    return std::max<uint64_t>(kChunk, static_cast<uint64_t>(static_cast<double>(kBytes) * scale));
+}
+
+void scalar(const bench::Options& options, bench::Report& report) {
+    std::string data = syntheticData(kChunk, 1);
+    uint64_t total = scaledBytes(options.scale);
+
+    Md5 md5;
+    bench::Stopwatch watch;
+    for (uint64_t done = 0; done < total; done += kChunk) {
+        md5.update(data.data(), data.size());
+    }
+    double seconds = watch.seconds();
+    g_sink = static_cast<uint32_t>(md5.hexDigest()[0]);
+
+    report.add(bench::Measurement{"scalar", "update"}
+                   .set("MBps", bench::megabytesPerSecond(total, seconds))
+                   .set("cpuSecondsPerGiB", bench::cpuSecondsPerGiB(watch.cpuSeconds(), total)));
+}
+
+// Each kernel alone, compressing a full set of lanes per call
+void kernels(const bench::Options& options, bench::Report& report) {
+    uint64_t total = scaledBytes(options.scale);
+
+    for (const auto& kernel : md5lanes::availableKernels()) {
+        std::vector<std::string> lanes;
+        std::vector<std::array<uint32_t, 4>> states(kernel.lanes, {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476});
+        std::vector<uint32_t*> statePointers;
+        std::vector<const uint8_t*> inputs;
+        for (int lane = 0; lane < kernel.lanes; ++lane) {
+            lanes.push_back(syntheticData(kChunk, static_cast<uint32_t>(lane + 2)));
+        }
+        for (int lane = 0; lane < kernel.lanes; ++lane) {
+            statePointers.push_back(states[lane].data());
+            inputs.push_back(reinterpret_cast<const uint8_t*>(lanes[lane].data()));
+        }
+
+        uint64_t perCall = static_cast<uint64_t>(kChunk) * kernel.lanes;
+        bench::Stopwatch watch;
+        uint64_t done = 0;
+        for (; done < total; done += perCall) {
+            kernel.compress(statePointers.data(), inputs.data(), kChunk / 64);
+        }
+        double seconds = watch.seconds();
+        g_sink = states[0][0];
+
+        report.add(bench::Measurement{"kernel", kernel.name}
+                       .set("lanes", kernel.lanes)
+                       .set("MBps", bench::megabytesPerSecond(done, seconds))
+                       .set("cpuSecondsPerGiB", bench::cpuSecondsPerGiB(watch.cpuSeconds(), done)));
+    }
+}
+
+// The checker's loop: one chunk of every open file per updateLanes call
+void lanes(const bench::Options& options, bench::Report& report) {
+    uint64_t total = scaledBytes(options.scale);
+    size_t width = Md5::laneWidth();
+
+    std::vector<std::string> streams;
+    for (size_t lane = 0; lane < width; ++lane) {
+        streams.push_back(syntheticData(kChunk, static_cast<uint32_t>(lane + 100)));
+    }
+
+    std::vector<Md5> hashers(width);
+    std::vector<Md5*> pointers;
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> lengths(width, kChunk);
+    for (size_t lane = 0; lane < width; ++lane) {
+        pointers.push_back(&hashers[lane]);
+        data.push_back(reinterpret_cast<const uint8_t*>(streams[lane].data()));
+    }
+
+    bench::Stopwatch watch;
+    uint64_t done = 0;
+    for (; done < total; done += static_cast<uint64_t>(kChunk) * width) {
+        Md5::updateLanes(pointers.data(), data.data(), lengths.data(), width);
+    }
+    double seconds = watch.seconds();
+    g_sink = static_cast<uint32_t>(hashers[0].hexDigest()[0]);
+
+    report.add(bench::Measurement{"update-lanes", Md5::laneKernel()}
+                   .set("lanes", static_cast<double>(width))
+                   .set("MBps", bench::megabytesPerSecond(done, seconds))
+                   .set("cpuSecondsPerGiB", bench::cpuSecondsPerGiB(watch.cpuSeconds(), done)));
+}
+
+struct Scenario {
+    const char* name;
+    void (*run)(const bench::Options& options, bench::Report& report);
+};
+
+const Scenario kScenarios[] = {
+    {"scalar", scalar},
+    {"kernel", kernels},
+    {"update-lanes", lanes},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bench::Options options = bench::parseOptions(argc, argv);
+    bench::Report report("md5_bench");
+
+    for (const auto& scenario : kScenarios) {
+        if (options.scenario.empty() || std::string(scenario.name).find(options.scenario) != std::string::npos) {
+            scenario.run(options, report);
+        }
+    }
+
+    if (!report.write(options.out)) {
+        std::fprintf(stderr, "Cannot write %s\n", options.out.c_str());
+        return 1;
+    }
+    return 0;
+}
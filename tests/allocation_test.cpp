@@ -0,0 +1,136 @@
+#include "allocationcounter.hpp"
+#include "downloadmanager.hpp"
+#include "diskwriter.hpp"
+#include "filewriter.hpp"
+#include "tokenbucket.hpp"
+#include "md5.hpp"
+#include "localserver.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const size_t kMiB = 1024 * 1024;
+
+// httplib hands the body over in pieces of up to CPPHTTPLIB_RECV_BUFSIZ, 16 KiB by default
+const size_t kChunk = 16 * 1024;
+
+std::string md5Of(const std::string& content) {
+    Md5 md5;
+    md5.update(content.data(), content.size());
+    return md5.hexDigest();
+}
+
+// Allocations of the engine and the server while the download runs; the polling is not counted
+uint64_t allocationsOf(DownloadManager& manager, const std::string& url, const std::string& dir,
+                       const DownloadOptions& options, bool& completed) {
+    AllocationCounter counter;
+    int id = manager.startDownload(url, dir, "", options);
+    {
+        UncountedScope uncounted;
+        waitUntil([&] {
+            DownloadInfo info = manager.getDownloadInfo(id);
+            return info.isCompleted || info.isFailed;
+        });
+        completed = manager.getDownloadInfo(id).isCompleted;
+    }
+    return counter.count();
+}
+
+} // namespace
+
+TEST_CASE(counterSeesAllocations) {
+    AllocationCounter counter;
+    std::vector<char> counted(100, 'x');
+    CHECK(counter.count() == 1);
+    CHECK(counter.bytes() == 100);
+
+    {
+        UncountedScope uncounted;
+        std::vector<char> ignored(counted);
+        CHECK(ignored.size() == 100);
+    }
+    CHECK(counter.count() == 1);
+}
+
+TEST_CASE(chunkPipelineDoesNotAllocate) {
+    ScratchDir dir("alloc-pipeline");
+    std::string chunk = syntheticData(kChunk, 1);
+
+    // What a download does per received chunk: stage it for the disk, hash it, pace it
+    DiskWriter stage;
+    FileWriter writer;
+    writer.setWriteStage(&stage);
+    REQUIRE(writer.open(dir.file("out.bin"), 0, true));
+    Md5 md5;
+    TokenBucket bucket(1024ull * 1024 * 1024 * 1024);
+
+    auto receive = [&](size_t count) {
+        bool ok = true;
+        for (size_t i = 0; i < count; ++i) {
+            ok = writer.write(chunk.data(), chunk.size()) && ok;
+            md5.update(chunk.data(), chunk.size());
+            bucket.consume(chunk.size());
+        }
+        return ok;
+    };
+
+    // Warm-up fills the buffer and job pools
+    CHECK(receive(64 * kMiB / kChunk));
+
+    AllocationCounter counter;
+    const size_t chunks = 256 * kMiB / kChunk;
+    CHECK(receive(chunks));
+    uint64_t allocations = counter.count();
+    std::printf("  %llu allocations over %zu chunks\n", static_cast<unsigned long long>(allocations), chunks);
+    CHECK(allocations == 0);
+
+    CHECK(writer.close());
+    CHECK(std::filesystem::file_size(dir.file("out.bin")) == (64 + 256) * kMiB);
+}
+
+TEST_CASE(downloadChunksDoNotAllocate) {
+    ScratchDir dir("alloc-download");
+    LocalServer server;
+    std::string small = syntheticData(1 * kMiB, 2);
+    std::string large = syntheticData(65 * kMiB, 3);
+    server.serve("small.pak", small);
+    server.serve("large.pak", large);
+
+    // One stream per file, so the large one differs from the small one only in its chunks
+    DownloadManager manager(1, 1);
+    DownloadOptions smallOptions;
+    smallOptions.segments = 1;
+    smallOptions.expectedMd5 = md5Of(small);
+    DownloadOptions largeOptions = smallOptions;
+    largeOptions.expectedMd5 = md5Of(large);
+
+    // Warm-up: the connection, the write buffers and the engine's bookkeeping
+    bool completed = false;
+    allocationsOf(manager, server.url("large.pak"), dir.file("warm"), largeOptions, completed);
+    REQUIRE(completed);
+
+    uint64_t smallAllocations = allocationsOf(manager, server.url("small.pak"), dir.file("small"), smallOptions,
+                                              completed);
+    REQUIRE(completed);
+    uint64_t largeAllocations = allocationsOf(manager, server.url("large.pak"), dir.file("large"), largeOptions,
+                                              completed);
+    REQUIRE(completed);
+    CHECK(readFile(dir.file("large/large.pak")) == large);
+
+    const size_t extraChunks = (large.size() - small.size()) / kChunk;
+    uint64_t extra = largeAllocations > smallAllocations ? largeAllocations - smallAllocations : 0;
+    std::printf("  %llu allocations for 1 MiB, %llu for 65 MiB (%zu more chunks)\n",
+                static_cast<unsigned long long>(smallAllocations), static_cast<unsigned long long>(largeAllocations),
+                extraChunks);
+
+    // Nothing per chunk; what remains comes with time (progress reports, checkpoints every
+    // 32 MiB, controller windows), not with the number of chunks
+    CHECK(extra < extraChunks / 32);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
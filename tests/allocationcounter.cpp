@@ -0,0 +1,157 @@
+#include "allocationcounter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+std::atomic<uint64_t> g_bytes{0};
+thread_local bool t_uncounted = false;
+
+void count(std::size_t size) {
+    if (t_uncounted) {
+        return;
+    }
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void* allocate(std::size_t size) {
+    count(size);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+    count(size);
+    size = size > 0 ? size : 1;
+#ifdef _WIN32
+    return _aligned_malloc(size, static_cast<std::size_t>(alignment));
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, static_cast<std::size_t>(alignment), size) != 0) {
+        return nullptr;
+    }
+    return memory;
+#endif
+}
+
+void releaseAligned(void* memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+} // namespace
+
+namespace launcher {
+namespace testing {
+
+uint64_t allocationCount() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t allocatedBytes() {
+    return g_bytes.load(std::memory_order_relaxed);
+}
+
+UncountedScope::UncountedScope() : m_previous(t_uncounted) {
+    t_uncounted = true;
+}
+
+UncountedScope::~UncountedScope() {
+    t_uncounted = m_previous;
+}
+
+} // namespace testing
+} // namespace launcher
+
+void* operator new(std::size_t size) {
+    void* memory = allocate(size);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* memory = allocateAligned(size, alignment);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    releaseAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    releaseAligned(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    releaseAligned(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+    releaseAligned(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    releaseAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    releaseAligned(memory);
+}
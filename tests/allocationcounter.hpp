@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts heap allocations of the whole process, every thread included. Programs that use it
+// compile allocationcounter.cpp in, which replaces the global operator new and delete; it is
+// not part of the engine library, so only those programs pay for the counting.
+
+namespace launcher {
+namespace testing {
+
+// Calls to operator new, and the bytes they asked for, since the process started
+uint64_t allocationCount();
+uint64_t allocatedBytes();
+
+// Leaves the current thread's allocations out while it lives, e.g. a test polling the engine
+class UncountedScope {
+public:
+    UncountedScope();
+    ~UncountedScope();
+
+    UncountedScope(const UncountedScope&) = delete;
+    UncountedScope& operator=(const UncountedScope&) = delete;
+
+private:
+    bool m_previous;
+};
+
+// Allocations since construction
+class AllocationCounter {
+public:
+    AllocationCounter() : m_count(allocationCount()), m_bytes(allocatedBytes()) {
+    }
+
+    uint64_t count() const { return allocationCount() - m_count; }
+    uint64_t bytes() const { return allocatedBytes() - m_bytes; }
+
+private:
+    uint64_t m_count;
+    uint64_t m_bytes;
+};
+
+} // namespace testing
+} // namespace launcher
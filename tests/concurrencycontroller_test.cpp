@@ -0,0 +1,179 @@
+#include "concurrencycontroller.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+// Drives one host through measurement windows on a simulated clock. Every window the
+// downloads want more connections than the host allows, and each connection gets
+// perConnection bytes per second until the host's capacity is reached.
+class Simulation {
+public:
+    Simulation(size_t initialLimit, size_t maxLimit)
+        : m_controller(initialLimit, maxLimit), m_now(std::chrono::steady_clock::now()) {
+    }
+
+    ConcurrencyController& controller() { return m_controller; }
+
+    size_t limit() const { return m_controller.getStats().front().limit; }
+    ConcurrencyController::HostStats stats() const { return m_controller.getStats().front(); }
+
+    // One window; status and failures are what the host answers with meanwhile
+    void window(double perConnection, double capacity, double latencyMs = 20.0, int status = 200,
+                size_t failures = 0) {
+        while (m_controller.tryAcquire(kHost)) {
+            ++m_held;
+        }
+
+        double goodput = std::min(perConnection * static_cast<double>(m_held), capacity);
+        m_controller.recordBytes(kHost, static_cast<uint64_t>(goodput * kWindow.count()));
+        m_controller.recordResponse(
+            kHost, std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double, std::milli>(latencyMs)),
+            status);
+        for (size_t i = 0; i < failures; ++i) {
+            m_controller.recordFailure(kHost);
+        }
+
+        m_now += std::chrono::duration_cast<std::chrono::steady_clock::duration>(kWindow);
+        m_controller.update(m_now);
+
+        // Connections over a shrunken window leave, as running transfers do between ranges
+        while (m_controller.shrink(kHost)) {
+            --m_held;
+        }
+    }
+
+    // Every connection finishes and the host sits idle for a window
+    void idle() {
+        for (; m_held > 0; --m_held) {
+            m_controller.release(kHost);
+        }
+        m_now += std::chrono::duration_cast<std::chrono::steady_clock::duration>(kWindow);
+        m_controller.update(m_now);
+    }
+
+    static constexpr const char* kHost = "cdn.example:443";
+
+private:
+    // A little over the controller's window, so every call closes one
+    static constexpr std::chrono::duration<double> kWindow{2.1};
+
+    ConcurrencyController m_controller;
+    std::chrono::steady_clock::time_point m_now;
+    size_t m_held = 0;
+};
+
+constexpr double kMB = 1024.0 * 1024.0;
+
+} // namespace
+
+TEST_CASE(windowGrowsWhileGoodputRises) {
+    // 1 MB/s per connection up to 10 MB/s: ten connections is the knee
+    Simulation sim(4, 32);
+    size_t peak = 0;
+    for (int i = 0; i < 60; ++i) {
+        sim.window(1 * kMB, 10 * kMB);
+        peak = std::max(peak, sim.limit());
+    }
+
+    CHECK(sim.stats().increases >= 6);
+    // It probes one past the knee, finds no gain and steps back
+    CHECK(peak == 11);
+    CHECK(sim.limit() >= 10);
+    CHECK(sim.limit() <= 11);
+}
+
+TEST_CASE(windowStopsAtTheMaximum) {
+    Simulation sim(4, 6);
+    for (int i = 0; i < 20; ++i) {
+        sim.window(1 * kMB, 100 * kMB);
+    }
+    CHECK(sim.limit() == 6);
+}
+
+TEST_CASE(throttlingHalvesTheWindow) {
+    for (int status : {429, 503}) {
+        Simulation sim(16, 32);
+        sim.window(1 * kMB, 100 * kMB);
+        size_t before = sim.limit();
+
+        sim.window(1 * kMB, 100 * kMB, 20.0, status);
+        CHECK(sim.limit() == before / 2);
+        CHECK(sim.stats().decreases == 1);
+
+        // It backs off for a while before probing upwards again
+        for (int i = 0; i < 5; ++i) {
+            sim.window(1 * kMB, 100 * kMB);
+            CHECK(sim.limit() == before / 2);
+        }
+        sim.window(1 * kMB, 100 * kMB);
+        CHECK(sim.limit() == before / 2 + 1);
+    }
+}
+
+TEST_CASE(failedConnectionsHalveTheWindow) {
+    Simulation sim(8, 32);
+    // A single failure is noise
+    sim.window(1 * kMB, 100 * kMB, 20.0, 200, 1);
+    size_t before = sim.limit();
+    CHECK(before >= 8);
+
+    sim.window(1 * kMB, 100 * kMB, 20.0, 200, 2);
+    CHECK(sim.limit() == before / 2);
+}
+
+TEST_CASE(windowNeverDropsBelowOne) {
+    Simulation sim(1, 32);
+    for (int i = 0; i < 5; ++i) {
+        sim.window(1 * kMB, 100 * kMB, 20.0, 503);
+        CHECK(sim.limit() == 1);
+    }
+}
+
+TEST_CASE(inflatedLatencyTakesOneConnectionAway) {
+    Simulation sim(8, 32);
+    sim.window(1 * kMB, 100 * kMB, 20.0);
+    size_t before = sim.limit();
+
+    // Well over twice the 20 ms baseline and more than 50 ms above it
+    sim.window(1 * kMB, 100 * kMB, 200.0);
+    CHECK(sim.limit() == before - 1);
+    CHECK(sim.stats().baseLatencyMs < 30.0);
+}
+
+TEST_CASE(idleHostKeepsItsWindow) {
+    Simulation sim(4, 32);
+    for (int i = 0; i < 4; ++i) {
+        sim.window(1 * kMB, 100 * kMB);
+    }
+    size_t before = sim.limit();
+    CHECK(before > 4);
+
+    for (int i = 0; i < 10; ++i) {
+        sim.idle();
+    }
+    CHECK(sim.limit() == before);
+    CHECK(sim.stats().inUse == 0);
+}
+
+TEST_CASE(slotsAreBoundedByTheWindow) {
+    ConcurrencyController controller(3, 8);
+    CHECK(controller.tryAcquire("a:80"));
+    CHECK(controller.tryAcquire("a:80"));
+    CHECK(controller.tryAcquire("a:80"));
+    CHECK(!controller.tryAcquire("a:80"));
+    // Hosts have separate windows
+    CHECK(controller.tryAcquire("b:80"));
+
+    // Nothing to give back while the host is within its window
+    CHECK(!controller.shrink("a:80"));
+    controller.release("a:80");
+    CHECK(controller.tryAcquire("a:80"));
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
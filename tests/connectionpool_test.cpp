@@ -0,0 +1,87 @@
+#include "connectionpool.hpp"
+#include "localserver.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+TEST_CASE(returnedClientIsReused) {
+    LocalServer server;
+    std::string content = syntheticData(64 * 1024, 1);
+    server.serve("file", content);
+
+    ConnectionPool pool;
+    {
+        auto lease = pool.acquire(server.host(), server.port());
+        CHECK(!lease.reused());
+        auto res = lease.client().Get("/file");
+        REQUIRE(res);
+        CHECK(res->body == content);
+    }
+    CHECK(pool.getStats().idle == 1);
+
+    for (int i = 0; i < 10; ++i) {
+        auto lease = pool.acquire(server.host(), server.port());
+        CHECK(lease.reused());
+        auto res = lease.client().Get("/file");
+        REQUIRE(res);
+        CHECK(res->status == 200);
+    }
+
+    ConnectionPool::Stats stats = pool.getStats();
+    CHECK(stats.leases == 11);
+    CHECK(stats.reused == 10);
+    CHECK(stats.reuseRatio > 0.9);
+    CHECK(server.connections() == 1);
+}
+
+TEST_CASE(hostsHaveSeparateClients) {
+    LocalServer first;
+    LocalServer second;
+    first.serve("file", "first");
+    second.serve("file", "second");
+
+    ConnectionPool pool;
+    for (auto* server : {&first, &second}) {
+        auto lease = pool.acquire(server->host(), server->port());
+        REQUIRE(lease.client().Get("/file"));
+    }
+    CHECK(pool.getStats().idle == 2);
+
+    auto lease = pool.acquire(second.host(), second.port());
+    auto res = lease.client().Get("/file");
+    REQUIRE(res);
+    CHECK(res->body == "second");
+}
+
+TEST_CASE(idleClientsPerHostAreBounded) {
+    LocalServer server;
+    server.serve("file", "content");
+
+    ConnectionPool pool(2);
+    {
+        // Four leases at once need four connections; only two are kept afterwards
+        std::vector<ConnectionPool::Lease> leases;
+        for (int i = 0; i < 4; ++i) {
+            leases.push_back(pool.acquire(server.host(), server.port()));
+            REQUIRE(leases.back().client().Get("/file"));
+        }
+    }
+    CHECK(pool.getStats().idle == 2);
+}
+
+TEST_CASE(closedClientsAreNotPooled) {
+    LocalServer server;
+    server.serve("file", "content");
+
+    ConnectionPool pool;
+    {
+        // Nothing was sent, so there is no open socket to keep
+        auto lease = pool.acquire(server.host(), server.port());
+    }
+    CHECK(pool.getStats().idle == 0);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,217 @@
+#include "contentstore.hpp"
+#include "md5.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const size_t kSize = 64 * 1024;
+
+std::string md5Of(const std::string& content) {
+    Md5 md5;
+    md5.update(content.data(), content.size());
+    return md5.hexDigest();
+}
+
+// Write a verified download into the install and hand it to the store. Files come out of the
+// store into beta/, which exists already as the download's destination would.
+std::string install(ContentStore& store, const ScratchDir& dir, const std::string& name, uint32_t seed) {
+    std::filesystem::create_directories(dir.path() / "beta");
+    std::string content = syntheticData(kSize, seed);
+    writeFile(dir.file("install/" + name), content);
+    std::string md5 = md5Of(content);
+    store.add(md5, dir.file("install/" + name));
+    return md5;
+}
+
+// Use order comes from mtimes, which some filesystems only keep to a few milliseconds
+void tick() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+} // namespace
+
+TEST_CASE(addedFileIsMaterializedElsewhere) {
+    ScratchDir dir("store-materialize");
+    ContentStore store;
+    store.open(dir.file("store"), 1024 * 1024);
+
+    std::string md5 = install(store, dir, "a.pak", 1);
+    CHECK(store.contains(md5));
+    CHECK(store.getStats().objects == 1);
+    CHECK(store.getStats().bytes == kSize);
+
+    uint64_t size = 0;
+    REQUIRE(store.materialize(md5, dir.file("beta/a.pak"), size));
+    CHECK(size == kSize);
+    CHECK(readFile(dir.file("beta/a.pak")) == syntheticData(kSize, 1));
+    CHECK(store.getStats().hits == 1);
+    CHECK(store.getStats().savedBytes == kSize);
+
+    // Same volume: the store, the install and the copy share one file
+    CHECK(std::filesystem::hard_link_count(dir.file("beta/a.pak")) == 3);
+}
+
+TEST_CASE(materializeReplacesTheTarget) {
+    ScratchDir dir("store-replace");
+    ContentStore store;
+    store.open(dir.file("store"), 1024 * 1024);
+    std::string md5 = install(store, dir, "a.pak", 2);
+
+    writeFile(dir.file("beta/a.pak"), "stale");
+    uint64_t size = 0;
+    REQUIRE(store.materialize(md5, dir.file("beta/a.pak"), size));
+    CHECK(readFile(dir.file("beta/a.pak")) == syntheticData(kSize, 2));
+
+    // Materializing over a link of the object itself leaves the object intact
+    REQUIRE(store.materialize(md5, dir.file("install/a.pak"), size));
+    CHECK(readFile(dir.file("install/a.pak")) == syntheticData(kSize, 2));
+    CHECK(store.contains(md5));
+}
+
+TEST_CASE(unknownContentIsNotMaterialized) {
+    ScratchDir dir("store-miss");
+    ContentStore store;
+    store.open(dir.file("store"), 1024 * 1024);
+
+    uint64_t size = 0;
+    CHECK(!store.materialize(md5Of("missing"), dir.file("a.pak"), size));
+    CHECK(!std::filesystem::exists(dir.file("a.pak")));
+    CHECK(store.getStats().hits == 0);
+}
+
+TEST_CASE(leastRecentlyUsedIsEvictedFirst) {
+    ScratchDir dir("store-lru");
+    ContentStore store;
+    store.open(dir.file("store"), 3 * kSize);
+
+    std::string a = install(store, dir, "a.pak", 3);
+    std::string b = install(store, dir, "b.pak", 4);
+    std::string c = install(store, dir, "c.pak", 5);
+    uint64_t size = 0;
+    REQUIRE(store.materialize(a, dir.file("beta/a.pak"), size));
+
+    // The fourth file goes over the budget; b is now the least recently used
+    std::string d = install(store, dir, "d.pak", 6);
+    CHECK(store.contains(a));
+    CHECK(!store.contains(b));
+    CHECK(store.contains(c));
+    CHECK(store.contains(d));
+    CHECK(store.getStats().bytes == 3 * kSize);
+
+    // Only the store's name went away; the install keeps its file
+    CHECK(readFile(dir.file("install/b.pak")) == syntheticData(kSize, 4));
+}
+
+TEST_CASE(shrinkingTheBudgetEvicts) {
+    ScratchDir dir("store-budget");
+    ContentStore store;
+    store.open(dir.file("store"), 4 * kSize);
+    std::string a = install(store, dir, "a.pak", 7);
+    std::string b = install(store, dir, "b.pak", 8);
+
+    store.setBudget(kSize);
+    CHECK(store.getBudget() == kSize);
+    CHECK(!store.contains(a));
+    CHECK(store.contains(b));
+
+    store.setBudget(0);
+    CHECK(store.getStats().objects == 0);
+    CHECK(store.getStats().bytes == 0);
+
+    // Nothing fits a zero budget
+    install(store, dir, "c.pak", 9);
+    CHECK(store.getStats().objects == 0);
+}
+
+TEST_CASE(fileOverTheBudgetIsLeftOut) {
+    ScratchDir dir("store-large");
+    ContentStore store;
+    store.open(dir.file("store"), kSize - 1);
+    std::string md5 = install(store, dir, "a.pak", 10);
+    CHECK(!store.contains(md5));
+}
+
+TEST_CASE(onlyMd5NamesAreAccepted) {
+    ScratchDir dir("store-names");
+    ContentStore store;
+    store.open(dir.file("store"), 1024 * 1024);
+    writeFile(dir.file("install/a.pak"), syntheticData(kSize, 11));
+
+    store.add("../../outside", dir.file("install/a.pak"));
+    store.add(std::string(32, 'A'), dir.file("install/a.pak"));
+    store.add("", dir.file("install/a.pak"));
+    CHECK(store.getStats().objects == 0);
+}
+
+TEST_CASE(removeDropsTheObject) {
+    ScratchDir dir("store-remove");
+    ContentStore store;
+    store.open(dir.file("store"), 1024 * 1024);
+    std::string md5 = install(store, dir, "a.pak", 12);
+
+    store.remove(md5);
+    CHECK(!store.contains(md5));
+    CHECK(store.getStats().bytes == 0);
+    CHECK(std::filesystem::hard_link_count(dir.file("install/a.pak")) == 1);
+
+    // Removing twice is harmless
+    store.remove(md5);
+    CHECK(store.getStats().objects == 0);
+}
+
+TEST_CASE(objectChangedThroughTheInstallIsDropped) {
+    ScratchDir dir("store-changed");
+    ContentStore store;
+    store.open(dir.file("store"), 1024 * 1024);
+    std::string md5 = install(store, dir, "a.pak", 13);
+
+    // A patcher rewriting the install in place rewrites the linked object too
+    writeFile(dir.file("install/a.pak"), "patched");
+    uint64_t size = 0;
+    CHECK(!store.materialize(md5, dir.file("beta/a.pak"), size));
+    CHECK(!store.contains(md5));
+    CHECK(!std::filesystem::exists(dir.file("beta/a.pak")));
+}
+
+TEST_CASE(reopenedStoreKeepsItsUseOrder) {
+    ScratchDir dir("store-reopen");
+    std::string a;
+    std::string b;
+    std::string c;
+    {
+        ContentStore store;
+        store.open(dir.file("store"), 1024 * 1024);
+        a = install(store, dir, "a.pak", 14);
+        tick();
+        b = install(store, dir, "b.pak", 15);
+        tick();
+        c = install(store, dir, "c.pak", 16);
+        tick();
+        uint64_t size = 0;
+        REQUIRE(store.materialize(a, dir.file("beta/a.pak"), size));
+    }
+
+    // Two of three fit, and b was used longest ago
+    ContentStore store;
+    store.open(dir.file("store"), 2 * kSize);
+    CHECK(store.getStats().objects == 2);
+    CHECK(store.contains(a));
+    CHECK(!store.contains(b));
+    CHECK(store.contains(c));
+}
+
+TEST_CASE(emptyRootDisablesTheStore) {
+    ScratchDir dir("store-disabled");
+    ContentStore store;
+    store.open("", 1024 * 1024);
+    std::string md5 = install(store, dir, "a.pak", 17);
+    CHECK(!store.contains(md5));
+    CHECK(std::filesystem::hard_link_count(dir.file("install/a.pak")) == 1);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
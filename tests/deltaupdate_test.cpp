@@ -0,0 +1,201 @@
+#include "deltaupdate.hpp"
+#include "md5.hpp"
+#include "testing.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const uint32_t kBlockSize = 16 * 1024;
+
+// What the publisher ships next to the new version
+ChunkManifest manifestOf(const std::string& content, uint32_t blockSize = kBlockSize) {
+    ChunkManifest manifest;
+    manifest.size = content.size();
+    manifest.blockSize = blockSize;
+    for (size_t offset = 0; offset < content.size(); offset += blockSize) {
+        size_t length = std::min<size_t>(blockSize, content.size() - offset);
+        ChunkManifest::Block block;
+        block.weak = DeltaBuilder::weakChecksum(content.data() + offset, length);
+        Md5 md5;
+        md5.update(content.data() + offset, length);
+        block.md5 = md5.hexDigest();
+        manifest.blocks.push_back(block);
+    }
+    return manifest;
+}
+
+uint64_t bytesIn(const std::vector<DownloadJournal::Range>& ranges, bool done) {
+    uint64_t bytes = 0;
+    for (const auto& range : ranges) {
+        if ((range.done == range.end) == done) {
+            bytes += range.end - range.begin;
+        }
+    }
+    return bytes;
+}
+
+// Assemble the new version from old and check that every done range already holds new content
+void checkAssembled(DeltaBuilder& builder, const ScratchDir& dir, const std::string& updated) {
+    REQUIRE(builder.assemble(dir.file("old.pak"), dir.file("new.pak")));
+    std::string assembled = readFile(dir.file("new.pak"));
+    REQUIRE(assembled.size() == updated.size());
+
+    uint64_t covered = 0;
+    for (const auto& range : builder.ranges()) {
+        CHECK(range.begin == covered);
+        covered = range.end;
+        CHECK(range.done == range.begin || range.done == range.end);
+        if (range.done == range.end) {
+            size_t begin = static_cast<size_t>(range.begin);
+            size_t length = static_cast<size_t>(range.end - range.begin);
+            CHECK(assembled.compare(begin, length, updated, begin, length) == 0);
+        }
+    }
+    CHECK(covered == updated.size());
+}
+
+} // namespace
+
+TEST_CASE(weakChecksumIsTheRsyncSum) {
+    // a = 97 + 98 + 99, b = 3 * 97 + 2 * 98 + 1 * 99
+    CHECK(DeltaBuilder::weakChecksum("abc", 3) == (294u | (586u << 16)));
+    CHECK(DeltaBuilder::weakChecksum("", 0) == 0);
+
+    // Same bytes, same sum, wherever they sit
+    std::string data = syntheticData(3 * kBlockSize, 1);
+    std::string copy = "xyz" + data.substr(kBlockSize, kBlockSize);
+    CHECK(DeltaBuilder::weakChecksum(data.data() + kBlockSize, kBlockSize) ==
+          DeltaBuilder::weakChecksum(copy.data() + 3, kBlockSize));
+    CHECK(DeltaBuilder::weakChecksum(data.data(), kBlockSize) !=
+          DeltaBuilder::weakChecksum(data.data() + 1, kBlockSize));
+}
+
+TEST_CASE(changedBlocksArePendingAndTheRestReused) {
+    ScratchDir dir("delta-changed");
+    // Eight full blocks and a short tail
+    std::string old = syntheticData(8 * kBlockSize + 5000, 2);
+    std::string updated = old;
+    updated[2 * kBlockSize + 100] ^= 0x55;
+    updated[5 * kBlockSize + kBlockSize - 1] ^= 0x55;
+    writeFile(dir.file("old.pak"), old);
+
+    ChunkManifest manifest = manifestOf(updated);
+    DeltaBuilder builder(manifest);
+    REQUIRE(builder.scan(dir.file("old.pak")));
+    CHECK(builder.missingBytes() == 2 * kBlockSize);
+    CHECK(builder.reusedBytes() == updated.size() - 2 * kBlockSize);
+
+    auto ranges = builder.ranges();
+    // done [0,2) pending [2] done [3,5) pending [5] done [6,8]+tail
+    REQUIRE(ranges.size() == 5);
+    CHECK(ranges[1].begin == 2 * kBlockSize);
+    CHECK(ranges[1].end == 3 * kBlockSize);
+    CHECK(ranges[1].done == ranges[1].begin);
+    CHECK(ranges[3].begin == 5 * kBlockSize);
+    CHECK(ranges[4].end == updated.size());
+    CHECK(bytesIn(ranges, false) == 2 * kBlockSize);
+    checkAssembled(builder, dir, updated);
+}
+
+TEST_CASE(blocksMovedByAPatchAreFound) {
+    ScratchDir dir("delta-shifted");
+    std::string old = syntheticData(10 * kBlockSize, 3);
+    // Bytes inserted near the front move everything after them off the block grid
+    std::string updated = old.substr(0, 1000) + syntheticData(777, 4) + old.substr(1000);
+    writeFile(dir.file("old.pak"), old);
+
+    ChunkManifest manifest = manifestOf(updated);
+    DeltaBuilder builder(manifest);
+    REQUIRE(builder.scan(dir.file("old.pak")));
+
+    // Only the block holding the insertion has to be fetched
+    CHECK(builder.missingBytes() == kBlockSize);
+    auto ranges = builder.ranges();
+    REQUIRE(!ranges.empty());
+    CHECK(ranges.front().begin == 0);
+    CHECK(ranges.front().done == 0);
+    CHECK(ranges.front().end == kBlockSize);
+    checkAssembled(builder, dir, updated);
+}
+
+TEST_CASE(shortLastBlockIsFoundAtTheEnd) {
+    ScratchDir dir("delta-tail");
+    std::string old = syntheticData(6 * kBlockSize + 3000, 5);
+    // A block dropped from the middle: the tail is no longer at its old offset
+    std::string updated = old.substr(0, 2 * kBlockSize) + old.substr(3 * kBlockSize);
+    writeFile(dir.file("old.pak"), old);
+
+    ChunkManifest manifest = manifestOf(updated);
+    DeltaBuilder builder(manifest);
+    REQUIRE(builder.scan(dir.file("old.pak")));
+    CHECK(builder.missingBytes() == 0);
+    CHECK(builder.ranges().size() == 1);
+    checkAssembled(builder, dir, updated);
+}
+
+TEST_CASE(unrelatedFileReusesNothing) {
+    ScratchDir dir("delta-unrelated");
+    std::string updated = syntheticData(4 * kBlockSize, 6);
+    writeFile(dir.file("old.pak"), syntheticData(4 * kBlockSize, 7));
+
+    ChunkManifest manifest = manifestOf(updated);
+    DeltaBuilder builder(manifest);
+    REQUIRE(builder.scan(dir.file("old.pak")));
+    CHECK(builder.reusedBytes() == 0);
+    REQUIRE(builder.ranges().size() == 1);
+    CHECK(builder.ranges()[0].done == 0);
+    CHECK(builder.ranges()[0].end == updated.size());
+}
+
+TEST_CASE(scanFailsWithoutTheOldFile) {
+    ScratchDir dir("delta-missing");
+    ChunkManifest manifest = manifestOf(syntheticData(kBlockSize, 8));
+    DeltaBuilder builder(manifest);
+    CHECK(!builder.scan(dir.file("old.pak")));
+    CHECK(!builder.error().empty());
+}
+
+TEST_CASE(cancelledScanStops) {
+    ScratchDir dir("delta-cancel");
+    std::string old = syntheticData(2 * kBlockSize, 9);
+    writeFile(dir.file("old.pak"), old);
+
+    ChunkManifest manifest = manifestOf(syntheticData(2 * kBlockSize, 10));
+    DeltaBuilder builder(manifest);
+    std::atomic<bool> cancelled{true};
+    CHECK(!builder.scan(dir.file("old.pak"), &cancelled));
+}
+
+TEST_CASE(manifestParsing) {
+    ChunkManifest manifest = ChunkManifest::parse(
+        R"({"size": 20000, "blockSize": 16384, "blocks": [{"weak": 1, "md5": "ABC"}, {"weak": 2, "md5": "def"}]})");
+    CHECK(manifest.size == 20000);
+    CHECK(manifest.blockSize == 16384);
+    REQUIRE(manifest.blocks.size() == 2);
+    CHECK(manifest.blocks[0].md5 == "abc");
+    CHECK(manifest.blocks[1].weak == 2);
+
+    const char* invalid[] = {
+        "[]",
+        R"({"size": 20000, "blockSize": 16384, "blocks": [{"weak": 1, "md5": "abc"}]})",
+        R"({"size": 100, "blockSize": 16, "blocks": []})",
+        R"({"size": 10, "blockSize": 16384, "blocks": [{"weak": "1", "md5": "abc"}]})",
+    };
+    for (const char* json : invalid) {
+        bool threw = false;
+        try {
+            ChunkManifest::parse(json);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
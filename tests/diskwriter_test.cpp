@@ -0,0 +1,207 @@
+#include "diskwriter.hpp"
+#include "testing.hpp"
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const size_t kBufferSize = DiskWriter::kBufferSize;
+
+#ifndef _WIN32
+
+// Raw descriptor as FileWriter hands it to the stage, closed at the end of the case
+class File {
+public:
+    File(const std::string& path, int flags) : m_fd(::open(path.c_str(), flags | O_CLOEXEC, 0644)) {}
+    ~File() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    int fd() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+DiskWriter::Segment segment(int handle, size_t from, size_t length, uint64_t offset) {
+    DiskWriter::Segment result;
+    result.handle = handle;
+    result.fallback = handle;
+    result.from = from;
+    result.length = length;
+    result.offset = offset;
+    return result;
+}
+
+#endif
+
+} // namespace
+
+#ifndef _WIN32
+
+TEST_CASE(buffersLandAtTheirOffsets) {
+    ScratchDir dir("stage-offsets");
+    std::string content = syntheticData(8 * kBufferSize, 1);
+    File file(dir.file("out.bin"), O_WRONLY | O_CREAT | O_TRUNC);
+    REQUIRE(file.fd() >= 0);
+
+    DiskWriter stage;
+    DiskWriter::Tracker tracker;
+    // Last buffer first: completion order must not matter
+    for (size_t i = 8; i-- > 0;) {
+        char* buffer = stage.acquire();
+        std::memcpy(buffer, content.data() + i * kBufferSize, kBufferSize);
+        auto write = segment(file.fd(), 0, kBufferSize, i * kBufferSize);
+        stage.submit(tracker, buffer, &write, 1);
+    }
+    CHECK(tracker.wait());
+    CHECK(tracker.error().empty());
+    CHECK(readFile(dir.file("out.bin")) == content);
+
+    DiskWriter::Stats stats = stage.getStats();
+    CHECK(stats.writes == 8);
+    CHECK(stats.bytes == content.size());
+    CHECK(stats.queueDepth == 0);
+    CHECK(stats.peakQueueDepth >= 1);
+    CHECK(stats.maxLatencyMs >= stats.averageLatencyMs);
+    std::printf("  backend %s\n", stats.backend);
+}
+
+TEST_CASE(oneBufferCanHoldTwoWrites) {
+    ScratchDir dir("stage-split");
+    std::string content = syntheticData(kBufferSize, 2);
+    File file(dir.file("out.bin"), O_WRONLY | O_CREAT | O_TRUNC);
+    REQUIRE(file.fd() >= 0);
+
+    DiskWriter stage;
+    DiskWriter::Tracker tracker;
+    char* buffer = stage.acquire();
+    std::memcpy(buffer, content.data(), kBufferSize);
+    // An aligned head and the unaligned tail, as FileWriter splits unbuffered writes
+    const size_t head = kBufferSize - 3 * DiskWriter::kAlignment;
+    DiskWriter::Segment writes[] = {segment(file.fd(), 0, head, 0),
+                                    segment(file.fd(), head, kBufferSize - head, head)};
+    stage.submit(tracker, buffer, writes, 2);
+    CHECK(tracker.wait());
+    CHECK(readFile(dir.file("out.bin")) == content);
+    // Both writes are one job
+    CHECK(stage.getStats().writes == 1);
+    CHECK(stage.getStats().bytes == kBufferSize);
+}
+
+TEST_CASE(waitLeavesUpToTheLimitInFlight) {
+    ScratchDir dir("stage-limit");
+    std::string content = syntheticData(kBufferSize, 3);
+    File file(dir.file("out.bin"), O_WRONLY | O_CREAT | O_TRUNC);
+    REQUIRE(file.fd() >= 0);
+
+    DiskWriter stage;
+    DiskWriter::Tracker tracker;
+    for (size_t i = 0; i < 6; ++i) {
+        char* buffer = stage.acquire();
+        std::memcpy(buffer, content.data(), kBufferSize);
+        auto write = segment(file.fd(), 0, kBufferSize, i * kBufferSize);
+        stage.submit(tracker, buffer, &write, 1);
+        // A writer keeps a couple of buffers on their way while it fills the next
+        CHECK(tracker.wait(2));
+        CHECK(stage.getStats().queueDepth <= 2);
+    }
+    CHECK(tracker.wait());
+    CHECK(stage.getStats().queueDepth == 0);
+    CHECK(std::filesystem::file_size(dir.file("out.bin")) == 6 * kBufferSize);
+}
+
+TEST_CASE(failedWriteReachesTheTracker) {
+    ScratchDir dir("stage-error");
+    writeFile(dir.file("out.bin"), "");
+    File file(dir.file("out.bin"), O_RDONLY);
+    REQUIRE(file.fd() >= 0);
+
+    DiskWriter stage;
+    DiskWriter::Tracker tracker;
+    auto write = segment(file.fd(), 0, 4096, 0);
+    stage.submit(tracker, stage.acquire(), &write, 1);
+    CHECK(!tracker.wait());
+    CHECK(tracker.error().find("Failed to write output file") == 0);
+    // The buffer came back all the same
+    CHECK(stage.getStats().idleBuffers == 1);
+
+    tracker.reset();
+    CHECK(tracker.error().empty());
+    CHECK(tracker.wait());
+}
+
+TEST_CASE(refusedWriteGoesThroughTheFallback) {
+    ScratchDir dir("stage-fallback");
+    std::string content = syntheticData(kBufferSize, 4);
+    writeFile(dir.file("out.bin"), "");
+    // The read-only descriptor stands in for an unbuffered handle the volume refuses
+    File refusing(dir.file("out.bin"), O_RDONLY);
+    File file(dir.file("out.bin"), O_WRONLY);
+    REQUIRE(refusing.fd() >= 0);
+    REQUIRE(file.fd() >= 0);
+
+    DiskWriter stage;
+    DiskWriter::Tracker tracker;
+    char* buffer = stage.acquire();
+    std::memcpy(buffer, content.data(), kBufferSize);
+    auto write = segment(refusing.fd(), 0, kBufferSize, 0);
+    write.fallback = file.fd();
+    stage.submit(tracker, buffer, &write, 1);
+
+    CHECK(tracker.wait());
+    CHECK(readFile(dir.file("out.bin")) == content);
+    CHECK(tracker.takeDirectFailed());
+    CHECK(!tracker.takeDirectFailed());
+}
+
+#endif
+
+TEST_CASE(buffersAreAlignedAndRecycled) {
+    DiskWriter stage;
+    char* first = stage.acquire();
+    CHECK(reinterpret_cast<uintptr_t>(first) % DiskWriter::kAlignment == 0);
+    stage.release(first);
+
+    // The steady state reuses what it has instead of allocating
+    for (int i = 0; i < 100; ++i) {
+        char* buffer = stage.acquire();
+        CHECK(buffer == first);
+        stage.release(buffer);
+    }
+    CHECK(stage.getStats().buffers == 1);
+    CHECK(stage.getStats().idleBuffers == 1);
+}
+
+TEST_CASE(idleBuffersAreBounded) {
+    DiskWriter stage;
+    std::vector<char*> buffers;
+    for (int i = 0; i < 40; ++i) {
+        buffers.push_back(stage.acquire());
+    }
+    CHECK(stage.getStats().buffers == 40);
+    CHECK(stage.getStats().idleBuffers == 0);
+
+    // A burst is not kept around for good
+    for (char* buffer : buffers) {
+        stage.release(buffer);
+    }
+    DiskWriter::Stats stats = stage.getStats();
+    CHECK(stats.idleBuffers == stats.buffers);
+    CHECK(stats.buffers < 40);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
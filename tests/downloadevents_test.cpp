@@ -0,0 +1,166 @@
+#include "downloadevents.hpp"
+#include "localserver.hpp"
+#include "testing.hpp"
+#include <rapidjson/document.h>
+#include <thread>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// What a subscriber was sent, with the time each push arrived
+class Pushes {
+public:
+    DownloadEvents::Sink sink() {
+        return [this](const std::string& json) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_json.push_back(json);
+            m_times.push_back(Clock::now());
+        };
+    }
+
+    size_t count() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_json.size();
+    }
+
+    rapidjson::Document parsed(size_t index) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        rapidjson::Document doc;
+        doc.Parse(m_json.at(index).c_str());
+        return doc;
+    }
+
+    Clock::time_point time(size_t index) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_times.at(index);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::string> m_json;
+    std::vector<Clock::time_point> m_times;
+};
+
+const rapidjson::Value* findDownload(const rapidjson::Document& push, int downloadId) {
+    for (const auto& download : push["downloads"].GetArray()) {
+        if (download["downloadId"].GetInt() == downloadId) {
+            return &download;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+TEST_CASE(changesWithinAnIntervalCoalesceIntoOneDelta) {
+    ScratchDir dir("events-coalesce");
+    LocalServer server;
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(300);
+    server.serve("busy.pak", syntheticData(64 * 1024, 1), slow);
+    server.serve("waiting.pak", syntheticData(64 * 1024, 2));
+
+    // One slot: the busy download holds it while the other is queued and paused, after which
+    // nothing changes until the test does something
+    DownloadManager manager(1, 1);
+    int busy = manager.startDownload(server.url("busy.pak"), dir.path(), "");
+    REQUIRE(waitUntil([&] { return server.requests("busy.pak") == 1; }));
+    int waiting = manager.startDownload(server.url("waiting.pak"), dir.path(), "");
+    REQUIRE(manager.pauseDownload(waiting));
+    REQUIRE(waitUntil([&] { return manager.getDownloadInfo(busy).isCompleted; }));
+    CHECK(server.requests("waiting.pak") == 0);
+
+    DownloadEvents events(manager);
+    Pushes pushes;
+    const auto interval = std::chrono::milliseconds(300);
+    int subscription = events.subscribe(pushes.sink(), interval);
+
+    // The snapshot carries every field of every download
+    REQUIRE(waitUntil([&] { return pushes.count() == 1; }));
+    rapidjson::Document snapshot = pushes.parsed(0);
+    REQUIRE(snapshot.IsObject());
+    CHECK(snapshot["downloads"].Size() == 2);
+    CHECK(snapshot["removed"].Empty());
+    const rapidjson::Value* full = findDownload(snapshot, waiting);
+    REQUIRE(full != nullptr);
+    CHECK(full->HasMember("url") && full->HasMember("downloadedSize") && full->HasMember("errorMessage"));
+    CHECK(std::string((*full)["priority"].GetString()) == "foreground");
+    CHECK((*full)["isPaused"].GetBool());
+    CHECK(findDownload(snapshot, busy) != nullptr);
+
+    // Two changes right after the snapshot fall into the same interval
+    REQUIRE(manager.setDownloadPriority(waiting, DownloadPriority::Background));
+    REQUIRE(manager.setDownloadPriority(waiting, DownloadPriority::Predownload));
+    REQUIRE(waitUntil([&] { return pushes.count() >= 2; }));
+    std::this_thread::sleep_for(interval * 2);
+    CHECK(pushes.count() == 2);
+    CHECK(pushes.time(1) - pushes.time(0) >= interval - std::chrono::milliseconds(20));
+
+    // One delta with the last value, and only the field that changed
+    rapidjson::Document delta = pushes.parsed(1);
+    REQUIRE(delta.IsObject());
+    CHECK(delta["downloads"].Size() == 1);
+    CHECK(delta["removed"].Empty());
+    const rapidjson::Value* changed = findDownload(delta, waiting);
+    REQUIRE(changed != nullptr);
+    CHECK(changed->MemberCount() == 2);
+    CHECK(std::string((*changed)["priority"].GetString()) == "predownload");
+
+    // A change notice that leaves every field as it was sends nothing
+    REQUIRE(manager.setDownloadPriority(waiting, DownloadPriority::Predownload));
+    std::this_thread::sleep_for(interval * 2);
+    CHECK(pushes.count() == 2);
+
+    // Nothing reaches the sink after unsubscribing
+    events.unsubscribe(subscription);
+    REQUIRE(manager.setDownloadPriority(waiting, DownloadPriority::Foreground));
+    REQUIRE(manager.cancelDownload(waiting));
+    std::this_thread::sleep_for(interval * 2);
+    CHECK(pushes.count() == 2);
+}
+
+TEST_CASE(eachSubscriberGetsItsOwnSnapshot) {
+    ScratchDir dir("events-subscribers");
+    LocalServer server;
+    server.serve("file.pak", syntheticData(64 * 1024, 3));
+
+    DownloadManager manager(1, 1);
+    DownloadEvents events(manager);
+
+    // With nothing to report the first push still comes, so the UI knows its list is complete
+    Pushes early;
+    events.subscribe(early.sink(), std::chrono::milliseconds(50));
+    REQUIRE(waitUntil([&] { return early.count() == 1; }));
+    CHECK(early.parsed(0)["downloads"].Empty());
+
+    int id = manager.startDownload(server.url("file.pak"), dir.path(), "");
+    REQUIRE(waitUntil([&] { return manager.getDownloadInfo(id).isCompleted; }));
+
+    // The earlier subscriber has seen the download finish through its deltas
+    REQUIRE(waitUntil([&] {
+        if (early.count() < 2) {
+            return false;
+        }
+        rapidjson::Document last = early.parsed(early.count() - 1);
+        const rapidjson::Value* download = findDownload(last, id);
+        return download && download->HasMember("isCompleted") && (*download)["isCompleted"].GetBool();
+    }));
+
+    // A late subscriber starts from the finished state, not from the deltas it missed
+    Pushes late;
+    events.subscribe(late.sink(), std::chrono::milliseconds(50));
+    REQUIRE(waitUntil([&] { return late.count() == 1; }));
+    rapidjson::Document snapshot = late.parsed(0);
+    const rapidjson::Value* download = findDownload(snapshot, id);
+    REQUIRE(download != nullptr);
+    CHECK((*download)["isCompleted"].GetBool());
+    CHECK((*download)["progress"].GetDouble() == 1.0);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
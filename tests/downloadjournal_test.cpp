@@ -0,0 +1,167 @@
+#include "downloadjournal.hpp"
+#include "testing.hpp"
+#include <algorithm>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+DownloadJournal::Entry entry(int id) {
+    DownloadJournal::Entry entry;
+    entry.downloadId = id;
+    entry.url = "http://cdn.example/game/file" + std::to_string(id);
+    entry.destination = "/games/example";
+    entry.filename = "file" + std::to_string(id);
+    entry.expectedMd5 = "0123456789abcdef0123456789abcdef";
+    entry.expectedSize = 1000000u + static_cast<uint64_t>(id);
+    entry.segments = 4;
+    entry.jobId = 7;
+    entry.priority = 2;
+    entry.mirrors = {"http://mirror.example/game/file" + std::to_string(id)};
+    return entry;
+}
+
+DownloadJournal::Range range(uint64_t begin, uint64_t end, uint64_t done) {
+    DownloadJournal::Range range;
+    range.begin = begin;
+    range.end = end;
+    range.done = done;
+    return range;
+}
+
+size_t lineCount(const std::string& path) {
+    std::string content = readFile(path);
+    return static_cast<size_t>(std::count(content.begin(), content.end(), '\n'));
+}
+
+} // namespace
+
+TEST_CASE(missingJournalReplaysNothing) {
+    ScratchDir dir("journal-missing");
+    DownloadJournal journal;
+    CHECK(journal.open(dir.file("state/downloads.journal")).empty());
+    CHECK(journal.isOpen());
+}
+
+TEST_CASE(replayReturnsUnfinishedDownloadsWithLatestRanges) {
+    ScratchDir dir("journal-replay");
+    std::string path = dir.file("downloads.journal");
+    {
+        DownloadJournal journal;
+        journal.open(path);
+        journal.recordTask(entry(1));
+        journal.recordTask(entry(2));
+        journal.recordRange(1, range(500000, 1000001, 600000));
+        journal.recordRange(1, range(0, 500000, 100000));
+        journal.recordRange(1, range(0, 500000, 250000));
+        journal.recordRange(2, range(0, 1000002, 42));
+        // Not recorded as a task, so its checkpoints are ignored
+        journal.recordRange(9, range(0, 10, 5));
+    }
+
+    DownloadJournal journal;
+    auto entries = journal.open(path);
+    REQUIRE(entries.size() == 2);
+
+    const auto& first = entries[0];
+    CHECK(first.downloadId == 1);
+    CHECK(first.url == entry(1).url);
+    CHECK(first.filename == "file1");
+    CHECK(first.expectedMd5 == entry(1).expectedMd5);
+    CHECK(first.expectedSize == 1000001);
+    CHECK(first.segments == 4);
+    CHECK(first.jobId == 7);
+    CHECK(first.priority == 2);
+    CHECK(first.mirrors == entry(1).mirrors);
+    // One range per segment, sorted by offset, with the last checkpoint of each
+    REQUIRE(first.ranges.size() == 2);
+    CHECK(first.ranges[0].begin == 0);
+    CHECK(first.ranges[0].done == 250000);
+    CHECK(first.ranges[1].begin == 500000);
+    CHECK(first.ranges[1].done == 600000);
+
+    CHECK(entries[1].downloadId == 2);
+    REQUIRE(entries[1].ranges.size() == 1);
+    CHECK(entries[1].ranges[0].done == 42);
+}
+
+TEST_CASE(finishedDownloadsAreDropped) {
+    ScratchDir dir("journal-finished");
+    std::string path = dir.file("downloads.journal");
+    {
+        DownloadJournal journal;
+        journal.open(path);
+        for (int id = 1; id <= 3; ++id) {
+            journal.recordTask(entry(id));
+            journal.recordRange(id, range(0, 100, 50));
+        }
+        journal.recordFinished(2);
+    }
+
+    {
+        DownloadJournal journal;
+        auto entries = journal.open(path);
+        REQUIRE(entries.size() == 2);
+        CHECK(entries[0].downloadId == 1);
+        CHECK(entries[1].downloadId == 3);
+        // Compacted to the live tasks and their ranges
+        CHECK(lineCount(path) == 4);
+
+        journal.recordFinished(1);
+        journal.recordFinished(3);
+    }
+
+    // Once nothing is left the file is emptied
+    CHECK(lineCount(path) == 0);
+    DownloadJournal journal;
+    CHECK(journal.open(path).empty());
+}
+
+TEST_CASE(tornOrCorruptLineEndsReplay) {
+    ScratchDir dir("journal-torn");
+    std::string path = dir.file("downloads.journal");
+    {
+        DownloadJournal journal;
+        journal.open(path);
+        journal.recordTask(entry(1));
+        journal.recordRange(1, range(0, 100, 10));
+        journal.recordTask(entry(2));
+        journal.recordRange(2, range(0, 100, 20));
+    }
+
+    std::string content = readFile(path);
+    std::vector<std::string> lines;
+    for (size_t start = 0; start < content.size();) {
+        size_t end = content.find('\n', start);
+        lines.push_back(content.substr(start, end - start + 1));
+        start = end + 1;
+    }
+    REQUIRE(lines.size() == 4);
+
+    // A write cut off mid-line, as after a power loss: the complete lines before it survive
+    writeFile(path, lines[0] + lines[1] + lines[2] + lines[3].substr(0, lines[3].size() / 2));
+    {
+        DownloadJournal journal;
+        auto entries = journal.open(path);
+        REQUIRE(entries.size() == 2);
+        CHECK(entries[0].ranges.size() == 1);
+        CHECK(entries[1].ranges.empty());
+    }
+
+    // A flipped byte fails the checksum, and nothing after it is trusted
+    std::string corrupt = lines[1];
+    corrupt[corrupt.size() / 2] ^= 0x01;
+    writeFile(path, lines[0] + corrupt + lines[2] + lines[3]);
+    {
+        DownloadJournal journal;
+        auto entries = journal.open(path);
+        REQUIRE(entries.size() == 1);
+        CHECK(entries[0].downloadId == 1);
+        CHECK(entries[0].ranges.empty());
+    }
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,969 @@
+#include "downloadmanager.hpp"
+#include "md5.hpp"
+#include "localserver.hpp"
+#include "testing.hpp"
+#include <zlib.h>
+#include <zstd.h>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+// Small files go over a single stream, so every download is exactly one request
+DownloadOptions singleStream() {
+    DownloadOptions options;
+    options.segments = 1;
+    return options;
+}
+
+std::string md5Of(const std::string& content) {
+    Md5 md5;
+    md5.update(content.data(), content.size());
+    return md5.hexDigest();
+}
+
+// 31: gzip wrapper, 15: zlib wrapper, -15: raw deflate
+std::string deflateWith(const std::string& data, int windowBits) {
+    z_stream stream = {};
+    deflateInit2(&stream, 6, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+std::string zstdOf(const std::string& data) {
+    std::string out(ZSTD_compressBound(data.size()), '\0');
+    out.resize(ZSTD_compress(&out[0], out.size(), data.data(), data.size(), 3));
+    return out;
+}
+
+bool finished(const DownloadManager& manager, int id) {
+    DownloadInfo info = manager.getDownloadInfo(id);
+    return info.isCompleted || info.isFailed;
+}
+
+ConcurrencyController::HostStats hostStats(const DownloadManager& manager, const LocalServer& server) {
+    std::string key = server.host() + ":" + std::to_string(server.port());
+    for (const auto& stats : manager.getHostStats()) {
+        if (stats.host == key) {
+            return stats;
+        }
+    }
+    return ConcurrencyController::HostStats();
+}
+
+// Calls of the completion callback and of onFinished, by download
+class FinishedCalls {
+public:
+    void attach(DownloadManager& manager) {
+        manager.setCompletionCallback([this](const DownloadInfo& info) { add(m_completion, info.downloadId); });
+    }
+
+    DownloadOptions& track(DownloadOptions& options) {
+        options.onFinished = [this](const DownloadInfo& info) { add(m_onFinished, info.downloadId); };
+        return options;
+    }
+
+    int completion(int id) const { return count(m_completion, id); }
+    int onFinished(int id) const { return count(m_onFinished, id); }
+
+private:
+    void add(std::map<int, int>& calls, int id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++calls[id];
+    }
+
+    int count(const std::map<int, int>& calls, int id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = calls.find(id);
+        return it != calls.end() ? it->second : 0;
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<int, int> m_completion;
+    std::map<int, int> m_onFinished;
+};
+
+// Order in which downloads finished
+class FinishOrder {
+public:
+    DownloadOptions& track(DownloadOptions& options) {
+        options.onFinished = [this](const DownloadInfo& info) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ids.push_back(info.downloadId);
+        };
+        return options;
+    }
+
+    std::vector<int> ids() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ids;
+    }
+
+    // Position of id, or -1 if it has not finished
+    int position(int id) const {
+        std::vector<int> finished = ids();
+        auto it = std::find(finished.begin(), finished.end(), id);
+        return it != finished.end() ? static_cast<int>(it - finished.begin()) : -1;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<int> m_ids;
+};
+
+} // namespace
+
+TEST_CASE(workerPoolBoundsConcurrentDownloads) {
+    ScratchDir dir("pool");
+    LocalServer server;
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(100);
+
+    std::vector<std::string> contents;
+    for (int i = 0; i < 12; ++i) {
+        contents.push_back(syntheticData(64 * 1024, i));
+        server.serve("file" + std::to_string(i), contents.back(), slow);
+    }
+
+    DownloadManager manager(3, 6);
+    std::vector<int> ids;
+    for (int i = 0; i < 12; ++i) {
+        ids.push_back(manager.startDownload(server.url("file" + std::to_string(i)), dir.path().string(), "",
+                                            singleStream()));
+    }
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+
+    for (int i = 0; i < 12; ++i) {
+        CHECK(manager.getDownloadInfo(ids[i]).isCompleted);
+        CHECK(readFile(dir.file("file" + std::to_string(i))) == contents[i]);
+    }
+    // Twelve slow files on three workers overlap, but never more than three at a time
+    CHECK(server.peakInFlight() <= 3);
+    CHECK(server.peakInFlight() >= 2);
+}
+
+TEST_CASE(workerPoolBoundsConnectionsPerHost) {
+    ScratchDir dir("perhost");
+    LocalServer first;
+    LocalServer second;
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(100);
+
+    std::string content = syntheticData(32 * 1024, 7);
+    for (int i = 0; i < 8; ++i) {
+        first.serve("a" + std::to_string(i), content, slow);
+        second.serve("b" + std::to_string(i), content, slow);
+    }
+
+    DownloadManager manager(8, 2);
+    std::vector<int> ids;
+    for (int i = 0; i < 8; ++i) {
+        ids.push_back(manager.startDownload(first.url("a" + std::to_string(i)), dir.path().string(), "",
+                                            singleStream()));
+        ids.push_back(manager.startDownload(second.url("b" + std::to_string(i)), dir.path().string(), "",
+                                            singleStream()));
+    }
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+
+    for (int id : ids) {
+        CHECK(manager.getDownloadInfo(id).isCompleted);
+    }
+    CHECK(first.peakInFlight() <= 2);
+    CHECK(second.peakInFlight() <= 2);
+    // The second host's files do not wait behind the first host's
+    CHECK(first.peakInFlight() + second.peakInFlight() >= 3);
+}
+
+TEST_CASE(raisingTheLimitStartsQueuedDownloads) {
+    ScratchDir dir("raise");
+    LocalServer server;
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(200);
+    for (int i = 0; i < 6; ++i) {
+        server.serve("file" + std::to_string(i), syntheticData(16 * 1024, i), slow);
+    }
+
+    DownloadManager manager(1, 6);
+    std::vector<int> ids;
+    for (int i = 0; i < 6; ++i) {
+        ids.push_back(manager.startDownload(server.url("file" + std::to_string(i)), dir.path().string(), "",
+                                            singleStream()));
+    }
+    manager.setConcurrencyLimits(4, 6);
+    CHECK(manager.getMaxConcurrent() == 4);
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+
+    for (int id : ids) {
+        CHECK(finished(manager, id));
+    }
+    CHECK(server.peakInFlight() >= 2);
+    CHECK(server.peakInFlight() <= 4);
+}
+
+TEST_CASE(globalRateLimitCapsAllDownloadsTogether) {
+    ScratchDir dir("ratelimit");
+    LocalServer server;
+    std::vector<std::string> contents;
+    for (int i = 0; i < 2; ++i) {
+        contents.push_back(syntheticData(1536 * 1024, 20 + i));
+        server.serve("file" + std::to_string(i), contents.back());
+    }
+
+    // 3 MB at 1 MB/s: about 2.75 s once the first quarter-second burst is spent
+    DownloadManager manager(4, 4);
+    manager.setGlobalRateLimit(1024 * 1024);
+    CHECK(manager.getGlobalRateLimit() == 1024 * 1024);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> ids;
+    for (int i = 0; i < 2; ++i) {
+        ids.push_back(manager.startDownload(server.url("file" + std::to_string(i)), dir.path().string(), "",
+                                            singleStream()));
+    }
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int i = 0; i < 2; ++i) {
+        CHECK(manager.getDownloadInfo(ids[i]).isCompleted);
+        CHECK(readFile(dir.file("file" + std::to_string(i))) == contents[i]);
+    }
+    CHECK(seconds > 2.2);
+    CHECK(seconds < 6.0);
+}
+
+TEST_CASE(downloadRateLimitCapsOnlyThatDownload) {
+    ScratchDir dir("ratelimit-one");
+    LocalServer server;
+    std::string content = syntheticData(1024 * 1024, 30);
+    server.serve("capped", content);
+    server.serve("free", content);
+
+    DownloadManager manager(4, 4);
+    DownloadOptions capped = singleStream();
+    capped.maxBytesPerSecond = 512 * 1024;
+
+    auto start = std::chrono::steady_clock::now();
+    int cappedId = manager.startDownload(server.url("capped"), dir.path().string(), "", capped);
+    int freeId = manager.startDownload(server.url("free"), dir.path().string(), "", singleStream());
+
+    REQUIRE(waitUntil([&] { return finished(manager, freeId); }));
+    double freeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    REQUIRE(waitUntil([&] { return finished(manager, cappedId); }));
+    double cappedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(manager.getDownloadInfo(cappedId).isCompleted);
+    CHECK(manager.getDownloadInfo(freeId).isCompleted);
+    CHECK(readFile(dir.file("capped")) == content);
+    // 1 MB at 512 KB/s, less the first burst, against a loopback transfer
+    CHECK(cappedSeconds > 1.5);
+    CHECK(freeSeconds < 1.0);
+}
+
+TEST_CASE(sequentialDownloadsReuseConnections) {
+    ScratchDir dir("keepalive");
+    LocalServer server;
+    for (int i = 0; i < 20; ++i) {
+        server.serve("file" + std::to_string(i), syntheticData(64 * 1024, 40 + i));
+    }
+
+    // One worker, so each download starts after the last returned its client
+    DownloadManager manager(1, 1);
+    std::vector<int> ids;
+    for (int i = 0; i < 20; ++i) {
+        ids.push_back(manager.startDownload(server.url("file" + std::to_string(i)), dir.path().string(), "",
+                                            singleStream()));
+    }
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+
+    for (int id : ids) {
+        CHECK(manager.getDownloadInfo(id).isCompleted);
+    }
+    ConnectionPool::Stats stats = manager.getConnectionStats();
+    CHECK(stats.leases >= 20);
+    CHECK(stats.reused >= 19);
+    CHECK(stats.idle >= 1);
+    CHECK(server.connections() <= 2);
+}
+
+TEST_CASE(connectionWindowGrowsWhileEachConnectionIsPaced) {
+    ScratchDir dir("aimd-grow");
+    LocalServer server;
+    // Every connection is held to 2 MB/s, so each one added raises goodput
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 2 * 1024 * 1024;
+    std::string content = syntheticData(64 * 1024 * 1024, 50);
+    server.serve("big", content, paced);
+
+    DownloadManager manager(1, 8);
+    int id = manager.startDownload(server.url("big"), dir.path().string(), "", DownloadOptions());
+    REQUIRE(waitUntil([&] { return finished(manager, id); }, std::chrono::seconds(60)));
+
+    CHECK(manager.getDownloadInfo(id).isCompleted);
+    CHECK(readFile(dir.file("big")) == content);
+    CHECK(hostStats(manager, server).increases >= 1);
+    // Past the initial window of four, within the download's eight segments
+    CHECK(server.peakInFlight() >= 5);
+    CHECK(server.peakInFlight() <= 8);
+}
+
+TEST_CASE(connectionWindowHalvesWhenTheServerThrottles) {
+    ScratchDir dir("aimd-throttle");
+    LocalServer server;
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 4 * 1024 * 1024;
+    std::string content = syntheticData(64 * 1024 * 1024, 51);
+    server.serve("big", content, paced);
+
+    DownloadManager manager(1, 8);
+    int id = manager.startDownload(server.url("big"), dir.path().string(), "", DownloadOptions());
+    REQUIRE(waitUntil([&] { return hostStats(manager, server).inUse >= 3; }));
+
+    // The next requests are turned away, as by an overloaded CDN; transfers already running go on
+    LocalServer::Behavior throttling = paced;
+    throttling.failFirst = 6;
+    throttling.failStatus = 503;
+    server.setBehavior("big", throttling);
+
+    REQUIRE(waitUntil([&] { return finished(manager, id); }, std::chrono::seconds(60)));
+    CHECK(manager.getDownloadInfo(id).isCompleted);
+    CHECK(readFile(dir.file("big")) == content);
+
+    // The 503s closed a window with the limit halved
+    CHECK(hostStats(manager, server).decreases >= 1);
+}
+
+TEST_CASE(droppedTransferResumesOnTheMirror) {
+    ScratchDir dir("failover-drop");
+    LocalServer primary;
+    LocalServer mirror;
+    std::string content = syntheticData(4 * 1024 * 1024, 60);
+
+    // The primary cuts the transfer off a quarter in; the paced mirror ranks second after the probes
+    LocalServer::Behavior dropping;
+    dropping.dropAfter = 1024 * 1024;
+    primary.serve("file.pak", content, dropping);
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 8 * 1024 * 1024;
+    mirror.serve("file.pak", content, paced);
+
+    DownloadManager manager(2, 2);
+    DownloadOptions options = singleStream();
+    options.mirrors = {mirror.url("file.pak")};
+    int id = manager.startDownload(primary.url("file.pak"), dir.path().string(), "", options);
+    REQUIRE(waitUntil([&] { return finished(manager, id); }));
+
+    CHECK(manager.getDownloadInfo(id).isCompleted);
+    CHECK(readFile(dir.file("file.pak")) == content);
+    CHECK(primary.requests("file.pak") >= 1);
+    CHECK(mirror.requests("file.pak") >= 1);
+
+    std::string primaryKey = primary.host() + ":" + std::to_string(primary.port());
+    for (const auto& stats : manager.getMirrorStats()) {
+        if (stats.host == primaryKey) {
+            CHECK(stats.failures >= 1);
+        }
+    }
+}
+
+TEST_CASE(failingPrimaryIsServedByTheMirror) {
+    ScratchDir dir("failover-error");
+    LocalServer primary;
+    LocalServer mirror;
+    std::string content = syntheticData(24 * 1024 * 1024, 61);
+
+    LocalServer::Behavior failing;
+    failing.failFirst = 1000;
+    failing.failStatus = 503;
+    primary.serve("file.pak", content, failing);
+    mirror.serve("file.pak", content);
+
+    // Segmented, so ranges fail over as well as the single stream
+    for (int segments : {1, 4}) {
+        DownloadManager manager(2, 2);
+        DownloadOptions options;
+        options.segments = segments;
+        options.mirrors = {mirror.url("file.pak")};
+        std::string name = "file" + std::to_string(segments) + ".pak";
+        int id = manager.startDownload(primary.url("file.pak"), dir.path().string(), name, options);
+        REQUIRE(waitUntil([&] { return finished(manager, id); }, std::chrono::seconds(60)));
+
+        DownloadInfo info = manager.getDownloadInfo(id);
+        CHECK(info.isCompleted);
+        if (!info.isCompleted) {
+            std::printf("  %d segments: %s\n", segments, info.errorMessage.c_str());
+        }
+        CHECK(readFile(dir.file(name)) == content);
+    }
+}
+
+TEST_CASE(storedContentIsLinkedInsteadOfFetched) {
+    ScratchDir dir("store");
+    LocalServer server;
+    std::string content = syntheticData(256 * 1024, 71);
+    server.serve("live/file.pak", content);
+    server.serve("beta/file.pak", content);
+
+    // The store lives next to the journal
+    DownloadManager manager(2, 2, dir.file("journal.json"));
+    DownloadOptions options = singleStream();
+    Md5 md5;
+    md5.update(content.data(), content.size());
+    options.expectedMd5 = md5.hexDigest();
+
+    int live = manager.startDownload(server.url("live/file.pak"), dir.file("live"), "", options);
+    REQUIRE(waitUntil([&] { return finished(manager, live); }));
+    REQUIRE(manager.getDownloadInfo(live).isCompleted);
+    CHECK(manager.hasStoredContent(options.expectedMd5));
+
+    // The beta branch ships the same file and gets it without a request
+    int beta = manager.startDownload(server.url("beta/file.pak"), dir.file("beta"), "", options);
+    REQUIRE(waitUntil([&] { return finished(manager, beta); }));
+    DownloadInfo info = manager.getDownloadInfo(beta);
+    CHECK(info.isCompleted);
+    CHECK(info.reusedSize == content.size());
+    CHECK(server.requests("beta/file.pak") == 0);
+    CHECK(readFile(dir.file("beta/file.pak")) == content);
+    CHECK(manager.getContentStoreStats().hits == 1);
+    CHECK(manager.getContentStoreStats().savedBytes == content.size());
+
+    // Without a budget nothing is kept and the next download is fetched again
+    manager.setContentStoreBudget(0);
+    CHECK(!manager.hasStoredContent(options.expectedMd5));
+    int again = manager.startDownload(server.url("beta/file.pak"), dir.file("again"), "", options);
+    REQUIRE(waitUntil([&] { return finished(manager, again); }));
+    CHECK(manager.getDownloadInfo(again).isCompleted);
+    CHECK(server.requests("beta/file.pak") >= 1);
+}
+
+TEST_CASE(cancelStopsQueuedAndRunningDownloads) {
+    ScratchDir dir("cancel");
+    LocalServer server;
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 1024 * 1024;
+    std::string content = syntheticData(8 * 1024 * 1024, 80);
+    server.serve("running.pak", content, paced);
+    server.serve("queued.pak", content, paced);
+
+    FinishedCalls calls;
+    {
+        // One worker, so the second download waits in the queue behind the first
+        DownloadManager manager(1, 1, dir.file("journal.json"));
+        calls.attach(manager);
+        DownloadOptions options = singleStream();
+        calls.track(options);
+
+        auto start = std::chrono::steady_clock::now();
+        int running = manager.startDownload(server.url("running.pak"), dir.file("out"), "", options);
+        int queued = manager.startDownload(server.url("queued.pak"), dir.file("out"), "", options);
+        REQUIRE(waitUntil([&] { return manager.getDownloadInfo(running).downloadedSize >= 256 * 1024; }));
+
+        // A queued task is dropped and reported on the spot
+        CHECK(manager.cancelDownload(queued));
+        CHECK(calls.completion(queued) == 1);
+        CHECK(calls.onFinished(queued) == 1);
+        CHECK(manager.getDownloadInfo(queued).isFailed);
+
+        CHECK(manager.cancelDownload(running));
+        REQUIRE(waitUntil([&] { return !manager.isBusy() && calls.onFinished(running) == 1; }));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        DownloadInfo info = manager.getDownloadInfo(running);
+        CHECK(info.isFailed);
+        CHECK(!info.isCompleted);
+        CHECK(info.errorMessage == "Download cancelled by user");
+        // Eight seconds of paced body, abandoned well before the end
+        CHECK(info.downloadedSize < content.size());
+        CHECK(seconds < 4.0);
+        CHECK(server.requests("queued.pak") == 0);
+        CHECK(!std::filesystem::exists(dir.file("out/running.pak")));
+        CHECK(!std::filesystem::exists(dir.file("out/queued.pak")));
+
+        // Cancelling again changes nothing and reports nothing
+        CHECK(!manager.cancelDownload(running));
+        CHECK(!manager.cancelDownload(queued));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        CHECK(calls.completion(running) == 1);
+        CHECK(calls.onFinished(running) == 1);
+        CHECK(calls.completion(queued) == 1);
+        CHECK(calls.onFinished(queued) == 1);
+    }
+
+    // Neither is resumed by the next session
+    DownloadJournal journal;
+    CHECK(journal.open(dir.file("journal.json")).empty());
+}
+
+TEST_CASE(encodedBodiesAreStoredDecoded) {
+    ScratchDir dir("encoding");
+    LocalServer server;
+    // An index-like file: mostly text that compresses well, some of it not at all
+    std::string content;
+    for (int i = 0; i < 20000; ++i) {
+        content += "pak/chunk_" + std::to_string(i) + ".bin " + std::to_string(i * 7919) + "\n";
+    }
+    content += syntheticData(256 * 1024, 90);
+
+    struct Encoded {
+        std::string name;
+        std::string encoding;
+        std::string body;
+    };
+    const Encoded encoded[] = {
+        {"gzip.idx", "gzip", deflateWith(content, 31)},
+        {"zlib.idx", "deflate", deflateWith(content, 15)},
+        {"raw.idx", "deflate", deflateWith(content, -15)},
+        {"zstd.idx", "zstd", zstdOf(content)},
+    };
+
+    DownloadManager manager(2, 2);
+    DownloadOptions options = singleStream();
+    options.acceptEncoding = true;
+    options.expectedMd5 = md5Of(content);
+
+    for (const auto& file : encoded) {
+        LocalServer::Behavior behavior;
+        behavior.contentEncoding = file.encoding;
+        server.serve(file.name, file.body, behavior);
+
+        int id = manager.startDownload(server.url(file.name), dir.path().string(), "", options);
+        REQUIRE(waitUntil([&] { return finished(manager, id); }));
+        DownloadInfo info = manager.getDownloadInfo(id);
+        CHECK(info.isCompleted);
+        if (!info.isCompleted) {
+            std::printf("  %s: %s\n", file.name.c_str(), info.errorMessage.c_str());
+        }
+
+        // What is stored, and verified, is the decoded file
+        CHECK(std::filesystem::file_size(dir.file(file.name)) == content.size());
+        CHECK(Md5::hashFile(dir.file(file.name)) == options.expectedMd5);
+        CHECK(readFile(dir.file(file.name)) == content);
+
+        // Side files fetched into memory are decoded the same way
+        std::string body;
+        std::string error;
+        CHECK(manager.fetch(server.url(file.name), body, error));
+        CHECK(body == content);
+    }
+}
+
+TEST_CASE(largeFileIsFetchedInRanges) {
+    ScratchDir dir("segmented");
+    LocalServer server;
+    std::string content = syntheticData(8 * 1024 * 1024 + 12345, 100);
+    server.serve("big.pak", content);
+    std::string small = syntheticData(1024 * 1024, 101);
+    server.serve("small.pak", small);
+
+    DownloadManager manager(2, 8);
+    DownloadOptions options;
+    options.segments = 4;
+    options.minSegmentSize = 256 * 1024;
+    options.expectedMd5 = md5Of(content);
+    int id = manager.startDownload(server.url("big.pak"), dir.path().string(), "", options);
+
+    // No minimum at all: split as finely as the segment count allows
+    DownloadOptions unbounded;
+    unbounded.segments = 2;
+    unbounded.minSegmentSize = 0;
+    int smallId = manager.startDownload(server.url("small.pak"), dir.path().string(), "", unbounded);
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+
+    DownloadInfo info = manager.getDownloadInfo(id);
+    CHECK(info.isCompleted);
+    CHECK(info.totalSize == content.size());
+    CHECK(readFile(dir.file("big.pak")) == content);
+    // Four segments, each working through several ranges
+    CHECK(server.rangeRequests("big.pak") >= 4);
+    CHECK(server.peakInFlight() >= 2);
+
+    CHECK(manager.getDownloadInfo(smallId).isCompleted);
+    CHECK(readFile(dir.file("small.pak")) == small);
+    CHECK(server.rangeRequests("small.pak") >= 2);
+}
+
+TEST_CASE(serverIgnoringRangesGetsASingleStream) {
+    ScratchDir dir("segmented-fallback");
+    LocalServer server;
+    std::string content = syntheticData(8 * 1024 * 1024, 102);
+    // Claims range support, then answers every range with the whole file
+    LocalServer::Behavior ignoring;
+    ignoring.ignoreRange = true;
+    ignoring.bytesPerSecond = 2 * 1024 * 1024;
+    server.serve("big.pak", content, ignoring);
+
+    DownloadOptions options;
+    options.segments = 4;
+    options.minSegmentSize = 256 * 1024;
+    options.expectedMd5 = md5Of(content);
+    {
+        DownloadManager manager(1, 8, dir.file("journal.json"));
+        int id = manager.startDownload(server.url("big.pak"), dir.path().string(), "", options);
+        REQUIRE(waitUntil([&] { return manager.getDownloadInfo(id).downloadedSize >= 1024 * 1024; }));
+        CHECK(server.rangeRequests("big.pak") >= 1);
+    }
+
+    // Shut down during the single stream: the journal holds it, not the abandoned segments
+    {
+        DownloadJournal journal;
+        auto entries = journal.open(dir.file("journal.json"));
+        REQUIRE(entries.size() == 1);
+        REQUIRE(entries[0].ranges.size() == 1);
+        CHECK(entries[0].ranges[0].begin == 0);
+        CHECK(entries[0].ranges[0].done > 0);
+    }
+
+    DownloadManager manager(1, 8, dir.file("journal.json"));
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }, std::chrono::seconds(60)));
+    std::vector<DownloadInfo> downloads = manager.getAllDownloads();
+    REQUIRE(downloads.size() == 1);
+    CHECK(downloads[0].isCompleted);
+    CHECK(readFile(dir.file("big.pak")) == content);
+}
+
+TEST_CASE(foregroundJumpsQueuedLowerClasses) {
+    ScratchDir dir("priority");
+    LocalServer server;
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(200);
+    for (const char* name : {"first", "background", "predownload", "foreground"}) {
+        server.serve(name, syntheticData(64 * 1024, 110), slow);
+    }
+
+    FinishOrder order;
+    DownloadManager manager(1, 1);
+    auto start = [&](const char* name, DownloadPriority priority) {
+        DownloadOptions options = singleStream();
+        options.priority = priority;
+        return manager.startDownload(server.url(name), dir.path().string(), "", order.track(options));
+    };
+
+    // The worker is busy with the first; the rest queue up, lowest class first
+    int first = start("first", DownloadPriority::Foreground);
+    REQUIRE(waitUntil([&] { return server.requests("first") == 1; }));
+    int predownload = start("predownload", DownloadPriority::Predownload);
+    int background = start("background", DownloadPriority::Background);
+    int foreground = start("foreground", DownloadPriority::Foreground);
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }));
+
+    CHECK(order.ids() == std::vector<int>({first, foreground, background, predownload}));
+    CHECK(manager.getDownloadInfo(predownload).isCompleted);
+    CHECK(manager.getDownloadInfo(predownload).priority == DownloadPriority::Predownload);
+    // One worker and a running foreground download: nothing was ever stopped
+    CHECK(server.requests("first") == 1);
+}
+
+TEST_CASE(predownloadStepsAsideAndResumes) {
+    ScratchDir dir("preempt");
+    LocalServer server;
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 2 * 1024 * 1024;
+    std::string content = syntheticData(6 * 1024 * 1024, 111);
+    server.serve("release.pak", content, paced);
+    LocalServer::Behavior slow;
+    slow.latency = std::chrono::milliseconds(300);
+    std::string patch = syntheticData(64 * 1024, 112);
+    server.serve("patch.pak", patch, slow);
+
+    FinishOrder order;
+    // Room for both: the predownload steps aside for the class, not for a worker
+    DownloadManager manager(2, 4);
+    DownloadOptions options = singleStream();
+    options.priority = DownloadPriority::Predownload;
+    options.expectedMd5 = md5Of(content);
+    int predownload = manager.startDownload(server.url("release.pak"), dir.path().string(), "",
+                                            order.track(options));
+    REQUIRE(waitUntil([&] { return manager.getDownloadInfo(predownload).downloadedSize >= 1024 * 1024; }));
+
+    DownloadOptions urgent = singleStream();
+    int foreground = manager.startDownload(server.url("patch.pak"), dir.path().string(), "", order.track(urgent));
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }, std::chrono::seconds(60)));
+
+    CHECK(order.ids() == std::vector<int>({foreground, predownload}));
+    CHECK(manager.getDownloadInfo(foreground).isCompleted);
+    DownloadInfo info = manager.getDownloadInfo(predownload);
+    CHECK(info.isCompleted);
+    CHECK(readFile(dir.file("release.pak")) == content);
+    // Picked up again from where it stopped: only the first request asked for the whole file
+    CHECK(server.rangeRequests("release.pak") >= 1);
+    CHECK(server.requests("release.pak") - server.rangeRequests("release.pak") == 1);
+}
+
+TEST_CASE(pauseStopsTheTransferAndResumeFinishesIt) {
+    ScratchDir dir("pause");
+    LocalServer server;
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = 2 * 1024 * 1024;
+    std::string content = syntheticData(6 * 1024 * 1024, 113);
+    server.serve("file.pak", content, paced);
+
+    DownloadManager manager(1, 1);
+    DownloadOptions options = singleStream();
+    options.expectedMd5 = md5Of(content);
+    int id = manager.startDownload(server.url("file.pak"), dir.path().string(), "", options);
+    REQUIRE(waitUntil([&] { return manager.getDownloadInfo(id).downloadedSize >= 1024 * 1024; }));
+
+    CHECK(manager.pauseDownload(id));
+    CHECK(!manager.pauseDownload(id));
+    CHECK(manager.getDownloadInfo(id).isPaused);
+
+    // Once the transfer has stopped, nothing more arrives while paused
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    size_t paused = manager.getDownloadInfo(id).downloadedSize;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    DownloadInfo info = manager.getDownloadInfo(id);
+    CHECK(info.downloadedSize == paused);
+    CHECK(info.downloadedSize < content.size());
+    CHECK(!info.isCompleted && !info.isFailed);
+    CHECK(manager.isBusy());
+    CHECK(server.requests("file.pak") == 1);
+
+    CHECK(manager.resumeDownload(id));
+    CHECK(!manager.resumeDownload(id));
+    REQUIRE(waitUntil([&] { return finished(manager, id); }));
+    info = manager.getDownloadInfo(id);
+    CHECK(info.isCompleted);
+    CHECK(!info.isPaused);
+    CHECK(readFile(dir.file("file.pak")) == content);
+    CHECK(server.rangeRequests("file.pak") >= 1);
+    CHECK(server.requests("file.pak") - server.rangeRequests("file.pak") == 1);
+
+    // Finished downloads cannot be paused
+    CHECK(!manager.pauseDownload(id));
+}
+
+TEST_CASE(progressIsSampledAtABoundedRate) {
+    ScratchDir dir("progress");
+    LocalServer server;
+    const double rate = 2 * 1024 * 1024;
+    LocalServer::Behavior paced;
+    paced.bytesPerSecond = static_cast<uint64_t>(rate);
+    std::string content = syntheticData(8 * 1024 * 1024, 120);
+    server.serve("file.pak", content, paced);
+
+    struct Sample {
+        double seconds;
+        DownloadInfo info;
+    };
+    std::mutex mutex;
+    std::vector<Sample> samples;
+    auto start = std::chrono::steady_clock::now();
+
+    DownloadManager manager(1, 1);
+    manager.setProgressCallback([&](const DownloadInfo& info) {
+        std::lock_guard<std::mutex> lock(mutex);
+        samples.push_back({std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), info});
+    });
+    int id = manager.startDownload(server.url("file.pak"), dir.path().string(), "", singleStream());
+    REQUIRE(waitUntil([&] { return finished(manager, id); }));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    REQUIRE(samples.size() >= 10);
+    // Every 100 ms, or at each of the 100 percent steps, and never per chunk
+    CHECK(samples.size() <= static_cast<size_t>(seconds * 10) + 100 + 10);
+
+    std::vector<double> speeds;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const DownloadInfo& info = samples[i].info;
+        CHECK(info.downloadId == id);
+        CHECK(info.totalSize == content.size());
+        CHECK(info.downloadedSize <= content.size());
+        if (i > 0) {
+            CHECK(info.downloadedSize >= samples[i - 1].info.downloadedSize);
+        }
+        // Past the first second the socket buffers have filled and the pace holds
+        if (samples[i].seconds > 1.0 && info.downloadedSize < content.size()) {
+            speeds.push_back(info.speed);
+        }
+    }
+
+    REQUIRE(speeds.size() >= 5);
+    std::sort(speeds.begin(), speeds.end());
+    double median = speeds[speeds.size() / 2];
+    std::printf("  median speed %.2f MB/s over %zu samples\n", median / (1024 * 1024), speeds.size());
+    CHECK(median > rate * 0.6);
+    CHECK(median < rate * 1.5);
+    double average = samples[samples.size() / 2 + samples.size() / 4].info.averageSpeed;
+    CHECK(average > rate * 0.5);
+    CHECK(average < rate * 1.5);
+
+    // Finished: complete, and no longer moving
+    DownloadInfo info = manager.getDownloadInfo(id);
+    CHECK(info.isCompleted);
+    CHECK(info.progress == 1.0);
+    CHECK(info.downloadedSize == content.size());
+    CHECK(info.speed == 0.0);
+    CHECK(info.averageSpeed == 0.0);
+}
+
+TEST_CASE(historyEvictsTheOldestFinishedDownloads) {
+    ScratchDir dir("history");
+    LocalServer server;
+    for (int i = 0; i < 5; ++i) {
+        server.serve("file" + std::to_string(i) + ".pak", syntheticData(64 * 1024, 130 + i));
+    }
+
+    DownloadManager manager(1, 1);
+    manager.setHistoryLimit(3);
+    CHECK(manager.getHistoryLimit() == 3);
+
+    // One at a time, so they finish in the order they were started
+    std::vector<int> ids;
+    for (int i = 0; i < 5; ++i) {
+        int id = manager.startDownload(server.url("file" + std::to_string(i) + ".pak"), dir.path().string(), "",
+                                       singleStream());
+        REQUIRE(waitUntil([&] { return finished(manager, id); }));
+        ids.push_back(id);
+    }
+
+    auto listed = [&] {
+        std::vector<int> result;
+        for (const auto& info : manager.getAllDownloads()) {
+            result.push_back(info.downloadId);
+        }
+        return result;
+    };
+    CHECK(listed() == std::vector<int>(ids.begin() + 2, ids.end()));
+
+    // An evicted download reads as the empty record, as an unknown ID does
+    for (int id : {ids[0], ids[1]}) {
+        DownloadInfo info = manager.getDownloadInfo(id);
+        CHECK(info.downloadId == 0);
+        CHECK(info.url.empty());
+        CHECK(!info.isCompleted);
+        CHECK(!info.isFailed);
+    }
+    CHECK(manager.getDownloadInfo(ids[2]).isCompleted);
+
+    // Lowering the cap evicts at once, again oldest first
+    manager.setHistoryLimit(1);
+    CHECK(listed() == std::vector<int>{ids[4]});
+    CHECK(manager.getDownloadInfo(ids[3]).downloadId == 0);
+    CHECK(manager.getDownloadInfo(ids[4]).isCompleted);
+
+    // The files stay; only the records go
+    for (int i = 0; i < 5; ++i) {
+        CHECK(std::filesystem::exists(dir.file("file" + std::to_string(i) + ".pak")));
+    }
+}
+
+TEST_CASE(md5MismatchFailsAndRemovesTheFile) {
+    ScratchDir dir("md5-mismatch");
+    LocalServer server;
+    std::string content = syntheticData(1024 * 1024, 140);
+    server.serve("file.pak", content);
+    const std::string wrong = md5Of(content + "x");
+
+    DownloadManager manager(2, 4);
+
+    // Hashed as it streams, and over the segments of a split file
+    DownloadOptions single = singleStream();
+    single.expectedMd5 = wrong;
+    DownloadOptions segmented;
+    segmented.minSegmentSize = 128 * 1024;
+    segmented.expectedMd5 = wrong;
+
+    for (const DownloadOptions& options : {single, segmented}) {
+        std::string destination = dir.file(options.segments == 1 ? "single" : "segmented");
+        int id = manager.startDownload(server.url("file.pak"), destination, "", options);
+        REQUIRE(waitUntil([&] { return finished(manager, id); }));
+
+        DownloadInfo info = manager.getDownloadInfo(id);
+        CHECK(info.isFailed);
+        CHECK(!info.isCompleted);
+        CHECK(info.errorMessage.find("Hash mismatch: expected " + wrong + ", got " + md5Of(content)) == 0);
+        // Nothing a later attempt could take for a good prefix
+        CHECK(!std::filesystem::exists(std::filesystem::path(destination) / "file.pak"));
+    }
+    CHECK(server.rangeRequests("file.pak") >= 2);
+}
+
+TEST_CASE(resumeFromSavedHashStateStillVerifies) {
+    ScratchDir dir("hash-resume");
+    LocalServer server;
+    std::string content = syntheticData(1024 * 1024, 141);
+    server.serve("file.pak", content);
+    const size_t prefix = 300 * 1000;
+
+    // The state the caller kept when the earlier session stopped at prefix
+    Md5 hasher;
+    hasher.update(content.data(), prefix);
+    const std::string state = hasher.saveState();
+
+    DownloadManager manager(1, 1);
+    for (const std::string& resumeHashState : {state, std::string("not a state")}) {
+        server.resetCounters();
+        writeFile(dir.file("file.pak"), content.substr(0, prefix));
+
+        DownloadOptions options = singleStream();
+        options.expectedMd5 = md5Of(content);
+        options.resumeHashState = resumeHashState;
+        int id = manager.startDownload(server.url("file.pak"), dir.path().string(), "", options);
+        REQUIRE(waitUntil([&] { return finished(manager, id); }));
+
+        // Only the rest was fetched, and the digest covers the prefix too; a state that does not
+        // fit falls back to hashing the prefix from disk
+        DownloadInfo info = manager.getDownloadInfo(id);
+        CHECK(info.isCompleted);
+        CHECK(info.errorMessage.empty());
+        CHECK(server.requests("file.pak") == 1);
+        CHECK(server.rangeRequests("file.pak") == 1);
+        CHECK(readFile(dir.file("file.pak")) == content);
+    }
+}
+
+TEST_CASE(restartResumesFromTheJournaledOffset) {
+    ScratchDir dir("restart-resume");
+    LocalServer server;
+    std::string content = syntheticData(8 * 1024 * 1024, 150);
+    LocalServer::Behavior dropping;
+    dropping.dropAfter = 2 * 1024 * 1024;
+    dropping.bytesPerSecond = 4 * 1024 * 1024;
+    server.serve("file.pak", content, dropping);
+
+    DownloadOptions options = singleStream();
+    options.expectedMd5 = md5Of(content);
+    {
+        DownloadManager manager(1, 1, dir.file("journal.json"));
+        int id = manager.startDownload(server.url("file.pak"), dir.path().string(), "", options);
+        // The drop is resumed within the session, which then ends mid-transfer
+        REQUIRE(waitUntil([&] {
+            return server.requests("file.pak") >= 2 && manager.getDownloadInfo(id).downloadedSize >= 3 * 1024 * 1024;
+        }));
+        CHECK(!finished(manager, id));
+    }
+
+    uint64_t saved = 0;
+    {
+        DownloadJournal journal;
+        auto entries = journal.open(dir.file("journal.json"));
+        REQUIRE(entries.size() == 1);
+        REQUIRE(entries[0].ranges.size() == 1);
+        saved = entries[0].ranges[0].done;
+        CHECK(saved >= dropping.dropAfter);
+        CHECK(saved < content.size());
+    }
+
+    // The next session picks the download up by itself and asks only for the rest
+    server.resetCounters();
+    DownloadManager manager(1, 1, dir.file("journal.json"));
+    REQUIRE(waitUntil([&] { return !manager.isBusy(); }, std::chrono::seconds(60)));
+    std::vector<DownloadInfo> downloads = manager.getAllDownloads();
+    REQUIRE(downloads.size() == 1);
+    CHECK(downloads[0].isCompleted);
+    CHECK(server.requests("file.pak") == 1);
+    CHECK(server.rangeHeaders("file.pak") == std::vector<std::string>{"bytes=" + std::to_string(saved) + "-"});
+    CHECK(readFile(dir.file("file.pak")) == content);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,146 @@
+#include "filewriter.hpp"
+#include "diskwriter.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+// Feed content the way sockets deliver it: uneven pieces, mostly far smaller than the buffer
+bool writeInPieces(FileWriter& writer, const std::string& content) {
+    size_t pieces[] = {16 * 1024, 1, 4093, 65536, 100003};
+    size_t offset = 0;
+    for (size_t i = 0; offset < content.size(); ++i) {
+        size_t length = std::min(pieces[i % 5], content.size() - offset);
+        if (!writer.write(content.data() + offset, length)) {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+// Every case runs with writes done inline and with writes handed to a DiskWriter
+template <typename Body>
+void withAndWithoutStage(Body body) {
+    body(nullptr);
+    DiskWriter stage;
+    body(&stage);
+}
+
+} // namespace
+
+TEST_CASE(writesRoundTrip) {
+    withAndWithoutStage([](DiskWriter* stage) {
+        ScratchDir dir("writer");
+        // Several buffers and an unaligned tail
+        std::string content = syntheticData(3 * FileWriter::kBufferSize + 12345, 1);
+
+        FileWriter writer;
+        writer.setWriteStage(stage);
+        REQUIRE(writer.open(dir.file("out.bin"), 0, true));
+        CHECK(writeInPieces(writer, content));
+        CHECK(writer.position() == content.size());
+        CHECK(writer.close());
+        CHECK(readFile(dir.file("out.bin")) == content);
+    });
+}
+
+TEST_CASE(openAtOffsetKeepsEarlierBytes) {
+    withAndWithoutStage([](DiskWriter* stage) {
+        ScratchDir dir("writer-resume");
+        std::string content = syntheticData(FileWriter::kBufferSize + 777777, 2);
+        size_t split = 1234567;
+        writeFile(dir.file("out.bin"), content.substr(0, split));
+
+        FileWriter writer;
+        writer.setWriteStage(stage);
+        REQUIRE(writer.open(dir.file("out.bin"), split, false));
+        CHECK(writeInPieces(writer, content.substr(split)));
+        CHECK(writer.close());
+        CHECK(readFile(dir.file("out.bin")) == content);
+    });
+}
+
+TEST_CASE(truncateDropsOldContent) {
+    withAndWithoutStage([](DiskWriter* stage) {
+        ScratchDir dir("writer-truncate");
+        writeFile(dir.file("out.bin"), syntheticData(500000, 3));
+        std::string content = syntheticData(1000, 4);
+
+        FileWriter writer;
+        writer.setWriteStage(stage);
+        REQUIRE(writer.open(dir.file("out.bin"), 0, true));
+        CHECK(writer.write(content.data(), content.size()));
+        CHECK(writer.close());
+        CHECK(readFile(dir.file("out.bin")) == content);
+    });
+}
+
+TEST_CASE(unbufferedWritesTheSameBytes) {
+    withAndWithoutStage([](DiskWriter* stage) {
+        ScratchDir dir("writer-direct");
+        std::string content = syntheticData(2 * FileWriter::kBufferSize + 5000, 5);
+        // An unaligned start, so the head goes through the cache and the body is aligned
+        size_t split = 3000;
+        writeFile(dir.file("out.bin"), content.substr(0, split));
+
+        FileWriter writer;
+        writer.setWriteStage(stage);
+        REQUIRE(writer.open(dir.file("out.bin"), split, false, true));
+        CHECK(writeInPieces(writer, content.substr(split)));
+        CHECK(writer.sync());
+        CHECK(writer.close());
+        CHECK(readFile(dir.file("out.bin")) == content);
+    });
+}
+
+TEST_CASE(preallocateKeepsTheFileSize) {
+    ScratchDir dir("writer-prealloc");
+    std::string content = syntheticData(100000, 6);
+
+    FileWriter writer;
+    REQUIRE(writer.open(dir.file("out.bin"), 0, true));
+    bool reserved = writer.preallocate(64 * 1024 * 1024);
+    CHECK(writer.write(content.data(), content.size()));
+    CHECK(writer.close());
+
+    // Resume reads the length as the bytes written, so reserving must not extend it
+    CHECK(std::filesystem::file_size(dir.file("out.bin")) == content.size());
+    CHECK(readFile(dir.file("out.bin")) == content);
+    std::printf("  preallocation %s\n", reserved ? "supported" : "not supported here");
+}
+
+TEST_CASE(stageWritesWholeBuffers) {
+    ScratchDir dir("writer-stage");
+    std::string content = syntheticData(4 * FileWriter::kBufferSize + 100, 7);
+
+    DiskWriter stage;
+    FileWriter writer;
+    writer.setWriteStage(&stage);
+    REQUIRE(writer.open(dir.file("out.bin"), 0, true));
+    CHECK(writeInPieces(writer, content));
+    CHECK(writer.close());
+
+    // The four full buffers go through the stage; only the short tail is written inline
+    DiskWriter::Stats stats = stage.getStats();
+    CHECK(stats.bytes == 4 * FileWriter::kBufferSize);
+    CHECK(stats.writes >= 4);
+    CHECK(stats.writes <= 8);
+    CHECK(stats.queueDepth == 0);
+    CHECK(readFile(dir.file("out.bin")) == content);
+}
+
+TEST_CASE(openFailsForMissingDirectory) {
+    ScratchDir dir("writer-fail");
+    FileWriter writer;
+    CHECK(!writer.open(dir.file("missing/out.bin"), 0, true));
+    CHECK(!writer.error().empty());
+    CHECK(!writer.isOpen());
+    CHECK(!writer.write("x", 1));
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
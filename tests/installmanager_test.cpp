@@ -0,0 +1,211 @@
+#include "installmanager.hpp"
+#include "md5.hpp"
+#include "localserver.hpp"
+#include "testing.hpp"
+#include <stdexcept>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+std::string md5Of(const std::string& content) {
+    Md5 md5;
+    md5.update(content.data(), content.size());
+    return md5.hexDigest();
+}
+
+// A synthetic game: every file is served under /game and listed in the manifest
+struct Game {
+    std::map<std::string, std::string> files;
+    std::vector<ResourceEntry> resources;
+
+    void add(LocalServer& server, const std::string& dest, std::string content) {
+        server.serve("game" + dest, content);
+        ResourceEntry entry;
+        entry.dest = dest;
+        entry.size = content.size();
+        entry.md5 = md5Of(content);
+        resources.push_back(entry);
+        files[dest] = std::move(content);
+    }
+};
+
+bool terminal(const InstallInfo& info) {
+    return info.state == "completed" || info.state == "failed" || info.state == "cancelled";
+}
+
+InstallInfo waitForJob(const InstallManager& installs, int installId) {
+    waitUntil([&] { return terminal(installs.getInstallInfo(installId)); });
+    return installs.getInstallInfo(installId);
+}
+
+} // namespace
+
+TEST_CASE(parseManifestReadsEntries) {
+    auto resources = InstallManager::parseManifest(
+        R"({"resource": [{"dest": "/a.pak", "size": 3, "md5": "ABCDEF"}, {"dest": "/b/c.bin", "size": 0}]})");
+    REQUIRE(resources.size() == 2);
+    CHECK(resources[0].dest == "/a.pak");
+    CHECK(resources[0].size == 3);
+    CHECK(resources[0].md5 == "abcdef");
+    CHECK(resources[1].md5.empty());
+}
+
+TEST_CASE(parseManifestRejectsBadInput) {
+    const char* inputs[] = {
+        "not json",
+        R"({"files": []})",
+        R"({"resource": [{"dest": "/a.pak"}]})",
+        R"({"resource": [{"dest": "/../outside.dll", "size": 1}]})",
+    };
+    for (const char* input : inputs) {
+        bool threw = false;
+        try {
+            InstallManager::parseManifest(input);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+TEST_CASE(installFetchesOnlyMissingAndChangedFiles) {
+    ScratchDir dir("install");
+    LocalServer server;
+    Game game;
+    game.add(server, "/current.pak", syntheticData(200 * 1024, 1));
+    game.add(server, "/changed.pak", syntheticData(200 * 1024, 2));
+    game.add(server, "/data/missing.bin", syntheticData(300 * 1024, 3));
+    game.add(server, "/partial.bin", syntheticData(500 * 1024, 4));
+
+    // One file is current, one has other content, one is a prefix left by an interrupted download
+    writeFile(dir.file("current.pak"), game.files["/current.pak"]);
+    writeFile(dir.file("changed.pak"), syntheticData(200 * 1024, 99));
+    writeFile(dir.file("partial.bin"), game.files["/partial.bin"].substr(0, 123 * 1024));
+
+    DownloadManager downloads(4, 4);
+    InstallManager installs(downloads);
+    int installId = installs.startInstall(server.url("game"), game.resources, dir.path().string());
+    InstallInfo info = waitForJob(installs, installId);
+
+    CHECK(info.state == "completed");
+    CHECK(info.totalFiles == 4);
+    CHECK(info.checkedFiles == 4);
+    CHECK(info.queuedFiles == 3);
+    CHECK(info.completedFiles == 3);
+    CHECK(info.failedFiles == 0);
+    CHECK(info.progress == 1.0);
+    for (const auto& file : game.files) {
+        CHECK(readFile(dir.file(file.first.substr(1))) == file.second);
+    }
+    CHECK(server.requests("game/current.pak") == 0);
+    CHECK(server.requests("game/changed.pak") >= 1);
+    CHECK(server.requests("game/data/missing.bin") >= 1);
+
+    // Job files are reported through the job, not as standalone downloads
+    CHECK(downloads.getAllDownloads().empty());
+}
+
+TEST_CASE(installFailsAfterRetriesWhenAFileIsMissing) {
+    ScratchDir dir("install-missing");
+    LocalServer server;
+    Game game;
+    game.add(server, "/ok.pak", syntheticData(64 * 1024, 5));
+
+    ResourceEntry gone;
+    gone.dest = "/gone.pak";
+    gone.size = 1024;
+    gone.md5 = md5Of(syntheticData(1024, 6));
+    game.resources.push_back(gone);
+
+    DownloadManager downloads(4, 4);
+    InstallManager installs(downloads);
+    int installId = installs.startInstall(server.url("game"), game.resources, dir.path().string());
+    InstallInfo info = waitForJob(installs, installId);
+
+    CHECK(info.state == "failed");
+    CHECK(info.completedFiles == 1);
+    CHECK(info.failedFiles == 1);
+    CHECK(!info.errorMessage.empty());
+    CHECK(readFile(dir.file("ok.pak")) == game.files["/ok.pak"]);
+}
+
+TEST_CASE(installRejectsFilesWithTheWrongHash) {
+    ScratchDir dir("install-hash");
+    LocalServer server;
+    Game game;
+    game.add(server, "/tampered.pak", syntheticData(64 * 1024, 7));
+    game.resources[0].md5 = md5Of("something else");
+
+    DownloadManager downloads(2, 2);
+    InstallManager installs(downloads);
+    int installId = installs.startInstall(server.url("game"), game.resources, dir.path().string());
+    InstallInfo info = waitForJob(installs, installId);
+
+    CHECK(info.state == "failed");
+    CHECK(info.errorMessage.find("Hash mismatch") != std::string::npos);
+}
+
+TEST_CASE(verifyRepairsOnlyDamagedFiles) {
+    ScratchDir dir("verify");
+    LocalServer server;
+    Game game;
+    for (int i = 0; i < 12; ++i) {
+        game.add(server, "/pak" + std::to_string(i) + ".pak", syntheticData((64 + 32 * i) * 1024, 10 + i));
+    }
+    for (const auto& file : game.files) {
+        writeFile(dir.file(file.first.substr(1)), file.second);
+    }
+
+    // Same size, one flipped byte: only hashing can tell
+    std::string damaged = game.files["/pak5.pak"];
+    damaged[damaged.size() / 2] ^= 0x5a;
+    writeFile(dir.file("pak5.pak"), damaged);
+
+    DownloadManager downloads(4, 4);
+    InstallManager installs(downloads);
+    int installId = installs.startVerify(server.url("game"), game.resources, dir.path().string());
+    InstallInfo info = waitForJob(installs, installId);
+
+    uint64_t totalBytes = 0;
+    for (const auto& entry : game.resources) {
+        totalBytes += entry.size;
+    }
+
+    CHECK(info.mode == "verify");
+    CHECK(info.state == "completed");
+    CHECK(info.checkedFiles == 12);
+    CHECK(info.checkedBytes == totalBytes);
+    CHECK(info.checkBytesPerSecond > 0.0);
+    CHECK(info.queuedFiles == 1);
+    CHECK(info.completedFiles == 1);
+    CHECK(server.totalRequests() == server.requests("game/pak5.pak"));
+    CHECK(readFile(dir.file("pak5.pak")) == game.files["/pak5.pak"]);
+}
+
+TEST_CASE(verifyOfAnIntactInstallDownloadsNothing) {
+    ScratchDir dir("verify-intact");
+    LocalServer server;
+    Game game;
+    for (int i = 0; i < 20; ++i) {
+        game.add(server, "/file" + std::to_string(i), syntheticData(1000 + 4099 * i, 40 + i));
+    }
+    for (const auto& file : game.files) {
+        writeFile(dir.file(file.first.substr(1)), file.second);
+    }
+
+    DownloadManager downloads(4, 4);
+    InstallManager installs(downloads);
+    int installId = installs.startVerify(server.url("game"), game.resources, dir.path().string());
+    InstallInfo info = waitForJob(installs, installId);
+
+    CHECK(info.state == "completed");
+    CHECK(info.checkedFiles == 20);
+    CHECK(info.queuedFiles == 0);
+    CHECK(server.totalRequests() == 0);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <httplib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+namespace launcher {
+namespace testing {
+
+// In-process stand-in for a CDN: serves files from memory on 127.0.0.1 with keep-alive and
+// Range support, and can be told to answer slowly, throttle, fail or drop a file's requests.
+// Counts requests and how many bodies are being sent at once.
+class LocalServer {
+public:
+    struct Behavior {
+        // Wait before the response headers
+        std::chrono::milliseconds latency{0};
+        // Pace every body to this rate (0 = as fast as the socket takes it)
+        uint64_t bytesPerSecond = 0;
+        // Answer this many requests with failStatus before serving normally
+        int failFirst = 0;
+        int failStatus = 503;
+        // Close the connection once a body gets this many bytes in, for the first body that
+        // does; shorter requests such as mirror probes pass (0 = never)
+        uint64_t dropAfter = 0;
+        // Sent as Content-Encoding; the content is then already encoded that way
+        std::string contentEncoding;
+        // Advertise byte ranges but answer every request with the whole body and 200
+        bool ignoreRange = false;
+    };
+
+    LocalServer() {
+        // Idle keep-alive connections hold a server thread each, so pooled clients need plenty
+        m_server.new_task_queue = [] { return new httplib::ThreadPool(64); };
+        m_server.set_keep_alive_max_count(100000);
+
+        m_server.Get(R"(/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+            handle(req, res);
+        });
+
+        m_port = m_server.bind_to_any_port("127.0.0.1");
+        m_thread = std::thread([this] { m_server.listen_after_bind(); });
+        while (!m_server.is_running()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    ~LocalServer() {
+        m_server.stop();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    LocalServer(const LocalServer&) = delete;
+    LocalServer& operator=(const LocalServer&) = delete;
+
+    // Serve content at /path, replacing what was there
+    void serve(const std::string& path, std::string content) {
+        serve(path, std::move(content), Behavior());
+    }
+
+    void serve(const std::string& path, std::string content, const Behavior& behavior) {
+        auto file = std::make_shared<File>();
+        file->content = std::move(content);
+        file->behavior = behavior;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_files[path] = file;
+    }
+
+    void setBehavior(const std::string& path, const Behavior& behavior) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(path);
+        if (it != m_files.end()) {
+            it->second->behavior = behavior;
+            it->second->failed = 0;
+            it->second->dropped = false;
+        }
+    }
+
+    int port() const { return m_port; }
+    std::string host() const { return "127.0.0.1"; }
+    std::string url(const std::string& path) const {
+        return "http://127.0.0.1:" + std::to_string(m_port) + "/" + path;
+    }
+
+    // GET and HEAD requests for path, and for every path
+    size_t requests(const std::string& path) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(path);
+        return it != m_files.end() ? it->second->requests : 0;
+    }
+    size_t totalRequests() const { return m_totalRequests; }
+
+    // Requests for path that carried a Range header
+    size_t rangeRequests(const std::string& path) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(path);
+        return it != m_files.end() ? it->second->rangeRequests : 0;
+    }
+
+    // Range headers of the requests for path, in the order they arrived
+    std::vector<std::string> rangeHeaders(const std::string& path) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(path);
+        return it != m_files.end() ? it->second->rangeHeaders : std::vector<std::string>();
+    }
+
+    // TCP connections the requests arrived on, told apart by the client's port
+    size_t connections() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_clientPorts.size();
+    }
+
+    // Most responses that were between their request and the end of their body at once
+    size_t peakInFlight() const { return m_peakInFlight; }
+
+    void resetCounters() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& file : m_files) {
+            file.second->requests = 0;
+            file.second->rangeRequests = 0;
+            file.second->rangeHeaders.clear();
+        }
+        m_clientPorts.clear();
+        m_totalRequests = 0;
+        m_peakInFlight = m_inFlight.load();
+    }
+
+private:
+    struct File {
+        std::string content;
+        Behavior behavior;
+        size_t requests = 0;
+        size_t rangeRequests = 0;
+        std::vector<std::string> rangeHeaders;
+        int failed = 0;
+        bool dropped = false;
+    };
+
+    // Slice a paced body is written in
+    static constexpr size_t kSlice = 16 * 1024;
+
+    void handle(const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<File> file;
+        Behavior behavior;
+        bool fail = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_clientPorts.insert(req.remote_port);
+            auto it = m_files.find(req.matches[1].str());
+            if (it != m_files.end()) {
+                file = it->second;
+                behavior = file->behavior;
+                ++file->requests;
+                if (req.has_header("Range")) {
+                    ++file->rangeRequests;
+                    file->rangeHeaders.push_back(req.get_header_value("Range"));
+                }
+                fail = file->failed < behavior.failFirst;
+                if (fail) {
+                    ++file->failed;
+                }
+            }
+        }
+        ++m_totalRequests;
+
+        if (!file) {
+            res.status = 404;
+            return;
+        }
+
+        size_t inFlight = ++m_inFlight;
+        size_t peak = m_peakInFlight;
+        while (inFlight > peak && !m_peakInFlight.compare_exchange_weak(peak, inFlight)) {
+        }
+
+        if (behavior.latency.count() > 0) {
+            std::this_thread::sleep_for(behavior.latency);
+        }
+
+        if (fail) {
+            --m_inFlight;
+            res.status = behavior.failStatus;
+            return;
+        }
+
+        // httplib cuts the requested range out of this provider and answers 206 for it
+        res.set_header("Accept-Ranges", "bytes");
+        // httplib only cuts the range out of a response it answers 206 itself
+        if (behavior.ignoreRange) {
+            res.status = 200;
+        }
+        if (!behavior.contentEncoding.empty()) {
+            res.set_header("Content-Encoding", behavior.contentEncoding);
+        }
+        auto sent = std::make_shared<uint64_t>(0);
+        res.set_content_provider(
+            file->content.size(), "application/octet-stream",
+            [this, file, behavior, sent](size_t offset, size_t length, httplib::DataSink& sink) {
+                size_t slice = std::min(length, kSlice);
+                if (behavior.dropAfter > 0 && *sent + slice > behavior.dropAfter && claimDrop(*file)) {
+                    return false;
+                }
+                if (!sink.write(file->content.data() + offset, slice)) {
+                    return false;
+                }
+                *sent += slice;
+                if (behavior.bytesPerSecond > 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(
+                        static_cast<int64_t>(slice * 1000000 / behavior.bytesPerSecond)));
+                }
+                return true;
+            },
+            [this](bool) { --m_inFlight; });
+    }
+
+    bool claimDrop(File& file) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (file.dropped) {
+            return false;
+        }
+        file.dropped = true;
+        return true;
+    }
+
+    httplib::Server m_server;
+    std::thread m_thread;
+    int m_port = 0;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<File>> m_files;
+    std::set<int> m_clientPorts;
+    std::atomic<size_t> m_totalRequests{0};
+    std::atomic<size_t> m_inFlight{0};
+    std::atomic<size_t> m_peakInFlight{0};
+};
+
+} // namespace testing
+} // namespace launcher
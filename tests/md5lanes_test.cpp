@@ -0,0 +1,174 @@
+#include "md5.hpp"
+#include "md5lanes.hpp"
+#include "testing.hpp"
+#include <array>
+#include <algorithm>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+std::string md5Of(const std::string& message) {
+    Md5 md5;
+    md5.update(message.data(), message.size());
+    return md5.hexDigest();
+}
+
+// RFC 1321 section A.5
+const std::pair<const char*, const char*> kRfcVectors[] = {
+    {"", "d41d8cd98f00b204e9800998ecf8427e"},
+    {"a", "0cc175b9c0f1b6a831c399e269772661"},
+    {"abc", "900150983cd24fb0d6963f7d28e17f72"},
+    {"message digest", "f96b697d7cb7938d525a2f31aaf161d0"},
+    {"abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b"},
+    {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f"},
+    {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+     "57edf4a22be3c955ac49da2e2107b67a"},
+};
+
+// The message with its MD5 padding and length, so compressing it leaves the digest in the state
+std::string padded(const std::string& message) {
+    std::string blocks = message;
+    blocks.push_back('\x80');
+    while (blocks.size() % 64 != 56) {
+        blocks.push_back('\0');
+    }
+    uint64_t bits = static_cast<uint64_t>(message.size()) * 8;
+    for (int i = 0; i < 8; ++i) {
+        blocks.push_back(static_cast<char>(bits >> (8 * i)));
+    }
+    return blocks;
+}
+
+std::string hexState(const uint32_t state[4]) {
+    static const char* digits = "0123456789abcdef";
+    std::string hex;
+    for (int word = 0; word < 4; ++word) {
+        for (int byte = 0; byte < 4; ++byte) {
+            uint8_t value = static_cast<uint8_t>(state[word] >> (8 * byte));
+            hex.push_back(digits[value >> 4]);
+            hex.push_back(digits[value & 0x0f]);
+        }
+    }
+    return hex;
+}
+
+// Run a kernel directly: every lane compresses its own padded message of the same block count
+std::vector<std::string> compressPadded(const md5lanes::KernelInfo& kernel, const std::vector<std::string>& messages) {
+    std::vector<std::string> blocks;
+    for (const auto& message : messages) {
+        blocks.push_back(padded(message));
+    }
+
+    std::vector<std::array<uint32_t, 4>> states(messages.size(), {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476});
+    std::vector<uint32_t*> statePointers;
+    std::vector<const uint8_t*> inputs;
+    for (size_t lane = 0; lane < messages.size(); ++lane) {
+        statePointers.push_back(states[lane].data());
+        inputs.push_back(reinterpret_cast<const uint8_t*>(blocks[lane].data()));
+    }
+    kernel.compress(statePointers.data(), inputs.data(), blocks[0].size() / 64);
+
+    std::vector<std::string> digests;
+    for (const auto& state : states) {
+        digests.push_back(hexState(state.data()));
+    }
+    return digests;
+}
+
+} // namespace
+
+TEST_CASE(scalarMatchesRfcVectors) {
+    for (const auto& vector : kRfcVectors) {
+        CHECK(md5Of(vector.first) == vector.second);
+    }
+}
+
+TEST_CASE(everyKernelMatchesRfcVectors) {
+    for (const auto& kernel : md5lanes::availableKernels()) {
+        std::printf("  kernel %s, %d lanes\n", kernel.name, kernel.lanes);
+        // One vector in every lane at a time, since a kernel call compresses equal block counts
+        for (const auto& vector : kRfcVectors) {
+            std::vector<std::string> messages(kernel.lanes, vector.first);
+            CHECK(compressPadded(kernel, messages) == std::vector<std::string>(kernel.lanes, vector.second));
+        }
+    }
+}
+
+TEST_CASE(everyKernelMatchesScalarOnRandomBlocks) {
+    for (const auto& kernel : md5lanes::availableKernels()) {
+        for (size_t length : {size_t(55), size_t(64 * 7 + 3), size_t(64 * 33 + 50)}) {
+            std::vector<std::string> messages;
+            std::vector<std::string> expected;
+            for (int lane = 0; lane < kernel.lanes; ++lane) {
+                messages.push_back(syntheticData(length, static_cast<uint32_t>(100 * lane + length)));
+                expected.push_back(md5Of(messages.back()));
+            }
+            CHECK(compressPadded(kernel, messages) == expected);
+        }
+    }
+}
+
+TEST_CASE(updateLanesMatchesScalarOnUnequalStreams) {
+    // Unequal lengths, lane counts that are not a kernel width, and streams that start with a
+    // buffered tail, so grouping, idle lanes and the scalar remainder are all exercised
+    uint32_t seed = 1;
+    for (size_t count : {size_t(1), size_t(3), size_t(4), size_t(7), size_t(16), size_t(21)}) {
+        std::vector<std::string> streams;
+        for (size_t i = 0; i < count; ++i) {
+            size_t length = (seed * 7919u + i * 104729u) % (300 * 1024);
+            streams.push_back(syntheticData(length, seed++));
+        }
+
+        std::vector<Md5> hashers(count);
+        std::vector<size_t> offsets(count, 0);
+        for (size_t i = 0; i < count; i += 2) {
+            size_t head = std::min<size_t>(streams[i].size(), 13);
+            hashers[i].update(streams[i].data(), head);
+            offsets[i] = head;
+        }
+
+        // Feed each stream in pieces of differing size until all are consumed
+        for (size_t round = 0;; ++round) {
+            std::vector<Md5*> pointers;
+            std::vector<const uint8_t*> data;
+            std::vector<size_t> lengths;
+            for (size_t i = 0; i < count; ++i) {
+                size_t piece = std::min(streams[i].size() - offsets[i], 4096 * (1 + (i + round) % 5));
+                pointers.push_back(&hashers[i]);
+                data.push_back(reinterpret_cast<const uint8_t*>(streams[i].data()) + offsets[i]);
+                lengths.push_back(piece);
+                offsets[i] += piece;
+            }
+            Md5::updateLanes(pointers.data(), data.data(), lengths.data(), count);
+
+            bool done = true;
+            for (size_t i = 0; i < count; ++i) {
+                done = done && offsets[i] == streams[i].size();
+            }
+            if (done) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            CHECK(hashers[i].length() == streams[i].size());
+            CHECK(hashers[i].hexDigest() == md5Of(streams[i]));
+        }
+    }
+}
+
+TEST_CASE(laneWidthMatchesWidestKernel) {
+    const auto& kernels = md5lanes::availableKernels();
+    if (kernels.empty()) {
+        CHECK(std::string(Md5::laneKernel()) == "scalar");
+        return;
+    }
+    CHECK(std::string(Md5::laneKernel()) == kernels.back().name);
+    CHECK(Md5::laneWidth() == static_cast<size_t>(kernels.back().lanes));
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,125 @@
+#include "mirrorselector.hpp"
+#include "testing.hpp"
+#include <algorithm>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const std::vector<std::string> kHosts = {"a.example:443", "b.example:443", "c.example:443"};
+
+// Record one transfer of a second at the given rate
+void measure(MirrorSelector& selector, const std::string& host, uint64_t bytesPerSecond) {
+    selector.recordThroughput(host, bytesPerSecond, std::chrono::seconds(1));
+}
+
+MirrorSelector::MirrorStats statsOf(const MirrorSelector& selector, const std::string& host) {
+    for (const auto& stats : selector.getStats()) {
+        if (stats.host == host) {
+            return stats;
+        }
+    }
+    return MirrorSelector::MirrorStats();
+}
+
+} // namespace
+
+TEST_CASE(unmeasuredHostsKeepTheirOrder) {
+    MirrorSelector selector;
+    CHECK(selector.rank(kHosts) == std::vector<size_t>({0, 1, 2}));
+}
+
+TEST_CASE(rankPutsTheFastestFirst) {
+    MirrorSelector selector;
+    measure(selector, kHosts[0], 1 * 1024 * 1024);
+    measure(selector, kHosts[1], 8 * 1024 * 1024);
+    measure(selector, kHosts[2], 4 * 1024 * 1024);
+    CHECK(selector.rank(kHosts) == std::vector<size_t>({1, 2, 0}));
+}
+
+TEST_CASE(tinySamplesAreIgnored) {
+    MirrorSelector selector;
+    selector.recordThroughput(kHosts[0], 1000, std::chrono::milliseconds(1));
+    CHECK(statsOf(selector, kHosts[0]).samples == 0);
+    CHECK(statsOf(selector, kHosts[0]).bytesPerSecond == 0.0);
+}
+
+TEST_CASE(throughputIsSmoothed) {
+    MirrorSelector selector;
+    measure(selector, kHosts[0], 10 * 1024 * 1024);
+    measure(selector, kHosts[0], 1024 * 1024);
+    // One slow transfer pulls the estimate down, but not all the way
+    double estimate = statsOf(selector, kHosts[0]).bytesPerSecond;
+    CHECK(estimate < 10.0 * 1024 * 1024);
+    CHECK(estimate > 5.0 * 1024 * 1024);
+    CHECK(statsOf(selector, kHosts[0]).samples == 2);
+}
+
+TEST_CASE(failureBenchesAHost) {
+    MirrorSelector selector;
+    measure(selector, kHosts[0], 8 * 1024 * 1024);
+    measure(selector, kHosts[1], 1 * 1024 * 1024);
+    selector.recordFailure(kHosts[0]);
+
+    auto stats = statsOf(selector, kHosts[0]);
+    CHECK(stats.benched);
+    CHECK(stats.failures == 1);
+    // Benched hosts go last, however fast they were
+    CHECK(selector.rank(kHosts).back() == 0);
+    CHECK(selector.hasAlternative(kHosts, 0));
+    CHECK(!selector.claimProbe(kHosts[0]));
+
+    auto next = selector.candidates(kHosts, {0, 0, 0});
+    CHECK(std::find(next.begin(), next.end(), 0) == next.end());
+}
+
+TEST_CASE(allBenchedLeavesTheEarliestBack) {
+    MirrorSelector selector;
+    std::vector<std::string> hosts = {kHosts[0], kHosts[1]};
+    selector.recordFailure(hosts[1]);
+    selector.recordFailure(hosts[0]);
+    // hosts[0] failed twice in a row now, so it is benched for longer
+    selector.recordFailure(hosts[0]);
+
+    CHECK(!selector.hasAlternative(hosts, 0));
+    CHECK(!selector.hasAlternative(hosts, 1));
+    CHECK(selector.candidates(hosts, {0, 0}) == std::vector<size_t>({1}));
+}
+
+TEST_CASE(onlyOneProbePerHost) {
+    MirrorSelector selector;
+    CHECK(selector.claimProbe(kHosts[0]));
+    CHECK(!selector.claimProbe(kHosts[0]));
+    measure(selector, kHosts[0], 2 * 1024 * 1024);
+    // Measured recently, so no new probe is needed
+    CHECK(!selector.claimProbe(kHosts[0]));
+    CHECK(selector.claimProbe(kHosts[1]));
+}
+
+TEST_CASE(candidatesSpreadConnectionsByThroughput) {
+    MirrorSelector selector;
+    measure(selector, kHosts[0], 8 * 1024 * 1024);
+    measure(selector, kHosts[1], 4 * 1024 * 1024);
+    // Under half the fastest: gets nothing while the others are usable
+    measure(selector, kHosts[2], 1 * 1024 * 1024);
+
+    CHECK(selector.candidates(kHosts, {0, 0, 0}).front() == 0);
+    auto next = selector.candidates(kHosts, {0, 0, 0});
+    CHECK(std::find(next.begin(), next.end(), 2) == next.end());
+
+    // Twice as fast takes about twice the connections before the other gets the next one
+    CHECK(selector.candidates(kHosts, {1, 0, 0}).front() == 0);
+    CHECK(selector.candidates(kHosts, {2, 0, 0}).front() == 1);
+    CHECK(selector.candidates(kHosts, {2, 1, 0}).front() == 0);
+}
+
+TEST_CASE(sameHostIsNoAlternative) {
+    MirrorSelector selector;
+    std::vector<std::string> hosts = {kHosts[0], kHosts[0]};
+    CHECK(!selector.hasAlternative(hosts, 0));
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,180 @@
+#include "splicetransfer.hpp"
+#include "localserver.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const size_t kSize = 4 * 1024 * 1024;
+
+// The file has to exist before SpliceTransfer opens it, as the engine creates it first
+std::string createOutput(const ScratchDir& dir) {
+    writeFile(dir.file("out.bin"), "");
+    return dir.file("out.bin");
+}
+
+struct Result {
+    SpliceTransfer::Outcome outcome = SpliceTransfer::Outcome::Failed;
+    int status = 0;
+    uint64_t reported = 0;
+};
+
+Result fetch(SpliceTransfer& transfer, const LocalServer& server, const std::string& path, uint64_t begin,
+             uint64_t end, uint64_t stopAfter = 0) {
+    Result result;
+    result.outcome = transfer.fetch(
+        server.host(), server.port(), "/" + path, begin, end,
+        [&](int status, std::chrono::steady_clock::duration) {
+            result.status = status;
+            return status == 206;
+        },
+        [&](size_t length) {
+            result.reported += length;
+            return stopAfter == 0 || result.reported < stopAfter;
+        });
+    return result;
+}
+
+} // namespace
+
+#ifdef __linux__
+
+TEST_CASE(rangeIsSplicedToItsOffset) {
+    ScratchDir dir("splice-range");
+    LocalServer server;
+    std::string content = syntheticData(kSize, 1);
+    server.serve("file.pak", content);
+
+    SpliceTransfer transfer;
+    REQUIRE(transfer.open(createOutput(dir)));
+    const uint64_t begin = 1024 * 1024 + 17;
+    const uint64_t end = 3 * 1024 * 1024;
+    Result result = fetch(transfer, server, "file.pak", begin, end);
+
+    CHECK(result.outcome == SpliceTransfer::Outcome::Completed);
+    CHECK(result.status == 206);
+    CHECK(result.reported == end - begin);
+
+    std::string written = readFile(dir.file("out.bin"));
+    REQUIRE(written.size() == end);
+    CHECK(written.compare(begin, end - begin, content, begin, end - begin) == 0);
+}
+
+TEST_CASE(rangesAssembleTheWholeFile) {
+    ScratchDir dir("splice-whole");
+    LocalServer server;
+    std::string content = syntheticData(kSize + 12345, 2);
+    server.serve("file.pak", content);
+
+    SpliceTransfer transfer;
+    REQUIRE(transfer.open(createOutput(dir)));
+    // Out of order, as segments finish
+    const uint64_t quarter = content.size() / 4;
+    for (uint64_t part : {2, 0, 3, 1}) {
+        uint64_t begin = part * quarter;
+        uint64_t end = part == 3 ? content.size() : begin + quarter;
+        CHECK(fetch(transfer, server, "file.pak", begin, end).outcome == SpliceTransfer::Outcome::Completed);
+    }
+    CHECK(readFile(dir.file("out.bin")) == content);
+    CHECK(server.requests("file.pak") == 4);
+}
+
+TEST_CASE(chunkHandlerStopsTheTransfer) {
+    ScratchDir dir("splice-stop");
+    LocalServer server;
+    std::string content = syntheticData(kSize, 3);
+    LocalServer::Behavior slow;
+    slow.bytesPerSecond = 8 * 1024 * 1024;
+    server.serve("file.pak", content, slow);
+
+    SpliceTransfer transfer;
+    REQUIRE(transfer.open(createOutput(dir)));
+    Result result = fetch(transfer, server, "file.pak", 0, kSize, 256 * 1024);
+
+    CHECK(result.outcome == SpliceTransfer::Outcome::Stopped);
+    CHECK(result.reported >= 256 * 1024);
+    CHECK(result.reported < kSize);
+    // Whatever was reported is on disk
+    std::string written = readFile(dir.file("out.bin"));
+    REQUIRE(written.size() >= result.reported);
+    CHECK(written.compare(0, result.reported, content, 0, result.reported) == 0);
+}
+
+TEST_CASE(errorStatusIsLeftToTheCaller) {
+    ScratchDir dir("splice-status");
+    LocalServer server;
+    LocalServer::Behavior failing;
+    failing.failFirst = 1;
+    server.serve("file.pak", syntheticData(kSize, 4), failing);
+
+    SpliceTransfer transfer;
+    REQUIRE(transfer.open(createOutput(dir)));
+    Result result = fetch(transfer, server, "file.pak", 0, kSize);
+    CHECK(result.status == 503);
+    CHECK(result.outcome == SpliceTransfer::Outcome::Stopped);
+    CHECK(result.reported == 0);
+
+    result = fetch(transfer, server, "missing.pak", 0, kSize);
+    CHECK(result.status == 404);
+    CHECK(result.outcome == SpliceTransfer::Outcome::Stopped);
+}
+
+TEST_CASE(droppedConnectionFails) {
+    ScratchDir dir("splice-drop");
+    LocalServer server;
+    std::string content = syntheticData(kSize, 5);
+    LocalServer::Behavior dropping;
+    dropping.dropAfter = 1024 * 1024;
+    server.serve("file.pak", content, dropping);
+
+    SpliceTransfer transfer;
+    REQUIRE(transfer.open(createOutput(dir)));
+    Result result = fetch(transfer, server, "file.pak", 0, kSize);
+    CHECK(result.outcome == SpliceTransfer::Outcome::Failed);
+    CHECK(result.reported <= 1024 * 1024);
+
+    // The part that arrived can be resumed from
+    std::string written = readFile(dir.file("out.bin"));
+    REQUIRE(written.size() >= result.reported);
+    CHECK(written.compare(0, result.reported, content, 0, result.reported) == 0);
+
+    result = fetch(transfer, server, "file.pak", result.reported, kSize);
+    CHECK(result.outcome == SpliceTransfer::Outcome::Completed);
+    CHECK(readFile(dir.file("out.bin")) == content);
+}
+
+TEST_CASE(unreachableHostFails) {
+    ScratchDir dir("splice-refused");
+    int port = 0;
+    {
+        LocalServer server;
+        port = server.port();
+    }
+
+    SpliceTransfer transfer;
+    REQUIRE(transfer.open(createOutput(dir)));
+    auto outcome = transfer.fetch(
+        "127.0.0.1", port, "/file.pak", 0, 1024, [](int, std::chrono::steady_clock::duration) { return true; },
+        [](size_t) { return true; });
+    CHECK(outcome == SpliceTransfer::Outcome::Failed);
+}
+
+#endif
+
+TEST_CASE(openNeedsAnExistingFile) {
+    ScratchDir dir("splice-open");
+    SpliceTransfer transfer;
+    CHECK(!transfer.open(dir.file("missing.bin")));
+
+    // Not opened: nothing is fetched, so the caller falls back to httplib
+    auto outcome = transfer.fetch(
+        "127.0.0.1", 1, "/file.pak", 0, 1024, [](int, std::chrono::steady_clock::duration) { return true; },
+        [](size_t) { return true; });
+    CHECK(outcome == SpliceTransfer::Outcome::Unsupported);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
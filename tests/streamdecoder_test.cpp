@@ -0,0 +1,217 @@
+#include "streamdecoder.hpp"
+#include "testing.hpp"
+#include <zlib.h>
+#include <zstd.h>
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+using Format = StreamDecoder::Format;
+
+// 31: gzip wrapper, 15: zlib wrapper, -15: raw deflate
+std::string deflateWith(const std::string& data, int windowBits) {
+    z_stream stream = {};
+    deflateInit2(&stream, 6, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// With the content checksum, as the zstd tool writes frames
+std::string zstdOf(const std::string& data) {
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+    std::string out(ZSTD_compressBound(data.size()), '\0');
+    out.resize(ZSTD_compress2(context, &out[0], out.size(), data.data(), data.size()));
+    ZSTD_freeCCtx(context);
+    return out;
+}
+
+// Text that compresses well, with incompressible stretches so the output is not trivial;
+// large enough to decode into several output chunks
+std::string sample() {
+    std::string data;
+    for (int i = 0; i < 4000; ++i) {
+        data += "pak/chunk_" + std::to_string(i) + ".bin size=" + std::to_string(i * 7919) + "\n";
+        if (i % 500 == 0) {
+            data += syntheticData(4096, static_cast<uint32_t>(i));
+        }
+    }
+    return data;
+}
+
+struct Decoded {
+    bool ok = false;
+    std::string data;
+    std::string error;
+    Format format = Format::None;
+};
+
+// Feed the body in pieces of chunk bytes, as a transfer receives it
+Decoded decode(Format format, const std::string& body, size_t chunk) {
+    Decoded result;
+    StreamDecoder decoder(format);
+    StreamDecoder::Sink sink = [&](const char* data, size_t length) {
+        result.data.append(data, length);
+        return true;
+    };
+
+    result.ok = true;
+    for (size_t offset = 0; offset < body.size() && result.ok; offset += chunk) {
+        result.ok = decoder.write(body.data() + offset, std::min(chunk, body.size() - offset), sink);
+    }
+    result.ok = result.ok && decoder.finish(sink);
+    result.error = decoder.error();
+    result.format = decoder.format();
+    return result;
+}
+
+const size_t kChunkSizes[] = {1, 2, 3, 7, 4095, 65537, 1 << 30};
+
+} // namespace
+
+TEST_CASE(encodingNamesMapToFormats) {
+    Format format = Format::Zstd;
+    CHECK(StreamDecoder::parseEncoding("", format) && format == Format::None);
+    CHECK(StreamDecoder::parseEncoding("identity", format) && format == Format::None);
+    CHECK(StreamDecoder::parseEncoding("gzip", format) && format == Format::Gzip);
+    CHECK(StreamDecoder::parseEncoding(" X-GZIP ", format) && format == Format::Gzip);
+    CHECK(StreamDecoder::parseEncoding("deflate", format) && format == Format::Deflate);
+    CHECK(StreamDecoder::parseEncoding("zstd", format) && format == Format::Zstd);
+    CHECK(!StreamDecoder::parseEncoding("br", format));
+}
+
+TEST_CASE(everyFormatRoundTripsAtAnyChunkSize) {
+    const std::string data = sample();
+    struct Encoded {
+        const char* name;
+        Format format;
+        std::string body;
+    };
+    const Encoded encoded[] = {
+        {"gzip", Format::Gzip, deflateWith(data, 31)},
+        {"zlib", Format::Gzip, deflateWith(data, 15)},
+        {"zlib as deflate", Format::Deflate, deflateWith(data, 15)},
+        {"raw deflate", Format::Deflate, deflateWith(data, -15)},
+        {"zstd", Format::Zstd, zstdOf(data)},
+        {"gzip detected", Format::Detect, deflateWith(data, 31)},
+        {"zstd detected", Format::Detect, zstdOf(data)},
+    };
+
+    for (const auto& body : encoded) {
+        for (size_t chunk : kChunkSizes) {
+            Decoded decoded = decode(body.format, body.body, chunk);
+            CHECK(decoded.ok);
+            CHECK(decoded.data == data);
+            if (!decoded.ok || decoded.data != data) {
+                std::printf("  %s in %zu-byte chunks: %s\n", body.name, chunk, decoded.error.c_str());
+            }
+        }
+    }
+}
+
+TEST_CASE(detectPassesPlainDataThrough) {
+    const std::string data = syntheticData(100000, 1);
+    for (size_t chunk : kChunkSizes) {
+        Decoded decoded = decode(Format::Detect, data, chunk);
+        CHECK(decoded.ok);
+        CHECK(decoded.data == data);
+        CHECK(decoded.format == Format::None);
+    }
+
+    // Shorter than any magic
+    Decoded tiny = decode(Format::Detect, "ab", 1);
+    CHECK(tiny.ok);
+    CHECK(tiny.data == "ab");
+    CHECK(decode(Format::Detect, "", 1).ok);
+
+    CHECK(decode(Format::Detect, deflateWith(data, 31), 4095).format == Format::Gzip);
+    CHECK(decode(Format::Detect, zstdOf(data), 4095).format == Format::Zstd);
+}
+
+TEST_CASE(concatenatedMembersAndFramesMakeOneFile) {
+    const std::string first = sample();
+    const std::string second = syntheticData(70000, 2);
+
+    for (size_t chunk : kChunkSizes) {
+        Decoded gzip = decode(Format::Gzip, deflateWith(first, 31) + deflateWith(second, 31), chunk);
+        CHECK(gzip.ok);
+        CHECK(gzip.data == first + second);
+
+        Decoded zstd = decode(Format::Zstd, zstdOf(first) + zstdOf(second), chunk);
+        CHECK(zstd.ok);
+        CHECK(zstd.data == first + second);
+    }
+}
+
+TEST_CASE(truncatedStreamFails) {
+    const std::string data = sample();
+    const std::pair<Format, std::string> bodies[] = {
+        {Format::Gzip, deflateWith(data, 31)},
+        {Format::Deflate, deflateWith(data, -15)},
+        {Format::Zstd, zstdOf(data)},
+    };
+
+    for (const auto& body : bodies) {
+        for (size_t chunk : {size_t(3), size_t(65537)}) {
+            Decoded decoded = decode(body.first, body.second.substr(0, body.second.size() - 10), chunk);
+            CHECK(!decoded.ok);
+            CHECK(decoded.error == "Compressed data ended early");
+        }
+    }
+
+    // A declared encoding with no body at all is not a valid stream either
+    CHECK(!decode(Format::Gzip, "", 1).ok);
+    CHECK(!decode(Format::Deflate, "", 1).ok);
+    CHECK(!decode(Format::Deflate, "x", 1).ok);
+}
+
+TEST_CASE(corruptDataFails) {
+    const std::string data = sample();
+
+    std::string gzip = deflateWith(data, 31);
+    gzip[gzip.size() / 2] ^= 0x55;
+    gzip[gzip.size() / 2 + 1] ^= 0x55;
+    Decoded decoded = decode(Format::Gzip, gzip, 4095);
+    CHECK(!decoded.ok);
+    CHECK(decoded.error.find("Corrupt gzip data") == 0);
+
+    // Raw deflate is not gzip, whatever the server claims
+    decoded = decode(Format::Gzip, deflateWith(data, -15), 4095);
+    CHECK(!decoded.ok);
+
+    std::string zstd = zstdOf(data);
+    zstd[zstd.size() / 2] ^= 0x55;
+    decoded = decode(Format::Zstd, zstd, 4095);
+    CHECK(!decoded.ok);
+    CHECK(decoded.error.find("Corrupt zstd data") == 0);
+}
+
+TEST_CASE(sinkStopsDecoding) {
+    const std::string data = sample();
+    const std::string body = deflateWith(data, 31);
+
+    StreamDecoder decoder(Format::Gzip);
+    size_t delivered = 0;
+    StreamDecoder::Sink sink = [&](const char*, size_t length) {
+        delivered += length;
+        return delivered < 100000;
+    };
+    CHECK(!decoder.write(body.data(), body.size(), sink));
+    CHECK(delivered >= 100000);
+    CHECK(delivered < data.size());
+    // Stopped by the sink, not by the data
+    CHECK(decoder.error().empty());
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+
+// Minimal harness for the engine tests. TEST_CASE bodies register themselves; CHECK records a
+// failure and carries on, REQUIRE returns from the case. Each test file has its own main()
+// calling runAll, and an argument runs only the cases whose name contains it.
+
+namespace launcher {
+namespace testing {
+
+struct Case {
+    const char* name;
+    void (*run)();
+};
+
+inline std::vector<Case>& cases() {
+    static std::vector<Case> registered;
+    return registered;
+}
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline bool registerCase(const char* name, void (*run)()) {
+    cases().push_back({name, run});
+    return true;
+}
+
+inline void fail(const char* file, int line, const char* expression) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+    ++failures();
+}
+
+inline int runAll(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    size_t ran = 0;
+    for (const auto& test : cases()) {
+        if (filter && !std::strstr(test.name, filter)) {
+            continue;
+        }
+
+        int before = failures();
+        std::printf("[ RUN  ] %s\n", test.name);
+        std::fflush(stdout);
+        test.run();
+        std::printf("[ %s ] %s\n", failures() == before ? " OK " : "FAIL", test.name);
+        ++ran;
+    }
+
+    std::printf("%zu cases, %d failed checks\n", ran, failures());
+    return failures() == 0 && ran > 0 ? 0 : 1;
+}
+
+// Directory under the system temp dir, removed with everything in it
+class ScratchDir {
+public:
+    explicit ScratchDir(const std::string& name) {
+        auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+        m_path = std::filesystem::temp_directory_path() / ("launcher-" + name + "-" + std::to_string(stamp));
+        std::filesystem::create_directories(m_path);
+    }
+
+    ~ScratchDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(m_path, ec);
+    }
+
+    ScratchDir(const ScratchDir&) = delete;
+    ScratchDir& operator=(const ScratchDir&) = delete;
+
+    const std::filesystem::path& path() const { return m_path; }
+    std::string file(const std::string& name) const { return (m_path / name).string(); }
+
+private:
+    std::filesystem::path m_path;
+};
+
+// Reproducible incompressible bytes; different seeds give different files
+inline std::string syntheticData(size_t size, uint32_t seed) {
+    std::string data(size, '\0');
+    uint32_t state = seed * 2654435761u + 1;
+    for (size_t i = 0; i < size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[i] = static_cast<char>(state >> 24);
+    }
+    return data;
+}
+
+inline std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::ostringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+// Creates the missing parent directories
+inline void writeFile(const std::string& path, const std::string& content) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+// Poll until done() holds; false if it did not within timeout
+inline bool waitUntil(const std::function<bool()>& done,
+                      std::chrono::milliseconds timeout = std::chrono::seconds(30)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+} // namespace testing
+} // namespace launcher
+
+#define TEST_CASE(name)                                                                   \
+    static void name();                                                                   \
+    static const bool name##Registered = launcher::testing::registerCase(#name, name);    \
+    static void name()
+
+#define CHECK(condition)                                                      \
+    do {                                                                      \
+        if (!(condition)) {                                                   \
+            launcher::testing::fail(__FILE__, __LINE__, #condition);          \
+        }                                                                     \
+    } while (0)
+
+#define REQUIRE(condition)                                                    \
+    do {                                                                      \
+        if (!(condition)) {                                                   \
+            launcher::testing::fail(__FILE__, __LINE__, #condition);          \
+            return;                                                           \
+        }                                                                     \
+    } while (0)
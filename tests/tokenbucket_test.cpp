@@ -0,0 +1,119 @@
+#include "tokenbucket.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+TEST_CASE(uncappedBucketNeverWaits) {
+    TokenBucket bucket;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100000; ++i) {
+        bucket.consume(1024 * 1024);
+    }
+    CHECK(secondsSince(start) < 1.0);
+    CHECK(bucket.getRate() == 0);
+}
+
+TEST_CASE(consumptionIsHeldToTheRate) {
+    // 2 MB at 1 MB/s: the first burst is free, the rest takes about 1.75 s
+    const uint64_t rate = 1024 * 1024;
+    TokenBucket bucket(rate);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 128; ++i) {
+        bucket.consume(16 * 1024);
+    }
+    double seconds = secondsSince(start);
+    CHECK(seconds > 1.6);
+    CHECK(seconds < 2.5);
+}
+
+TEST_CASE(transfersShareOneBucket) {
+    const uint64_t rate = 2 * 1024 * 1024;
+    TokenBucket bucket(rate);
+    auto start = std::chrono::steady_clock::now();
+
+    // Four readers together take 4 MB, so the rate holds for their sum
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&bucket] {
+            for (int i = 0; i < 64; ++i) {
+                bucket.consume(16 * 1024);
+            }
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    double seconds = secondsSince(start);
+    CHECK(seconds > 1.6);
+    CHECK(seconds < 2.5);
+}
+
+TEST_CASE(removingTheCapReleasesWaiters) {
+    TokenBucket bucket(64 * 1024);
+    bucket.consume(64 * 1024);
+
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        // Ten seconds of debt at this rate
+        bucket.consume(640 * 1024);
+        done = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!done);
+    bucket.setRate(0);
+    CHECK(waitUntil([&] { return done.load(); }, std::chrono::seconds(2)));
+    reader.join();
+}
+
+TEST_CASE(pauseBlocksUntilResumed) {
+    TokenBucket bucket;
+    bucket.setPaused(true);
+    CHECK(bucket.isPaused());
+
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        bucket.consume(1);
+        done = true;
+    });
+
+    // Paused holds even an uncapped bucket
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    CHECK(!done);
+    bucket.setPaused(false);
+    CHECK(waitUntil([&] { return done.load(); }, std::chrono::seconds(2)));
+    reader.join();
+}
+
+TEST_CASE(cancellationEndsTheWait) {
+    TokenBucket bucket(1024);
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        bucket.consume(100 * 1024 * 1024, &cancelled);
+        done = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    cancelled = true;
+    CHECK(waitUntil([&] { return done.load(); }, std::chrono::seconds(1)));
+    reader.join();
+
+    // A paused bucket lets cancelled callers go as well
+    bucket.setPaused(true);
+    bucket.consume(1, &cancelled);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
@@ -0,0 +1,130 @@
+#include "volumespace.hpp"
+#include "filewriter.hpp"
+#include "testing.hpp"
+
+using namespace launcher;
+using namespace launcher::testing;
+
+namespace {
+
+const uint64_t kMiB = 1024 * 1024;
+
+// VolumeSpace keeps this much free for everything else
+const uint64_t kMargin = 256 * kMiB;
+
+// What downloads may take on the scratch directory's volume right now
+uint64_t usable(const ScratchDir& dir) {
+    uint64_t available = std::filesystem::space(dir.path()).available;
+    return available > kMargin ? available - kMargin : 0;
+}
+
+VolumeSpace::VolumeStats statsOf(const VolumeSpace& space) {
+    auto stats = space.getStats();
+    return stats.empty() ? VolumeSpace::VolumeStats() : stats.front();
+}
+
+} // namespace
+
+TEST_CASE(downloadThatFitsIsGranted) {
+    ScratchDir dir("space-fits");
+    VolumeSpace space;
+    REQUIRE(usable(dir) > 64 * kMiB);
+
+    CHECK(space.reserve(1, 1, dir.file("a.pak"), 16 * kMiB) == VolumeSpace::Admission::Granted);
+    // Asking again for a granted download does not reserve twice
+    CHECK(space.reserve(1, 1, dir.file("a.pak"), 16 * kMiB) == VolumeSpace::Admission::Granted);
+
+    auto stats = statsOf(space);
+    CHECK(stats.reservations == 1);
+    CHECK(stats.reserved == 16 * kMiB);
+    CHECK(stats.capacity > 0);
+    CHECK(stats.available > 0);
+
+    space.release(1);
+    CHECK(statsOf(space).reservations == 0);
+    CHECK(statsOf(space).reserved == 0);
+}
+
+TEST_CASE(downloadLargerThanTheVolumeIsRejected) {
+    ScratchDir dir("space-large");
+    VolumeSpace space;
+    uint64_t size = std::filesystem::space(dir.path()).available + 1024 * kMiB;
+
+    CHECK(space.reserve(1, 1, dir.file("huge.pak"), size) == VolumeSpace::Admission::Rejected);
+    CHECK(statsOf(space).reservations == 0);
+    CHECK(space.describe(dir.file("huge.pak"), size).find("Not enough disk space") == 0);
+}
+
+TEST_CASE(otherGroupsHoldAndOwnGroupRejects) {
+    ScratchDir dir("space-groups");
+    VolumeSpace space;
+    uint64_t free = usable(dir);
+    REQUIRE(free > 64 * kMiB);
+    // Each fits alone, no two fit together; the margin absorbs whatever else writes meanwhile
+    uint64_t size = free / 5 * 3;
+
+    CHECK(space.reserve(1, 1, dir.file("a.pak"), size) == VolumeSpace::Admission::Granted);
+    // Its own job can never fit both
+    CHECK(space.reserve(2, 1, dir.file("b.pak"), size) == VolumeSpace::Admission::Rejected);
+    // Another job fits once the first one goes away
+    CHECK(space.reserve(3, 2, dir.file("c.pak"), size) == VolumeSpace::Admission::Held);
+
+    space.release(1);
+    CHECK(space.reserve(3, 2, dir.file("c.pak"), size) == VolumeSpace::Admission::Granted);
+    CHECK(statsOf(space).reservations == 1);
+}
+
+TEST_CASE(writtenBytesAreNotReservedAgain) {
+    ScratchDir dir("space-partial");
+    VolumeSpace space;
+    // A resumed download that already holds 1 MiB of its 3
+    writeFile(dir.file("a.pak"), syntheticData(static_cast<size_t>(kMiB), 1));
+
+    REQUIRE(space.reserve(1, 1, dir.file("a.pak"), 3 * kMiB) == VolumeSpace::Admission::Granted);
+    uint64_t reserved = statsOf(space).reserved;
+    // Filesystems may allocate a little more than the data for metadata
+    CHECK(reserved <= 2 * kMiB);
+    CHECK(reserved >= 2 * kMiB - 64 * 1024);
+
+    // A complete file needs nothing at all
+    REQUIRE(space.reserve(2, 1, dir.file("a.pak"), kMiB) == VolumeSpace::Admission::Granted);
+    CHECK(statsOf(space).reserved == reserved);
+}
+
+TEST_CASE(preallocatedFileIsNotReservedTwice) {
+    ScratchDir dir("space-prealloc");
+    const uint64_t size = 32 * kMiB;
+
+    FileWriter writer;
+    REQUIRE(writer.open(dir.file("a.pak"), 0, true));
+    bool preallocated = writer.preallocate(size);
+    CHECK(writer.close());
+    // The file is still empty by length, but already occupies its space
+    CHECK(std::filesystem::file_size(dir.file("a.pak")) == 0);
+    if (!preallocated) {
+        std::printf("  preallocation not supported here\n");
+        return;
+    }
+
+    VolumeSpace space;
+    REQUIRE(space.reserve(1, 1, dir.file("a.pak"), size) == VolumeSpace::Admission::Granted);
+    CHECK(statsOf(space).reservations == 1);
+    CHECK(statsOf(space).reserved == 0);
+}
+
+TEST_CASE(volumesAreToldApart) {
+    ScratchDir dir("space-volumes");
+    VolumeSpace space;
+    CHECK(space.reserve(1, 1, dir.file("a.pak"), kMiB) == VolumeSpace::Admission::Granted);
+    // A target whose directories do not exist yet is on the volume of its nearest ancestor
+    CHECK(space.reserve(2, 1, dir.file("games/new/b.pak"), kMiB) == VolumeSpace::Admission::Granted);
+
+    auto stats = space.getStats();
+    REQUIRE(stats.size() == 1);
+    CHECK(stats.front().reservations == 2);
+    CHECK(stats.front().reserved == 2 * kMiB);
+}
+
+int main(int argc, char** argv) {
+    return runAll(argc, argv);
+}
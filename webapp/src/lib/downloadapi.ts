@@ -1,5 +1,6 @@
 // Download API for interfacing with the backend download manager
-// This uses the existing nativeAPI.call system to communicate with C++ backend
+// This uses the existing nativeAPI.call system to communicate with C++ backend,
+// and nativeAPI.subscribe for pushed progress
 
 export interface DownloadInfo {
   id: string;
@@ -13,10 +14,46 @@ export interface DownloadInfo {
   error?: string;
 }
 
+// Scheduling class; lower classes wait and step aside while a higher one has work
+export type DownloadPriority = 'foreground' | 'background' | 'predownload';
+
+// A download as the backend reports it. Pushed events carry downloadId plus only the
+// fields that changed since the previous event.
+export interface DownloadRecord {
+  downloadId: number;
+  url?: string;
+  destination?: string;
+  filename?: string;
+  totalSize?: number;
+  downloadedSize?: number;
+  progress?: number; // 0-1
+  speed?: number; // bytes per second over the last ~100 ms
+  averageSpeed?: number; // bytes per second, smoothed over a few seconds
+  isCompleted?: boolean;
+  isFailed?: boolean;
+  errorMessage?: string;
+  priority?: DownloadPriority;
+  isPaused?: boolean;
+  reusedSize?: number; // bytes a delta update kept from the old file instead of downloading
+}
+
+export interface DownloadEvent {
+  downloads: DownloadRecord[];
+  removed: number[];
+}
+
+export interface DownloadSubscriptionOptions {
+  intervalMs?: number; // minimum time between events, 16-5000 (default 250)
+}
+
 export interface StartDownloadRequest {
   url: string;
   filename: string;
   directory?: string;
+  mirrors?: string[]; // other URLs of the same file, tried by measured speed
+  size?: number; // final size if known; disk space is reserved for it when queued
+  acceptEncoding?: boolean; // offer gzip/zstd transfer encoding, store the decoded file
+  decompress?: boolean; // the file itself is gzip/zstd (e.g. a resource index); store it decoded
 }
 
 export interface StartDownloadResponse {
@@ -42,10 +79,173 @@ export interface GetAllDownloadsResponse {
   error?: string;
 }
 
+export type GamePolicy = 'none' | 'pause' | 'throttle';
+
+export interface DownloadLimits {
+  maxConcurrent?: number;
+  maxPerHost?: number;
+  // Bandwidth caps in bytes per second, 0 = unlimited
+  maxBytesPerSecond?: number;
+  gamePolicy?: GamePolicy;
+  gameBytesPerSecond?: number;
+  // Finished downloads kept in the list; older ones are dropped
+  historyLimit?: number;
+  // Disk the shared content store may use, 0 = store disabled
+  storeBytes?: number;
+}
+
+export interface SetDownloadLimitsResponse {
+  success: boolean;
+  maxConcurrent?: number;
+  maxPerHost?: number;
+  maxBytesPerSecond?: number;
+  gamePolicy?: GamePolicy;
+  gameBytesPerSecond?: number;
+  historyLimit?: number;
+  storeBytes?: number;
+  error?: string;
+}
+
+export interface SetDownloadRateLimitResponse {
+  success: boolean;
+  error?: string;
+}
+
+export interface ConnectionStats {
+  leases: number;
+  reused: number;
+  idle: number;
+  reuseRatio: number; // 0-1
+  // Time to response headers on fresh vs kept-alive connections
+  newConnectionLatencyMs: number;
+  reusedConnectionLatencyMs: number;
+}
+
+// Adaptive connection window of one host ("host:port")
+export interface HostStats {
+  host: string;
+  limit: number;
+  inUse: number;
+  // Over the last measurement window
+  bytesPerSecond: number;
+  latencyMs: number;
+  baseLatencyMs: number;
+  increases: number;
+  decreases: number;
+}
+
+export interface MirrorStats {
+  host: string;
+  // Smoothed single-connection throughput; 0 until measured
+  bytesPerSecond: number;
+  samples: number;
+  failures: number;
+  benched: boolean; // skipped for a while after an error or stall
+}
+
+// Verified files kept by MD5 and shared between games and branches
+export interface ContentStoreStats {
+  objects: number;
+  bytes: number;
+  budget: number;
+  hits: number; // downloads served from the store
+  savedBytes: number;
+}
+
+// Disk space of a volume downloads write to
+export interface VolumeStats {
+  volume: string;
+  capacity: number;
+  available: number;
+  reserved: number; // still to be written by queued and running downloads
+  reservations: number;
+}
+
+// Write stage between the network and the disk
+export interface DiskWriterStats {
+  backend: 'io_uring' | 'threads';
+  queueDepth: number; // buffers waiting for the disk
+  peakQueueDepth: number;
+  writes: number;
+  bytes: number;
+  averageLatencyMs: number;
+  maxLatencyMs: number;
+  buffers: number;
+  idleBuffers: number;
+}
+
+// The download engine as a whole since the last reset
+export interface EngineStats {
+  bytes: number;
+  busySeconds: number; // while at least one download was running
+  bytesPerSecond: number;
+  responses: number;
+  firstByteP50Ms: number; // time to response headers, recent responses
+  firstByteP99Ms: number;
+  cpuSeconds: number; // whole process, while busy
+  cpuSecondsPerGiB: number;
+}
+
+export interface GetDownloadStatsResponse {
+  success: boolean;
+  connections?: ConnectionStats;
+  hosts?: HostStats[];
+  mirrors?: MirrorStats[];
+  store?: ContentStoreStats;
+  volumes?: VolumeStats[];
+  disk?: DiskWriterStats;
+  engine?: EngineStats;
+  error?: string;
+}
+
+export interface InstallInfo {
+  installId: number;
+  installDir: string;
+  mode: 'install' | 'verify';
+  state: 'checking' | 'downloading' | 'completed' | 'failed' | 'cancelled';
+  priority: DownloadPriority;
+  totalFiles: number;
+  checkedFiles: number;
+  checkedBytes: number;
+  checkBytesPerSecond: number;
+  queuedFiles: number;
+  completedFiles: number;
+  failedFiles: number;
+  totalBytes: number;
+  downloadedBytes: number;
+  reusedBytes: number; // part of downloadedBytes kept from old files by delta updates
+  progress: number; // 0-1
+  errorMessage: string;
+}
+
+export interface StartInstallRequest {
+  baseUrl: string;
+  installDir: string;
+  manifest?: string; // resource manifest JSON text
+  manifestPath?: string;
+  priority?: DownloadPriority; // default foreground
+  mirrors?: string[]; // other base URLs with the same layout, e.g. the rest of a cdnList
+}
+
+export interface StartInstallResponse {
+  success: boolean;
+  installId?: number;
+  error?: string;
+}
+
+export interface GetInstallInfoResponse {
+  success: boolean;
+  installInfo?: InstallInfo;
+  error?: string;
+}
+
 declare global {
   interface Window {
     nativeAPI: {
       call: (method: string, message?: string) => Promise<string>;
+      // Returns a function that ends the subscription
+      subscribe: (topic: string, message: string, onEvent: (message: string) => void,
+                  onError?: (error: Error) => void) => () => void;
     };
   }
 }
@@ -83,6 +283,54 @@ export class DownloadAPI {
     }
   }
 
+  /**
+   * Stop a download without losing its data; it waits until resumed
+   */
+  static async pauseDownload(downloadId: number): Promise<CancelDownloadResponse> {
+    try {
+      const message = JSON.stringify({ downloadId });
+      const response = await window.nativeAPI.call('pauseDownload', message);
+      return JSON.parse(response) as CancelDownloadResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Queue a paused download again
+   */
+  static async resumeDownload(downloadId: number): Promise<CancelDownloadResponse> {
+    try {
+      const message = JSON.stringify({ downloadId });
+      const response = await window.nativeAPI.call('resumeDownload', message);
+      return JSON.parse(response) as CancelDownloadResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Move a queued or running download to another priority class
+   */
+  static async setDownloadPriority(downloadId: number, priority: DownloadPriority): Promise<CancelDownloadResponse> {
+    try {
+      const message = JSON.stringify({ downloadId, priority });
+      const response = await window.nativeAPI.call('setDownloadPriority', message);
+      return JSON.parse(response) as CancelDownloadResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
   /**
    * Get information about a specific download
    */
@@ -114,6 +362,154 @@ export class DownloadAPI {
     }
   }
 
+  /**
+   * Receive download changes as they happen instead of polling getAllDownloads.
+   * The first event lists every download; later ones only what changed. Returns an unsubscribe function.
+   */
+  static subscribeDownloads(onEvent: (event: DownloadEvent) => void,
+                            options: DownloadSubscriptionOptions = {}): () => void {
+    if (!window.nativeAPI?.subscribe) {
+      return () => {};
+    }
+
+    return window.nativeAPI.subscribe('downloads', JSON.stringify(options), (message) => {
+      try {
+        onEvent(JSON.parse(message) as DownloadEvent);
+      } catch (error) {
+        console.error('Invalid download event:', error);
+      }
+    }, (error) => {
+      console.error('Download subscription failed:', error);
+    });
+  }
+
+  /**
+   * Set how many downloads may run at once, overall and per host, and the bandwidth caps
+   */
+  static async setDownloadLimits(limits: DownloadLimits): Promise<SetDownloadLimitsResponse> {
+    try {
+      const message = JSON.stringify(limits);
+      const response = await window.nativeAPI.call('setDownloadLimits', message);
+      return JSON.parse(response) as SetDownloadLimitsResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Cap the bandwidth of a single download (0 removes the cap)
+   */
+  static async setDownloadRateLimit(downloadId: number, maxBytesPerSecond: number): Promise<SetDownloadRateLimitResponse> {
+    try {
+      const message = JSON.stringify({ downloadId, maxBytesPerSecond });
+      const response = await window.nativeAPI.call('setDownloadRateLimit', message);
+      return JSON.parse(response) as SetDownloadRateLimitResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Get connection pool and per-host connection window statistics of the download manager
+   */
+  static async getDownloadStats(reset = false): Promise<GetDownloadStatsResponse> {
+    try {
+      const response = await window.nativeAPI.call('getDownloadStats', JSON.stringify({ reset }));
+      return JSON.parse(response) as GetDownloadStatsResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Install or update a game from a resource manifest
+   */
+  static async startInstall(request: StartInstallRequest): Promise<StartInstallResponse> {
+    try {
+      const message = JSON.stringify(request);
+      const response = await window.nativeAPI.call('startInstall', message);
+      return JSON.parse(response) as StartInstallResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Hash installed files against the manifest and re-download damaged ones
+   */
+  static async verifyInstall(request: StartInstallRequest): Promise<StartInstallResponse> {
+    try {
+      const message = JSON.stringify(request);
+      const response = await window.nativeAPI.call('verifyInstall', message);
+      return JSON.parse(response) as StartInstallResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Cancel an install job and its pending downloads
+   */
+  static async cancelInstall(installId: number): Promise<CancelDownloadResponse> {
+    try {
+      const message = JSON.stringify({ installId });
+      const response = await window.nativeAPI.call('cancelInstall', message);
+      return JSON.parse(response) as CancelDownloadResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Move an install job and its pending downloads to another priority class
+   */
+  static async setInstallPriority(installId: number, priority: DownloadPriority): Promise<CancelDownloadResponse> {
+    try {
+      const message = JSON.stringify({ installId, priority });
+      const response = await window.nativeAPI.call('setInstallPriority', message);
+      return JSON.parse(response) as CancelDownloadResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
+  /**
+   * Get aggregate progress of an install job
+   */
+  static async getInstallInfo(installId: number): Promise<GetInstallInfoResponse> {
+    try {
+      const message = JSON.stringify({ installId });
+      const response = await window.nativeAPI.call('getInstallInfo', message);
+      return JSON.parse(response) as GetInstallInfoResponse;
+    } catch (error) {
+      return {
+        success: false,
+        error: error instanceof Error ? error.message : 'Unknown error occurred'
+      };
+    }
+  }
+
   /**
    * Utility function to format bytes to human readable format
    */
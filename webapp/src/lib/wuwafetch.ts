@@ -3,11 +3,13 @@ export interface WuwaResource {
   url: string;
   size?: number;
   md5?: string;
+  mirrors: string[]; // the same file on every CDN of the index
 }
 
 export interface WuwaGameData {
   baseUrl: string;
   cdnUrl: string;
+  cdnUrls: string[];
   resourcesPath: string;
   resourcesBasePath: string;
   totalResources: number;
@@ -41,7 +43,12 @@ export class WuwaFetcher {
       console.log("✅ Successfully fetched base JSON");
       
       // Extract CDN URL and resources path
-      const cdnUrl = baseData.default?.cdnList?.[0]?.url;
+      // Every CDN serves the same files; the launcher ranks them by measured speed
+      const cdnUrls: string[] = (baseData.default?.cdnList ?? [])
+        .map((cdn: { url?: string }) => cdn.url)
+        .filter((url: string | undefined): url is string => !!url)
+        .map((url: string) => url.replace(/\/+$/, ''));
+      const cdnUrl = cdnUrls[0];
       const resourcesPath = baseData.default?.resources;
       const resourcesBasePath = baseData.default?.resourcesBasePath;
       const gameSize = baseData.default.config.size;
@@ -50,7 +57,7 @@ export class WuwaFetcher {
         throw new Error("Missing required fields in base JSON");
       }
       
-      console.log(`CDN URL: ${cdnUrl}`);
+      console.log(`CDN URLs: ${cdnUrls.join(', ')}`);
       console.log(`Resources path: ${resourcesPath}`);
       console.log(`Resources base path: ${resourcesBasePath}`);
       console.log(`Config game size: ${this.formatBytes(gameSize)}`);
@@ -94,7 +101,8 @@ export class WuwaFetcher {
           dest,
           url: outputUrl,
           size,
-          md5: resource.md5
+          md5: resource.md5,
+          mirrors: cdnUrls.map((cdn) => `${cdn}/${resourcesBasePath}/${dest}`)
         });
         
         totalSize += size;
@@ -106,6 +114,7 @@ export class WuwaFetcher {
       const gameData: WuwaGameData = {
         baseUrl: this.BASE_URL,
         cdnUrl,
+        cdnUrls,
         resourcesPath,
         resourcesBasePath,
         totalResources: resources.length,
@@ -1,7 +1,7 @@
-import { useState, useEffect } from "react";
+import { useState, useEffect, useRef } from "react";
 import { Pause, Play, X, HardDrive, Download, ArrowLeft } from "lucide-react";
 import { motion } from "motion/react";
-import { DownloadAPI, type DownloadInfo as APIDownloadInfo } from "../lib/downloadapi";
+import { DownloadAPI, type DownloadRecord, type DownloadEvent } from "../lib/downloadapi";
 
 interface DownloadInfo {
   id: string;
@@ -9,7 +9,7 @@ interface DownloadInfo {
   size: string;
   downloaded: string;
   progress: number; // 0 - 100
-  status: "pending" | "downloading" | "completed" | "failed" | "cancelled";
+  status: "pending" | "downloading" | "paused" | "completed" | "failed" | "cancelled";
   speed?: string;
   eta?: string;
 }
@@ -18,55 +18,61 @@ interface DownloadsProps {
   onBack?: () => void;
 }
 
+function downloadStatus(record: DownloadRecord): DownloadInfo["status"] {
+  if (record.isCompleted) return "completed";
+  if (record.isFailed) {
+    return record.errorMessage === "Download cancelled by user" ? "cancelled" : "failed";
+  }
+  if (record.isPaused) return "paused";
+  return (record.downloadedSize ?? 0) > 0 ? "downloading" : "pending";
+}
+
+function formatDownload(record: DownloadRecord): DownloadInfo {
+  // The smoothed speed keeps the ETA from jumping with every sample
+  const speed = record.averageSpeed ?? 0;
+  const total = record.totalSize ?? 0;
+  const downloaded = record.downloadedSize ?? 0;
+  return {
+    id: String(record.downloadId),
+    name: record.filename ?? "",
+    size: DownloadAPI.formatBytes(total),
+    downloaded: DownloadAPI.formatBytes(downloaded),
+    progress: (record.progress ?? 0) * 100,
+    status: downloadStatus(record),
+    speed: speed > 0 ? DownloadAPI.formatSpeed(speed) : undefined,
+    eta: speed > 0 ? DownloadAPI.estimateTimeRemaining(total, downloaded, speed) : undefined,
+  };
+}
+
 export default function Downloads({ onBack }: DownloadsProps) {
   const [downloads, setDownloads] = useState<DownloadInfo[]>([]);
   const [loading, setLoading] = useState(true);
+  // Full state of every download, patched by the changed fields of each event
+  const records = useRef(new Map<number, DownloadRecord>());
 
-  // Fetch downloads from API
-  const fetchDownloads = async () => {
-    try {
-      const response = await DownloadAPI.getAllDownloads();
-      if (response.success && response.downloads) {
-        const formattedDownloads: DownloadInfo[] = response.downloads.map((download: APIDownloadInfo) => ({
-          id: download.id,
-          name: download.filename,
-          size: DownloadAPI.formatBytes(download.totalBytes),
-          downloaded: DownloadAPI.formatBytes(download.downloadedBytes),
-          progress: download.progress,
-          status: download.status,
-          speed: download.speed > 0 ? DownloadAPI.formatSpeed(download.speed) : undefined,
-          eta: download.speed > 0 ? DownloadAPI.estimateTimeRemaining(download.totalBytes, download.downloadedBytes, download.speed) : undefined
-        }));
-        setDownloads(formattedDownloads);
+  useEffect(() => {
+    const applyEvent = (event: DownloadEvent) => {
+      for (const id of event.removed) {
+        records.current.delete(id);
       }
-    } catch (error) {
-      console.error('Failed to fetch downloads:', error);
-    } finally {
+      for (const change of event.downloads) {
+        records.current.set(change.downloadId, { ...records.current.get(change.downloadId), ...change });
+      }
+      setDownloads(Array.from(records.current.values(), formatDownload));
       setLoading(false);
-    }
-  };
+    };
 
-  useEffect(() => {
-    fetchDownloads();
-    
-    // Poll for updates every 2 seconds
-    const interval = setInterval(fetchDownloads, 2000);
-    return () => clearInterval(interval);
+    return DownloadAPI.subscribeDownloads(applyEvent, { intervalMs: 250 });
   }, []);
 
-  const togglePause = async (id: string) => {
-    // Note: This would need to be implemented in the backend
-    // For now, we'll just update the local state
-    setDownloads((prev) =>
-      prev.map((d) =>
-        d.id === id
-          ? {
-              ...d,
-              status: d.status === "downloading" ? "cancelled" : "downloading",
-            }
-          : d
-      )
-    );
+  const togglePause = async (id: string, paused: boolean) => {
+    // The new state arrives with the next pushed event
+    const response = paused
+      ? await DownloadAPI.resumeDownload(Number(id))
+      : await DownloadAPI.pauseDownload(Number(id));
+    if (!response.success) {
+      console.error('Failed to toggle pause:', response.error);
+    }
   };
 
   const cancelDownload = async (id: string) => {
@@ -163,17 +169,17 @@ export default function Downloads({ onBack }: DownloadsProps) {
 
               {/* Actions */}
               <div className="flex items-center space-x-2 flex-shrink-0">
-                {d.status === "downloading" ? (
+                {d.status === "downloading" || d.status === "pending" ? (
                   <button
-                    onClick={() => togglePause(d.id)}
+                    onClick={() => togglePause(d.id, false)}
                     className="p-2 rounded bg-neutral-700 hover:bg-neutral-600 transition-colors"
                     title="Pause"
                   >
                     <Pause className="w-4 h-4" />
                   </button>
-                ) : d.status === "pending" ? (
+                ) : d.status === "paused" ? (
                   <button
-                    onClick={() => togglePause(d.id)}
+                    onClick={() => togglePause(d.id, true)}
                     className="p-2 rounded bg-neutral-700 hover:bg-neutral-600 transition-colors"
                     title="Resume"
                   >
@@ -83,7 +83,8 @@ const WuwaPage: React.FC<WuwaPageProps> = ({ onBack, onNavigateToDownloads }) =>
                 const response = await DownloadAPI.startDownload({
                     url: resource.url,
                     filename: resource.dest,
-                    directory: `C:\\Games\\WuWa`
+                    directory: `C:\\Games\\WuWa`,
+                    mirrors: resource.mirrors
                 });
 
                 if (!response.success) {